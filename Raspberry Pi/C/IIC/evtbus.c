@@ -0,0 +1,241 @@
+/***************************************************************************************
+ * Project  :rc522 event bus
+ * Describe :Single-producer, multi-consumer ring of rc522d frames in shared memory
+ *			 (shm_open, or a memfd handed to the consumers). Publishing is a copy into
+ *			 the next slot between two stores of its sequence number plus one load of
+ *			 the sleeper count; the futex is only woken when a consumer sleeps.
+ *			 Consumers only read the ring: each keeps its cursor in its own process, a
+ *			 consumer that falls a full ring behind loses the oldest events and is told
+ *			 how many, the publisher never waits for anyone. A restarted publisher
+ *			 resumes the sequence of an existing segment, consumers keep their mapping.
+***************************************************************************************/
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "evtbus.h"
+
+#define EVTBUS_SIZE           (EVTBUS_DATA_OFF + EVTBUS_SLOTS*sizeof(evtbus_slot_t))
+#define EVTBUS_SPIN           4000               //Polls of head before a consumer sleeps, a few microseconds
+
+static inline void EvtBusPause(void)
+{
+#if defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#elif defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause");
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Map a segment
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+static int EvtBusMap(evtbus_t *bus,int fd,unsigned long size)
+{
+    void *base = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    if(base == MAP_FAILED)
+    {
+		return -1;
+    }
+    bus->base = (unsigned char *)base;
+    bus->size = size;
+    bus->fd = fd;
+    bus->hdr = (evtbus_hdr_t *)base;
+    bus->slot = (evtbus_slot_t *)(bus->base + EVTBUS_DATA_OFF);
+    return 0;
+}
+
+static int EvtBusValid(const evtbus_t *bus)
+{
+    const evtbus_hdr_t *h = bus->hdr;
+    return h->magic == EVTBUS_MAGIC && h->version == EVTBUS_VERSION && h->slot_size == sizeof(evtbus_slot_t) &&
+		   h->slots != 0 && (h->slots & (h->slots-1)) == 0 &&
+		   bus->size >= EVTBUS_DATA_OFF + (unsigned long)h->slots*sizeof(evtbus_slot_t);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Create (or take over) the segment as its publisher
+//Parameters:bus[OUT]:Bus
+//          name[IN]:shm_open name, NULL = anonymous memfd, pass bus->fd on
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int EvtBusCreate(evtbus_t *bus,const char *name)
+{
+    int fd;
+    memset(bus,0,sizeof(evtbus_t));
+    bus->fd = -1;
+    fd = name ? shm_open(name,O_RDWR|O_CREAT|O_CLOEXEC,0644) : memfd_create("rc522d-events",MFD_CLOEXEC);
+    if(fd < 0)
+    {
+		return -1;
+    }
+    if(ftruncate(fd,EVTBUS_SIZE) != 0 || EvtBusMap(bus,fd,EVTBUS_SIZE) != 0)
+    {
+		close(fd);
+		return -1;
+    }
+    if(!EvtBusValid(bus) || bus->hdr->slots != EVTBUS_SLOTS)
+    {
+		memset(bus->base,0,EVTBUS_SIZE);
+		bus->hdr->version = EVTBUS_VERSION;
+		bus->hdr->slot_size = sizeof(evtbus_slot_t);
+		bus->hdr->slots = EVTBUS_SLOTS;
+		__atomic_store_n(&bus->hdr->magic,EVTBUS_MAGIC,__ATOMIC_RELEASE);
+    }
+    bus->mask = EVTBUS_SLOTS - 1;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Attach as a consumer, reading starts with the next event published
+//Parameters:bus[OUT]:Bus
+//          name[IN]:shm_open name, ignored when fd is given
+//            fd[IN]:memfd received from the publisher, -1 = open name
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int EvtBusOpen(evtbus_t *bus,const char *name,int fd)
+{
+    struct stat st;
+    memset(bus,0,sizeof(evtbus_t));
+    bus->fd = -1;
+    if(fd < 0 && (fd = shm_open(name,O_RDWR|O_CLOEXEC,0)) < 0)//The futex word is written by sleepers
+    {
+		return -1;
+    }
+    if(fstat(fd,&st) != 0 || st.st_size < EVTBUS_DATA_OFF || EvtBusMap(bus,fd,st.st_size) != 0)
+    {
+		close(fd);
+		return -1;
+    }
+    if(!EvtBusValid(bus))
+    {
+		EvtBusClose(bus);
+		return -1;
+    }
+    bus->mask = bus->hdr->slots - 1;
+    bus->cursor = __atomic_load_n(&bus->hdr->head,__ATOMIC_ACQUIRE);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Publish an event, never blocks; one publisher thread only
+//Parameters:bus[IN]:Bus from EvtBusCreate
+//        frame[IN]:Event, header and hdr.len bytes of payload are copied
+/////////////////////////////////////////////////////////////////////
+void EvtBusPublish(evtbus_t *bus,const rc522d_frame_t *frame)
+{
+    unsigned long long h = bus->hdr->head;
+    evtbus_slot_t *s = &bus->slot[h & bus->mask];
+    __atomic_store_n(&s->seq,0,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);//Consumers see the slot invalid before its body changes
+    memcpy(&s->frame,frame,sizeof(rc522d_hdr_t)+frame->hdr.len);
+    __atomic_store_n(&s->seq,h+1,__ATOMIC_RELEASE);
+    __atomic_store_n(&bus->hdr->head,h+1,__ATOMIC_RELEASE);
+    __atomic_store_n(&bus->hdr->wake,(unsigned int)(h+1),__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&bus->hdr->waiters,__ATOMIC_SEQ_CST))//Pairs with the increment in EvtBusNext
+    {
+		syscall(SYS_futex,&bus->hdr->wake,FUTEX_WAKE,INT_MAX,NULL,NULL,0);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Take the next event
+//Parameters:bus[IN]:Bus from EvtBusOpen
+//        frame[OUT]:Event
+//   timeout_ms[IN]:0 = do not wait, -1 = wait forever; wakeups for
+//                  events overwritten meanwhile do not extend it
+//return:1 = event copied, 0 = none within the timeout
+//       bus->lost counts the events this consumer missed
+//       A consumer killed while it sleeps leaves hdr->waiters raised:
+//       from then on every publish makes a FUTEX_WAKE syscall, until
+//       the segment is removed
+/////////////////////////////////////////////////////////////////////
+int EvtBusNext(evtbus_t *bus,rc522d_frame_t *frame,int timeout_ms)
+{
+    evtbus_slot_t *s;
+    unsigned long long head,seq;
+    unsigned int wake,i;
+    struct timespec deadline;
+    int r;
+    if(timeout_ms > 0)
+    {
+		clock_gettime(CLOCK_MONOTONIC,&deadline);
+		deadline.tv_sec += timeout_ms/1000;
+		deadline.tv_nsec += (timeout_ms%1000)*1000000L;
+		if(deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+    }
+    while(1)
+    {
+		wake = __atomic_load_n(&bus->hdr->wake,__ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&bus->hdr->head,__ATOMIC_ACQUIRE);
+		if(bus->cursor < head)
+		{
+			if(head - bus->cursor > bus->mask + 1)//Lapped: the oldest still in the ring is next
+			{
+				bus->lost += head - bus->cursor - (bus->mask + 1);
+				bus->cursor = head - (bus->mask + 1);
+			}
+			s = &bus->slot[bus->cursor & bus->mask];
+			seq = __atomic_load_n(&s->seq,__ATOMIC_ACQUIRE);
+			memcpy(frame,&s->frame,sizeof(rc522d_frame_t));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			bus->cursor++;
+			if(seq == bus->cursor && __atomic_load_n(&s->seq,__ATOMIC_RELAXED) == seq)
+			{
+				return 1;
+			}
+			bus->lost++;                         //Overwritten while we copied it
+			continue;
+		}
+		if(timeout_ms == 0)
+		{
+			return 0;
+		}
+		for(i=0;i<EVTBUS_SPIN && __atomic_load_n(&bus->hdr->head,__ATOMIC_ACQUIRE) == head;i++)
+		{
+			EvtBusPause();                       //A burst keeps us awake, the publisher then makes no syscall
+		}
+		if(i < EVTBUS_SPIN)
+		{
+			continue;
+		}
+		__atomic_add_fetch(&bus->hdr->waiters,1,__ATOMIC_SEQ_CST);
+		//Returns at once when an event was published after wake was read; the
+		//timeout of FUTEX_WAIT_BITSET is absolute, on CLOCK_MONOTONIC
+		r = syscall(SYS_futex,&bus->hdr->wake,FUTEX_WAIT_BITSET,wake,timeout_ms < 0 ? NULL : &deadline,NULL,FUTEX_BITSET_MATCH_ANY);
+		__atomic_sub_fetch(&bus->hdr->waiters,1,__ATOMIC_SEQ_CST);//Whatever ended the wait
+		if(r != 0 && errno == ETIMEDOUT)
+		{
+			return 0;
+		}
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Unmap the segment, the shm name stays for the next publisher
+/////////////////////////////////////////////////////////////////////
+void EvtBusClose(evtbus_t *bus)
+{
+    if(bus->base != NULL)
+    {
+		munmap(bus->base,bus->size);
+		bus->base = NULL;
+    }
+    if(bus->fd >= 0)
+    {
+		close(bus->fd);
+		bus->fd = -1;
+    }
+}
@@ -0,0 +1,70 @@
+/***************************************************************************************
+ * Project  :rc522 event bus consumer
+ * Describe :Attaches to the shared memory event bus of rc522d (rc522d -B) and prints
+ *			 every event as JSON Lines, or CBOR with -c. Any number of these (or of
+ *			 other consumers) can run side by side, none of them slows the reader.
+ * Usage    :evtbus_cat [-c] [-b name]
+***************************************************************************************/
+#include <stdio.h>
+#include <unistd.h>
+#include "evtbus.h"
+#include "evtfmt.h"
+
+int main(int argc,char *argv[])
+{
+    evtbus_t bus;
+    rc522d_frame_t frame,ovf;
+    evtfmt_t *f = EvtFmtThread();
+    const char *name = EVTBUS_NAME;
+    unsigned long lost = 0;
+    int opt,timeout;
+
+    EvtFmtInit(f,EVTFMT_JSONL);
+    while((opt = getopt(argc,argv,"cb:")) != -1)
+    {
+		switch(opt)
+		{
+			case 'c': EvtFmtInit(f,EVTFMT_CBOR); break;
+			case 'b': name = optarg; break;
+			default:
+				fprintf(stderr,"usage: %s [-c] [-b name]\n",argv[0]);
+				return 1;
+		}
+    }
+    if(EvtBusOpen(&bus,name,-1) != 0)
+    {
+		fprintf(stderr,"%s: no event bus, is rc522d running with -B?\n",name);
+		return 1;
+    }
+    timeout = -1;
+    while(1)
+    {
+		if(!EvtBusNext(&bus,&frame,timeout))
+		{
+			EvtFmtFlush(STDOUT_FILENO,&f,1);//Caught up, write the batch
+			timeout = -1;
+			continue;
+		}
+		if(bus.lost != lost)
+		{
+			ovf.hdr.type = RC522D_EVT_OVERFLOW;
+			ovf.hdr.len = sizeof(rc522d_overflow_t);
+			ovf.hdr.seq = 0;
+			ovf.hdr.time_ms = frame.hdr.time_ms;
+			ovf.u.overflow.dropped = bus.lost - lost;
+			lost = bus.lost;
+			if(EvtFmtFrame(f,0,&ovf) != 0)
+			{
+				EvtFmtFlush(STDOUT_FILENO,&f,1);
+				EvtFmtFrame(f,0,&ovf);
+			}
+		}
+		if(EvtFmtFrame(f,0,&frame) != 0)
+		{
+			EvtFmtFlush(STDOUT_FILENO,&f,1);
+			EvtFmtFrame(f,0,&frame);
+		}
+		timeout = 0;
+    }
+    return 0;
+}
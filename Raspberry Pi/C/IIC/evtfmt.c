@@ -0,0 +1,332 @@
+/***************************************************************************************
+ * Project  :rc522 event formatter
+ * Describe :Serialises tap/read events to JSON Lines or CBOR. Events are appended to a
+ *			 caller-owned (or per-thread) buffer with table-driven hex and integer
+ *			 encoders, no printf and no allocation; EvtFmtFlush hands any number of
+ *			 buffers to the kernel with a single writev.
+***************************************************************************************/
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "evtfmt.h"
+
+//Two hex digits per byte value
+static const char HexPair[513] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+static const char *const EvtName[] = {"","present","removed","read","overflow","access","health"};
+
+static __thread evtfmt_t ThreadFmt;
+
+//Append a string literal, its length is known at compile time
+#define PUT_LIT(p,s)          (memcpy((p),(s),sizeof(s)-1),(p) += sizeof(s)-1)
+//CBOR text string key of at most 23 bytes
+#define CBOR_KEY(p,s)         (*(p)++ = 0x60|(sizeof(s)-1),PUT_LIT(p,s))
+
+/////////////////////////////////////////////////////////////////////
+//function:Reset a formatter
+//Parameters:f[OUT]:Formatter
+//         fmt[IN]:EVTFMT_JSONL or EVTFMT_CBOR
+/////////////////////////////////////////////////////////////////////
+void EvtFmtInit(evtfmt_t *f,unsigned char fmt)
+{
+    f->fmt = fmt;
+    f->len = 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Formatter of the calling thread, JSON Lines until EvtFmtInit
+/////////////////////////////////////////////////////////////////////
+evtfmt_t *EvtFmtThread(void)
+{
+    return &ThreadFmt;
+}
+
+static unsigned char *PutHex(unsigned char *p,const unsigned char *pData,unsigned char len)
+{
+    unsigned char i;
+    for(i=0;i<len;i++)
+    {
+		memcpy(p,&HexPair[pData[i]*2],2);
+		p += 2;
+    }
+    return p;
+}
+
+static unsigned char *PutUint(unsigned char *p,unsigned int v)
+{
+    unsigned char tmp[10];
+    unsigned char n = 0;
+    do
+    {
+		tmp[n++] = '0' + v%10;
+		v /= 10;
+    }
+    while(v);
+    while(n)
+    {
+		*p++ = tmp[--n];
+    }
+    return p;
+}
+
+//CBOR head of major type mt (0 uint, 2 bytes, 3 text, 5 map) with argument v
+static unsigned char *CborHead(unsigned char *p,unsigned char mt,unsigned int v)
+{
+    mt <<= 5;
+    if(v < 24)
+    {
+		*p++ = mt | v;
+    }
+    else if(v < 0x100)
+    {
+		*p++ = mt | 24;
+		*p++ = v;
+    }
+    else if(v < 0x10000)
+    {
+		*p++ = mt | 25;
+		*p++ = v >> 8;
+		*p++ = v;
+    }
+    else
+    {
+		*p++ = mt | 26;
+		*p++ = v >> 24;
+		*p++ = v >> 16;
+		*p++ = v >> 8;
+		*p++ = v;
+    }
+    return p;
+}
+
+static unsigned char *CborBytes(unsigned char *p,const unsigned char *pData,unsigned char len)
+{
+    p = CborHead(p,2,len);
+    memcpy(p,pData,len);
+    return p + len;
+}
+
+static unsigned char UidLen(unsigned char len)
+{
+    return len > 10 ? 10 : len;
+}
+
+static unsigned char *JsonFrame(unsigned char *p,unsigned char reader,const rc522d_frame_t *frame)
+{
+    const char *name = EvtName[frame->hdr.type];
+    PUT_LIT(p,"{\"ev\":\"");
+    memcpy(p,name,strlen(name));
+    p += strlen(name);
+    PUT_LIT(p,"\",\"seq\":");
+    p = PutUint(p,frame->hdr.seq);
+    PUT_LIT(p,",\"t\":");
+    p = PutUint(p,frame->hdr.time_ms);
+    PUT_LIT(p,",\"reader\":");
+    p = PutUint(p,reader);
+    switch(frame->hdr.type)
+    {
+		case RC522D_EVT_PRESENT:
+		case RC522D_EVT_REMOVED:
+			PUT_LIT(p,",\"uid\":\"");
+			p = PutHex(p,frame->u.card.uid,UidLen(frame->u.card.uid_len));
+			PUT_LIT(p,"\",\"atqa\":\"");
+			p = PutHex(p,frame->u.card.atqa,2);
+			PUT_LIT(p,"\",\"sak\":");
+			p = PutUint(p,frame->u.card.sak);
+			break;
+		case RC522D_EVT_READ:
+			PUT_LIT(p,",\"uid\":\"");
+			p = PutHex(p,frame->u.read.uid,UidLen(frame->u.read.uid_len));
+			PUT_LIT(p,"\",\"block\":");
+			p = PutUint(p,frame->u.read.block);
+			PUT_LIT(p,",\"status\":");
+			p = PutUint(p,frame->u.read.status);
+			PUT_LIT(p,",\"data\":\"");
+			p = PutHex(p,frame->u.read.data,16);
+			*p++ = '"';
+			break;
+		case RC522D_EVT_ACCESS:
+			PUT_LIT(p,",\"uid\":\"");
+			p = PutHex(p,frame->u.access.uid,UidLen(frame->u.access.uid_len));
+			if(frame->u.access.allowed)
+			{
+				PUT_LIT(p,"\",\"allowed\":true,\"tag\":");
+			}
+			else
+			{
+				PUT_LIT(p,"\",\"allowed\":false,\"tag\":");
+			}
+			p = PutUint(p,frame->u.access.tag);
+			break;
+		case RC522D_EVT_OVERFLOW:
+			PUT_LIT(p,",\"dropped\":");
+			p = PutUint(p,frame->u.overflow.dropped);
+			break;
+		case RC522D_EVT_HEALTH:
+			PUT_LIT(p,",\"fault\":");
+			p = PutUint(p,frame->u.health.fault);
+			PUT_LIT(p,",\"status\":");
+			p = PutUint(p,frame->u.health.status);
+			PUT_LIT(p,",\"recover_us\":");
+			p = PutUint(p,frame->u.health.recover_us);
+			PUT_LIT(p,",\"recoveries\":");
+			p = PutUint(p,frame->u.health.recoveries);
+			break;
+    }
+    PUT_LIT(p,"}\n");
+    return p;
+}
+
+static unsigned char *CborFrame(unsigned char *p,unsigned char reader,const rc522d_frame_t *frame)
+{
+    static const unsigned char Pairs[] = {0,7,7,8,5,7,8};//Map size per event type
+    const char *name = EvtName[frame->hdr.type];
+    p = CborHead(p,5,Pairs[frame->hdr.type]);
+    CBOR_KEY(p,"ev");
+    p = CborHead(p,3,strlen(name));
+    memcpy(p,name,strlen(name));
+    p += strlen(name);
+    CBOR_KEY(p,"seq");
+    p = CborHead(p,0,frame->hdr.seq);
+    CBOR_KEY(p,"t");
+    p = CborHead(p,0,frame->hdr.time_ms);
+    CBOR_KEY(p,"reader");
+    p = CborHead(p,0,reader);
+    switch(frame->hdr.type)
+    {
+		case RC522D_EVT_PRESENT:
+		case RC522D_EVT_REMOVED:
+			CBOR_KEY(p,"uid");
+			p = CborBytes(p,frame->u.card.uid,UidLen(frame->u.card.uid_len));
+			CBOR_KEY(p,"atqa");
+			p = CborBytes(p,frame->u.card.atqa,2);
+			CBOR_KEY(p,"sak");
+			p = CborHead(p,0,frame->u.card.sak);
+			break;
+		case RC522D_EVT_READ:
+			CBOR_KEY(p,"uid");
+			p = CborBytes(p,frame->u.read.uid,UidLen(frame->u.read.uid_len));
+			CBOR_KEY(p,"block");
+			p = CborHead(p,0,frame->u.read.block);
+			CBOR_KEY(p,"status");
+			p = CborHead(p,0,frame->u.read.status);
+			CBOR_KEY(p,"data");
+			p = CborBytes(p,frame->u.read.data,16);
+			break;
+		case RC522D_EVT_ACCESS:
+			CBOR_KEY(p,"uid");
+			p = CborBytes(p,frame->u.access.uid,UidLen(frame->u.access.uid_len));
+			CBOR_KEY(p,"allowed");
+			*p++ = frame->u.access.allowed ? 0xF5 : 0xF4;
+			CBOR_KEY(p,"tag");
+			p = CborHead(p,0,frame->u.access.tag);
+			break;
+		case RC522D_EVT_OVERFLOW:
+			CBOR_KEY(p,"dropped");
+			p = CborHead(p,0,frame->u.overflow.dropped);
+			break;
+		case RC522D_EVT_HEALTH:
+			CBOR_KEY(p,"fault");
+			p = CborHead(p,0,frame->u.health.fault);
+			CBOR_KEY(p,"status");
+			p = CborHead(p,0,frame->u.health.status);
+			CBOR_KEY(p,"recover_us");
+			p = CborHead(p,0,frame->u.health.recover_us);
+			CBOR_KEY(p,"recoveries");
+			p = CborHead(p,0,frame->u.health.recoveries);
+			break;
+    }
+    return p;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Append one event
+//Parameters:f[IN]:Formatter
+//      reader[IN]:Reader the event comes from
+//       frame[IN]:Event as published by rc522d
+//return:0, -1 when the buffer is full (flush first) or the type is unknown
+/////////////////////////////////////////////////////////////////////
+int EvtFmtFrame(evtfmt_t *f,unsigned char reader,const rc522d_frame_t *frame)
+{
+    unsigned char *p;
+    if(f->len > EVTFMT_BUF - EVTFMT_EVENT_MAX || frame->hdr.type == 0 || frame->hdr.type > RC522D_EVT_HEALTH)
+    {
+		return -1;
+    }
+    p = f->buf + f->len;
+    if(f->fmt == EVTFMT_CBOR)
+    {
+		p = CborFrame(p,reader,frame);
+    }
+    else
+    {
+		p = JsonFrame(p,reader,frame);
+    }
+    f->len = p - f->buf;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write out formatters with one writev and empty them
+//         Several threads may each fill their own and one of them flushes
+//         all; the events of each buffer stay in order and contiguous
+//Parameters:fd[IN]:Destination
+//            f[IN]:Formatters, empty ones are skipped
+//        count[IN]:Number of formatters, at most EVTFMT_IOV_MAX
+//return:0, -1 on a write error (the events are dropped)
+/////////////////////////////////////////////////////////////////////
+int EvtFmtFlush(int fd,evtfmt_t **f,int count)
+{
+    struct iovec iov[EVTFMT_IOV_MAX];
+    struct iovec *v = iov;
+    int i,n = 0,ret = 0;
+    ssize_t r;
+    for(i=0;i<count && i<EVTFMT_IOV_MAX;i++)
+    {
+		if(f[i]->len)
+		{
+			iov[n].iov_base = f[i]->buf;
+			iov[n].iov_len = f[i]->len;
+			n++;
+		}
+    }
+    while(n > 0)
+    {
+		r = writev(fd,v,n);
+		if(r < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			ret = -1;
+			break;
+		}
+		while(n > 0 && (size_t)r >= v->iov_len)//Short write: go on after the last byte taken
+		{
+			r -= v->iov_len;
+			v++;
+			n--;
+		}
+		if(n > 0)
+		{
+			v->iov_base = (char *)v->iov_base + r;
+			v->iov_len -= r;
+		}
+    }
+    for(i=0;i<count && i<EVTFMT_IOV_MAX;i++)
+    {
+		f[i]->len = 0;
+    }
+    return ret;
+}
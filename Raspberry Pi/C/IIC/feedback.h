@@ -0,0 +1,28 @@
+#ifndef __FEEDBACK_H
+#define	__FEEDBACK_H
+
+/////////////////////////////////////////////////////////////////////
+//Feedback patterns, a lower ID is played first when several are pending
+/////////////////////////////////////////////////////////////////////
+#define FB_PATTERN_ERROR      0                  //Two long blinks
+#define FB_PATTERN_DENY       1                  //Three short beeps
+#define FB_PATTERN_ALLOW      2                  //One long beep with the LED on
+#define FB_PATTERN_TAP        3                  //Short beep then short blink
+#define FB_PATTERNS           4
+
+#define FB_BUZZER_DUTY        90                 //High time of a beep in percent
+#define FB_TONE_HIGH          1000               //Tone of taps and allowed cards
+#define FB_TONE_LOW           500                //Tone of denied cards
+
+typedef struct
+{
+    unsigned short tone;                         //Buzzer tone in Hz, 0 = silent
+    unsigned char led;                           //1 = LED on
+    unsigned short ms;                           //Step length, 0 ends the pattern
+} fb_step_t;
+
+int FeedbackStart();
+void FeedbackPost(unsigned char pattern);
+void FeedbackStop();
+
+#endif
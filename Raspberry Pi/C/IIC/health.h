@@ -0,0 +1,56 @@
+#ifndef __HEALTH_H
+#define	__HEALTH_H
+
+#include "rc522.h"
+
+/////////////////////////////////////////////////////////////////////
+//Faults found by a check
+/////////////////////////////////////////////////////////////////////
+#define HEALTH_OK             0
+#define HEALTH_FAULT_STUCK    1                  //A wait on the chip ran out
+#define HEALTH_FAULT_VERSION  2                  //VersionReg is not what it was: no answer or garbage
+#define HEALTH_FAULT_CONFIG   3                  //A register lost its setup: the chip reset itself
+#define HEALTH_FAULT_SELFTEST 4                  //Digital self-test differs from the reference
+#define HEALTH_FAULTS         5
+
+#define HEALTH_INTERVAL_MS    100                //Default: VersionReg and setup checked this often while idle
+#define HEALTH_SELFTEST_S     3600               //Default: the self-test runs this often
+#define HEALTH_BACKOFF_MS     10000              //Longest wait between recoveries of a chip that stays down
+
+/////////////////////////////////////////////////////////////////////
+//Health monitor of one reader. The checks only run from HealthCheck,
+//called by the poll loop while no card is in the field, because a
+//recovery or a self-test resets the chip and switches the field off
+/////////////////////////////////////////////////////////////////////
+typedef struct health
+{
+    unsigned int interval_ms;
+    unsigned int selftest_ms;                    //0 = only from HealthAttach, not after a warm start
+    unsigned char version;                       //VersionReg at attach
+    unsigned char reference[64];                 //Self-test result of a good chip of this version
+    unsigned char has_reference;
+    unsigned char fault;                         //Last fault found, HEALTH_OK = none
+    unsigned char down;                          //The last recovery did not bring the chip back
+    unsigned int last_ms;                        //millis() of the last check
+    unsigned int selftest_last_ms;
+    unsigned int backoff_ms;                     //Wait before the next recovery while down
+    unsigned long stuck;                         //pcd->stuck at the last check
+    unsigned long checks;                        //Totals
+    unsigned long selftests;
+    unsigned long faults[HEALTH_FAULTS];
+    unsigned long recoveries;                    //Chip back after the recovery
+    unsigned long failed;                        //Chip still failing after the recovery
+    unsigned int recover_us;                     //Duration of the last recovery
+    unsigned int recover_max_us;
+    unsigned long long recover_sum_us;
+} health_t;
+
+void HealthInit(health_t *h,unsigned int interval_ms,unsigned int selftest_s);
+unsigned char HealthAttach(rc522_t *pcd,health_t *h);
+unsigned char HealthProbe(rc522_t *pcd,health_t *h);
+unsigned char HealthSelfTest(rc522_t *pcd,health_t *h);
+unsigned char HealthRecover(rc522_t *pcd,health_t *h);
+unsigned char HealthCheck(rc522_t *pcd,health_t *h);
+const char *HealthFaultName(unsigned char fault);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __MULTIREADER_H
+#define	__MULTIREADER_H
+
+#include <pthread.h>
+#include "rc522.h"
+#include "presence.h"
+
+#define MR_READERS_MAX        8                  //SPI CE0/CE1, or boards at different ADR0-ADR5 addresses
+#define MR_POLL_MS            10                 //Idle time between polls of an empty field
+#define MR_THREAD_POLL_US     50                 //Threads mode: IRQ poll interval, leaves the bus to the others
+
+#define MR_MODE_THREADS       0                  //One thread per reader
+#define MR_MODE_INTERLEAVED   1                  //One thread, card requests of all readers in flight together
+
+struct mr_sched;
+
+//Called on every presence change, from the reader's own thread in MR_MODE_THREADS
+typedef void (*mr_event_fn)(unsigned char reader,unsigned char evt,presence_t *pres,void *arg);
+
+typedef struct
+{
+    rc522_t pcd;
+    presence_t pres;
+    unsigned char id;
+    unsigned char req_pending;                   //Interleaved: card request in flight
+    unsigned char req_status;
+    unsigned long polls;
+    unsigned long taps;
+    pthread_t thread;
+    struct mr_sched *sched;
+} __attribute__((aligned(64))) mr_reader_t;      //Own cache lines, no false sharing between reader threads
+
+typedef struct mr_sched
+{
+    mr_reader_t reader[MR_READERS_MAX];
+    unsigned char count;
+    unsigned char mode;
+    unsigned char threads;                       //Threads MrStart created, MrStop joins them
+    volatile int running;                        //Set by MrStart, cleared by MrStop
+    unsigned int poll_ms;
+    mr_event_fn on_event;
+    void *arg;
+} mr_sched_t;
+
+void MrInit(mr_sched_t *s,mr_event_fn on_event,void *arg);
+int MrAddReader(mr_sched_t *s,int fd,int rst);
+int MrStart(mr_sched_t *s,unsigned char mode);
+unsigned char MrPoll(mr_sched_t *s);
+void MrRunInterleaved(mr_sched_t *s);
+void MrStop(mr_sched_t *s);
+unsigned long MrTaps(mr_sched_t *s);
+
+#endif
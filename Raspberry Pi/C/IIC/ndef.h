@@ -0,0 +1,111 @@
+#ifndef __NDEF_H
+#define	__NDEF_H
+
+#include "rc522.h"
+#include "ultralight.h"
+
+/////////////////////////////////////////////////////////////////////
+//Card image layouts
+/////////////////////////////////////////////////////////////////////
+#define NDEF_LAYOUT_TYPE2     0                  //Mifare_UltraLight/NTAG image, data area starts at page 4
+#define NDEF_LAYOUT_CLASSIC   1                  //Mifare_One 1K/4K image, MAD sectors and trailers are skipped
+
+/////////////////////////////////////////////////////////////////////
+//TLV blocks
+/////////////////////////////////////////////////////////////////////
+#define NDEF_TLV_NULL         0x00
+#define NDEF_TLV_LOCK_CTRL    0x01
+#define NDEF_TLV_MEM_CTRL     0x02
+#define NDEF_TLV_MESSAGE      0x03
+#define NDEF_TLV_PROPRIETARY  0xFD
+#define NDEF_TLV_TERMINATOR   0xFE
+
+/////////////////////////////////////////////////////////////////////
+//Record header flags and type name format
+/////////////////////////////////////////////////////////////////////
+#define NDEF_MB               0x80               //Message begin
+#define NDEF_ME               0x40               //Message end
+#define NDEF_CF               0x20               //Chunk flag
+#define NDEF_SR               0x10               //Short record, 1 byte payload length
+#define NDEF_IL               0x08               //ID length present
+#define NDEF_TNF_EMPTY        0x00
+#define NDEF_TNF_WELL_KNOWN   0x01
+#define NDEF_TNF_MEDIA        0x02
+#define NDEF_TNF_URI          0x03
+#define NDEF_TNF_EXTERNAL     0x04
+#define NDEF_TNF_UNKNOWN      0x05
+#define NDEF_TNF_UNCHANGED    0x06
+
+#define NDEF_PLAN_BLOCKS      224                //Enough for NTAG216 pages or a 4K card
+#define NDEF_KEY_PUBLIC       {0xD3,0xF7,0xD3,0xF7,0xD3,0xF7} //Key A of NFC Forum formatted Mifare_One sectors
+
+typedef struct
+{
+    const unsigned char *data;                   //Card image from UlReadTag or a block dump
+    unsigned short size;                         //Image size in bytes
+    unsigned char layout;                        //NDEF_LAYOUT_*
+} ndef_image_t;
+
+typedef struct
+{
+    unsigned short off;                          //Offset in the data area of the image
+    unsigned short len;                          //Length in bytes
+} ndef_span_t;
+
+typedef struct
+{
+    unsigned char flags;                         //MB/ME/CF/SR/IL
+    unsigned char tnf;                           //Type name format
+    ndef_span_t type;
+    ndef_span_t id;
+    ndef_span_t payload;
+} ndef_record_t;
+
+typedef struct
+{
+    const ndef_image_t *img;
+    ndef_span_t msg;                             //NDEF message TLV value
+    unsigned short pos;                          //Next record
+} ndef_reader_t;
+
+typedef struct
+{
+    unsigned char tnf;
+    const unsigned char *type;
+    unsigned char type_len;
+    const unsigned char *id;
+    unsigned char id_len;
+    const unsigned char *payload;
+    unsigned long payload_len;
+} ndef_out_record_t;
+
+typedef struct
+{
+    unsigned char addr;                          //Block or page address
+    unsigned char data[16];
+} ndef_block_t;
+
+typedef struct
+{
+    unsigned char layout;                        //NDEF_LAYOUT_*
+    unsigned char unit;                          //Bytes per write, 16 or 4
+    unsigned short capacity;                     //Data area size in bytes
+    unsigned short pos;                          //Next byte of the data area
+    unsigned short count;                        //Blocks in use
+    unsigned char last_page;                     //Type 2: last user memory page, the lock and configuration pages follow
+    ndef_block_t block[NDEF_PLAN_BLOCKS];
+} ndef_plan_t;
+
+unsigned short NdefDataSize(const ndef_image_t *img);
+const unsigned char *NdefSpanPtr(const ndef_image_t *img,ndef_span_t span);
+unsigned short NdefSpanCopy(const ndef_image_t *img,ndef_span_t span,unsigned char *pDst,unsigned short max);
+unsigned char NdefFindMessage(const ndef_image_t *img,ndef_span_t *pMsg);
+unsigned char NdefReaderInit(ndef_reader_t *rd,const ndef_image_t *img);
+unsigned char NdefNextRecord(ndef_reader_t *rd,ndef_record_t *rec);
+void NdefPlanInit(ndef_plan_t *plan,unsigned char layout,unsigned short image_size);
+void NdefPlanInitUl(ndef_plan_t *plan,const ul_tag_t *pTag);
+unsigned char NdefPlanMessage(ndef_plan_t *plan,const ndef_out_record_t *rec,unsigned char count);
+unsigned char NdefPlanWriteUl(rc522_t *pcd,ndef_plan_t *plan);
+unsigned char NdefPlanWriteClassic(rc522_t *pcd,ndef_plan_t *plan,unsigned char auth_mode,unsigned char *pKey,unsigned char *pSnr);
+
+#endif
@@ -0,0 +1,150 @@
+/***************************************************************************************
+ * Project  :rc522 card presence tracker
+ * Describe :absent -> arriving -> present -> leaving state machine per reader.
+ *			 Only an absent reader runs the full request/anticollision/select cycle,
+ *			 a known card is confirmed with the cheapest probe available: a block READ
+ *			 while it is still selected, otherwise WUPA plus a direct SELECT of its UID.
+ *			 Events are returned only on state changes, after a configurable debounce.
+***************************************************************************************/
+#include <string.h>
+#include <wiringPi.h>
+#include "rc522.h"
+#include "presence.h"
+
+/////////////////////////////////////////////////////////////////////
+//function:Reset a tracker
+//Parameters:pres[OUT]:Tracker
+//   arrive_polls[IN]:Polls a new card must answer before ARRIVED, 0 = default
+//    leave_polls[IN]:Failed probes before LEFT, 0 = default
+/////////////////////////////////////////////////////////////////////
+void PresenceInit(presence_t *pres,unsigned char arrive_polls,unsigned char leave_polls)
+{
+    memset(pres,0,sizeof(presence_t));
+    pres->state = PRES_ABSENT;
+    pres->arrive_polls = arrive_polls ? arrive_polls : PRES_ARRIVE_POLLS;
+    pres->leave_polls = leave_polls ? leave_polls : PRES_LEAVE_POLLS;
+    pres->since_ms = millis();
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Probe the card with READ instead of WUPA/SELECT
+//         Call after an authentication (Mifare_One) or select (Ultralight)
+//         that leaves the card able to answer READ; the first failed READ
+//         falls back to WUPA/SELECT
+//Parameters:pres[IN]:Tracker
+//          block[IN]:Block the current session may read
+/////////////////////////////////////////////////////////////////////
+void PresenceReadProbe(presence_t *pres,unsigned char block)
+{
+    pres->read_probe = 1;
+    pres->read_block = block;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Cheapest check that the tracked card still answers
+//return:Card answered returns MI_OK
+/////////////////////////////////////////////////////////////////////
+static unsigned char PresenceProbe(rc522_t *pcd,presence_t *pres)
+{
+    unsigned char buf[16];
+    pres->probes++;
+    if(pres->read_probe)
+    {
+		if((pres->status = PcdRead(pcd,pres->read_block,buf)) == MI_OK)
+		{
+			return MI_OK;
+		}
+		pres->read_probe = 0;//The card dropped to IDLE, its session is gone
+    }
+    return pres->status = PcdWakeupSelect(pcd,pres->uid,pres->uid_len);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Change state and restart the debounce counter
+/////////////////////////////////////////////////////////////////////
+static void PresenceEnter(presence_t *pres,unsigned char state)
+{
+    pres->state = state;
+    pres->count = 0;
+    pres->since_ms = millis();
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:One poll of a card waiting for the arrive debounce
+/////////////////////////////////////////////////////////////////////
+static unsigned char PresenceArrive(rc522_t *pcd,presence_t *pres)
+{
+    if(pres->count > 0 && PresenceProbe(pcd,pres) != MI_OK)
+    {
+		PresenceEnter(pres,PRES_ABSENT);//Card brushed past the antenna
+		return PRES_EVT_NONE;
+    }
+    if(++pres->count < pres->arrive_polls)
+    {
+		return PRES_EVT_NONE;
+    }
+    PresenceEnter(pres,PRES_PRESENT);
+    return PRES_EVT_ARRIVED;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Run one poll whose card request has already been sent
+//         For schedulers that wait for the requests of several readers
+//         at once (PcdRequestStart/PcdRequestPoll)
+//Parameters:pres[IN]:Tracker, request answer in pres->atqa
+//          status[IN]:Result of the request
+//return:PRES_EVT_ARRIVED, PRES_EVT_LEFT or PRES_EVT_NONE
+/////////////////////////////////////////////////////////////////////
+unsigned char PresencePollRequested(rc522_t *pcd,presence_t *pres,unsigned char status)
+{
+    if(pres->state != PRES_ABSENT)
+    {
+		return PresencePoll(pcd,pres);
+    }
+    pres->full_cycles++;
+    if((pres->status = status) != MI_OK || (pres->status = PcdAnticollSelect(pcd,pres->uid,&pres->uid_len,&pres->sak)) != MI_OK)
+    {
+		return PRES_EVT_NONE;
+    }
+    pres->read_probe = 0;
+    PresenceEnter(pres,PRES_ARRIVING);
+    return PresenceArrive(pcd,pres);//The select counts as the first answer
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Run one poll of the reader
+//Parameters:pres[IN]:Tracker, pres->uid holds the card of the event
+//return:PRES_EVT_ARRIVED, PRES_EVT_LEFT or PRES_EVT_NONE
+/////////////////////////////////////////////////////////////////////
+unsigned char PresencePoll(rc522_t *pcd,presence_t *pres)
+{
+    switch(pres->state)
+    {
+		case PRES_ABSENT:
+			return PresencePollRequested(pcd,pres,PcdRequest(pcd,PICC_REQIDL,pres->atqa));
+		case PRES_ARRIVING:
+			return PresenceArrive(pcd,pres);
+		case PRES_PRESENT:
+		case PRES_LEAVING:
+			if(PresenceProbe(pcd,pres) == MI_OK)
+			{
+				if(pres->state == PRES_LEAVING)
+				{
+					PresenceEnter(pres,PRES_PRESENT);
+				}
+				return PRES_EVT_NONE;
+			}
+			if(pres->state == PRES_PRESENT)
+			{
+				PresenceEnter(pres,PRES_LEAVING);
+			}
+			if(++pres->count < pres->leave_polls)
+			{
+				return PRES_EVT_NONE;
+			}
+			PresenceEnter(pres,PRES_ABSENT);
+			return PRES_EVT_LEFT;
+    }
+    PresenceEnter(pres,PRES_ABSENT);
+    return PRES_EVT_NONE;
+}
@@ -0,0 +1,257 @@
+/***************************************************************************************
+ * Project  :rc522 register traffic audit
+ * Describe :Analysis mode of the transport layer (make AUDIT=1). Every ReadRawRC/
+ *			 WriteRawRC is timed and checked against what the driver already knows:
+ *			 writes that store the value a register already holds (from the register
+ *			 shadow), the same value written twice with nothing in between, reads of
+ *			 registers whose value is in the shadow, and SetBitMask/ClearBitMask that
+ *			 change no bit. Findings are counted per call site, with the bus time they
+ *			 cost, and reported at exit to the file named by RC522_AUDIT (stderr
+ *			 without it), the costliest first. Reads whose result is dropped are found
+ *			 by the compiler instead: ReadRawRC is warn_unused_result in this mode.
+ *			 Sites are code addresses, printed as function+offset and as an offset in
+ *			 the program for addr2line -f -e <program> <offset>.
+***************************************************************************************/
+#ifdef RC522_AUDIT
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "rc522.h"
+#ifdef RC522_EMU
+#include "rc522_emu.h"
+#endif
+
+typedef struct
+{
+    void *site;                                  //NULL = free
+    unsigned char kind;
+    unsigned char reg;
+    unsigned long count;
+    unsigned long long ns;
+} audit_site_t;
+
+static const char *AuditKinds[AUDIT_KINDS] = {"noop_write","repeat_write","known_read","rmw_nochange"};
+static const char *AuditRegs[64] =
+{
+    "RFU00","CommandReg","ComIEnReg","DivlEnReg","ComIrqReg","DivIrqReg","ErrorReg","Status1Reg",
+    "Status2Reg","FIFODataReg","FIFOLevelReg","WaterLevelReg","ControlReg","BitFramingReg","CollReg","RFU0F",
+    "RFU10","ModeReg","TxModeReg","RxModeReg","TxControlReg","TxAutoReg","TxSelReg","RxSelReg",
+    "RxThresholdReg","DemodReg","RFU1A","RFU1B","MifareReg","RFU1D","RFU1E","SerialSpeedReg",
+    "RFU20","CRCResultRegM","CRCResultRegL","RFU23","ModWidthReg","RFU25","RFCfgReg","GsNReg",
+    "CWGsCfgReg","ModGsCfgReg","TModeReg","TPrescalerReg","TReloadRegH","TReloadRegL","TCounterValueRegH","TCounterValueRegL",
+    "RFU30","TestSel1Reg","TestSel2Reg","TestPinEnReg","TestPinValueReg","TestBusReg","AutoTestReg","VersionReg",
+    "AnalogTestReg","TestDAC1Reg","TestDAC2Reg","TestADCReg","RFU3C","RFU3D","RFU3E","RFU3F",
+};
+
+static struct
+{
+    audit_site_t site[AUDIT_SITES];
+    unsigned long lost;                          //Findings of sites that did not fit
+    unsigned long accesses;
+    unsigned long long bus_ns;
+} Audit;
+static pthread_mutex_t AuditLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t AuditOnce = PTHREAD_ONCE_INIT;
+
+static void AuditExit(void)
+{
+    AuditReport(getenv("RC522_AUDIT"));
+}
+
+static void AuditSetup(void)
+{
+    atexit(AuditExit);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Clock of the audit, emulator time under EMU=1
+//return:Nanoseconds
+/////////////////////////////////////////////////////////////////////
+unsigned long long AuditNow(void)
+{
+#ifdef RC522_EMU
+    return EmuNow();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (unsigned long long)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+//Count a finding against its call site
+static void AuditFind(void *site,unsigned char kind,unsigned char reg,unsigned long long ns)
+{
+    unsigned int h = (unsigned int)(((unsigned long)site >> 2)*31 + kind*64 + reg) % AUDIT_SITES,i;
+    audit_site_t *s;
+    pthread_mutex_lock(&AuditLock);
+    for(i=0;i<AUDIT_SITES;i++)
+    {
+		s = &Audit.site[(h + i) % AUDIT_SITES];
+		if(s->site == NULL)
+		{
+			s->site = site;
+			s->kind = kind;
+			s->reg = reg;
+		}
+		if(s->site == site && s->kind == kind && s->reg == reg)
+		{
+			s->count++;
+			s->ns += ns;
+			break;
+		}
+    }
+    if(i == AUDIT_SITES)
+    {
+		Audit.lost++;
+    }
+    pthread_mutex_unlock(&AuditLock);
+}
+
+//Bus time of every access, the findings are a share of it
+static void AuditAccess(unsigned long long ns)
+{
+    pthread_once(&AuditOnce,AuditSetup);
+    __atomic_add_fetch(&Audit.accesses,1,__ATOMIC_RELAXED);
+    __atomic_add_fetch(&Audit.bus_ns,ns,__ATOMIC_RELAXED);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Check a register read, from ReadRawRC once the value is in
+//Parameters:value[IN]:Value read
+//               t[IN]:AuditNow() before the access
+//              ra[IN]:Return address of ReadRawRC
+/////////////////////////////////////////////////////////////////////
+void AuditRead(rc522_t *pcd,unsigned char reg,unsigned char value,unsigned long long t,void *ra)
+{
+    rc522_audit_t *a = &pcd->audit;
+    unsigned long long ns = AuditNow() - t;
+    (void)value;
+    AuditAccess(ns);
+    a->last_wr &= ~(1ULL<<reg);
+    if(a->site != NULL)
+    {
+		a->rmw_ns += ns;                         //Judged with the whole SetBitMask/ClearBitMask
+    }
+    else if(pcd->shadow_valid & (1ULL<<reg))
+    {
+		AuditFind(ra,AUDIT_KNOWN_READ,reg,ns);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Check a register write, from WriteRawRC before the shadow
+//         takes the new value
+/////////////////////////////////////////////////////////////////////
+void AuditWrite(rc522_t *pcd,unsigned char reg,unsigned char value,unsigned long long t,void *ra)
+{
+    rc522_audit_t *a = &pcd->audit;
+    unsigned long long ns = AuditNow() - t,bit = 1ULL<<reg;
+    AuditAccess(ns);
+    if(a->site != NULL)
+    {
+		a->rmw_ns += ns;
+    }
+    else if((pcd->shadow_valid & bit) && pcd->shadow[reg] == value)
+    {
+		AuditFind(ra,AUDIT_NOOP_WRITE,reg,ns);
+    }
+    else if((a->last_wr & bit) && a->last[reg] == value && reg != FIFODataReg)
+    {
+		AuditFind(ra,AUDIT_REPEAT_WRITE,reg,ns);
+    }
+    a->last_wr |= bit;
+    a->last[reg] = value;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:End of a SetBitMask/ClearBitMask started with AUDIT_RMW_START
+//Parameters:old[IN]:Register before
+//         value[IN]:Register written
+/////////////////////////////////////////////////////////////////////
+void AuditRmw(rc522_t *pcd,unsigned char reg,unsigned char old,unsigned char value)
+{
+    rc522_audit_t *a = &pcd->audit;
+    void *site = a->site;
+    a->site = NULL;
+    if(old == value && !(AUDIT_STROBE_REGS & (1ULL<<reg)))
+    {
+		AuditFind(site,AUDIT_RMW_NOCHANGE,reg,a->rmw_ns);
+    }
+}
+
+static int AuditCompare(const void *x,const void *y)
+{
+    const audit_site_t *a = (const audit_site_t *)x,*b = (const audit_site_t *)y;
+    return a->ns < b->ns ? 1 : a->ns > b->ns ? -1 : 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write the findings, the costliest call site first
+//Parameters:path[IN]:Output file, NULL = stderr
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int AuditReport(const char *path)
+{
+    static audit_site_t sorted[AUDIT_SITES];
+    unsigned long long wasted = 0;
+    unsigned int i,n = 0;
+    char where[96];
+    const char *base;
+    Dl_info info;
+    FILE *fp = path != NULL && *path ? fopen(path,"w") : stderr;
+    if(fp == NULL)
+    {
+		return -1;
+    }
+    pthread_mutex_lock(&AuditLock);
+    for(i=0;i<AUDIT_SITES;i++)
+    {
+		if(Audit.site[i].site != NULL)
+		{
+			sorted[n++] = Audit.site[i];
+			wasted += Audit.site[i].ns;
+		}
+    }
+    pthread_mutex_unlock(&AuditLock);
+    qsort(sorted,n,sizeof(audit_site_t),AuditCompare);
+    fprintf(fp,"# rc522 register traffic: %lu accesses, %.3f ms on the bus, %.3f ms (%.1f%%) wasted\n",
+            Audit.accesses,Audit.bus_ns/1e6,wasted/1e6,Audit.bus_ns ? 100.0*wasted/Audit.bus_ns : 0.0);
+    fprintf(fp,"# %-12s %-18s %10s %12s  %s\n","kind","register","count","wasted_us","site");
+    for(i=0;i<n;i++)
+    {
+		const audit_site_t *s = &sorted[i];
+		where[0] = 0;
+		if(dladdr(s->site,&info) != 0)
+		{
+			base = info.dli_fname && strrchr(info.dli_fname,'/') ? strrchr(info.dli_fname,'/') + 1 : info.dli_fname;
+			snprintf(where,sizeof(where),"%s+0x%lx (%s 0x%lx)",info.dli_sname ? info.dli_sname : "?",
+					 info.dli_saddr ? (unsigned long)((char *)s->site - (char *)info.dli_saddr) : 0UL,
+					 base ? base : "?",(unsigned long)((char *)s->site - (char *)info.dli_fbase) - 1);
+		}
+		fprintf(fp,"  %-12s %-18s %10lu %12.1f  %s\n",AuditKinds[s->kind],AuditRegs[s->reg & 0x3F],s->count,s->ns/1e3,
+				where[0] ? where : "?");
+    }
+    if(Audit.lost)
+    {
+		fprintf(fp,"# %lu findings of sites beyond the first %d not shown\n",Audit.lost,AUDIT_SITES);
+    }
+    return fp == stderr ? 0 : fclose(fp);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Forget the findings, e.g. after the reader has been set up
+/////////////////////////////////////////////////////////////////////
+void AuditReset(void)
+{
+    pthread_mutex_lock(&AuditLock);
+    memset(Audit.site,0,sizeof(Audit.site));
+    Audit.lost = 0;
+    __atomic_store_n(&Audit.accesses,0,__ATOMIC_RELAXED);
+    __atomic_store_n(&Audit.bus_ns,0,__ATOMIC_RELAXED);
+    pthread_mutex_unlock(&AuditLock);
+}
+#endif
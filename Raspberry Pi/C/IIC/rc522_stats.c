@@ -0,0 +1,268 @@
+/***************************************************************************************
+ * Project  :rc522 statistics
+ * Describe :Snapshots of the per-reader phase histograms and error counters that
+ *			 rc522.c keeps when built with make STATS=1, and their export as a Prometheus
+ *			 text-format file for the node_exporter textfile collector. The file is
+ *			 written next to its final name and renamed, so the collector never reads
+ *			 half of it. Without RC522_STATS this file is empty and rc522.c carries no
+ *			 instrumentation at all.
+***************************************************************************************/
+#ifdef RC522_STATS
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "rc522.h"
+
+#define STATS_READERS_MAX     8                  //Readers one exporter writes
+
+static const char *StatsPhases[STATS_PHASES] = {"request","anticoll","select","auth","read","write","halt","transceive","recover"};
+static const char *StatsCounters[STATS_COUNTERS] = {"timeout","crc","parity","collision","protocol","overflow","retry","stuck"};
+//Bucket bounds of the exported histogram, us
+static const unsigned long StatsLe[] = {50,100,200,500,1000,2000,5000,10000,20000,50000,100000,200000,500000,1000000};
+
+static struct
+{
+    char path[256];
+    rc522_t *pcd[STATS_READERS_MAX];
+    int n;
+    unsigned int period_ms;
+    volatile int running;
+    pthread_t thread;
+} StatsExport;
+
+/////////////////////////////////////////////////////////////////////
+//function:Copy the statistics of a reader, safe while it runs
+//Parameters:pcd[IN]:Reader
+//         snap[OUT]:Copy
+/////////////////////////////////////////////////////////////////////
+void StatsSnapshot(const rc522_t *pcd,rc522_stats_t *snap)
+{
+    const rc522_stats_t *s = &pcd->stats;
+    unsigned long n;
+    unsigned int p,i;
+    for(i=0;i<STATS_COUNTERS;i++)
+    {
+		snap->counter[i] = __atomic_load_n(&s->counter[i],__ATOMIC_RELAXED);
+    }
+    snap->t_com = snap->t_req = 0;
+    for(p=0;p<STATS_PHASES;p++)
+    {
+		const stats_hist_t *h = &s->phase[p];
+		stats_hist_t *c = &snap->phase[p];
+		c->count = __atomic_load_n(&h->count,__ATOMIC_ACQUIRE);
+		c->failed = __atomic_load_n(&h->failed,__ATOMIC_RELAXED);
+		c->sum_us = __atomic_load_n(&h->sum_us,__ATOMIC_RELAXED);
+		c->max_us = __atomic_load_n(&h->max_us,__ATOMIC_RELAXED);
+		for(i=0,n=0;i<STATS_BUCKETS;i++)
+		{
+			c->bucket[i] = __atomic_load_n(&h->bucket[i],__ATOMIC_RELAXED);
+			n += c->bucket[i];
+		}
+		if(n > c->count)
+		{
+			c->count = n;                        //Recorded while copying: +Inf and _count never below a finite bucket
+		}
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Clear the statistics of a reader, from the reader's own
+//         thread or while it is stopped
+/////////////////////////////////////////////////////////////////////
+void StatsReset(rc522_t *pcd)
+{
+    memset(&pcd->stats,0,sizeof(rc522_stats_t));
+}
+
+//Lowest value of the next bucket
+static unsigned long long StatsBucketEnd(unsigned int b)
+{
+    unsigned int e;
+    if(b < STATS_SUB)
+    {
+		return b + 1;
+    }
+    e = b/STATS_SUB + STATS_SUB_BITS - 1;
+    return (unsigned long long)(STATS_SUB + b%STATS_SUB + 1) << (e - STATS_SUB_BITS);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Percentile of a histogram
+//Parameters:h[IN]:Histogram, of a snapshot
+//           p[IN]:0.5, 0.99, 0.999...
+//return:Highest value of the bucket the percentile falls into, us
+/////////////////////////////////////////////////////////////////////
+unsigned long StatsPercentile(const stats_hist_t *h,double p)
+{
+    unsigned long long total = 0,rank,seen = 0,v;
+    unsigned int i;
+    for(i=0;i<STATS_BUCKETS;i++)
+    {
+		total += h->bucket[i];
+    }
+    if(total == 0)
+    {
+		return 0;
+    }
+    rank = (unsigned long long)(p*total + 0.999999);
+    for(i=0;i<STATS_BUCKETS && (seen += h->bucket[i]) < rank;i++);
+    v = StatsBucketEnd(i < STATS_BUCKETS ? i : STATS_BUCKETS-1) - 1;
+    return v < h->max_us ? v : h->max_us;
+}
+
+const char *StatsPhaseName(unsigned char ph)
+{
+    return ph < STATS_PHASES ? StatsPhases[ph] : "?";
+}
+
+const char *StatsCounterName(unsigned char c)
+{
+    return c < STATS_COUNTERS ? StatsCounters[c] : "?";
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write the statistics of some readers as a Prometheus text file
+//Parameters:path[IN]:e.g. /var/lib/node_exporter/textfile/rc522.prom
+//            pcd[IN]:Readers, labelled reader="0".. in this order
+//              n[IN]:Number of readers, up to 8
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int StatsWriteProm(const char *path,rc522_t *const *pcd,int n)
+{
+    static rc522_stats_t snap[STATS_READERS_MAX];//Too big for the stack of a small thread
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static const double Q[] = {0.5,0.99,0.999};
+    char tmp[300];
+    unsigned long long cum;
+    unsigned int p,i,b;
+    int r,ret;
+    FILE *fp;
+    snprintf(tmp,sizeof(tmp),"%s.%d",path,(int)getpid());
+    pthread_mutex_lock(&lock);
+    if(n > STATS_READERS_MAX || (fp = fopen(tmp,"w")) == NULL)
+    {
+		pthread_mutex_unlock(&lock);
+		return -1;
+    }
+    for(r=0;r<n;r++)                             //One snapshot per reader, every family shows the same moment
+    {
+		StatsSnapshot(pcd[r],&snap[r]);
+    }
+    fprintf(fp,"# HELP rc522_phase_seconds Time taken by each protocol phase of the RC522 driver\n"
+			   "# TYPE rc522_phase_seconds histogram\n");
+    for(r=0;r<n;r++)
+    {
+		for(p=0;p<STATS_PHASES;p++)
+		{
+			const stats_hist_t *h = &snap[r].phase[p];
+			for(i=0,b=0,cum=0;i<sizeof(StatsLe)/sizeof(StatsLe[0]);i++)
+			{
+				for(;b<STATS_BUCKETS && StatsBucketEnd(b) <= StatsLe[i] + 1;b++)
+				{
+					cum += h->bucket[b];
+				}
+				fprintf(fp,"rc522_phase_seconds_bucket{reader=\"%d\",phase=\"%s\",le=\"%g\"} %llu\n",r,StatsPhases[p],StatsLe[i]/1e6,cum);
+			}
+			fprintf(fp,"rc522_phase_seconds_bucket{reader=\"%d\",phase=\"%s\",le=\"+Inf\"} %lu\n",r,StatsPhases[p],h->count);
+			fprintf(fp,"rc522_phase_seconds_sum{reader=\"%d\",phase=\"%s\"} %.6f\n",r,StatsPhases[p],h->sum_us/1e6);
+			fprintf(fp,"rc522_phase_seconds_count{reader=\"%d\",phase=\"%s\"} %lu\n",r,StatsPhases[p],h->count);
+		}
+    }
+    fprintf(fp,"# HELP rc522_phase_quantile_seconds Latency percentiles since start, from the full resolution histogram\n"
+			   "# TYPE rc522_phase_quantile_seconds gauge\n");
+    for(r=0;r<n;r++)
+    {
+		for(p=0;p<STATS_PHASES;p++)
+		{
+			for(i=0;i<sizeof(Q)/sizeof(Q[0]);i++)
+			{
+				fprintf(fp,"rc522_phase_quantile_seconds{reader=\"%d\",phase=\"%s\",quantile=\"%g\"} %.6f\n",
+						r,StatsPhases[p],Q[i],StatsPercentile(&snap[r].phase[p],Q[i])/1e6);
+			}
+		}
+    }
+    fprintf(fp,"# HELP rc522_phase_failures_total Phases that did not return MI_OK\n"
+			   "# TYPE rc522_phase_failures_total counter\n");
+    for(r=0;r<n;r++)
+    {
+		for(p=0;p<STATS_PHASES;p++)
+		{
+			fprintf(fp,"rc522_phase_failures_total{reader=\"%d\",phase=\"%s\"} %lu\n",r,StatsPhases[p],snap[r].phase[p].failed);
+		}
+    }
+    fprintf(fp,"# HELP rc522_errors_total Timeouts, ErrorReg errors and retries\n"
+			   "# TYPE rc522_errors_total counter\n");
+    for(r=0;r<n;r++)
+    {
+		for(i=0;i<STATS_COUNTERS;i++)
+		{
+			fprintf(fp,"rc522_errors_total{reader=\"%d\",type=\"%s\"} %lu\n",r,StatsCounters[i],snap[r].counter[i]);
+		}
+    }
+    ret = fclose(fp) == 0 && rename(tmp,path) == 0 ? 0 : -1;
+    if(ret != 0)
+    {
+		unlink(tmp);
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+static void *StatsWorker(void *arg)
+{
+    unsigned int ms = 0;
+    (void)arg;
+    while(StatsExport.running)
+    {
+		usleep(100000);
+		if((ms += 100) >= StatsExport.period_ms)
+		{
+			StatsWriteProm(StatsExport.path,StatsExport.pcd,StatsExport.n);
+			ms = 0;
+		}
+    }
+    StatsWriteProm(StatsExport.path,StatsExport.pcd,StatsExport.n);//Final numbers
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write the Prometheus file every period_ms on a thread of its own
+//Parameters:path[IN]:Output file
+//            pcd[IN]:Readers, up to 8, they must outlive the exporter
+//              n[IN]:Number of readers
+//      period_ms[IN]:0 = STATS_EXPORT_MS
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int StatsExportStart(const char *path,rc522_t *const *pcd,int n,unsigned int period_ms)
+{
+    if(StatsExport.running || n <= 0 || n > STATS_READERS_MAX || strlen(path) >= sizeof(StatsExport.path))
+    {
+		return -1;
+    }
+    strcpy(StatsExport.path,path);
+    memcpy(StatsExport.pcd,pcd,n*sizeof(rc522_t *));
+    StatsExport.n = n;
+    StatsExport.period_ms = period_ms ? period_ms : STATS_EXPORT_MS;
+    if(StatsWriteProm(path,pcd,n) != 0)
+    {
+		return -1;
+    }
+    StatsExport.running = 1;
+    if(pthread_create(&StatsExport.thread,NULL,StatsWorker,NULL) != 0)
+    {
+		StatsExport.running = 0;
+		return -1;
+    }
+    return 0;
+}
+
+void StatsExportStop(void)
+{
+    if(StatsExport.running)
+    {
+		StatsExport.running = 0;
+		pthread_join(StatsExport.thread,NULL);
+    }
+}
+#endif
@@ -0,0 +1,87 @@
+#ifndef __RC522D_H
+#define	__RC522D_H
+
+/////////////////////////////////////////////////////////////////////
+//rc522d event framing
+//Every event is one SOCK_SEQPACKET message: an 8 byte header followed
+//by len bytes of payload, all multi-byte fields little endian. Clients
+//send requests the same way, seq and time_ms are ignored
+/////////////////////////////////////////////////////////////////////
+#define RC522D_SOCKET         "/run/rc522d.sock" //Default socket path
+
+#define RC522D_EVT_PRESENT    0x01               //Card arrived: rc522d_card_t
+#define RC522D_EVT_REMOVED    0x02               //Card left: rc522d_card_t
+#define RC522D_EVT_READ       0x03               //Block read finished: rc522d_read_t
+#define RC522D_EVT_OVERFLOW   0x04               //Events were dropped for this client: rc522d_overflow_t
+#define RC522D_EVT_ACCESS     0x05               //Allowlist decision for an arrived card: rc522d_access_t
+#define RC522D_EVT_HEALTH     0x06               //The RC522 failed and was reset: rc522d_health_t
+
+#define RC522D_REQ_READ       0x81               //Client to daemon: read a block of the card in the field,
+                                                 //rc522d_req_read_t, every client gets the RC522D_EVT_READ
+
+typedef struct __attribute__((packed))
+{
+    unsigned char type;                          //RC522D_EVT_*
+    unsigned char len;                           //Payload length
+    unsigned short seq;                          //Event sequence number, shared by all clients
+    unsigned int time_ms;                        //Monotonic time of the event
+} rc522d_hdr_t;
+
+typedef struct __attribute__((packed))
+{
+    unsigned char uid_len;                       //4, 7 or 10
+    unsigned char uid[10];
+    unsigned char atqa[2];
+    unsigned char sak;
+} rc522d_card_t;
+
+typedef struct __attribute__((packed))
+{
+    unsigned char uid_len;
+    unsigned char uid[10];
+    unsigned char block;                         //Block address
+    unsigned char status;                        //MI_OK or MI_* error code
+    unsigned char data[16];
+} rc522d_read_t;
+
+typedef struct __attribute__((packed))
+{
+    unsigned char uid_len;
+    unsigned char uid[10];
+    unsigned char allowed;                       //1 = allowed, 0 = denied
+    unsigned int tag;                            //Tag of the allowlist entry, 0 when denied
+} rc522d_access_t;
+
+typedef struct __attribute__((packed))
+{
+    unsigned char block;                         //Block address, read with the key of rc522d -k
+} rc522d_req_read_t;
+
+typedef struct __attribute__((packed))
+{
+    unsigned int dropped;                        //Events lost since the previous frame
+} rc522d_overflow_t;
+
+typedef struct __attribute__((packed))
+{
+    unsigned char fault;                         //HEALTH_FAULT_* of health.h
+    unsigned char status;                        //MI_OK = the chip is back, else it is still down
+    unsigned int recover_us;                     //Duration of the recovery
+    unsigned int recoveries;                     //Successful recoveries since the start
+} rc522d_health_t;
+
+typedef struct __attribute__((packed))
+{
+    rc522d_hdr_t hdr;
+    union
+    {
+		rc522d_card_t card;
+		rc522d_read_t read;
+		rc522d_access_t access;
+		rc522d_overflow_t overflow;
+		rc522d_health_t health;
+		rc522d_req_read_t req_read;
+    } u;
+} rc522d_frame_t;
+
+#endif
@@ -0,0 +1,136 @@
+/***************************************************************************************
+ * Project  :rc522 retry policy
+ * Describe :Decides after every failed REQA, anticollision or SELECT whether to send it
+ *			 again and after which gap. Without a policy PcdRequest sends a silent REQA a
+ *			 second time 5 us later and nothing else is retried, which wastes a request
+ *			 on every poll of an empty field and gives a garbled SELECT of a marginal card
+ *			 no second chance.
+ *			 The policy looks at why the attempt failed and at what it has seen lately:
+ *			 - a silent field is only asked again when a card answered in the last
+ *			   RETRY_RECENT_MS, a card at the edge of the field; otherwise nobody is there
+ *			 - an answer with errors means a card is there: retried after a gap that
+ *			   doubles with every retry and grows with the rate of garbled answers
+ *			 - a collision in anticollision is not retried, the same cards collide again,
+ *			   nor is a SELECT that got an answer: the card is ACTIVE and ignores another
+ *			 - a phase whose retries rarely succeed gets fewer of them
+ *			 - no retry starts that would end the tap after budget_us
+ *			 persist is the trade-off between success and latency: it sets the number of
+ *			 retries of a phase (RETRY_MAX at 100, none below 13) and how often retries
+ *			 must have helped before (half of the time at 0, never mind at 100).
+***************************************************************************************/
+#include <string.h>
+#include <wiringPi.h>
+#include "rc522.h"
+#include "retry.h"
+
+//Move a rate 1/8 of the way to the outcome
+static void RetryRate(unsigned short *rate,int hit)
+{
+    *rate = *rate - (*rate >> 3) + (hit ? 1024 >> 3 : 0);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Reset a policy
+//Parameters:r[OUT]:Policy
+//     budget_us[IN]:Longest tap, 0 = RETRY_BUDGET_US
+//       persist[IN]:0 = fastest ... 100 = most persistent
+/////////////////////////////////////////////////////////////////////
+void RetryInit(retry_t *r,unsigned int budget_us,unsigned char persist)
+{
+    int p;
+    memset(r,0,sizeof(retry_t));
+    r->budget_us = budget_us ? budget_us : RETRY_BUDGET_US;
+    r->persist = persist > 100 ? 100 : persist;
+    for(p=0;p<RETRY_PHASES;p++)
+    {
+		r->p_first[p] = 512;
+		r->p_retry[p] = 512;                     //Unknown: worth trying
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Let the policy decide the retries of a reader
+/////////////////////////////////////////////////////////////////////
+void RetryAttach(rc522_t *pcd,retry_t *r)
+{
+    pcd->retry = r;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:A tap starts, from PcdRequest
+/////////////////////////////////////////////////////////////////////
+void RetryTap(retry_t *r)
+{
+    r->tap_us = micros();
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Learn from an attempt and decide on the next one
+//Parameters:phase[IN]:RETRY_*
+//         attempt[IN]:Attempts of the phase so far, 1 = the first one
+//          status[IN]:Result of the attempt, MI_OK = done
+//              t0[IN]:micros() when the attempt started
+//return:Gap in us before the next attempt, -1 = give up (or done)
+/////////////////////////////////////////////////////////////////////
+int RetryAgain(rc522_t *pcd,unsigned char phase,unsigned char attempt,unsigned char status,unsigned int t0)
+{
+    retry_t *r = pcd->retry;
+    unsigned int now = micros(),cost = now - t0,d;
+    int ok = status == MI_OK;
+    r->cost_us[phase] = r->cost_us[phase] ? r->cost_us[phase] - r->cost_us[phase]/8 + cost/8 : cost;
+    RetryRate(attempt > 1 ? &r->p_retry[phase] : &r->p_first[phase],ok);
+    if(attempt > 1 && ok)
+    {
+		r->saved[phase]++;
+    }
+    if(pcd->com_answered)
+    {
+		r->last_card_ms = millis();
+		r->seen = 1;
+		RetryRate(&r->noise,(pcd->com_error & 0x07) != 0);
+    }
+    if(ok)
+    {
+		return -1;
+    }
+    if(!pcd->com_answered && phase == RETRY_REQUEST && !(r->seen && millis() - r->last_card_ms < RETRY_RECENT_MS))
+    {
+		r->idle++;
+		return -1;                               //Nobody there to ask again
+    }
+    if(pcd->com_answered && (pcd->com_error & 0x08) && phase == RETRY_ANTICOLL)
+    {
+		return -1;                               //Several cards, the driver does not resolve collisions
+    }
+    if(pcd->com_answered && phase == RETRY_SELECT)
+    {
+		return -1;                               //The card took the SELECT and is ACTIVE, a second one gets no answer
+    }
+    if(attempt > (r->persist*RETRY_MAX + 50)/100)
+    {
+		r->denied++;
+		return -1;
+    }
+    if(r->p_retry[phase]*200U < (100U - r->persist)*1024U)
+    {
+		r->p_retry[phase] += (512 - r->p_retry[phase])/32;//Drifts back, so a phase that stopped retrying can learn again
+		r->denied++;
+		return -1;
+    }
+    if(pcd->com_answered)
+    {
+		d = RETRY_GAP_US << (attempt - 1);       //Garbled: a short gap, longer in a noisy field
+		d += d*r->noise/1024;
+    }
+    else
+    {
+		d = 4*RETRY_GAP_US << (attempt - 1);     //Silent with a card around: it may be coming or going
+    }
+    if(now - r->tap_us + d + r->cost_us[phase] > r->budget_us)
+    {
+		r->denied++;
+		return -1;
+    }
+    r->retries[phase]++;
+    return d;
+}
@@ -0,0 +1,317 @@
+/***************************************************************************************
+ * Project  :rc522 RF tuner
+ * Describe :Adapts the receiver of one reader to where it is mounted. RFCfgReg is fixed
+ *			 at 0x6F by M500PcdConfigISOType and the other RF registers stay at their
+ *			 reset values, which suits some sites and costs others CRC and parity errors
+ *			 and retries. The tuner counts the answers of cards with an error in ErrorReg
+ *			 (fed by PcdComPoll) and the cards that stopped answering (fed by the caller),
+ *			 judges the profile in use over RFTUNE_WINDOW samples, then tries its
+ *			 neighbours one knob and one step at a time: RxGain, MinLevel, the field
+ *			 conductance CWGsN/CWGsP and AddIQ. A neighbour is kept when it saves at
+ *			 least RFTUNE_MARGIN bad samples per 1024, otherwise the best profile is
+ *			 written back. When no neighbour helps the tuner settles and keeps watching:
+ *			 an error rate RFTUNE_RISE above the kept score rolls back to the profile
+ *			 before the last change and starts the search again.
+ *			 Profiles are only changed from RfTuneIdle, called by the poll loop while no
+ *			 card is in the field, so a tap never sees two receivers.
+***************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "rc522.h"
+#include "rftune.h"
+
+//Register of each profile entry
+static const unsigned char RfTuneReg[RFTUNE_REGS] = {RFCfgReg,RxThresholdReg,DemodReg,GsNReg,CWGsCfgReg};
+//After M500PcdConfigISOType: RFCfgReg as it writes it, the rest at reset values
+static const unsigned char RfTuneDefault[RFTUNE_REGS] = {0x6F,0x84,0x4D,0x88,0x20};
+
+typedef struct
+{
+    unsigned char reg;                           //RFTUNE_RFCFG...
+    unsigned char mask;                          //Bits of the knob
+    unsigned char step;                          //One step, in place
+    unsigned char max;                           //Highest value, in place
+} rftune_knob_t;
+
+//Searched in this order, the strongest lever first
+static const rftune_knob_t RfTuneKnob[] =
+{
+    {RFTUNE_RFCFG,      0x70,0x10,0x70},         //RxGain, 18 to 48 dB
+    {RFTUNE_RXTHRESHOLD,0xF0,0x10,0xF0},         //MinLevel of the decoder
+    {RFTUNE_GSN,        0xF0,0x10,0xF0},         //CWGsN, field strength while not modulating
+    {RFTUNE_CWGSCFG,    0x3F,0x04,0x3F},         //CWGsP
+    {RFTUNE_DEMOD,      0xC0,0x40,0x80},         //AddIQ, 3 is reserved
+};
+#define RFTUNE_KNOBS          (sizeof(RfTuneKnob)/sizeof(RfTuneKnob[0]))
+
+/////////////////////////////////////////////////////////////////////
+//function:Reset a tuner
+//Parameters:tune[OUT]:Tuner
+//        profile[IN]:Profile to start from, NULL = the driver's default
+/////////////////////////////////////////////////////////////////////
+void RfTuneInit(rftune_t *tune,const unsigned char *profile)
+{
+    memset(tune,0,sizeof(rftune_t));
+    memcpy(tune->best,profile != NULL ? profile : RfTuneDefault,RFTUNE_REGS);
+    memcpy(tune->prev,tune->best,RFTUNE_REGS);
+    tune->state = RFTUNE_BASELINE;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write a profile to the chip
+//Parameters:profile[IN]:RFTUNE_REGS register values, NULL = the driver's default
+/////////////////////////////////////////////////////////////////////
+void RfTuneApply(rc522_t *pcd,const unsigned char *profile)
+{
+    int i;
+    if(profile == NULL)
+    {
+		profile = RfTuneDefault;
+    }
+    for(i=0;i<RFTUNE_REGS;i++)
+    {
+		if(!(pcd->shadow_valid & (1ULL<<RfTuneReg[i])) || pcd->shadow[RfTuneReg[i]] != profile[i])
+		{
+			WriteRawRC(pcd,RfTuneReg[i],profile[i]);
+		}
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Tune a reader from now on, after RC522_Init
+//Parameters:tune[IN]:Tuner set up by RfTuneInit, its best profile is written
+/////////////////////////////////////////////////////////////////////
+void RfTuneAttach(rc522_t *pcd,rftune_t *tune)
+{
+    RfTuneApply(pcd,tune->best);
+    pcd->tune = tune;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Count one sample, the window ends after RFTUNE_WINDOW of them
+//         or as soon as a trial can no longer be kept
+/////////////////////////////////////////////////////////////////////
+static void RfTuneSample(rftune_t *tune,int bad)
+{
+    if(tune->pending)
+    {
+		return;                                  //Profile judged already, waiting for the next idle
+    }
+    tune->samples++;
+    tune->n++;
+    if(bad)
+    {
+		tune->errors++;
+		tune->bad++;
+    }
+    if(tune->n >= RFTUNE_WINDOW ||
+       (tune->state == RFTUNE_TRIAL && tune->bad*1024UL + RFTUNE_MARGIN*RFTUNE_WINDOW > tune->best_score*(unsigned long)RFTUNE_WINDOW))
+    {
+		tune->pending = 1;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:An exchange got an answer, from PcdComPoll
+//Parameters:error[IN]:ErrorReg after the answer
+/////////////////////////////////////////////////////////////////////
+void RfTuneNote(rftune_t *tune,unsigned char error)
+{
+    RfTuneSample(tune,(error & 0x07) != 0);      //ProtocolErr, ParityErr, CRCErr; collisions are not the receiver's fault
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:A card in the field did not answer, from the caller that
+//         knows it is there (a failed keepalive probe or block read)
+/////////////////////////////////////////////////////////////////////
+void RfTuneMiss(rftune_t *tune)
+{
+    RfTuneSample(tune,1);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Done with this direction: the other one, unless this one
+//         was kept, which makes the other one a profile already beaten
+/////////////////////////////////////////////////////////////////////
+static void RfTuneTurn(rftune_t *tune)
+{
+    if(tune->dir > 0 && !tune->moved)
+    {
+		tune->dir = -1;
+		return;
+    }
+    tune->dir = 1;
+    tune->moved = 0;
+    tune->knob++;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Next neighbour of the best profile, or settle
+/////////////////////////////////////////////////////////////////////
+static void RfTuneNext(rc522_t *pcd,rftune_t *tune)
+{
+    const rftune_knob_t *k;
+    int v;
+    while(tune->best_score > RFTUNE_MARGIN)
+    {
+		if(tune->knob >= RFTUNE_KNOBS)
+		{
+			if(!tune->improved)
+			{
+				break;
+			}
+			tune->knob = 0;                      //Kept something: another sweep from the new best
+			tune->moved = 0;
+			tune->improved = 0;
+		}
+		k = &RfTuneKnob[tune->knob];
+		v = (tune->best[k->reg] & k->mask) + tune->dir*k->step;
+		if(v >= 0 && v <= k->max)
+		{
+			memcpy(tune->trial,tune->best,RFTUNE_REGS);
+			tune->trial[k->reg] = (tune->best[k->reg] & ~k->mask) | v;
+			RfTuneApply(pcd,tune->trial);
+			tune->state = RFTUNE_TRIAL;
+			tune->trials++;
+			return;
+		}
+		RfTuneTurn(tune);
+    }
+    tune->state = RFTUNE_SETTLED;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Act on a judged profile, call while no card is in the field
+/////////////////////////////////////////////////////////////////////
+void RfTuneIdle(rc522_t *pcd)
+{
+    rftune_t *tune = pcd->tune;
+    unsigned int score;
+    if(tune == NULL || !tune->pending)
+    {
+		return;
+    }
+    score = tune->bad*1024U/tune->n;
+    tune->pending = 0;
+    tune->n = 0;
+    tune->bad = 0;
+    switch(tune->state)
+    {
+		case RFTUNE_BASELINE:
+			tune->best_score = score;
+			tune->knob = 0;
+			tune->dir = 1;
+			tune->moved = 0;
+			tune->improved = 0;
+			RfTuneNext(pcd,tune);
+			break;
+		case RFTUNE_TRIAL:
+			if(score + RFTUNE_MARGIN <= tune->best_score)
+			{
+				memcpy(tune->prev,tune->best,RFTUNE_REGS);
+				memcpy(tune->best,tune->trial,RFTUNE_REGS);
+				tune->best_score = score;
+				tune->moved = 1;
+				tune->improved = 1;
+				tune->changed = 1;
+				tune->kept++;
+			}
+			else
+			{
+				RfTuneApply(pcd,tune->best);
+				RfTuneTurn(tune);
+			}
+			RfTuneNext(pcd,tune);
+			break;
+		case RFTUNE_SETTLED:
+			if(score > tune->best_score + RFTUNE_RISE)
+			{
+				tune->rollbacks++;
+				if(memcmp(tune->prev,tune->best,RFTUNE_REGS) != 0)
+				{
+					memcpy(tune->best,tune->prev,RFTUNE_REGS);
+					tune->changed = 1;
+					RfTuneApply(pcd,tune->best);
+				}
+				tune->state = RFTUNE_BASELINE;
+			}
+			else
+			{
+				tune->best_score = (tune->best_score*3 + score)/4;
+			}
+			break;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write the profile in use again, RC522_Init has reset it
+/////////////////////////////////////////////////////////////////////
+void RfTuneRestore(rc522_t *pcd)
+{
+    rftune_t *tune = pcd->tune;
+    RfTuneApply(pcd,tune->state == RFTUNE_TRIAL ? tune->trial : tune->best);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Whether the kept profile changed since the last call, to save it
+/////////////////////////////////////////////////////////////////////
+int RfTuneChanged(rftune_t *tune)
+{
+    int changed = tune->changed;
+    tune->changed = 0;
+    return changed;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read a profile saved by RfTuneSave
+//Parameters:profile[OUT]:RFTUNE_REGS register values
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int RfTuneLoad(unsigned char *profile,const char *path)
+{
+    char line[128];
+    unsigned int v[RFTUNE_REGS];
+    int i,ok = 0;
+    FILE *fp = fopen(path,"r");
+    if(fp == NULL)
+    {
+		return -1;
+    }
+    while(!ok && fgets(line,sizeof(line),fp) != NULL)
+    {
+		ok = line[0] != '#' && sscanf(line,"%x %x %x %x %x",&v[0],&v[1],&v[2],&v[3],&v[4]) == RFTUNE_REGS;
+    }
+    fclose(fp);
+    if(!ok)
+    {
+		return -1;
+    }
+    for(i=0;i<RFTUNE_REGS;i++)
+    {
+		profile[i] = (unsigned char)v[i];
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Save a profile, replaced in one rename
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int RfTuneSave(const unsigned char *profile,const char *path)
+{
+    char tmp[256];
+    FILE *fp;
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    if((fp = fopen(tmp,"w")) == NULL)
+    {
+		return -1;
+    }
+    fprintf(fp,"# RFCfgReg RxThresholdReg DemodReg GsNReg CWGsCfgReg\n%02X %02X %02X %02X %02X\n",
+            profile[0],profile[1],profile[2],profile[3],profile[4]);
+    if(fclose(fp) != 0 || rename(tmp,path) != 0)
+    {
+		remove(tmp);
+		return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+/***************************************************************************************
+ * Project  :rc522 tap journal reader
+ * Describe :Prints the newest records of a tap journal and, with -f, follows it while
+ *			 the reader keeps appending. Works on the file of a crashed or powered off
+ *			 reader as well: torn records are skipped, the ring is read as it is.
+ * Usage    :taplog_tail [-f] [-n count] <journal>
+***************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "taplog.h"
+
+/////////////////////////////////////////////////////////////////////
+//function:Print one record
+/////////////////////////////////////////////////////////////////////
+static void PrintRecord(const taplog_rec_t *rec)
+{
+    char when[32];
+    time_t t = (time_t)(rec->real_ns/1000000000ULL);
+    struct tm tm;
+    unsigned char i;
+    localtime_r(&t,&tm);
+    strftime(when,sizeof(when),"%Y-%m-%d %H:%M:%S",&tm);
+    printf("%llu %s.%03u reader %u %s uid ",rec->seq,when,(unsigned int)(rec->real_ns/1000000ULL%1000),rec->reader,
+		   rec->event == TAPLOG_EVT_LEFT ? "left   " : "arrived");
+    for(i=0;i<rec->uid_len && i<sizeof(rec->uid);i++)
+    {
+		printf("%02X",rec->uid[i]);
+    }
+    printf(" atqa %02X%02X sak %02X status %u latency %u us\n",rec->atqa[0],rec->atqa[1],rec->sak,rec->status,rec->latency_us);
+}
+
+int main(int argc,char *argv[])
+{
+    taplog_t log;
+    taplog_rec_t rec;
+    unsigned long long first,last,seq,count = 10;
+    int opt,follow = 0,r;
+
+    while((opt = getopt(argc,argv,"fn:")) != -1)
+    {
+		switch(opt)
+		{
+			case 'f': follow = 1; break;
+			case 'n': count = strtoull(optarg,NULL,0); break;
+			default:
+				fprintf(stderr,"usage: %s [-f] [-n count] <journal>\n",argv[0]);
+				return 1;
+		}
+    }
+    if(optind != argc-1)
+    {
+		fprintf(stderr,"usage: %s [-f] [-n count] <journal>\n",argv[0]);
+		return 1;
+    }
+    if(TapLogOpenReadOnly(&log,argv[optind]) != 0)
+    {
+		fprintf(stderr,"%s: not a tap journal\n",argv[optind]);
+		return 1;
+    }
+    TapLogBounds(&log,&first,&last);
+    seq = last >= first + count ? last - count + 1 : first;
+    while(1)
+    {
+		r = TapLogGet(&log,seq,&rec);
+		if(r == 0)
+		{
+			PrintRecord(&rec);
+			seq++;
+			continue;
+		}
+		TapLogBounds(&log,&first,&last);
+		if(r < 0 && seq <= last)//Torn by a power cut, or overtaken by the writer
+		{
+			if(seq < first)
+			{
+				printf("# %llu records overwritten\n",first - seq);
+				seq = first;
+			}
+			else
+			{
+				seq++;
+			}
+			continue;
+		}
+		if(!follow)
+		{
+			break;
+		}
+		fflush(stdout);
+		usleep(100000);
+    }
+    TapLogClose(&log);
+    return 0;
+}
@@ -0,0 +1,357 @@
+/***************************************************************************************
+ * Project  :rc522 Mifare_UltraLight / NTAG21x support
+ * Describe :READ, FAST_READ, GET_VERSION type detection, WRITE, COMPATIBILITY_WRITE
+ *			 and PWD_AUTH for Type 2 tags (7 byte UID, 4 byte pages, no Crypto1).
+ *			 FAST_READ answers are drained from the FIFO while they are still being
+ *			 received, so a whole NTAG216 comes in with a single RF exchange instead of
+ *			 one READ per 4 pages.
+***************************************************************************************/
+#include <string.h>
+#include <wiringPi.h>
+#include "rc522.h"
+#include "ultralight.h"
+
+#define UL_BYTE_US            85                 //One answer byte with its parity bit at 106 kbit/s
+
+/////////////////////////////////////////////////////////////////////
+//function:Send a frame with CRC and stream the answer out of the FIFO
+//         The FIFO is drained while the card is still sending, so the
+//         answer may be longer than FIFO_LENGTH
+//Parameters:pTx[IN]:Frame sent to the card, without CRC
+//          txLen[IN]:Frame length in bytes
+//          pRx[OUT]:Received bytes
+//          rxMax[IN]:Size of pRx, extra bytes are counted but dropped
+//        pRxLen[OUT]:Number of bytes received
+//        TimeOut[IN]:Time to wait for the card to start answering
+//return:Successfully returns MI_OK, FIFO overrun returns MI_COM_ERR,
+//       and so does a chip that ends the exchange neither with an answer
+//       nor with its timer by the time the whole answer should be in
+/////////////////////////////////////////////////////////////////////
+static unsigned char UlTransceive(rc522_t *pcd,unsigned char *pTx,unsigned char txLen,
+                                  unsigned char *pRx,unsigned short rxMax,
+                                  unsigned short *pRxLen,unsigned short TimeOut)
+{
+    unsigned char n,irq,err,b;
+    unsigned short len = 0;
+    unsigned int now,deadline;
+    unsigned char status = MI_TIMEOUT;
+    SetBitMask(pcd,TxModeReg,0x80);
+    SetBitMask(pcd,RxModeReg,0x80);
+    WriteRawRC(pcd,TPrescalerReg,0xFF);
+    WriteRawRC(pcd,TModeReg,0x87);
+    WriteRawRC(pcd,TReloadRegL,(unsigned char)TimeOut);
+    WriteRawRC(pcd,TReloadRegH,(unsigned char)(TimeOut>>8));
+    WriteRawRC(pcd,CommandReg,PCD_IDLE);
+    WriteRawRC(pcd,ComIrqReg,0x7F);
+    WriteRawRC(pcd,FIFOLevelReg,0x80);
+    for(n=0;n<txLen;n++)
+    {
+		WriteRawRC(pcd,FIFODataReg,pTx[n]);
+    }
+    WriteRawRC(pcd,CommandReg,PCD_TRANSCEIVE);
+    SetBitMask(pcd,BitFramingReg,0x80);
+    deadline = micros() + TimeOut*PCD_TIMER_TICK_US + rxMax*UL_BYTE_US + PCD_WAIT_US;
+    for(;;)
+    {
+		now = micros();                          //Before the read: a late poll must not look like a hang
+		irq = ReadRawRC(pcd,ComIrqReg);
+		n = ReadRawRC(pcd,FIFOLevelReg) & 0x7F;
+		while(n--)
+		{
+			b = ReadRawRC(pcd,FIFODataReg);
+			if(len < rxMax)
+			{
+				pRx[len] = b;
+			}
+			len++;
+		}
+		if(irq & 0x30)//RxIRq or IdleIRq, everything is in the buffer now
+		{
+			status = MI_OK;
+			break;
+		}
+		if(irq & 0x01)//Timer ran out before the card answered
+		{
+			break;
+		}
+		if((int)(now - deadline) >= 0)
+		{
+			PcdStuck(pcd);
+			ClearBitMask(pcd,BitFramingReg,0x80);
+			*pRxLen = len;
+			return MI_COM_ERR;
+		}
+    }
+    err = ReadRawRC(pcd,ErrorReg);
+    WriteRawRC(pcd,CommandReg,PCD_IDLE);
+    ClearBitMask(pcd,BitFramingReg,0x80);
+    if(err & 0x10)
+    {
+		status = MI_COM_ERR;
+    }
+    else if(status == MI_OK && (err & 0x1F))
+    {
+		status = MI_ERR;
+    }
+    *pRxLen = len;
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read the product version
+//Parameters:pVersion[OUT]:GET_VERSION answer, 8 bytes
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char UlGetVersion(rc522_t *pcd,unsigned char *pVersion)
+{
+    unsigned char status;
+    unsigned char ucCmd = UL_GET_VERSION;
+    unsigned char ucBuf[10];
+    unsigned short len;
+    status = UlTransceive(pcd,&ucCmd,1,ucBuf,sizeof(ucBuf),&len,0x0020);
+    if(status == MI_OK && len >= 8)
+    {
+		memcpy(pVersion,ucBuf,8);
+		return MI_OK;
+    }
+    return MI_ERR;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Identify the selected tag
+//         A tag without GET_VERSION drops back to IDLE on the unknown command,
+//         it is selected again before returning
+//Parameters:pUid[IN]:Card UID from PcdAnticollSelect
+//            len[IN]:UID length, 7 bytes for Type 2 tags
+//          pTag[OUT]:Tag geometry
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char UlDetect(rc522_t *pcd,unsigned char *pUid,unsigned char len,ul_tag_t *pTag)
+{
+    memset(pTag,0,sizeof(ul_tag_t));
+    pTag->user_start = 4;
+    if(UlGetVersion(pcd,pTag->version) != MI_OK)
+    {
+		if(PcdWakeupSelect(pcd,pUid,len) != MI_OK)
+		{
+			return MI_ERR;
+		}
+		pTag->type = UL_TYPE_ULTRALIGHT;
+		pTag->pages = 16;
+		pTag->user_end = 15;
+		return MI_OK;
+    }
+    pTag->fast_read = 1;
+    if(pTag->version[2] == 0x04)//NTAG
+    {
+		switch(pTag->version[6])
+		{
+			case 0x0F:
+				pTag->type = UL_TYPE_NTAG213;
+				pTag->pages = 45;
+				break;
+			case 0x11:
+				pTag->type = UL_TYPE_NTAG215;
+				pTag->pages = 135;
+				break;
+			case 0x13:
+				pTag->type = UL_TYPE_NTAG216;
+				pTag->pages = 231;
+				break;
+			default:
+				return MI_ERR;
+		}
+		pTag->cfg_page = pTag->pages - 4;
+		pTag->user_end = pTag->cfg_page - 2;//Dynamic lock bytes sit before the configuration
+    }
+    else if(pTag->version[2] == 0x03)//Mifare_UltraLight EV1
+    {
+		switch(pTag->version[6])
+		{
+			case 0x0B:
+				pTag->type = UL_TYPE_ULTRALIGHT_EV1_11;
+				pTag->pages = 20;
+				pTag->user_end = 15;
+				break;
+			case 0x0E:
+				pTag->type = UL_TYPE_ULTRALIGHT_EV1_21;
+				pTag->pages = 41;
+				pTag->user_end = 35;
+				break;
+			default:
+				return MI_ERR;
+		}
+		pTag->cfg_page = pTag->user_end + 1 + (pTag->type == UL_TYPE_ULTRALIGHT_EV1_21);
+    }
+    else
+    {
+		return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read 4 pages
+//Parameters:page[IN]:First page
+//         pData[OUT]:Read data, 16 bytes
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char UlRead(rc522_t *pcd,unsigned char page,unsigned char *pData)
+{
+    unsigned char status;
+    unsigned char ucCmd[2];
+    unsigned char ucBuf[18];
+    unsigned short len;
+    ucCmd[0] = UL_READ;
+    ucCmd[1] = page;
+    status = UlTransceive(pcd,ucCmd,2,ucBuf,sizeof(ucBuf),&len,0x0020);
+    if(status == MI_OK && len >= 16)
+    {
+		memcpy(pData,ucBuf,16);
+		return MI_OK;
+    }
+    return MI_ERR;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read a page range with FAST_READ
+//         The answer is streamed out of the FIFO, if the bus cannot keep up
+//         with the RF data rate the range is fetched again in FIFO sized pieces
+//Parameters:start[IN]:First page
+//             end[IN]:Last page, inclusive
+//         pData[OUT]:Read data, (end-start+1)*4 bytes
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char UlFastRead(rc522_t *pcd,unsigned char start,unsigned char end,unsigned char *pData)
+{
+    unsigned char status;
+    unsigned char ucCmd[3];
+    unsigned short want,len;
+    unsigned short chunk_end;
+    if(start > end)
+    {
+		return MI_ERR;
+    }
+    want = (unsigned short)(end-start+1)*UL_PAGE_SIZE;
+    ucCmd[0] = UL_FAST_READ;
+    ucCmd[1] = start;
+    ucCmd[2] = end;
+    status = UlTransceive(pcd,ucCmd,3,pData,want,&len,0x0020);
+    if(status == MI_OK)
+    {
+		return (len >= want) ? MI_OK : MI_ERR;
+    }
+    if(status != MI_COM_ERR || end-start < UL_FIFO_PAGES)
+    {
+		return MI_ERR;
+    }
+    while(start <= end)//FIFO overrun, fall back to pieces that fit in the FIFO
+    {
+		chunk_end = start + UL_FIFO_PAGES - 1;
+		if(chunk_end > end)
+		{
+			chunk_end = end;
+		}
+		if(UlFastRead(pcd,start,(unsigned char)chunk_end,pData) != MI_OK)
+		{
+			return MI_ERR;
+		}
+		pData += (chunk_end-start+1)*UL_PAGE_SIZE;
+		if(chunk_end == end)
+		{
+			break;
+		}
+		start = (unsigned char)(chunk_end+1);
+    }
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read every page of the tag
+//         FAST_READ capable tags need one exchange, older Mifare_UltraLight
+//         tags one READ per 4 pages
+//Parameters:pTag[IN]:Tag geometry from UlDetect
+//          pData[OUT]:Tag image, pTag->pages*4 bytes
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char UlReadTag(rc522_t *pcd,ul_tag_t *pTag,unsigned char *pData)
+{
+    unsigned char page;
+    unsigned char ucBuf[16];
+    if(pTag->pages == 0)
+    {
+		return MI_ERR;
+    }
+    if(pTag->fast_read)
+    {
+		return UlFastRead(pcd,0,pTag->pages-1,pData);
+    }
+    for(page=0;page<pTag->pages;page+=4)
+    {
+		if(UlRead(pcd,page,ucBuf) != MI_OK)
+		{
+			return MI_ERR;
+		}
+		memcpy(pData+page*UL_PAGE_SIZE,ucBuf,(pTag->pages-page >= 4) ? 16 : (pTag->pages-page)*UL_PAGE_SIZE);
+    }
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write one page
+//Parameters:page[IN]:Page address
+//          pData[IN]:Write data, 4 bytes
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char UlWrite(rc522_t *pcd,unsigned char page,unsigned char *pData)
+{
+    unsigned char status;
+    unsigned char *ucComMF522Buf = pcd->buf;
+    pcd->write_gen++;
+    ucComMF522Buf[0] = UL_WRITE;
+    ucComMF522Buf[1] = page;
+    memcpy(&ucComMF522Buf[2],pData,UL_PAGE_SIZE);
+    SetBitMask(pcd,TxModeReg,0x80);
+    SetBitMask(pcd,RxModeReg,0x80);
+    status = Opation_MF1Card(pcd,PCD_TRANSCEIVE,ucComMF522Buf,6,0X0020);
+    if((status != MI_OK) || ((ucComMF522Buf[0] & 0x0F) != UL_ACK))
+    {
+		status = MI_ERR;
+    }
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write one page with the Mifare_One compatible 16 byte frame
+//Parameters:page[IN]:Page address
+//          pData[IN]:16 bytes, only the first 4 are stored
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char UlCompatWrite(rc522_t *pcd,unsigned char page,unsigned char *pData)
+{
+    return PcdWrite(pcd,page,pData);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Password authentication, NTAG21x and Mifare_UltraLight EV1
+//Parameters:pPwd[IN]:Password, 4 bytes
+//          pPack[OUT]:Password acknowledge, 2 bytes
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char UlPwdAuth(rc522_t *pcd,unsigned char *pPwd,unsigned char *pPack)
+{
+    unsigned char status;
+    unsigned char ucCmd[5];
+    unsigned char ucBuf[4];
+    unsigned short len;
+    ucCmd[0] = UL_PWD_AUTH;
+    memcpy(&ucCmd[1],pPwd,4);
+    status = UlTransceive(pcd,ucCmd,5,ucBuf,sizeof(ucBuf),&len,0x0020);
+    if(status == MI_OK && len >= 2)
+    {
+		pPack[0] = ucBuf[0];
+		pPack[1] = ucBuf[1];
+		return MI_OK;
+    }
+    return MI_ERR;
+}
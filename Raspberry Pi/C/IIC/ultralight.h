@@ -0,0 +1,54 @@
+#ifndef __ULTRALIGHT_H
+#define	__ULTRALIGHT_H
+
+#include "rc522.h"
+
+/////////////////////////////////////////////////////////////////////
+//Mifare_UltraLight / NTAG21x command word
+/////////////////////////////////////////////////////////////////////
+#define UL_GET_VERSION        0x60               //Product version, 8 bytes
+#define UL_READ               0x30               //Read 4 pages
+#define UL_FAST_READ          0x3A               //Read a page range
+#define UL_WRITE              0xA2               //Write 1 page
+#define UL_COMP_WRITE         0xA0               //Compatibility write, 16 bytes sent, first page written
+#define UL_READ_CNT           0x39               //Read NFC counter
+#define UL_PWD_AUTH           0x1B               //Password authentication
+#define UL_READ_SIG           0x3C               //Read originality signature
+
+#define UL_PAGE_SIZE          4                  //Page size in bytes
+#define UL_ACK                0x0A               //4 bit ACK
+#define UL_FIFO_PAGES         15                 //Pages that fit in the FIFO together with the CRC
+#define UL_MAX_PAGES          231                //NTAG216
+
+/////////////////////////////////////////////////////////////////////
+//Tag types detected with GET_VERSION
+/////////////////////////////////////////////////////////////////////
+#define UL_TYPE_UNKNOWN       0
+#define UL_TYPE_ULTRALIGHT    1                  //MF0ICU1, no GET_VERSION
+#define UL_TYPE_ULTRALIGHT_EV1_11 2              //MF0UL11
+#define UL_TYPE_ULTRALIGHT_EV1_21 3              //MF0UL21
+#define UL_TYPE_NTAG213       4
+#define UL_TYPE_NTAG215       5
+#define UL_TYPE_NTAG216       6
+
+typedef struct
+{
+    unsigned char type;                          //UL_TYPE_*
+    unsigned char version[8];                    //GET_VERSION response, zero for UL_TYPE_ULTRALIGHT
+    unsigned char pages;                         //Total number of pages
+    unsigned char user_start;                    //First user memory page
+    unsigned char user_end;                      //Last user memory page
+    unsigned char cfg_page;                      //First configuration page (AUTH0), 0 = none
+    unsigned char fast_read;                     //FAST_READ supported
+} ul_tag_t;
+
+unsigned char UlGetVersion(rc522_t *pcd,unsigned char *pVersion);
+unsigned char UlDetect(rc522_t *pcd,unsigned char *pUid,unsigned char len,ul_tag_t *pTag);
+unsigned char UlRead(rc522_t *pcd,unsigned char page,unsigned char *pData);
+unsigned char UlFastRead(rc522_t *pcd,unsigned char start,unsigned char end,unsigned char *pData);
+unsigned char UlReadTag(rc522_t *pcd,ul_tag_t *pTag,unsigned char *pData);
+unsigned char UlWrite(rc522_t *pcd,unsigned char page,unsigned char *pData);
+unsigned char UlCompatWrite(rc522_t *pcd,unsigned char page,unsigned char *pData);
+unsigned char UlPwdAuth(rc522_t *pcd,unsigned char *pPwd,unsigned char *pPack);
+
+#endif
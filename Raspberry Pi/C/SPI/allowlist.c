@@ -0,0 +1,553 @@
+/***************************************************************************************
+ * Project  :rc522 UID allowlist
+ * Describe :Allow/deny decision for 4, 7 and 10 byte UIDs without leaving the library.
+ *			 The allowlist is compiled offline into one file that is mmap'd as is:
+ *			 a blocked Bloom filter (one cache line per key) rejects unknown cards,
+ *			 a minimal perfect hash (hash and displace, one seed per bucket) finds the
+ *			 only slot a known card can be in. A lookup is a few multiplies and at most
+ *			 three cache lines, with no allocation and no syscall.
+ *			 The directory is watched with inotify, a new file (written elsewhere and
+ *			 renamed over the old one) is mapped, validated and swapped in atomically;
+ *			 lookups never wait, the old mapping is released once they have left it.
+***************************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include "allowlist.h"
+
+#define ACL_GOLDEN            0x9E3779B97F4A7C15ULL
+#define ACL_SALT_TRIES        64                 //Salts tried before the compiler gives up
+
+/////////////////////////////////////////////////////////////////////
+//function:64 bit finalizer (splitmix64)
+/////////////////////////////////////////////////////////////////////
+static unsigned long long AclMix(unsigned long long x)
+{
+    x ^= x>>30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x>>27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x>>31;
+    return x;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Map a 32 bit hash onto 0..n-1 without a division
+/////////////////////////////////////////////////////////////////////
+static unsigned int AclRange(unsigned int h,unsigned int n)
+{
+    return (unsigned int)(((unsigned long long)h*n)>>32);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Hash of a UID, shared by the compiler and the lookup
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length
+//           salt[IN]:Salt stored in the file header
+/////////////////////////////////////////////////////////////////////
+unsigned long long AclHash(const unsigned char *pUid,unsigned char len,unsigned int salt)
+{
+    unsigned char i;
+    unsigned long long h = 0xCBF29CE484222325ULL ^ salt;
+    h = (h ^ len)*0x100000001B3ULL;
+    for(i=0;i<len;i++)
+    {
+		h = (h ^ pUid[i])*0x100000001B3ULL;
+    }
+    return AclMix(h);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Slot of a key in the table for a bucket seed
+/////////////////////////////////////////////////////////////////////
+static unsigned int AclSlot(unsigned long long h,unsigned int seed,unsigned int count)
+{
+    return AclRange((unsigned int)(AclMix(h ^ ((unsigned long long)seed+1)*ACL_GOLDEN)>>32),count);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Bloom filter bits of a key inside its block
+//Parameters:pBlock[IN]:64 byte block of the key
+//             h[IN]:Key hash
+//             set[IN]:1 = set the bits, 0 = test them
+//return:1 when every bit is set
+/////////////////////////////////////////////////////////////////////
+static unsigned char AclBloom(unsigned char *pBlock,unsigned long long h,unsigned char set)
+{
+    unsigned char i;
+    unsigned int pos;
+    unsigned long long bits = AclMix(h + ACL_GOLDEN);
+    for(i=0;i<ACL_BLOOM_K;i++)
+    {
+		pos = (unsigned int)(bits >> (i*9)) & (ACL_BLOOM_BLOCK*8-1);
+		if(set)
+		{
+			pBlock[pos>>3] |= 1 << (pos&7);
+		}
+		else if(!(pBlock[pos>>3] & (1 << (pos&7))))
+		{
+			return 0;
+		}
+    }
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:FNV-1a checksum of the file body
+/////////////////////////////////////////////////////////////////////
+static unsigned int AclChecksum(const unsigned char *p,size_t len)
+{
+    unsigned int h = 0x811C9DC5;
+    while(len--)
+    {
+		h = (h ^ *p++)*0x01000193;
+    }
+    return h;
+}
+
+static unsigned int AclAlign(unsigned int off)
+{
+    return (off + ACL_ALIGN-1) & ~(ACL_ALIGN-1);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Find a seed per bucket so that every key gets its own slot
+//Parameters:h[IN]:Key hashes
+//      start[IN]:Bucket b holds member[start[b]]..member[start[b+1]-1]
+//     pSeed[OUT]:Seed of every bucket
+//return:Successfully returns 0, -1 when the salt has to change
+/////////////////////////////////////////////////////////////////////
+static int AclDisplace(const unsigned long long *h,unsigned int count,unsigned int buckets,
+                       const unsigned int *start,const unsigned int *member,unsigned int *pSeed)
+{
+    unsigned int size,maxsize = 0,b,i,j,seed;
+    unsigned int slot[64];
+    unsigned char *used = calloc(count,1);
+    unsigned char ok;
+    int ret = 0;
+    if(used == NULL)
+    {
+		return -1;
+    }
+    for(b=0;b<buckets;b++)
+    {
+		if(start[b+1]-start[b] > maxsize)
+		{
+			maxsize = start[b+1]-start[b];
+		}
+    }
+    if(maxsize > 64)
+    {
+		free(used);
+		return -1;
+    }
+    //Largest buckets first, while the table is still empty enough to place them
+    for(size=maxsize;size>0 && ret == 0;size--)
+    {
+		for(b=0;b<buckets && ret == 0;b++)
+		{
+			if(start[b+1]-start[b] != size)
+			{
+				continue;
+			}
+			ok = 0;
+			for(seed=0;seed<count*8+1024 && !ok;seed++)
+			{
+				ok = 1;
+				for(i=0;i<size && ok;i++)
+				{
+					slot[i] = AclSlot(h[member[start[b]+i]],seed,count);
+					if(used[slot[i]])
+					{
+						ok = 0;
+					}
+					for(j=0;j<i && ok;j++)
+					{
+						if(slot[j] == slot[i])
+						{
+							ok = 0;
+						}
+					}
+				}
+			}
+			if(!ok)
+			{
+				ret = -1;
+				break;
+			}
+			pSeed[b] = seed-1;
+			for(i=0;i<size;i++)
+			{
+				used[slot[i]] = 1;
+			}
+		}
+    }
+    free(used);
+    return ret;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Compile an allowlist file
+//         The file is written next to path and renamed over it, so a
+//         running reader switches to it in one step
+//Parameters:pKeys[IN]:Keys, no duplicates
+//          count[IN]:Number of keys
+//           path[IN]:Output file
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int AclCompile(acl_key_t *pKeys,unsigned int count,const char *path)
+{
+    unsigned int buckets = count/ACL_BUCKET_LOAD + 1;
+    unsigned int blocks = count/ACL_BLOOM_KEYS + 1;
+    unsigned int i,b,try,salt = 0;
+    unsigned int *start,*member,*seed;
+    unsigned long long *h;
+    unsigned char *buf;
+    acl_header_t *hdr;
+    acl_key_t *key;
+    char tmp[300];
+    int fd,ret = -1;
+    size_t size,off;
+    ssize_t n;
+
+    for(i=0;i<count;i++)
+    {
+		if(pKeys[i].len == 0 || pKeys[i].len > ACL_UID_MAX)
+		{
+			return -1;
+		}
+    }
+    size = AclAlign(AclAlign(AclAlign(sizeof(acl_header_t)) + blocks*ACL_BLOOM_BLOCK) + buckets*4) + (size_t)count*sizeof(acl_key_t);
+    buf = calloc(size,1);
+    h = malloc((count+1)*sizeof(unsigned long long));
+    start = calloc(buckets+2,sizeof(unsigned int));
+    member = malloc((count+1)*sizeof(unsigned int));
+    if(buf == NULL || h == NULL || start == NULL || member == NULL)
+    {
+		goto out;
+    }
+    hdr = (acl_header_t *)buf;
+    hdr->magic = ACL_MAGIC;
+    hdr->version = ACL_VERSION;
+    hdr->count = count;
+    hdr->buckets = buckets;
+    hdr->bloom_blocks = blocks;
+    hdr->bloom_off = AclAlign(sizeof(acl_header_t));
+    hdr->seed_off = AclAlign(hdr->bloom_off + blocks*ACL_BLOOM_BLOCK);
+    hdr->key_off = AclAlign(hdr->seed_off + buckets*4);
+    hdr->size = (unsigned int)size;
+    seed = (unsigned int *)(buf + hdr->seed_off);
+    key = (acl_key_t *)(buf + hdr->key_off);
+
+    for(try=0;try<ACL_SALT_TRIES;try++)
+    {
+		salt = try*0x9E3779B9u + 0x7F4A7C15u;
+		memset(start,0,(buckets+2)*sizeof(unsigned int));
+		for(i=0;i<count;i++)
+		{
+			h[i] = AclHash(pKeys[i].uid,pKeys[i].len,salt);
+			start[AclRange((unsigned int)h[i],buckets)+2]++;
+		}
+		for(b=0;b<buckets;b++)//Counting sort of the keys by bucket
+		{
+			start[b+2] += start[b+1];
+		}
+		for(i=0;i<count;i++)
+		{
+			member[start[AclRange((unsigned int)h[i],buckets)+1]++] = i;
+		}
+		memset(seed,0,buckets*4);
+		if(AclDisplace(h,count,buckets,start,member,seed) == 0)
+		{
+			break;
+		}
+    }
+    if(try == ACL_SALT_TRIES)
+    {
+		goto out;//Duplicate keys never separate
+    }
+    hdr->salt = salt;
+    for(i=0;i<count;i++)
+    {
+		b = AclRange((unsigned int)h[i],buckets);
+		key[AclSlot(h[i],seed[b],count)] = pKeys[i];
+		AclBloom(buf + hdr->bloom_off + AclRange((unsigned int)(h[i]>>32),blocks)*ACL_BLOOM_BLOCK,h[i],1);
+    }
+    hdr->checksum = AclChecksum(buf + sizeof(acl_header_t),size - sizeof(acl_header_t));
+
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    if((fd = open(tmp,O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0644)) < 0)
+    {
+		goto out;
+    }
+    for(off=0;off<size;off+=n)
+    {
+		if((n = write(fd,buf+off,size-off)) <= 0)
+		{
+			break;
+		}
+    }
+    if(off == size && fsync(fd) == 0 && close(fd) == 0)
+    {
+		fd = -1;
+		ret = rename(tmp,path);
+    }
+    if(fd >= 0)
+    {
+		close(fd);
+    }
+    if(ret != 0)
+    {
+		unlink(tmp);
+    }
+out:
+    free(buf);
+    free(h);
+    free(start);
+    free(member);
+    return ret;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Map and validate an allowlist file
+//return:Mapping or NULL
+/////////////////////////////////////////////////////////////////////
+static acl_map_t *AclMapOpen(const char *path)
+{
+    acl_map_t *m;
+    const acl_header_t *hdr;
+    struct stat st;
+    void *base;
+    int fd = open(path,O_RDONLY|O_CLOEXEC);
+    if(fd < 0)
+    {
+		return NULL;
+    }
+    if(fstat(fd,&st) != 0 || st.st_size < (off_t)sizeof(acl_header_t))
+    {
+		close(fd);
+		return NULL;
+    }
+    //Populate now, a lookup must never take a page fault
+    base = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED|MAP_POPULATE,fd,0);
+    close(fd);
+    if(base == MAP_FAILED)
+    {
+		return NULL;
+    }
+    hdr = (const acl_header_t *)base;
+    if(hdr->magic != ACL_MAGIC || hdr->version != ACL_VERSION || hdr->size != (unsigned int)st.st_size ||
+       hdr->buckets == 0 || hdr->bloom_blocks == 0 ||
+       hdr->bloom_off < sizeof(acl_header_t) || hdr->bloom_off % ACL_ALIGN ||
+       hdr->seed_off < hdr->bloom_off + (unsigned long long)hdr->bloom_blocks*ACL_BLOOM_BLOCK || hdr->seed_off % ACL_ALIGN ||
+       hdr->key_off < hdr->seed_off + (unsigned long long)hdr->buckets*4 || hdr->key_off % ACL_ALIGN ||
+       hdr->size < hdr->key_off + (unsigned long long)hdr->count*sizeof(acl_key_t) ||
+       hdr->checksum != AclChecksum((const unsigned char *)base + sizeof(acl_header_t),hdr->size - sizeof(acl_header_t)) ||
+       (m = malloc(sizeof(acl_map_t))) == NULL)
+    {
+		munmap(base,st.st_size);
+		return NULL;
+    }
+    m->base = base;
+    m->size = st.st_size;
+    m->hdr = hdr;
+    m->bloom = (const unsigned char *)base + hdr->bloom_off;
+    m->seed = (const unsigned int *)((const unsigned char *)base + hdr->seed_off);
+    m->key = (const acl_key_t *)((const unsigned char *)base + hdr->key_off);
+    return m;
+}
+
+static void AclMapClose(acl_map_t *m)
+{
+    if(m != NULL)
+    {
+		munmap(m->base,m->size);
+		free(m);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Inotify watcher, reloads the file when it is replaced
+/////////////////////////////////////////////////////////////////////
+static void *AclWatch(void *arg)
+{
+    acl_t *acl = (acl_t *)arg;
+    struct pollfd pfd[2];
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    const char *name = strrchr(acl->path,'/');
+    unsigned char changed;
+    ssize_t n;
+    char *p;
+    name = name ? name+1 : acl->path;
+    pfd[0].fd = acl->ino_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = acl->stop_fd;
+    pfd[1].events = POLLIN;
+    while(acl->running)
+    {
+		if(poll(pfd,2,-1) <= 0 || !(pfd[0].revents & POLLIN))
+		{
+			continue;
+		}
+		changed = 0;
+		while((n = read(acl->ino_fd,buf,sizeof(buf))) > 0)
+		{
+			for(p=buf;p<buf+n;p+=sizeof(struct inotify_event)+ev->len)
+			{
+				ev = (const struct inotify_event *)p;
+				if(ev->len && strcmp(ev->name,name) == 0)
+				{
+					changed = 1;
+				}
+			}
+		}
+		if(changed)
+		{
+			AclReload(acl);
+		}
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Open an allowlist and watch it for changes
+//Parameters:acl[OUT]:Allowlist
+//         path[IN]:Compiled file
+//return:Successfully returns 0; without inotify the file is not reloaded
+//       automatically, AclReload still works
+/////////////////////////////////////////////////////////////////////
+int AclOpen(acl_t *acl,const char *path)
+{
+    char dir[256];
+    char *p;
+    memset(acl,0,sizeof(acl_t));
+    acl->ino_fd = acl->stop_fd = -1;
+    if(strlen(path) >= sizeof(acl->path) || (acl->map = AclMapOpen(path)) == NULL)
+    {
+		return -1;
+    }
+    strcpy(acl->path,path);
+    strcpy(dir,path);
+    p = strrchr(dir,'/');
+    if(p == NULL)
+    {
+		strcpy(dir,".");
+    }
+    else
+    {
+		*(p == dir ? p+1 : p) = 0;
+    }
+    acl->ino_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    acl->stop_fd = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+    if(acl->ino_fd < 0 || acl->stop_fd < 0 ||
+       inotify_add_watch(acl->ino_fd,dir,IN_CLOSE_WRITE|IN_MOVED_TO) < 0)
+    {
+		return 0;
+    }
+    acl->running = 1;
+    if(pthread_create(&acl->watcher,NULL,AclWatch,acl) != 0)
+    {
+		acl->running = 0;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Map the file again and swap it in
+//         A file that does not validate is ignored, the old one stays
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int AclReload(acl_t *acl)
+{
+    acl_map_t *old,*m = AclMapOpen(acl->path);
+    if(m == NULL)
+    {
+		acl->reload_errors++;
+		return -1;
+    }
+    old = __atomic_exchange_n(&acl->map,m,__ATOMIC_SEQ_CST);
+    //A lookup that still holds the old mapping has raised in_use before loading it
+    while(__atomic_load_n(&acl->in_use,__ATOMIC_SEQ_CST) != 0)
+    {
+		sched_yield();
+    }
+    AclMapClose(old);
+    acl->reloads++;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Decide whether a card is allowed
+//Parameters:acl[IN]:Allowlist
+//         pUid[IN]:Card UID
+//          len[IN]:UID length, 4, 7 or 10 bytes
+//        pTag[OUT]:Tag of the card when allowed, may be NULL
+//return:ACL_ALLOW or ACL_DENY
+/////////////////////////////////////////////////////////////////////
+unsigned char AclCheck(acl_t *acl,const unsigned char *pUid,unsigned char len,unsigned int *pTag)
+{
+    const acl_map_t *m;
+    const acl_header_t *hdr;
+    const acl_key_t *k;
+    unsigned long long h;
+    unsigned char ret = ACL_DENY;
+    __atomic_add_fetch(&acl->in_use,1,__ATOMIC_SEQ_CST);
+    m = __atomic_load_n(&acl->map,__ATOMIC_SEQ_CST);
+    if(m != NULL && m->hdr->count != 0 && len <= ACL_UID_MAX)
+    {
+		hdr = m->hdr;
+		h = AclHash(pUid,len,hdr->salt);
+		if(AclBloom((unsigned char *)m->bloom + AclRange((unsigned int)(h>>32),hdr->bloom_blocks)*ACL_BLOOM_BLOCK,h,0))
+		{
+			k = &m->key[AclSlot(h,m->seed[AclRange((unsigned int)h,hdr->buckets)],hdr->count)];
+			if(k->len == len && memcmp(k->uid,pUid,len) == 0)
+			{
+				if(pTag != NULL)
+				{
+					*pTag = k->tag;
+				}
+				ret = ACL_ALLOW;
+			}
+		}
+    }
+    __atomic_sub_fetch(&acl->in_use,1,__ATOMIC_RELEASE);
+    return ret;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Stop watching and unmap the allowlist
+/////////////////////////////////////////////////////////////////////
+void AclClose(acl_t *acl)
+{
+    unsigned long long one = 1;
+    if(acl->running)
+    {
+		acl->running = 0;
+		if(write(acl->stop_fd,&one,sizeof(one)) < 0)
+		{
+			//The watcher is awake anyway
+		}
+		pthread_join(acl->watcher,NULL);
+    }
+    if(acl->ino_fd >= 0)
+    {
+		close(acl->ino_fd);
+    }
+    if(acl->stop_fd >= 0)
+    {
+		close(acl->stop_fd);
+    }
+    AclMapClose(acl->map);
+    memset(acl,0,sizeof(acl_t));
+    acl->ino_fd = acl->stop_fd = -1;
+}
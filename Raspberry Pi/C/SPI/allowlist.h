@@ -0,0 +1,77 @@
+#ifndef __ALLOWLIST_H
+#define	__ALLOWLIST_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/////////////////////////////////////////////////////////////////////
+//Compiled allowlist file, host byte order, every section 64 byte aligned
+//  header | bloom filter | bucket seeds | keys
+/////////////////////////////////////////////////////////////////////
+#define ACL_MAGIC             0x4C414352         //"RCAL"
+#define ACL_VERSION           1
+#define ACL_ALIGN             64
+#define ACL_BUCKET_LOAD       4                  //Average keys per perfect hash bucket
+#define ACL_BLOOM_BLOCK       64                 //Bloom block = one cache line
+#define ACL_BLOOM_KEYS        40                 //Keys per bloom block, about 12 bits per key
+#define ACL_BLOOM_K           6                  //Bits set per key inside its block
+#define ACL_UID_MAX           10
+
+#define ACL_DENY              0
+#define ACL_ALLOW             1
+
+typedef struct
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int count;                          //Keys, also the number of slots (minimal perfect hash)
+    unsigned int buckets;                        //Perfect hash buckets
+    unsigned int bloom_blocks;
+    unsigned int salt;                           //Hash salt the compiler settled on
+    unsigned int bloom_off;                      //Section offsets from the start of the file
+    unsigned int seed_off;
+    unsigned int key_off;
+    unsigned int size;                           //File size
+    unsigned int checksum;                       //FNV-1a of everything after the header
+    unsigned int reserved[5];
+} acl_header_t;
+
+typedef struct
+{
+    unsigned char uid[ACL_UID_MAX];
+    unsigned char len;                           //4, 7 or 10
+    unsigned char flags;                         //Free for the application
+    unsigned int tag;                            //Free for the application (door mask, expiry...)
+} acl_key_t;
+
+typedef struct
+{
+    void *base;                                  //mmap'd file
+    size_t size;
+    const acl_header_t *hdr;
+    const unsigned char *bloom;
+    const unsigned int *seed;
+    const acl_key_t *key;
+} acl_map_t;
+
+typedef struct
+{
+    acl_map_t *map;                              //Current file, swapped by the watcher
+    unsigned int in_use;                         //Lookups running, the old file is unmapped at 0
+    char path[256];
+    int ino_fd;
+    int stop_fd;
+    volatile int running;
+    pthread_t watcher;
+    unsigned long reloads;
+    unsigned long reload_errors;
+} acl_t;
+
+unsigned long long AclHash(const unsigned char *pUid,unsigned char len,unsigned int salt);
+int AclCompile(acl_key_t *pKeys,unsigned int count,const char *path);
+int AclOpen(acl_t *acl,const char *path);
+int AclReload(acl_t *acl);
+unsigned char AclCheck(acl_t *acl,const unsigned char *pUid,unsigned char len,unsigned int *pTag);
+void AclClose(acl_t *acl);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __BUZZER_H
+#define	__BUZZER_H
+
+/////////////////////////////////////////////////////////////////////
+//Buzzer on wiringPi pin 24 (BCM19), PWM1 of the SoC
+//Hardware PWM needs "dtoverlay=pwm-2chan" in /boot/config.txt
+/////////////////////////////////////////////////////////////////////
+#define BUZZER_PWM_CHIP       "/sys/class/pwm/pwmchip0"
+#define BUZZER_PWM_CHANNEL    1                  //BCM19
+#define BUZZER_TONE_HZ        1000               //Tone of the original softPwm(range 10) setup
+#define BUZZER_TONE_MIN       100                //Lowest tone softPwm can still make
+#define BUZZER_TONE_MAX       5000               //Highest tone softPwm can still make
+
+#define BUZZER_NONE           0
+#define BUZZER_HARDWARE       1                  //Kernel PWM driver, no CPU time while sounding
+#define BUZZER_SOFTWARE       2                  //softPwm thread fallback
+
+int BuzzerStart();
+void BuzzerTone(unsigned int hz,unsigned char duty);
+void BuzzerOff();
+void BuzzerStop();
+int BuzzerBackend();
+
+#endif
@@ -0,0 +1,259 @@
+/***************************************************************************************
+ * Project  :rc522 card content cache
+ * Describe :Bounded LRU cache from full card UID to block contents.
+ *			 Every entry belongs to a presence epoch: it is valid only while the card
+ *			 stays in the field without interruption, as confirmed by keepalive probes.
+ *			 A removal starts a new epoch and any write through the reader (write_gen)
+ *			 drops the cached blocks, so a hit never returns data the card no longer holds.
+ *			 A keepalive probe is a WUPA+SELECT, which ends the Crypto1 session of the card
+ *			 (so does any failed exchange). With a key set by CacheSetKey a miss therefore
+ *			 checks MFCrypto1On and authenticates the sector again when the session is gone;
+ *			 without one the caller must authenticate before every read that may miss.
+***************************************************************************************/
+#include <string.h>
+#include <wiringPi.h>
+#include "rc522.h"
+#include "card_cache.h"
+
+/////////////////////////////////////////////////////////////////////
+//function:Find the cache entry of a card
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length in bytes
+//return:Entry or NULL
+/////////////////////////////////////////////////////////////////////
+static card_cache_entry_t *CacheFind(card_cache_t *cache,unsigned char *pUid,unsigned char len)
+{
+    unsigned char i;
+    for(i=0;i<CACHE_ENTRIES;i++)
+    {
+		if(cache->entry[i].uid_len == len && memcmp(cache->entry[i].uid,pUid,len) == 0)
+		{
+			return &cache->entry[i];
+		}
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Entry usable for a lookup
+//         The card must be present, confirmed recently and nothing may
+//         have been written since the blocks were filled
+/////////////////////////////////////////////////////////////////////
+static unsigned char CacheUsable(card_cache_t *cache,card_cache_entry_t *e)
+{
+    if(e == NULL || !e->present)
+    {
+		return 0;
+    }
+    if((unsigned int)(millis() - e->confirmed_ms) > CACHE_KEEPALIVE_MS)
+    {
+		return 0;
+    }
+    if(e->write_gen != cache->pcd->write_gen)
+    {
+		e->valid = 0;
+		e->write_gen = cache->pcd->write_gen;
+    }
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Clear the cache
+//Parameters:cache[OUT]:Cache
+//            pcd[IN]:Reader the cards are seen on
+/////////////////////////////////////////////////////////////////////
+void CacheInit(card_cache_t *cache,rc522_t *pcd)
+{
+    memset(cache,0,sizeof(card_cache_t));
+    cache->pcd = pcd;
+    cache->auth_sector = -1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Key CacheRead authenticates a miss with
+//Parameters:auth_mode[IN]:C_A or C_B
+//               pKey[IN]:6 byte key, NULL = the caller authenticates
+/////////////////////////////////////////////////////////////////////
+void CacheSetKey(card_cache_t *cache,unsigned char auth_mode,const unsigned char *pKey)
+{
+    cache->has_key = pKey != NULL;
+    if(pKey != NULL)
+    {
+		cache->auth_mode = auth_mode;
+		memcpy(cache->key,pKey,6);
+    }
+    cache->auth_sector = -1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Report that a card has been selected in the field
+//         A card that was absent gets a fresh epoch and empty contents,
+//         the least recently used entry is recycled for a new card
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length in bytes
+/////////////////////////////////////////////////////////////////////
+void CacheCardPresent(card_cache_t *cache,unsigned char *pUid,unsigned char len)
+{
+    unsigned char i;
+    card_cache_entry_t *e;
+    if(len == 0 || len > CACHE_UID_MAX)
+    {
+		return;
+    }
+    e = CacheFind(cache,pUid,len);
+    if(e == NULL)
+    {
+		e = &cache->entry[0];
+		for(i=1;i<CACHE_ENTRIES;i++)
+		{
+			if(cache->entry[i].last_use < e->last_use)
+			{
+				e = &cache->entry[i];
+			}
+		}
+		memcpy(e->uid,pUid,len);
+		e->uid_len = len;
+		e->present = 0;
+    }
+    if(!e->present)
+    {
+		e->present = 1;
+		e->epoch = ++cache->epoch;
+		e->write_gen = cache->pcd->write_gen;
+		e->valid = 0;
+    }
+    e->confirmed_ms = millis();
+    e->last_use = ++cache->tick;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Report that a card has left the field, its contents are dropped
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length in bytes
+/////////////////////////////////////////////////////////////////////
+void CacheCardRemoved(card_cache_t *cache,unsigned char *pUid,unsigned char len)
+{
+    card_cache_entry_t *e = CacheFind(cache,pUid,len);
+    if(e != NULL)
+    {
+		e->present = 0;
+		e->valid = 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Confirm that a cached card is still in the field
+//         Probes only when the last confirmation is older than half the
+//         keepalive period, a failed probe ends the presence epoch
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length in bytes
+//return:Card still present returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char CacheKeepalive(card_cache_t *cache,unsigned char *pUid,unsigned char len)
+{
+    unsigned char status;
+    card_cache_entry_t *e = CacheFind(cache,pUid,len);
+    if(e == NULL || !e->present)
+    {
+		return MI_NOTAGERR;
+    }
+    if((unsigned int)(millis() - e->confirmed_ms) < CACHE_KEEPALIVE_MS/2)
+    {
+		return MI_OK;
+    }
+    status = PcdWakeupSelect(cache->pcd,pUid,len);
+    if(status == MI_OK)
+    {
+		e->confirmed_ms = millis();
+    }
+    else
+    {
+		CacheCardRemoved(cache,pUid,len);
+    }
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read a block from memory only
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length in bytes
+//           addr[IN]:Block address
+//         pData[OUT]:Block data, 16 bytes
+//return:Cache hit returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char CacheLookup(card_cache_t *cache,unsigned char *pUid,unsigned char len,unsigned char addr,unsigned char *pData)
+{
+    card_cache_entry_t *e = CacheFind(cache,pUid,len);
+    if(addr >= CACHE_BLOCKS || !CacheUsable(cache,e) || !(e->valid & (1ULL<<addr)))
+    {
+		return MI_ERR;
+    }
+    memcpy(pData,e->block[addr],CACHE_BLOCK_SIZE);
+    e->last_use = ++cache->tick;
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Remember a block that was just read from the card
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length in bytes
+//           addr[IN]:Block address
+//          pData[IN]:Block data, 16 bytes
+/////////////////////////////////////////////////////////////////////
+void CacheStore(card_cache_t *cache,unsigned char *pUid,unsigned char len,unsigned char addr,unsigned char *pData)
+{
+    card_cache_entry_t *e = CacheFind(cache,pUid,len);
+    if(addr >= CACHE_BLOCKS || e == NULL || !e->present)
+    {
+		return;
+    }
+    if(e->write_gen != cache->pcd->write_gen)
+    {
+		e->valid = 0;
+		e->write_gen = cache->pcd->write_gen;
+    }
+    memcpy(e->block[addr],pData,CACHE_BLOCK_SIZE);
+    e->valid |= 1ULL<<addr;
+    e->confirmed_ms = millis();
+    e->last_use = ++cache->tick;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read a block through the cache
+//         A miss goes over RF with PcdRead, and a successful read also
+//         confirms presence. With a key set the miss authenticates the
+//         sector when no Crypto1 session of it is open (MFCrypto1On is
+//         off after a keepalive); without one the sector must already
+//         be authenticated
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length in bytes
+//           addr[IN]:Block address
+//         pData[OUT]:Block data, 16 bytes
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char CacheRead(card_cache_t *cache,unsigned char *pUid,unsigned char len,unsigned char addr,unsigned char *pData)
+{
+    unsigned char status;
+    if(CacheLookup(cache,pUid,len,addr,pData) == MI_OK)
+    {
+		cache->hits++;
+		return MI_OK;
+    }
+    cache->misses++;
+    if(cache->has_key && (cache->auth_sector != addr/4 || !(ReadRawRC(cache->pcd,Status2Reg) & 0x08)))
+    {
+		cache->auth_sector = -1;
+		status = PcdAuthState(cache->pcd,cache->auth_mode,addr,cache->key,pUid+len-4);
+		if(status != MI_OK)
+		{
+			return status;
+		}
+		cache->auth_sector = addr/4;
+    }
+    status = PcdRead(cache->pcd,addr,pData);
+    if(status == MI_OK)
+    {
+		CacheStore(cache,pUid,len,addr,pData);
+    }
+    return status;
+}
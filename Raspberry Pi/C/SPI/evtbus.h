@@ -0,0 +1,52 @@
+#ifndef __EVTBUS_H
+#define	__EVTBUS_H
+
+#include "rc522d.h"
+
+/////////////////////////////////////////////////////////////////////
+//Shared memory event bus: a header followed by a ring of fixed size
+//slots, each holding one rc522d frame. One publisher, any number of
+//consumers, every consumer keeps its own cursor in its own memory
+/////////////////////////////////////////////////////////////////////
+#define EVTBUS_MAGIC          0x53554245         //"EBUS"
+#define EVTBUS_VERSION        1
+#define EVTBUS_NAME           "/rc522d-events"   //Default shm_open name
+#define EVTBUS_SLOTS          1024               //Ring size, power of 2
+#define EVTBUS_DATA_OFF       4096               //Slots start on the second page
+
+typedef struct
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int slot_size;                      //sizeof(evtbus_slot_t)
+    unsigned int slots;
+    unsigned long long head __attribute__((aligned(64)));//Events published so far
+    unsigned int wake __attribute__((aligned(64)));//Futex word, low 32 bits of head
+    unsigned int waiters;                        //Consumers sleeping on wake, stays raised for one killed asleep
+} evtbus_hdr_t;
+
+typedef struct
+{
+    unsigned long long seq;                      //Event number + 1, 0 = being written
+    rc522d_frame_t frame;
+} __attribute__((aligned(64))) evtbus_slot_t;
+
+typedef struct
+{
+    unsigned char *base;
+    unsigned long size;
+    evtbus_hdr_t *hdr;
+    evtbus_slot_t *slot;
+    unsigned int mask;                           //slots - 1
+    int fd;                                      //Segment, can be passed to another process
+    unsigned long long cursor;                   //Consumer: next event to read
+    unsigned long lost;                          //Consumer: events overwritten before they were read
+} evtbus_t;
+
+int EvtBusCreate(evtbus_t *bus,const char *name);
+int EvtBusOpen(evtbus_t *bus,const char *name,int fd);
+void EvtBusPublish(evtbus_t *bus,const rc522d_frame_t *frame);
+int EvtBusNext(evtbus_t *bus,rc522d_frame_t *frame,int timeout_ms);
+void EvtBusClose(evtbus_t *bus);
+
+#endif
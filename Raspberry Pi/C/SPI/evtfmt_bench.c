@@ -0,0 +1,92 @@
+/***************************************************************************************
+ * Project  :rc522 event formatter benchmark
+ * Describe :Formats a mix of present/read/access/removed events as fast as it can and
+ *			 flushes to /dev/null (or a file), then prints events/s and bytes per event.
+ *			 Needs no reader hardware.
+ * Usage    :evtfmt_bench [-c] [-n events] [-o output]
+ *			 -c CBOR instead of JSON Lines
+***************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "evtfmt.h"
+
+static double NowSec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+int main(int argc,char *argv[])
+{
+    rc522d_frame_t ev[4];
+    evtfmt_t *f = EvtFmtThread();
+    unsigned long long i,count = 4000000,bytes = 0;
+    const char *out = "/dev/null";
+    unsigned char fmt = EVTFMT_JSONL;
+    double t0,t;
+    int opt,fd;
+
+    while((opt = getopt(argc,argv,"cn:o:")) != -1)
+    {
+		switch(opt)
+		{
+			case 'c': fmt = EVTFMT_CBOR; break;
+			case 'n': count = strtoull(optarg,NULL,0); break;
+			case 'o': out = optarg; break;
+			default:
+				fprintf(stderr,"usage: %s [-c] [-n events] [-o output]\n",argv[0]);
+				return 1;
+		}
+    }
+    fd = open(out,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if(fd < 0)
+    {
+		perror(out);
+		return 1;
+    }
+    memset(ev,0,sizeof(ev));
+    ev[0].hdr.type = RC522D_EVT_PRESENT;
+    ev[0].u.card.uid_len = 7;
+    memcpy(ev[0].u.card.uid,"\x04\xA1\xB2\xC3\xD4\xE5\xF6",7);
+    ev[0].u.card.atqa[0] = 0x44;
+    ev[0].u.card.sak = 0x00;
+    ev[1].hdr.type = RC522D_EVT_ACCESS;
+    ev[1].u.access.uid_len = 7;
+    memcpy(ev[1].u.access.uid,ev[0].u.card.uid,7);
+    ev[1].u.access.allowed = 1;
+    ev[1].u.access.tag = 1042;
+    ev[2].hdr.type = RC522D_EVT_READ;
+    ev[2].u.read.uid_len = 4;
+    memcpy(ev[2].u.read.uid,"\xDE\xAD\xBE\xEF",4);
+    ev[2].u.read.block = 8;
+    memcpy(ev[2].u.read.data,"0123456789ABCDEF",16);
+    ev[3] = ev[0];
+    ev[3].hdr.type = RC522D_EVT_REMOVED;
+
+    EvtFmtInit(f,fmt);
+    t0 = NowSec();
+    for(i=0;i<count;i++)
+    {
+		rc522d_frame_t *e = &ev[i&3];
+		e->hdr.seq = (unsigned short)i;
+		e->hdr.time_ms = (unsigned int)(i*7);
+		if(EvtFmtFrame(f,i&1,e) != 0)
+		{
+			bytes += f->len;
+			EvtFmtFlush(fd,&f,1);
+			EvtFmtFrame(f,i&1,e);
+		}
+    }
+    bytes += f->len;
+    EvtFmtFlush(fd,&f,1);
+    t = NowSec() - t0;
+    close(fd);
+    printf("%s: %llu events in %.3f s, %.2f M events/s, %.1f bytes/event, %.1f MB/s\n",
+		fmt == EVTFMT_CBOR ? "cbor" : "jsonl",count,t,count/t/1e6,(double)bytes/count,bytes/t/1e6);
+    return 0;
+}
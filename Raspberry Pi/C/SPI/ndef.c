@@ -0,0 +1,517 @@
+/***************************************************************************************
+ * Project  :rc522 NDEF support
+ * Describe :Walks the TLV container and NDEF records in place on a card image, the
+ *			 record views are offsets into that image and nothing is copied.
+ *			 The data area of a Mifare_One image is the concatenation of its data blocks
+ *			 without the MAD sectors and sector trailers, the mapping is computed on the
+ *			 fly so the image is used exactly as it was read from the card.
+ *			 Messages are serialised straight into a write plan of block/page writes.
+ *			 No heap allocation anywhere.
+***************************************************************************************/
+#include <string.h>
+#include "rc522.h"
+#include "ultralight.h"
+#include "ndef.h"
+
+#define NDEF_TYPE2_DATA       16                 //Pages 0-3 hold UID, lock bytes and capability container
+
+/////////////////////////////////////////////////////////////////////
+//function:Block number of the n-th Mifare_One data block
+//         Sector 0 (and sector 16 on 4K) hold the MAD, the last block of
+//         every sector is the trailer
+//Parameters:n[IN]:Data block index
+//        size[IN]:Image size, 1024 or 4096
+//return:Block number, -1 past the end of the card
+/////////////////////////////////////////////////////////////////////
+static int NdefClassicBlock(unsigned short n,unsigned short size)
+{
+    if(n < 45)
+    {
+		return (1+n/3)*4 + n%3;
+    }
+    if(size < 4096)
+    {
+		return -1;
+    }
+    if(n < 90)
+    {
+		n -= 45;
+		return (17+n/3)*4 + n%3;
+    }
+    n -= 90;
+    if(n >= 8*15)
+    {
+		return -1;
+    }
+    return 128 + (n/15)*16 + n%15;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Image offset of a data area byte
+//return:Byte offset in img->data, -1 past the end
+/////////////////////////////////////////////////////////////////////
+static long NdefPhys(const ndef_image_t *img,unsigned short off)
+{
+    int block;
+    if(off >= NdefDataSize(img))
+    {
+		return -1;
+    }
+    if(img->layout == NDEF_LAYOUT_TYPE2)
+    {
+		return NDEF_TYPE2_DATA + off;
+    }
+    block = NdefClassicBlock(off/16,img->size);
+    return (block < 0) ? -1 : (long)block*16 + off%16;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read one data area byte with bounds check
+//return:Byte value, -1 past the end
+/////////////////////////////////////////////////////////////////////
+static int NdefByte(const ndef_image_t *img,unsigned short off)
+{
+    long phys = NdefPhys(img,off);
+    return (phys < 0) ? -1 : img->data[phys];
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Size of the data area of an image
+//Parameters:img[IN]:Card image
+//return:Data area size in bytes
+/////////////////////////////////////////////////////////////////////
+unsigned short NdefDataSize(const ndef_image_t *img)
+{
+    if(img->layout == NDEF_LAYOUT_TYPE2)
+    {
+		return (img->size > NDEF_TYPE2_DATA) ? img->size - NDEF_TYPE2_DATA : 0;
+    }
+    if(img->size >= 4096)
+    {
+		return (90 + 8*15)*16;
+    }
+    if(img->size >= 1024)
+    {
+		return 45*16;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Direct pointer to a span
+//Parameters:img[IN]:Card image
+//          span[IN]:Span in the data area
+//return:Pointer into the image, NULL if the span crosses a skipped block
+/////////////////////////////////////////////////////////////////////
+const unsigned char *NdefSpanPtr(const ndef_image_t *img,ndef_span_t span)
+{
+    long first,last;
+    first = NdefPhys(img,span.off);
+    if(first < 0)
+    {
+		return NULL;
+    }
+    if(span.len > 1)
+    {
+		last = NdefPhys(img,span.off+span.len-1);
+		if(last - first != span.len-1)
+		{
+			return NULL;
+		}
+    }
+    return img->data + first;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Copy a span that may cross skipped blocks
+//Parameters:img[IN]:Card image
+//          span[IN]:Span in the data area
+//         pDst[OUT]:Destination
+//           max[IN]:Destination size
+//return:Number of bytes copied
+/////////////////////////////////////////////////////////////////////
+unsigned short NdefSpanCopy(const ndef_image_t *img,ndef_span_t span,unsigned char *pDst,unsigned short max)
+{
+    unsigned short done = 0;
+    unsigned short piece;
+    long phys;
+    if(span.len < max)
+    {
+		max = span.len;
+    }
+    while(done < max)
+    {
+		phys = NdefPhys(img,span.off+done);
+		if(phys < 0)
+		{
+			break;
+		}
+		piece = (img->layout == NDEF_LAYOUT_TYPE2) ? max-done : 16 - (span.off+done)%16;
+		if(piece > max-done)
+		{
+			piece = max-done;
+		}
+		memcpy(pDst+done,img->data+phys,piece);
+		done += piece;
+    }
+    return done;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Find the first NDEF message TLV
+//Parameters:img[IN]:Card image
+//          pMsg[OUT]:Message value span
+//return:Found returns MI_OK, no message returns MI_NOTAGERR, broken TLV returns MI_ERR
+/////////////////////////////////////////////////////////////////////
+unsigned char NdefFindMessage(const ndef_image_t *img,ndef_span_t *pMsg)
+{
+    unsigned short pos = 0;
+    unsigned short size = NdefDataSize(img);
+    int t,l,h;
+    while(pos < size)
+    {
+		t = NdefByte(img,pos++);
+		if(t == NDEF_TLV_NULL)
+		{
+			continue;
+		}
+		if(t == NDEF_TLV_TERMINATOR)
+		{
+			return MI_NOTAGERR;
+		}
+		l = NdefByte(img,pos++);
+		if(l < 0)
+		{
+			return MI_ERR;
+		}
+		if(l == 0xFF)//3 byte length format
+		{
+			h = NdefByte(img,pos++);
+			l = NdefByte(img,pos++);
+			if(h < 0 || l < 0)
+			{
+				return MI_ERR;
+			}
+			l |= h<<8;
+		}
+		if((unsigned long)pos + l > size)
+		{
+			return MI_ERR;
+		}
+		if(t == NDEF_TLV_MESSAGE)
+		{
+			pMsg->off = pos;
+			pMsg->len = (unsigned short)l;
+			return MI_OK;
+		}
+		pos += l;
+    }
+    return MI_NOTAGERR;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Start walking the records of the first NDEF message
+//Parameters:rd[OUT]:Record reader
+//          img[IN]:Card image, must stay valid while records are used
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char NdefReaderInit(ndef_reader_t *rd,const ndef_image_t *img)
+{
+    rd->img = img;
+    rd->pos = 0;
+    rd->msg.off = 0;
+    rd->msg.len = 0;
+    return NdefFindMessage(img,&rd->msg);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Next record of the message
+//Parameters:rd[IN]:Record reader
+//         rec[OUT]:Record view, spans point into the image
+//return:Successfully returns MI_OK, end of message returns MI_NOTAGERR
+/////////////////////////////////////////////////////////////////////
+unsigned char NdefNextRecord(ndef_reader_t *rd,ndef_record_t *rec)
+{
+    const ndef_image_t *img = rd->img;
+    unsigned short pos = rd->msg.off + rd->pos;
+    unsigned short end = rd->msg.off + rd->msg.len;
+    unsigned long payload_len;
+    int h,b,i;
+    if(rd->pos >= rd->msg.len)
+    {
+		return MI_NOTAGERR;
+    }
+    if(end - pos < 3)
+    {
+		return MI_ERR;
+    }
+    h = NdefByte(img,pos++);
+    rec->flags = h & 0xF8;
+    rec->tnf = h & 0x07;
+    rec->type.len = NdefByte(img,pos++);
+    if(h & NDEF_SR)
+    {
+		payload_len = NdefByte(img,pos++);
+    }
+    else
+    {
+		if(end - pos < 4)
+		{
+			return MI_ERR;
+		}
+		payload_len = 0;
+		for(i=0;i<4;i++)
+		{
+			payload_len = (payload_len<<8) | NdefByte(img,pos++);
+		}
+    }
+    rec->id.len = 0;
+    if(h & NDEF_IL)
+    {
+		b = NdefByte(img,pos++);
+		if(pos > end)
+		{
+			return MI_ERR;
+		}
+		rec->id.len = b;
+    }
+    if((unsigned long)rec->type.len + rec->id.len + payload_len > (unsigned long)(end - pos))
+    {
+		return MI_ERR;
+    }
+    rec->type.off = pos;
+    pos += rec->type.len;
+    rec->id.off = pos;
+    pos += rec->id.len;
+    rec->payload.off = pos;
+    rec->payload.len = (unsigned short)payload_len;
+    pos += rec->payload.len;
+    rd->pos = (h & NDEF_ME) ? rd->msg.len : pos - rd->msg.off;
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Prepare an empty write plan
+//         The image size of a Type 2 tag also covers its lock and
+//         configuration pages, which a plan must never write: such a
+//         plan gets no room, use NdefPlanInitUl
+//Parameters:plan[OUT]:Write plan
+//          layout[IN]:NDEF_LAYOUT_*
+//      image_size[IN]:Card size in bytes
+/////////////////////////////////////////////////////////////////////
+void NdefPlanInit(ndef_plan_t *plan,unsigned char layout,unsigned short image_size)
+{
+    ndef_image_t img;
+    img.data = NULL;
+    img.size = image_size;
+    img.layout = layout;
+    plan->layout = layout;
+    plan->unit = (layout == NDEF_LAYOUT_TYPE2) ? UL_PAGE_SIZE : 16;
+    plan->capacity = (layout == NDEF_LAYOUT_TYPE2) ? 0 : NdefDataSize(&img);
+    plan->pos = 0;
+    plan->count = 0;
+    plan->last_page = 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Prepare an empty write plan for a Type 2 tag, limited to its
+//         user memory: on an NTAG21x the pages after it hold the
+//         dynamic lock bytes, AUTH0 and ACCESS, and writing them can
+//         lock the tag or put it behind a password for good
+//Parameters:plan[OUT]:Write plan
+//          pTag[IN]:Tag found by UlDetect
+/////////////////////////////////////////////////////////////////////
+void NdefPlanInitUl(ndef_plan_t *plan,const ul_tag_t *pTag)
+{
+    NdefPlanInit(plan,NDEF_LAYOUT_TYPE2,0);
+    if(pTag->user_end >= NDEF_TYPE2_DATA/UL_PAGE_SIZE)
+    {
+		plan->capacity = (pTag->user_end - NDEF_TYPE2_DATA/UL_PAGE_SIZE + 1)*UL_PAGE_SIZE;
+		plan->last_page = pTag->user_end;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Append one byte to the data area of the plan
+//return:Successfully returns MI_OK, plan full returns MI_ERR
+/////////////////////////////////////////////////////////////////////
+static unsigned char NdefPlanPut(ndef_plan_t *plan,unsigned char b)
+{
+    int addr;
+    ndef_block_t *blk;
+    if(plan->pos >= plan->capacity)
+    {
+		return MI_ERR;
+    }
+    if(plan->pos % plan->unit == 0)
+    {
+		if(plan->count >= NDEF_PLAN_BLOCKS)
+		{
+			return MI_ERR;
+		}
+		if(plan->layout == NDEF_LAYOUT_TYPE2)
+		{
+			addr = (NDEF_TYPE2_DATA + plan->pos)/UL_PAGE_SIZE;
+			if(addr > plan->last_page)
+			{
+				return MI_ERR;                   //Lock or configuration page
+			}
+		}
+		else
+		{
+			addr = NdefClassicBlock(plan->pos/16,plan->capacity > 45*16 ? 4096 : 1024);
+		}
+		blk = &plan->block[plan->count++];
+		blk->addr = (unsigned char)addr;
+		memset(blk->data,0,sizeof(blk->data));
+    }
+    plan->block[plan->count-1].data[plan->pos % plan->unit] = b;
+    plan->pos++;
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Append a byte string to the data area of the plan
+/////////////////////////////////////////////////////////////////////
+static unsigned char NdefPlanPutBuf(ndef_plan_t *plan,const unsigned char *p,unsigned long len)
+{
+    while(len--)
+    {
+		if(NdefPlanPut(plan,*p++) != MI_OK)
+		{
+			return MI_ERR;
+		}
+    }
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Serialise an NDEF message TLV and a terminator into the plan
+//Parameters:plan[IN]:Write plan from NdefPlanInit or NdefPlanInitUl
+//            rec[IN]:Records of the message
+//          count[IN]:Number of records
+//return:Successfully returns MI_OK, message too big returns MI_ERR
+/////////////////////////////////////////////////////////////////////
+unsigned char NdefPlanMessage(ndef_plan_t *plan,const ndef_out_record_t *rec,unsigned char count)
+{
+    unsigned long total = 0;
+    unsigned char i,h,sr;
+    unsigned char status = MI_OK;
+    for(i=0;i<count;i++)
+    {
+		sr = rec[i].payload_len < 256;
+		total += 2 + (sr ? 1 : 4) + (rec[i].id_len ? 1 : 0) + rec[i].type_len + rec[i].id_len + rec[i].payload_len;
+    }
+    if(total > 0xFFFE)
+    {
+		return MI_ERR;
+    }
+    status |= NdefPlanPut(plan,NDEF_TLV_MESSAGE);
+    if(total < 0xFF)
+    {
+		status |= NdefPlanPut(plan,(unsigned char)total);
+    }
+    else
+    {
+		status |= NdefPlanPut(plan,0xFF);
+		status |= NdefPlanPut(plan,(unsigned char)(total>>8));
+		status |= NdefPlanPut(plan,(unsigned char)total);
+    }
+    for(i=0;i<count && status == MI_OK;i++)
+    {
+		sr = rec[i].payload_len < 256;
+		h = rec[i].tnf & 0x07;
+		if(i == 0)
+		{
+			h |= NDEF_MB;
+		}
+		if(i == count-1)
+		{
+			h |= NDEF_ME;
+		}
+		if(sr)
+		{
+			h |= NDEF_SR;
+		}
+		if(rec[i].id_len)
+		{
+			h |= NDEF_IL;
+		}
+		status |= NdefPlanPut(plan,h);
+		status |= NdefPlanPut(plan,rec[i].type_len);
+		if(sr)
+		{
+			status |= NdefPlanPut(plan,(unsigned char)rec[i].payload_len);
+		}
+		else
+		{
+			status |= NdefPlanPut(plan,(unsigned char)(rec[i].payload_len>>24));
+			status |= NdefPlanPut(plan,(unsigned char)(rec[i].payload_len>>16));
+			status |= NdefPlanPut(plan,(unsigned char)(rec[i].payload_len>>8));
+			status |= NdefPlanPut(plan,(unsigned char)rec[i].payload_len);
+		}
+		if(rec[i].id_len)
+		{
+			status |= NdefPlanPut(plan,rec[i].id_len);
+		}
+		status |= NdefPlanPutBuf(plan,rec[i].type,rec[i].type_len);
+		status |= NdefPlanPutBuf(plan,rec[i].id,rec[i].id_len);
+		status |= NdefPlanPutBuf(plan,rec[i].payload,rec[i].payload_len);
+    }
+    status |= NdefPlanPut(plan,NDEF_TLV_TERMINATOR);
+    return (status == MI_OK) ? MI_OK : MI_ERR;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write a Type 2 plan to the selected tag
+//Parameters:plan[IN]:Write plan
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char NdefPlanWriteUl(rc522_t *pcd,ndef_plan_t *plan)
+{
+    unsigned short i;
+    for(i=0;i<plan->count;i++)
+    {
+		if(UlWrite(pcd,plan->block[i].addr,plan->block[i].data) != MI_OK)
+		{
+			return MI_ERR;
+		}
+    }
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write a Mifare_One plan to the selected card
+//         Every sector is authenticated once, trailers are never touched
+//Parameters:plan[IN]:Write plan
+//      auth_mode[IN]:C_A or C_B
+//           pKey[IN]:Key of the NDEF sectors
+//           pSnr[IN]:Card serial number, 4 bytes
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char NdefPlanWriteClassic(rc522_t *pcd,ndef_plan_t *plan,unsigned char auth_mode,unsigned char *pKey,unsigned char *pSnr)
+{
+    unsigned short i;
+    unsigned char addr,sector;
+    unsigned char last = 0xFF;
+    unsigned char buf[16];
+    for(i=0;i<plan->count;i++)
+    {
+		addr = plan->block[i].addr;
+		sector = (addr < 128) ? addr/4 : 32 + (addr-128)/16;
+		if(sector != last)
+		{
+			if(PcdAuthState(pcd,auth_mode,addr,pKey,pSnr) != MI_OK)
+			{
+				return MI_ERR;
+			}
+			last = sector;
+		}
+		memcpy(buf,plan->block[i].data,16);  //PcdWrite receives the ACK of the card into the data
+		if(PcdWrite(pcd,addr,buf) != MI_OK)
+		{
+			return MI_ERR;
+		}
+    }
+    return MI_OK;
+}
@@ -0,0 +1,47 @@
+#ifndef __PRESENCE_H
+#define	__PRESENCE_H
+
+#include "rc522.h"
+
+/////////////////////////////////////////////////////////////////////
+//Card presence states
+/////////////////////////////////////////////////////////////////////
+#define PRES_ABSENT           0                  //No card, full request/anticollision every poll
+#define PRES_ARRIVING         1                  //Card seen, waiting for the arrive debounce
+#define PRES_PRESENT          2                  //Card reported, keepalive probes only
+#define PRES_LEAVING          3                  //Probes failed, waiting for the leave debounce
+
+/////////////////////////////////////////////////////////////////////
+//Events returned by PresencePoll
+/////////////////////////////////////////////////////////////////////
+#define PRES_EVT_NONE         0
+#define PRES_EVT_ARRIVED      1                  //The card in pres->uid is now present
+#define PRES_EVT_LEFT         2                  //The card in pres->uid has left the field
+
+#define PRES_ARRIVE_POLLS     2                  //Default: polls a new card must answer before it is reported
+#define PRES_LEAVE_POLLS      3                  //Default: failed probes before a card is reported gone
+
+typedef struct presence
+{
+    unsigned char state;                         //PRES_*
+    unsigned char uid[10];                       //Card being tracked
+    unsigned char uid_len;
+    unsigned char atqa[2];
+    unsigned char sak;
+    unsigned char arrive_polls;                  //Debounce configuration
+    unsigned char leave_polls;
+    unsigned char count;                         //Debounce counter of the current state
+    unsigned char status;                        //MI_* of the last request, select or keepalive probe
+    unsigned char read_probe;                    //1 = probe with READ of read_block, card is selected
+    unsigned char read_block;
+    unsigned int since_ms;                       //millis() of the last state change
+    unsigned long full_cycles;                   //Request/anticollision/select cycles run
+    unsigned long probes;                        //Keepalive probes run
+} presence_t;
+
+void PresenceInit(presence_t *pres,unsigned char arrive_polls,unsigned char leave_polls);
+unsigned char PresencePoll(rc522_t *pcd,presence_t *pres);
+unsigned char PresencePollRequested(rc522_t *pcd,presence_t *pres,unsigned char status);
+void PresenceReadProbe(presence_t *pres,unsigned char block);
+
+#endif
@@ -0,0 +1,301 @@
+/***************************************************************************************
+ * Project  :rc522 bulk card provisioning
+ * Describe :Access bit encoder/decoder with inverse bit validation, sector layout
+ *			 templates and a personalisation pipeline: detect the card, authenticate
+ *			 with the transport key, write data blocks and trailers in one session,
+ *			 verify with the new keys and HALT the card so the next one is picked up.
+ *			 Throughput and per-stage timings are kept so a line operator can keep pace.
+***************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rc522.h"
+#include "provision.h"
+
+static const char *ProvStageName[PROV_STAGES] = {"detect","auth","data","trailer","verify"};
+
+/////////////////////////////////////////////////////////////////////
+//function:Monotonic time in microseconds
+/////////////////////////////////////////////////////////////////////
+static unsigned long long ProvNowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (unsigned long long)ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Encode the access conditions of a sector
+//Parameters:pCond[IN]:C1C2C3 of blocks 0-3, bit 2 = C1, bit 1 = C2, bit 0 = C3
+//          pBits[OUT]:Trailer bytes 6-8
+/////////////////////////////////////////////////////////////////////
+void AccessBitsEncode(const unsigned char *pCond,unsigned char *pBits)
+{
+    unsigned char i;
+    unsigned char c1 = 0,c2 = 0,c3 = 0;
+    for(i=0;i<4;i++)
+    {
+		c1 |= ((pCond[i]>>2)&0x01)<<i;
+		c2 |= ((pCond[i]>>1)&0x01)<<i;
+		c3 |= (pCond[i]&0x01)<<i;
+    }
+    pBits[0] = (unsigned char)((~c2&0x0F)<<4 | (~c1&0x0F));
+    pBits[1] = (unsigned char)(c1<<4 | (~c3&0x0F));
+    pBits[2] = (unsigned char)(c3<<4 | c2);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Decode and validate the access bits of a trailer
+//         Every bit is stored twice, once inverted. A trailer whose copies
+//         disagree locks the sector for good when written, so it is rejected
+//Parameters:pBits[IN]:Trailer bytes 6-8
+//          pCond[OUT]:C1C2C3 of blocks 0-3
+//return:Consistent bits returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char AccessBitsDecode(const unsigned char *pBits,unsigned char *pCond)
+{
+    unsigned char i;
+    unsigned char c1 = pBits[1]>>4;
+    unsigned char c2 = pBits[2]&0x0F;
+    unsigned char c3 = pBits[2]>>4;
+    if((pBits[0]&0x0F) != (~c1&0x0F) || (pBits[0]>>4) != (~c2&0x0F) || (pBits[1]&0x0F) != (~c3&0x0F))
+    {
+		return MI_ERR;
+    }
+    for(i=0;i<4;i++)
+    {
+		pCond[i] = (unsigned char)(((c1>>i)&0x01)<<2 | ((c2>>i)&0x01)<<1 | ((c3>>i)&0x01));
+    }
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Build a sector trailer
+//Parameters:pSector[IN]:Sector layout
+//         pTrailer[OUT]:Key A, access bits, GPB, key B, 16 bytes
+/////////////////////////////////////////////////////////////////////
+void TrailerBuild(const prov_sector_t *pSector,unsigned char *pTrailer)
+{
+    memcpy(pTrailer,pSector->key_a,6);
+    AccessBitsEncode(pSector->cond,pTrailer+6);
+    pTrailer[9] = pSector->gpb;
+    memcpy(pTrailer+10,pSector->key_b,6);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Key that may read a data block under the given condition
+//return:C_A, C_B or 0 when the block cannot be read
+/////////////////////////////////////////////////////////////////////
+static unsigned char ProvReadKey(unsigned char cond)
+{
+    switch(cond)
+    {
+		case 0x03:
+		case 0x05:
+			return C_B;
+		case 0x07:
+			return 0;
+		default:
+			return C_A;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Template with every sector untouched and transport settings
+//Parameters:tpl[OUT]:Template
+/////////////////////////////////////////////////////////////////////
+void ProvisionTemplateInit(prov_template_t *tpl)
+{
+    unsigned char i;
+    memset(tpl,0,sizeof(prov_template_t));
+    tpl->transport_mode = C_A;
+    memset(tpl->transport_key,0xFF,6);
+    tpl->verify = 1;
+    for(i=0;i<PROV_SECTORS;i++)
+    {
+		memset(tpl->sector[i].key_a,0xFF,6);
+		memset(tpl->sector[i].key_b,0xFF,6);
+		tpl->sector[i].cond[3] = ACC_TRAILER_TRANSPORT;
+		tpl->sector[i].gpb = 0x69;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Personalise the card in the field
+//Parameters:tpl[IN]:Sector layout template
+//        stats[IN]:Statistics, updated
+//return:Successfully returns MI_OK, no card returns MI_NOTAGERR
+/////////////////////////////////////////////////////////////////////
+unsigned char ProvisionCard(rc522_t *pcd,prov_template_t *tpl,prov_stats_t *stats)
+{
+    unsigned char uid[10],len,sak,tag[2];
+    unsigned char s,b,mode;
+    unsigned char *pKey;
+    unsigned char *pAuthUid;
+    unsigned char written[PROV_SECTORS][3][16];
+    unsigned char buf[16];
+    unsigned char cond[4];
+    unsigned char stage = PROV_STAGE_DETECT;
+    unsigned long long t,t0;
+    t0 = t = ProvNowUs();
+    if(PcdRequest(pcd,PICC_REQIDL,tag) != MI_OK)
+    {
+		return MI_NOTAGERR;
+    }
+    if(PcdAnticollSelect(pcd,uid,&len,&sak) != MI_OK)
+    {
+		goto fail;
+    }
+    pAuthUid = uid + len - 4;//Crypto1 uses the last 4 UID bytes
+    stats->stage_us[PROV_STAGE_DETECT] += ProvNowUs() - t;
+    for(s=0;s<PROV_SECTORS;s++)
+    {
+		if(!tpl->sector[s].flags)
+		{
+			continue;
+		}
+		stage = PROV_STAGE_AUTH;
+		t = ProvNowUs();
+		if(PcdAuthState(pcd,tpl->transport_mode,s*4,tpl->transport_key,pAuthUid) != MI_OK)
+		{
+			goto fail;
+		}
+		stats->stage_us[PROV_STAGE_AUTH] += ProvNowUs() - t;
+		if(tpl->sector[s].flags & PROV_SECTOR_DATA)
+		{
+			stage = PROV_STAGE_DATA;
+			t = ProvNowUs();
+			for(b=(s == 0);b<3;b++)//Block 0 holds the manufacturer data
+			{
+				memcpy(written[s][b],tpl->sector[s].data[b],16);
+				if(tpl->fill != NULL)
+				{
+					tpl->fill(s,b,written[s][b],uid,len,tpl->arg);
+				}
+				memcpy(buf,written[s][b],16);//PcdWrite receives the ACK of the card into the data
+				if(PcdWrite(pcd,s*4+b,buf) != MI_OK)
+				{
+					goto fail;
+				}
+			}
+			stats->stage_us[PROV_STAGE_DATA] += ProvNowUs() - t;
+		}
+		if(tpl->sector[s].flags & PROV_SECTOR_TRAILER)
+		{
+			stage = PROV_STAGE_TRAILER;
+			t = ProvNowUs();
+			TrailerBuild(&tpl->sector[s],buf);
+			if(AccessBitsDecode(buf+6,cond) != MI_OK || memcmp(cond,tpl->sector[s].cond,4) != 0)
+			{
+				goto fail;//Never write access bits that do not read back as intended
+			}
+			if(PcdWrite(pcd,s*4+3,buf) != MI_OK)
+			{
+				goto fail;
+			}
+			stats->stage_us[PROV_STAGE_TRAILER] += ProvNowUs() - t;
+		}
+    }
+    if(tpl->verify)
+    {
+		stage = PROV_STAGE_VERIFY;
+		t = ProvNowUs();
+		for(s=0;s<PROV_SECTORS;s++)
+		{
+			if(!(tpl->sector[s].flags & PROV_SECTOR_DATA))
+			{
+				continue;
+			}
+			mode = tpl->transport_mode;
+			pKey = tpl->transport_key;
+			if(tpl->sector[s].flags & PROV_SECTOR_TRAILER)
+			{
+				mode = ProvReadKey(tpl->sector[s].cond[0]);
+				pKey = (mode == C_B) ? tpl->sector[s].key_b : tpl->sector[s].key_a;
+			}
+			if(mode == 0)
+			{
+				continue;
+			}
+			if(PcdAuthState(pcd,mode,s*4,pKey,pAuthUid) != MI_OK)
+			{
+				goto fail;
+			}
+			for(b=(s == 0);b<3;b++)
+			{
+				if(PcdRead(pcd,s*4+b,buf) != MI_OK || memcmp(buf,written[s][b],16) != 0)
+				{
+					goto fail;
+				}
+			}
+		}
+		stats->stage_us[PROV_STAGE_VERIFY] += ProvNowUs() - t;
+    }
+    PcdHalt(pcd);
+    stats->cards_ok++;
+    stats->last_card_us = ProvNowUs() - t0;
+    return MI_OK;
+fail:
+    PcdHalt(pcd);
+    stats->cards_failed++;
+    stats->stage_fail[stage]++;
+    stats->last_card_us = ProvNowUs() - t0;
+    return MI_ERR;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Personalise cards as they are presented
+//Parameters:tpl[IN]:Sector layout template
+//         count[IN]:Number of cards, 0 = until stats->stop is set
+//         stats[IN]:Statistics, updated
+//        report[IN]:One line per card is printed here, may be NULL
+/////////////////////////////////////////////////////////////////////
+void ProvisionRun(rc522_t *pcd,prov_template_t *tpl,unsigned long count,prov_stats_t *stats,FILE *report)
+{
+    unsigned char status;
+    unsigned long long t,elapsed;
+    if(stats->start_us == 0)
+    {
+		stats->start_us = ProvNowUs();
+    }
+    while(!stats->stop && (count == 0 || stats->cards_ok + stats->cards_failed < count))
+    {
+		t = ProvNowUs();
+		status = ProvisionCard(pcd,tpl,stats);
+		if(status == MI_NOTAGERR)
+		{
+			stats->idle_us += ProvNowUs() - t;
+			continue;
+		}
+		if(report != NULL)
+		{
+			elapsed = ProvNowUs() - stats->start_us;
+			fprintf(report,"card %lu %s %llu ms, %.1f cards/min\n",
+			        stats->cards_ok + stats->cards_failed,
+			        status == MI_OK ? "ok" : "FAILED",
+			        stats->last_card_us/1000,
+			        elapsed ? stats->cards_ok*60e6/elapsed : 0.0);
+		}
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Print throughput and per-stage timings
+//Parameters:stats[IN]:Statistics
+//              fp[IN]:Output stream
+/////////////////////////////////////////////////////////////////////
+void ProvisionReport(const prov_stats_t *stats,FILE *fp)
+{
+    unsigned char i;
+    unsigned long cards = stats->cards_ok + stats->cards_failed;
+    unsigned long long elapsed = ProvNowUs() - stats->start_us;
+    fprintf(fp,"cards ok %lu failed %lu in %.1f s, %.1f cards/min, idle %.0f%%\n",
+            stats->cards_ok,stats->cards_failed,elapsed/1e6,
+            elapsed ? stats->cards_ok*60e6/elapsed : 0.0,
+            elapsed ? stats->idle_us*100.0/elapsed : 0.0);
+    for(i=0;i<PROV_STAGES;i++)
+    {
+		fprintf(fp,"  %-8s avg %7.2f ms  failures %lu\n",ProvStageName[i],
+		        cards ? stats->stage_us[i]/1000.0/cards : 0.0,stats->stage_fail[i]);
+    }
+}
@@ -0,0 +1,264 @@
+/***************************************************************************************
+ * Project  :rc522 card provisioning
+ * Describe :Personalises the Mifare_One cards presented to the reader one after the
+ *			 other with the sector layout of a template file (provision.h), then prints
+ *			 the throughput and per-stage timings. One entry per line, '#' starts a comment:
+ *			   block <block> <32 hex digits>
+ *			     Data block 1-63 other than a trailer. The other data blocks of its
+ *			     sector are written with zeros
+ *			   trailer <sector> <keyA> <keyB> <C1C2C3 of blocks 0-3> [gpb]
+ *			     Keys in 12 hex digits, the access conditions as 4 octal digits
+ *			     (provision.h ACC_*), e.g. trailer 1 A0A1A2A3A4A5 B0B1B2B3B4B5 4443 69
+ *			 A trailer whose keys or access bits could never be changed again is
+ *			 refused unless -f is given.
+ * Usage    :provision -t template [-k transport_key] [-B] [-n count] [-N] [-f]
+ *			 -k the key blank cards are shipped with, FFFFFFFFFFFF by default
+ *			 -B authenticate with the transport key as key B instead of key A
+ *			 -n stop after count cards, Ctrl-C stops at any time
+ *			 -N skip reading the written blocks back with the new keys
+ * Hardware Connection :
+ *	SW1:	RX   -> OFF			SW2:	A1	 -> -
+ *          TX   -> OFF					A0	 -> +
+ *          SDA  -> OFF					ADR5 -> 0
+ *          SCL  -> OFF					ADR4 -> 0
+ *          NSS  -> ON					ADR3 -> 0
+ *          MOSI -> ON					ADR2 -> 0
+ *          MISO -> ON					ADR1 -> 0
+ *          SCK  -> ON					ADR0 -> 0
+ * Library Version :WiringPi_V2.52
+***************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <signal.h>
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#include "rc522.h"
+#include "provision.h"
+
+static rc522_t Reader;
+static prov_template_t Tpl;
+static prov_stats_t Stats;
+
+static void OnSignal(int sig)
+{
+    (void)sig;
+    Stats.stop = 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Parse a fixed number of hex bytes
+//return:0 = ok, -1 = wrong length or not hex
+/////////////////////////////////////////////////////////////////////
+static int ParseHex(const char *s,unsigned char *pData,unsigned int len)
+{
+    unsigned int i,v;
+    if(strlen(s) != 2*len)
+    {
+		return -1;
+    }
+    for(i=0;i<len;i++)
+    {
+		if(!isxdigit((unsigned char)s[2*i]) || !isxdigit((unsigned char)s[2*i+1]) || sscanf(s+2*i,"%2x",&v) != 1)
+		{
+			return -1;
+		}
+		pData[i] = (unsigned char)v;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Parse one template line into the template
+//return:0 = ok or empty line, -1 = syntax error
+/////////////////////////////////////////////////////////////////////
+static int ParseLine(char *line,prov_template_t *tpl)
+{
+    char *tok[7],*p;
+    unsigned int n = 0,v,i;
+    prov_sector_t *sec;
+    if((p = strchr(line,'#')) != NULL)
+    {
+		*p = 0;
+    }
+    for(p=strtok(line," \t\r\n");p != NULL && n < 7;p=strtok(NULL," \t\r\n"))
+    {
+		tok[n++] = p;
+    }
+    if(n == 0)
+    {
+		return 0;
+    }
+    if(!strcmp(tok[0],"block") && n == 3)
+    {
+		v = (unsigned int)atoi(tok[1]);
+		if(v == 0 || v >= PROV_SECTORS*4 || v%4 == 3)
+		{
+			return -1;
+		}
+		sec = &tpl->sector[v/4];
+		if(ParseHex(tok[2],sec->data[v%4],16) != 0)
+		{
+			return -1;
+		}
+		sec->flags |= PROV_SECTOR_DATA;
+		return 0;
+    }
+    if(!strcmp(tok[0],"trailer") && (n == 5 || n == 6))
+    {
+		v = (unsigned int)atoi(tok[1]);
+		if(v >= PROV_SECTORS || strlen(tok[4]) != 4)
+		{
+			return -1;
+		}
+		sec = &tpl->sector[v];
+		if(ParseHex(tok[2],sec->key_a,6) != 0 || ParseHex(tok[3],sec->key_b,6) != 0)
+		{
+			return -1;
+		}
+		for(i=0;i<4;i++)
+		{
+			if(tok[4][i] < '0' || tok[4][i] > '7')
+			{
+				return -1;
+			}
+			sec->cond[i] = (unsigned char)(tok[4][i]-'0');
+		}
+		if(n == 6 && ParseHex(tok[5],&sec->gpb,1) != 0)
+		{
+			return -1;
+		}
+		sec->flags |= PROV_SECTOR_TRAILER;
+		return 0;
+    }
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Load a template file
+//return:0 = ok, -1 = error, reported on stderr
+/////////////////////////////////////////////////////////////////////
+static int LoadTemplate(const char *path,prov_template_t *tpl)
+{
+    FILE *fp;
+    char line[256];
+    unsigned int lineno = 0;
+    if((fp = fopen(path,"r")) == NULL)
+    {
+		perror(path);
+		return -1;
+    }
+    while(fgets(line,sizeof(line),fp) != NULL)
+    {
+		lineno++;
+		if(ParseLine(line,tpl) != 0)
+		{
+			fprintf(stderr,"%s:%u: expected block <1-63> <32 hex> or trailer <0-15> <keyA> <keyB> <4 octal> [gpb]\n",path,lineno);
+			fclose(fp);
+			return -1;
+		}
+    }
+    fclose(fp);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Check that every trailer can be rewritten later
+//         C1C2C3 001 lets key A and 011 key B write keys and access bits
+//         again, every other trailer condition freezes some of them for good
+//return:Number of sectors that would be frozen
+/////////////////////////////////////////////////////////////////////
+static unsigned int LockedSectors(const prov_template_t *tpl)
+{
+    unsigned int s,locked = 0;
+    for(s=0;s<PROV_SECTORS;s++)
+    {
+		if((tpl->sector[s].flags & PROV_SECTOR_TRAILER) &&
+		   tpl->sector[s].cond[3] != ACC_TRAILER_TRANSPORT && tpl->sector[s].cond[3] != ACC_TRAILER_B)
+		{
+			fprintf(stderr,"sector %u: trailer condition %o can never be rewritten in full\n",s,tpl->sector[s].cond[3]);
+			locked++;
+		}
+    }
+    return locked;
+}
+
+int main(int argc,char *argv[])
+{
+    int opt,spi_Fd,force = 0,bad = 0;
+    unsigned int s;
+    unsigned long count = 0;
+    const char *path = NULL;
+    struct sigaction sa;
+
+    ProvisionTemplateInit(&Tpl);
+    while((opt = getopt(argc,argv,"t:k:Bn:Nf")) != -1)
+    {
+		switch(opt)
+		{
+			case 't': path = optarg; break;
+			case 'k':
+				if(ParseHex(optarg,Tpl.transport_key,6) != 0)
+				{
+					fprintf(stderr,"key must be 12 hex digits\n");
+					return 1;
+				}
+				break;
+			case 'B': Tpl.transport_mode = C_B; break;
+			case 'n': count = strtoul(optarg,NULL,0); break;
+			case 'N': Tpl.verify = 0; break;
+			case 'f': force = 1; break;
+			default: bad = 1; break;
+		}
+    }
+    if(bad || path == NULL || optind != argc)
+    {
+		fprintf(stderr,"usage: %s -t template [-k transport_key] [-B] [-n count] [-N] [-f]\n",argv[0]);
+		return 1;
+    }
+    if(LoadTemplate(path,&Tpl) != 0)
+    {
+		return 1;
+    }
+    for(s=0;s<PROV_SECTORS && !Tpl.sector[s].flags;s++);
+    if(s == PROV_SECTORS)
+    {
+		fprintf(stderr,"%s: nothing to write\n",path);
+		return 1;
+    }
+    if(LockedSectors(&Tpl) != 0 && !force)
+    {
+		fprintf(stderr,"refusing to lock sectors for good, -f writes them anyway\n");
+		return 1;
+    }
+
+	if(wiringPiSetup()==-1)
+	{
+		printf("init wiringPi error\n");
+		return 1;
+	}
+	spi_Fd=wiringPiSPISetup(0,500000);
+	if(spi_Fd==-1)
+	{
+		printf("init spi failed!\n");
+		return 1;
+	}
+	pinMode(RST,OUTPUT);
+	PcdInit(&Reader,0,RST);
+	if(RC522_Init(&Reader) != MI_OK)
+	{
+		fprintf(stderr,"provision: the RC522 does not start\n");
+		return 1;
+	}
+
+    memset(&sa,0,sizeof(sa));
+    sa.sa_handler = OnSignal;
+    sigaction(SIGINT,&sa,NULL);
+    sigaction(SIGTERM,&sa,NULL);
+    printf("present the cards, Ctrl-C stops\n");
+    ProvisionRun(&Reader,&Tpl,count,&Stats,stdout);
+    ProvisionReport(&Stats,stdout);
+    return Stats.cards_failed ? 2 : 0;
+}
@@ -1,10 +1,15 @@
 #ifndef __RC522_H
 #define	__RC522_H	
 
+#include "rc522_stats.h"
+#include "rc522_trace.h"
+#include "rc522_audit.h"
+
 /////////////////////////////////////////////////////////////////////
 //MF522 command word
 /////////////////////////////////////////////////////////////////////
 #define PCD_IDLE              0x00               //Cancel the current command
+#define PCD_MEM               0x01               //Move 25 bytes between the FIFO and the internal buffer
 #define PCD_AUTHENT           0x0E               //Authentication key
 #define PCD_RECEIVE           0x08               //Receive data
 #define PCD_TRANSMIT          0x04               //Send data
@@ -19,6 +24,7 @@
 #define PICC_REQALL           0x52               //All cards in search area
 #define PICC_ANTICOLL1        0x93               //Prevent a collision
 #define PICC_ANTICOLL2        0x95               //Prevent a collision
+#define PICC_ANTICOLL3        0x97               //Prevent a collision
 #define PICC_AUTHENT1A        0x60               //Verifying A key
 #define PICC_AUTHENT1B        0x61               //Verifying B key
 #define PICC_READ             0x30               //Read block
@@ -119,38 +125,105 @@
 #define RST 25
 #define PWM 24
 #define LED 29
-#define macRC522_Reset_Enable() digitalWrite(RST, 0)
-#define macRC522_Reset_Disable() digitalWrite(RST, 1)
+#define macRC522_Reset_Enable() digitalWrite(pcd->rst, 0)
+#define macRC522_Reset_Disable() digitalWrite(pcd->rst, 1)
 #define LED_Enable() digitalWrite(LED, 0)
 #define LED_Disable() digitalWrite(LED, 1)
 #define MAXRLEN 64 
 #define C_A 0x01
 #define C_B 0x02
 
+#define RC522_CACHELINE       64
+#define PCD_SHADOW_REGS       0x00003FD003FE000CULL//Registers the chip never changes by itself: IRQ enables, Tx/Rx modes, RF and timer setup
+#define PCD_TIMER_TICK_US     302                //Timer tick as PcdComStart sets it, (2*0x7FF+1)/13.56 MHz
+#define PCD_WAIT_US           20000              //A wait on the chip gives up this long after its own timer should have ended it
+#define PCD_START_MS          100                //Longest start-up of the chip after a reset
+#define PCD_FIELD_US          5000               //A card in a field just switched on answers after this long (ISO 14443-3)
+
+/////////////////////////////////////////////////////////////////////
+//Reader handle, owns everything one reader needs so that each reader
+//can run on its own thread. Every Pcd* function takes one.
+//Read-mostly configuration, register shadow and the per-exchange
+//state/scratch buffer sit on separate cache lines
+/////////////////////////////////////////////////////////////////////
+typedef struct rc522
+{
+    //Transport, set up by PcdInit
+    int fd;                                      //SPI channel, 0 = CE0, 1 = CE1
+    int rst;                                     //Reset pin, -1 = RC522_Init leaves it alone (shared with another reader)
+    unsigned short poll_us;                      //Sleep between IRQ polls, 0 = spin; lets other readers use the bus
+    struct rftune *tune;                         //RF tuner fed by every answer, NULL = fixed RF setup (rftune.h)
+    struct retry *retry;                         //Retry policy of request/anticollision/select, NULL = fixed (retry.h)
+    //Register shadow: last value written to each PCD_SHADOW_REGS register
+    unsigned long long shadow_valid __attribute__((aligned(RC522_CACHELINE)));
+    unsigned char shadow[64];
+    //Protocol state
+    unsigned char fHasRATS __attribute__((aligned(RC522_CACHELINE)));
+    unsigned char com_halt;                      //The exchange in flight is a HALT
+    unsigned char com_answered;                  //The last exchange got an answer...
+    unsigned char com_error;                     //...with this ErrorReg
+    unsigned int com_deadline;                   //micros() by which the exchange in flight must be over
+    unsigned long stuck;                         //Waits on the chip that ran out: the chip hangs (health.h)
+    unsigned int field_us;                       //micros() from which the cards of the field PcdAntennaOn switched on...
+    unsigned char field_wait;                    //...answer, the next exchange waits for it while set
+    unsigned char warm;                          //RC522_Init took the chip over as it was, without a reset
+    unsigned char CT[2];                         //Card type of the last card read by ReadIDData
+    unsigned char SN[4];                         //Card number used for authentication
+    unsigned long write_gen;                     //Bumped by every write so cached block contents can be invalidated
+    //Scratch frame of one exchange
+    unsigned char buf[MAXRLEN] __attribute__((aligned(RC522_CACHELINE)));
+#ifdef RC522_STATS
+    //Phase histograms and error counters, make STATS=1
+    rc522_stats_t stats __attribute__((aligned(RC522_CACHELINE)));
+#endif
+#ifdef RC522_AUDIT
+    //Register traffic audit, make AUDIT=1
+    rc522_audit_t audit;
+#endif
+} __attribute__((aligned(RC522_CACHELINE))) rc522_t;
+
+struct rftune;
+struct retry;
+
 void delayMicrosecondsHard (unsigned int howLong);
-unsigned char Uart_ReadWriteByte(unsigned char TxData);
-unsigned char ReadRawRC(unsigned char Address);
-void WriteRawRC(unsigned char Address, unsigned char value);
-void SetBitMask(unsigned char reg,unsigned char mask);
-void ClearBitMask(unsigned char reg,unsigned char mask);
-void PcdAntennaOn();
-void PcdAntennaOff();
-void M500PcdConfigISOType(unsigned char ucType);
-void RC522_Init();
-unsigned char PcdRequest(unsigned char req_code,unsigned char *pTagType);
-unsigned char PcdAnticoll(unsigned char *pSnr);
-unsigned char PcdSelect(unsigned char *pSnr);
-unsigned char PcdAuthState(unsigned char auth_mode,unsigned char addr,unsigned char *pKey,unsigned char *pSnr);
-unsigned char PcdRead(unsigned char addr,unsigned char *pData);
-unsigned char PcdWrite(unsigned char addr,unsigned char *pData);
-void ReadIDData();
-unsigned char PcdComMF522_P(unsigned char Command, 
+void PcdInit(rc522_t *pcd,int fd,int rst);
+unsigned char Uart_ReadWriteByte(rc522_t *pcd,unsigned char TxData) AUDIT_USED;
+unsigned char ReadRawRC(rc522_t *pcd,unsigned char Address) AUDIT_USED;
+void WriteRawRC(rc522_t *pcd,unsigned char Address, unsigned char value);
+void SetBitMask(rc522_t *pcd,unsigned char reg,unsigned char mask);
+void ClearBitMask(rc522_t *pcd,unsigned char reg,unsigned char mask);
+void PcdAntennaOn(rc522_t *pcd);
+void PcdAntennaOff(rc522_t *pcd);
+void M500PcdConfigISOType(rc522_t *pcd,unsigned char ucType);
+unsigned char PcdReset(rc522_t *pcd);
+unsigned char RC522_Init(rc522_t *pcd);
+unsigned char PcdRequest(rc522_t *pcd,unsigned char req_code,unsigned char *pTagType);
+void PcdRequestStart(rc522_t *pcd,unsigned char req_code);
+unsigned char PcdRequestPoll(rc522_t *pcd,unsigned char *pTagType,unsigned char *pStatus);
+unsigned char PcdAnticoll(rc522_t *pcd,unsigned char *pSnr);
+unsigned char PcdSelect(rc522_t *pcd,unsigned char *pSnr);
+unsigned char PcdAnticollLevel(rc522_t *pcd,unsigned char level,unsigned char *pSnr);
+unsigned char PcdSelectLevel(rc522_t *pcd,unsigned char level,unsigned char *pSnr,unsigned char *pSak);
+unsigned char PcdAnticollSelect(rc522_t *pcd,unsigned char *pUid,unsigned char *pLen,unsigned char *pSak);
+unsigned char PcdSelectUid(rc522_t *pcd,unsigned char *pUid,unsigned char len,unsigned char *pSak);
+unsigned char PcdWakeupSelect(rc522_t *pcd,unsigned char *pUid,unsigned char len);
+unsigned char PcdAuthState(rc522_t *pcd,unsigned char auth_mode,unsigned char addr,unsigned char *pKey,unsigned char *pSnr);
+unsigned char PcdRead(rc522_t *pcd,unsigned char addr,unsigned char *pData);
+unsigned char PcdWrite(rc522_t *pcd,unsigned char addr,unsigned char *pData);
+unsigned char PcdHalt(rc522_t *pcd);
+unsigned char PcdComMF522_P(rc522_t *pcd,unsigned char Command, 
                              unsigned char *pInData, 
                              unsigned char InLenByte,
                              unsigned char *pOutData, 
                              unsigned int  *pOutLenBit,
                              unsigned short TimeOut);
-unsigned char Opation_MF1Card(unsigned char Command, 
+void PcdComStart(rc522_t *pcd,unsigned char Command,
+                 unsigned char *pInData,
+                 unsigned char InLenByte,
+                 unsigned short TimeOut);
+unsigned char PcdComPoll(rc522_t *pcd,unsigned char *pOutData,unsigned int *pOutLenBit,unsigned char *pStatus);
+void PcdStuck(rc522_t *pcd);
+unsigned char Opation_MF1Card(rc522_t *pcd,unsigned char Command, 
                              unsigned char *pInData, 
                              unsigned char InLenByte,
                              unsigned short TimeOut);
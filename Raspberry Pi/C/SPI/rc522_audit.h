@@ -0,0 +1,56 @@
+#ifndef __RC522_AUDIT_H
+#define	__RC522_AUDIT_H
+
+/////////////////////////////////////////////////////////////////////
+//Kinds of wasted register traffic
+/////////////////////////////////////////////////////////////////////
+#define AUDIT_NOOP_WRITE      0                  //The register only the driver changes already holds the value
+#define AUDIT_REPEAT_WRITE    1                  //Same value as the previous write, nothing accessed it in between
+#define AUDIT_KNOWN_READ      2                  //Read of a register whose value the driver holds in its shadow
+#define AUDIT_RMW_NOCHANGE    3                  //SetBitMask/ClearBitMask that leaves every bit as it was
+#define AUDIT_KINDS           4
+
+//Registers where writing the value read back is not a no-op: commands, write-1-to-clear
+//IRQ bits, FIFO data and flush, timer start/stop and StartSend strobes
+#define AUDIT_STROBE_REGS     0x3632ULL
+#define AUDIT_SITES           512                //Call site, kind and register combinations kept
+
+/////////////////////////////////////////////////////////////////////
+//Audit state of one reader, written by the reader's own thread
+/////////////////////////////////////////////////////////////////////
+typedef struct rc522_audit
+{
+    void *site;                                  //Caller of the SetBitMask/ClearBitMask in progress
+    unsigned long long rmw_ns;                   //Bus time of its read and write
+    unsigned long long last_wr;                  //Bit per register: its last access was a write...
+    unsigned char last[64];                      //...of this value
+} rc522_audit_t;
+
+struct rc522;
+
+#ifdef RC522_AUDIT
+unsigned long long AuditNow(void);
+void AuditRead(struct rc522 *pcd,unsigned char reg,unsigned char value,unsigned long long t,void *ra);
+void AuditWrite(struct rc522 *pcd,unsigned char reg,unsigned char value,unsigned long long t,void *ra);
+void AuditRmw(struct rc522 *pcd,unsigned char reg,unsigned char old,unsigned char value);
+
+//Instrumentation of rc522.c, nothing at all without RC522_AUDIT
+#define AUDIT_START(t)                unsigned long long t = AuditNow()
+#define AUDIT_READ(pcd,addr,v,t)      AuditRead(pcd,(addr) & 0x3F,v,t,__builtin_return_address(0))
+#define AUDIT_WRITE(pcd,addr,v,t)     AuditWrite(pcd,(addr) & 0x3F,v,t,__builtin_return_address(0))
+#define AUDIT_RMW_START(pcd)          ((pcd)->audit.site = __builtin_return_address(0),(pcd)->audit.rmw_ns = 0)
+#define AUDIT_RMW(pcd,reg,old,v)      AuditRmw(pcd,reg,old,v)
+#define AUDIT_USED                    __attribute__((warn_unused_result))//A read whose result is dropped is a compile warning
+#else
+#define AUDIT_START(t)
+#define AUDIT_READ(pcd,addr,v,t)
+#define AUDIT_WRITE(pcd,addr,v,t)
+#define AUDIT_RMW_START(pcd)
+#define AUDIT_RMW(pcd,reg,old,v)
+#define AUDIT_USED
+#endif
+
+int AuditReport(const char *path);
+void AuditReset(void);
+
+#endif
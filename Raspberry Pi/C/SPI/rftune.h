@@ -0,0 +1,65 @@
+#ifndef __RFTUNE_H
+#define	__RFTUNE_H
+
+#include "rc522.h"
+
+/////////////////////////////////////////////////////////////////////
+//Registers of an RF profile
+/////////////////////////////////////////////////////////////////////
+#define RFTUNE_RFCFG          0                  //RFCfgReg: RxGain
+#define RFTUNE_RXTHRESHOLD    1                  //RxThresholdReg: MinLevel, CollLevel
+#define RFTUNE_DEMOD          2                  //DemodReg: AddIQ
+#define RFTUNE_GSN            3                  //GsNReg: CWGsN, ModGsN
+#define RFTUNE_CWGSCFG        4                  //CWGsCfgReg: CWGsP
+#define RFTUNE_REGS           5
+
+/////////////////////////////////////////////////////////////////////
+//Tuner states
+/////////////////////////////////////////////////////////////////////
+#define RFTUNE_BASELINE       0                  //Measuring the profile in use
+#define RFTUNE_TRIAL          1                  //Measuring a neighbour of the best profile
+#define RFTUNE_SETTLED        2                  //No neighbour did better, watching the error rate
+
+#define RFTUNE_WINDOW         64                 //Samples a profile is judged on
+#define RFTUNE_MARGIN         16                 //Bad samples per 1024 a trial must save to be kept
+#define RFTUNE_RISE           64                 //Bad samples per 1024 over the kept score that roll it back
+
+/////////////////////////////////////////////////////////////////////
+//RF tuner of one reader. Exchanges with a card are the samples: an
+//answer with CRC, parity or protocol errors, or a card that stopped
+//answering, is bad. Profiles only change while no card is in the field
+/////////////////////////////////////////////////////////////////////
+typedef struct rftune
+{
+    unsigned char best[RFTUNE_REGS];             //Profile kept
+    unsigned char prev[RFTUNE_REGS];             //Profile before the last kept change
+    unsigned char trial[RFTUNE_REGS];            //Profile on trial
+    unsigned char state;                         //RFTUNE_*
+    unsigned char knob;                          //Knob being searched
+    signed char dir;                             //+1 or -1
+    unsigned char moved;                         //A trial of this knob was kept
+    unsigned char improved;                      //A trial was kept in this sweep
+    unsigned char pending;                       //Window complete, decided at the next idle
+    unsigned char changed;                       //best changed since RfTuneChanged
+    unsigned short n;                            //Samples of the window
+    unsigned short bad;
+    unsigned int best_score;                     //Bad samples per 1024 of best
+    unsigned long samples;                       //Totals
+    unsigned long errors;
+    unsigned long trials;
+    unsigned long kept;
+    unsigned long rollbacks;
+} rftune_t;
+
+void RfTuneInit(rftune_t *tune,const unsigned char *profile);
+void RfTuneAttach(rc522_t *pcd,rftune_t *tune);
+void RfTuneApply(rc522_t *pcd,const unsigned char *profile);
+void RfTuneNote(rftune_t *tune,unsigned char error);
+void RfTuneMiss(rftune_t *tune);
+void RfTuneIdle(rc522_t *pcd);
+void RfTuneRestore(rc522_t *pcd);
+int RfTuneChanged(rftune_t *tune);
+int RfTuneLoad(unsigned char *profile,const char *path);
+int RfTuneSave(const unsigned char *profile,const char *path);
+
+#endif
@@ -0,0 +1,255 @@
+/***************************************************************************************
+ * Project  :rc522 tap journal
+ * Describe :Append-only binary journal of card taps in a preallocated mmap'd ring.
+ *			 Appending a record is plain stores into shared memory (the timestamps come
+ *			 from the vDSO), the kernel writes the pages back on its own, so the read
+ *			 path makes no syscall. One writer; every record carries its sequence
+ *			 number and a checksum, a concurrent reader copies it between two reads of
+ *			 the sequence number (seqlock) and a record torn by a power cut fails its
+ *			 checksum. Opening the file again resumes after the newest valid record.
+***************************************************************************************/
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "taplog.h"
+
+/////////////////////////////////////////////////////////////////////
+//function:FNV-1a of a record up to its check field
+/////////////////////////////////////////////////////////////////////
+static unsigned int TapLogCheck(const taplog_rec_t *rec)
+{
+    const unsigned char *p = (const unsigned char *)rec;
+    unsigned int i,h = 0x811C9DC5;
+    for(i=0;i<sizeof(taplog_rec_t)-sizeof(rec->check);i++)
+    {
+		h = (h ^ p[i])*0x01000193;
+    }
+    return h;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Map a journal file
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+static int TapLogMap(taplog_t *log,int fd,unsigned long size,int prot)
+{
+    void *base = mmap(NULL,size,prot,MAP_SHARED,fd,0);
+    if(base == MAP_FAILED)
+    {
+		return -1;
+    }
+    log->base = (unsigned char *)base;
+    log->size = size;
+    log->hdr = (taplog_hdr_t *)base;
+    log->rec = (taplog_rec_t *)(log->base + TAPLOG_DATA_OFF);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Check the header of a mapped journal and find the newest record
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+static int TapLogScan(taplog_t *log)
+{
+    unsigned int i;
+    unsigned long long last = 0;
+    const taplog_rec_t *r;
+    if(log->hdr->magic != TAPLOG_MAGIC || log->hdr->version != TAPLOG_VERSION ||
+       log->hdr->record_size != sizeof(taplog_rec_t) || log->hdr->capacity == 0 ||
+       log->size != TAPLOG_DATA_OFF + (unsigned long)log->hdr->capacity*sizeof(taplog_rec_t))
+    {
+		return -1;
+    }
+    log->capacity = log->hdr->capacity;
+    //The head in the header may not have reached the disk, the records are the truth
+    for(i=0;i<log->capacity;i++)
+    {
+		r = &log->rec[i];
+		if(r->seq != 0 && (r->seq-1) % log->capacity == i && r->seq > last && TapLogCheck(r) == r->check)
+		{
+			last = r->seq;
+		}
+    }
+    log->next = last + 1;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Open the journal for writing, create and preallocate it if needed
+//Parameters:log[OUT]:Journal
+//         path[IN]:File
+//     capacity[IN]:Records of a new file, 0 = TAPLOG_RECORDS; an existing
+//                  file keeps its own size
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int TapLogOpen(taplog_t *log,const char *path,unsigned int capacity)
+{
+    struct stat st;
+    unsigned long size;
+    int fd;
+    memset(log,0,sizeof(taplog_t));
+    if((fd = open(path,O_RDWR|O_CREAT|O_CLOEXEC,0644)) < 0)
+    {
+		return -1;
+    }
+    if(fstat(fd,&st) != 0)
+    {
+		close(fd);
+		return -1;
+    }
+    if(st.st_size == 0)
+    {
+		capacity = capacity ? capacity : TAPLOG_RECORDS;
+		size = TAPLOG_DATA_OFF + (unsigned long)capacity*sizeof(taplog_rec_t);
+		//Allocate every block now, a store into the ring can never hit a full disk
+		if(posix_fallocate(fd,0,size) != 0 || TapLogMap(log,fd,size,PROT_READ|PROT_WRITE) != 0)
+		{
+			close(fd);
+			return -1;
+		}
+		log->hdr->version = TAPLOG_VERSION;
+		log->hdr->record_size = sizeof(taplog_rec_t);
+		log->hdr->capacity = capacity;
+		log->hdr->head = 0;
+		__atomic_store_n(&log->hdr->magic,TAPLOG_MAGIC,__ATOMIC_RELEASE);
+		msync(log->base,TAPLOG_DATA_OFF,MS_SYNC);
+    }
+    else if(TapLogMap(log,fd,st.st_size,PROT_READ|PROT_WRITE) != 0)
+    {
+		close(fd);
+		return -1;
+    }
+    close(fd);
+    if(TapLogScan(log) != 0)
+    {
+		TapLogClose(log);
+		return -1;
+    }
+    log->hdr->head = log->next - 1;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Open the journal for reading, while a writer may be appending
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int TapLogOpenReadOnly(taplog_t *log,const char *path)
+{
+    struct stat st;
+    int fd;
+    memset(log,0,sizeof(taplog_t));
+    if((fd = open(path,O_RDONLY|O_CLOEXEC)) < 0)
+    {
+		return -1;
+    }
+    if(fstat(fd,&st) != 0 || st.st_size < TAPLOG_DATA_OFF || TapLogMap(log,fd,st.st_size,PROT_READ) != 0)
+    {
+		close(fd);
+		return -1;
+    }
+    close(fd);
+    if(TapLogScan(log) != 0)
+    {
+		TapLogClose(log);
+		return -1;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Append a record, no syscall
+//Parameters:log[IN]:Journal opened for writing
+//          rec[IN]:Reader, UID, ATQA/SAK, status and latency filled in;
+//                  sequence number, timestamps and checksum are set here
+/////////////////////////////////////////////////////////////////////
+void TapLogAppend(taplog_t *log,taplog_rec_t *rec)
+{
+    struct timespec ts;
+    taplog_rec_t *r = &log->rec[(log->next-1) % log->capacity];
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    rec->mono_ns = (unsigned long long)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+    clock_gettime(CLOCK_REALTIME,&ts);
+    rec->real_ns = (unsigned long long)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+    rec->seq = log->next;
+    rec->check = TapLogCheck(rec);
+    __atomic_store_n(&r->seq,0,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);//Readers see the slot empty before its body changes
+    memcpy((unsigned char *)r + sizeof(r->seq),(unsigned char *)rec + sizeof(rec->seq),sizeof(taplog_rec_t) - sizeof(rec->seq));
+    __atomic_store_n(&r->seq,rec->seq,__ATOMIC_RELEASE);
+    __atomic_store_n(&log->hdr->head,rec->seq,__ATOMIC_RELEASE);
+    log->next++;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Copy a record out of the ring
+//Parameters:log[IN]:Journal
+//          seq[IN]:Sequence number
+//         rec[OUT]:Record
+//return:0 = copied, 1 = not written yet, -1 = overwritten or torn
+/////////////////////////////////////////////////////////////////////
+int TapLogGet(taplog_t *log,unsigned long long seq,taplog_rec_t *rec)
+{
+    const taplog_rec_t *r = &log->rec[(seq-1) % log->capacity];
+    unsigned long long head;
+    if(seq == 0)
+    {
+		return -1;
+    }
+    if(__atomic_load_n(&r->seq,__ATOMIC_ACQUIRE) == seq)
+    {
+		memcpy(rec,(const void *)r,sizeof(taplog_rec_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&r->seq,__ATOMIC_RELAXED) == seq && rec->seq == seq && TapLogCheck(rec) == rec->check)
+		{
+			return 0;
+		}
+		return -1;
+    }
+    head = __atomic_load_n(&log->hdr->head,__ATOMIC_ACQUIRE);
+    if(log->next - 1 > head)
+    {
+		head = log->next - 1;//Header hint of a file that was not closed cleanly
+    }
+    return seq > head ? 1 : -1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Range of sequence numbers still in the ring
+//Parameters:pFirst[OUT]:Oldest record
+//            pLast[OUT]:Newest record, pLast < pFirst when the ring is empty
+/////////////////////////////////////////////////////////////////////
+void TapLogBounds(taplog_t *log,unsigned long long *pFirst,unsigned long long *pLast)
+{
+    unsigned long long last = __atomic_load_n(&log->hdr->head,__ATOMIC_ACQUIRE);
+    if(log->next - 1 > last)
+    {
+		last = log->next - 1;
+    }
+    *pLast = last;
+    *pFirst = last >= log->capacity ? last - log->capacity + 1 : 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Start writeback of the journal, call outside the read path
+/////////////////////////////////////////////////////////////////////
+void TapLogSync(taplog_t *log)
+{
+    msync(log->base,log->size,MS_ASYNC);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Flush and unmap the journal
+/////////////////////////////////////////////////////////////////////
+void TapLogClose(taplog_t *log)
+{
+    if(log->base != NULL)
+    {
+		msync(log->base,log->size,MS_SYNC);
+		munmap(log->base,log->size);
+    }
+    memset(log,0,sizeof(taplog_t));
+}
@@ -0,0 +1,60 @@
+#ifndef __TAPLOG_H
+#define	__TAPLOG_H
+
+/////////////////////////////////////////////////////////////////////
+//Tap journal file: one header page followed by a ring of fixed size
+//records, host byte order
+/////////////////////////////////////////////////////////////////////
+#define TAPLOG_MAGIC          0x50415452         //"RTAP"
+#define TAPLOG_VERSION        1
+#define TAPLOG_DATA_OFF       4096               //Records start on the second page
+#define TAPLOG_RECORDS        16384              //Default ring size, 1 MiB of records
+
+#define TAPLOG_EVT_ARRIVED    0                  //A card was selected, status MI_OK
+#define TAPLOG_EVT_LEFT       1                  //A card stopped answering, status of its last probe
+
+typedef struct
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int record_size;                    //sizeof(taplog_rec_t)
+    unsigned int capacity;                       //Records in the ring
+    unsigned long long head;                     //Hint only: last sequence number written
+} taplog_hdr_t;
+
+typedef struct
+{
+    unsigned long long seq;                      //1, 2, 3... 0 = empty or being written
+    unsigned long long mono_ns;                  //CLOCK_MONOTONIC
+    unsigned long long real_ns;                  //CLOCK_REALTIME
+    unsigned int latency_us;                     //Poll start to the event
+    unsigned short reader;                       //Reader ID
+    unsigned char status;                        //MI_OK or MI_* of the tap
+    unsigned char uid_len;
+    unsigned char uid[10];
+    unsigned char atqa[2];
+    unsigned char sak;
+    unsigned char event;                         //TAPLOG_EVT_*
+    unsigned char reserved[14];
+    unsigned int check;                          //FNV-1a of every byte before it
+} taplog_rec_t;                                  //64 bytes
+
+typedef struct
+{
+    unsigned char *base;                         //mmap'd file
+    unsigned long size;
+    taplog_hdr_t *hdr;
+    taplog_rec_t *rec;
+    unsigned int capacity;
+    unsigned long long next;                     //Writer: next sequence number
+} taplog_t;
+
+int TapLogOpen(taplog_t *log,const char *path,unsigned int capacity);
+int TapLogOpenReadOnly(taplog_t *log,const char *path);
+void TapLogAppend(taplog_t *log,taplog_rec_t *rec);
+int TapLogGet(taplog_t *log,unsigned long long seq,taplog_rec_t *rec);
+void TapLogBounds(taplog_t *log,unsigned long long *pFirst,unsigned long long *pLast);
+void TapLogSync(taplog_t *log);
+void TapLogClose(taplog_t *log);
+
+#endif
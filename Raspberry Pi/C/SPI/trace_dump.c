@@ -0,0 +1,144 @@
+/***************************************************************************************
+ * Project  :rc522 bus trace reader
+ * Describe :Prints a bus trace recorded with make TRACE=1 (rc522_trace.c), one register
+ *			 access per line, or with -s the accesses counted per register. Works on
+ *			 the ring of a crashed or hung process as well, -n then shows the last
+ *			 accesses before it stopped. Needs no reader hardware.
+ * Usage    :trace_dump [-s] [-n count] [-r reader] <trace>
+***************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "rc522_trace.h"
+
+static const char *RegName[64] =
+{
+    "RFU00","CommandReg","ComIEnReg","DivlEnReg","ComIrqReg","DivIrqReg","ErrorReg","Status1Reg",
+    "Status2Reg","FIFODataReg","FIFOLevelReg","WaterLevelReg","ControlReg","BitFramingReg","CollReg","RFU0F",
+    "RFU10","ModeReg","TxModeReg","RxModeReg","TxControlReg","TxAutoReg","TxSelReg","RxSelReg",
+    "RxThresholdReg","DemodReg","RFU1A","RFU1B","MifareReg","RFU1D","RFU1E","SerialSpeedReg",
+    "RFU20","CRCResultRegM","CRCResultRegL","RFU23","ModWidthReg","RFU25","RFCfgReg","GsNReg",
+    "CWGsCfgReg","ModGsCfgReg","TModeReg","TPrescalerReg","TReloadRegH","TReloadRegL","TCounterValueRegH","TCounterValueRegL",
+    "RFU30","TestSel1Reg","TestSel2Reg","TestPinEnReg","TestPinValueReg","TestBusReg","AutoTestReg","VersionReg",
+    "AnalogTestReg","TestDAC1Reg","TestDAC2Reg","TestADCReg","RFU3C","RFU3D","RFU3E","RFU3F",
+};
+
+/////////////////////////////////////////////////////////////////////
+//function:Print one record
+/////////////////////////////////////////////////////////////////////
+static void PrintRecord(unsigned long long i,const trace_rec_t *r)
+{
+    static const char Kind[] = "?RWE";
+    printf("%10llu %6llu.%09llu t%-6u r%-3u %c %-18s 0x%02X\n",i,r->t_ns/1000000000ULL,r->t_ns%1000000000ULL,
+           r->tid,r->reader,Kind[r->kind < 4 ? r->kind : 0],RegName[r->addr & 0x3F],r->value);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Accesses per register, and how many writes stored the value
+//         the register already had from the previous write
+/////////////////////////////////////////////////////////////////////
+static void PrintSummary(trace_t *t,unsigned long long first,unsigned long long end,int reader)
+{
+    static unsigned long long rd[64],wr[64],same[64];
+    unsigned char last[64],seen[64] = {0};
+    unsigned long long i,n = 0,echo = 0,t0 = 0,t1 = 0;
+    const trace_rec_t *r;
+    int a;
+    for(i=first;i<end;i++)
+    {
+		if((r = TraceGet(t,i)) == NULL || (reader >= 0 && r->reader != reader))
+		{
+			continue;
+		}
+		a = r->addr & 0x3F;
+		t0 = n++ == 0 ? r->t_ns : t0;
+		t1 = r->t_ns;
+		switch(r->kind)
+		{
+			case TRACE_RD: rd[a]++; break;
+			case TRACE_WR:
+				wr[a]++;
+				if(seen[a] && last[a] == r->value)
+				{
+					same[a]++;
+				}
+				seen[a] = 1;
+				last[a] = r->value;
+				break;
+			case TRACE_ECHO: echo++; break;
+		}
+    }
+    printf("%llu accesses in %.6f s, %llu UART echo mismatches\n",n,(t1 - t0)/1e9,echo);
+    printf("%-18s %10s %10s %10s\n","register","reads","writes","same");
+    for(a=0;a<64;a++)
+    {
+		if(rd[a] || wr[a])
+		{
+			printf("%-18s %10llu %10llu %10llu\n",RegName[a],rd[a],wr[a],same[a]);
+		}
+    }
+}
+
+int main(int argc,char *argv[])
+{
+    trace_t t;
+    unsigned long long first,end,i,count = 0;
+    time_t when;
+    int opt,summary = 0,reader = -1;
+    const trace_rec_t *r;
+
+    while((opt = getopt(argc,argv,"sn:r:")) != -1)
+    {
+		switch(opt)
+		{
+			case 's': summary = 1; break;
+			case 'n': count = strtoull(optarg,NULL,0); break;
+			case 'r': reader = atoi(optarg); break;
+			default:
+				fprintf(stderr,"usage: %s [-s] [-n count] [-r reader] <trace>\n",argv[0]);
+				return 1;
+		}
+    }
+    if(optind >= argc)
+    {
+		fprintf(stderr,"usage: %s [-s] [-n count] [-r reader] <trace>\n",argv[0]);
+		return 1;
+    }
+    if(TraceOpenReadOnly(&t,argv[optind]) != 0)
+    {
+		fprintf(stderr,"%s: not a bus trace\n",argv[optind]);
+		return 1;
+    }
+    TraceBounds(&t,&first,&end);
+    when = (time_t)(t.hdr->real_ns/1000000000ULL);
+    printf("# %s trace of %s",t.hdr->transport,ctime(&when));
+    if(t.hdr->flags & TRACE_RING)
+    {
+		printf("# %llu accesses recorded, the last %llu kept\n",end,end - first);
+    }
+    else
+    {
+		printf("# %llu accesses recorded, %llu dropped because the file was full\n",end,t.hdr->dropped);
+    }
+    if(count && end - first > count)
+    {
+		first = end - count;
+    }
+    if(summary)
+    {
+		PrintSummary(&t,first,end,reader);
+    }
+    else
+    {
+		for(i=first;i<end;i++)
+		{
+			if((r = TraceGet(&t,i)) != NULL && (reader < 0 || r->reader == reader))
+			{
+				PrintRecord(i,r);
+			}
+		}
+    }
+    TraceClose(&t);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/***************************************************************************************
+ * Project  :rc522 allowlist compiler
+ * Describe :Compiles a text allowlist into the mmap'able file read by allowlist.c.
+ *			 One card per line: the UID in hex, bytes optionally separated by ':' or '-',
+ *			 then an optional tag (decimal or 0x hex) handed back to the application.
+ *			 '#' starts a comment. Duplicate UIDs are reported and kept once.
+ *			 The output is replaced atomically, a running reader reloads it by itself.
+ * Usage    :allowlist_compile <list.txt> <list.acl>
+***************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "allowlist.h"
+
+/////////////////////////////////////////////////////////////////////
+//function:Parse one line
+//return:1 = key, 0 = empty line, -1 = syntax error
+/////////////////////////////////////////////////////////////////////
+static int ParseLine(char *line,acl_key_t *k)
+{
+    char *p,*end;
+    int hi = -1,v;
+    if((p = strchr(line,'#')) != NULL)
+    {
+		*p = 0;
+    }
+    for(p=line;isspace((unsigned char)*p);p++);
+    if(*p == 0)
+    {
+		return 0;
+    }
+    memset(k,0,sizeof(acl_key_t));
+    for(;*p && !isspace((unsigned char)*p);p++)
+    {
+		if(*p == ':' || *p == '-')
+		{
+			continue;
+		}
+		if(!isxdigit((unsigned char)*p))
+		{
+			return -1;
+		}
+		v = isdigit((unsigned char)*p) ? *p-'0' : tolower((unsigned char)*p)-'a'+10;
+		if(hi < 0)
+		{
+			hi = v;
+			continue;
+		}
+		if(k->len == ACL_UID_MAX)
+		{
+			return -1;
+		}
+		k->uid[k->len++] = (unsigned char)(hi<<4 | v);
+		hi = -1;
+    }
+    if(hi >= 0 || (k->len != 4 && k->len != 7 && k->len != 10))
+    {
+		return -1;
+    }
+    for(;isspace((unsigned char)*p);p++);
+    if(*p)
+    {
+		k->tag = (unsigned int)strtoul(p,&end,0);
+		for(;isspace((unsigned char)*end);end++);
+		if(end == p || *end)
+		{
+			return -1;
+		}
+    }
+    return 1;
+}
+
+static int KeyCompare(const void *a,const void *b)
+{
+    const acl_key_t *x = (const acl_key_t *)a;
+    const acl_key_t *y = (const acl_key_t *)b;
+    if(x->len != y->len)
+    {
+		return x->len - y->len;
+    }
+    return memcmp(x->uid,y->uid,x->len);
+}
+
+int main(int argc,char *argv[])
+{
+    FILE *fp;
+    char line[256];
+    acl_key_t *keys = NULL,*grown;
+    unsigned int count = 0,cap = 0,lineno = 0,i,n;
+    int r;
+
+    if(argc != 3)
+    {
+		fprintf(stderr,"usage: %s <list.txt> <list.acl>\n",argv[0]);
+		return 1;
+    }
+    if((fp = fopen(argv[1],"r")) == NULL)
+    {
+		perror(argv[1]);
+		return 1;
+    }
+    while(fgets(line,sizeof(line),fp) != NULL)
+    {
+		lineno++;
+		if(count == cap)
+		{
+			cap = cap ? cap*2 : 1024;
+			if((grown = realloc(keys,cap*sizeof(acl_key_t))) == NULL)
+			{
+				fprintf(stderr,"out of memory\n");
+				return 1;
+			}
+			keys = grown;
+		}
+		r = ParseLine(line,&keys[count]);
+		if(r < 0)
+		{
+			fprintf(stderr,"%s:%u: expected a 4, 7 or 10 byte hex UID and an optional tag\n",argv[1],lineno);
+			fclose(fp);
+			return 1;
+		}
+		count += r;
+    }
+    fclose(fp);
+
+    qsort(keys,count,sizeof(acl_key_t),KeyCompare);
+    for(i=0,n=0;i<count;i++)
+    {
+		if(n > 0 && KeyCompare(&keys[n-1],&keys[i]) == 0)
+		{
+			fprintf(stderr,"duplicate UID dropped, tag %u kept\n",keys[n-1].tag);
+			continue;
+		}
+		keys[n++] = keys[i];
+    }
+    if(AclCompile(keys,n,argv[2]) != 0)
+    {
+		fprintf(stderr,"%s: cannot compile\n",argv[2]);
+		return 1;
+    }
+    printf("%u cards -> %s\n",n,argv[2]);
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,232 @@
+/***************************************************************************************
+ * Project  :rc522 buzzer driver
+ * Describe :Drives the buzzer from the PWM1 block of the SoC through the kernel PWM
+ *			 sysfs interface, so a sounding buzzer costs no CPU time and no thread.
+ *			 softPwm, which keeps a real-time thread toggling the pin forever, is only
+ *			 started when the PWM channel is not available (overlay not loaded).
+***************************************************************************************/
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <wiringPi.h>
+#include <softPwm.h>
+#include "rc522.h"
+#include "buzzer.h"
+
+static int BzBackend = BUZZER_NONE;
+static int BzPeriodFd = -1;
+static int BzDutyFd = -1;
+static int BzEnableFd = -1;
+static unsigned long BzPeriodNs;                 //Hardware: current period
+static unsigned long BzDutyNs;                   //Hardware: current high time
+static int BzRange;                              //Software: current softPwm range, 100us steps
+static int BzValue;                              //Software: current softPwm value
+
+/////////////////////////////////////////////////////////////////////
+//function:Write a number to an open sysfs attribute
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+static int BzWrite(int fd,unsigned long value)
+{
+    char buf[24];
+    int n = snprintf(buf,sizeof(buf),"%lu",value);
+    return pwrite(fd,buf,n,0) == n ? 0 : -1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Open an attribute of the buzzer PWM channel
+/////////////////////////////////////////////////////////////////////
+static int BzOpen(const char *attr)
+{
+    char path[96];
+    snprintf(path,sizeof(path),BUZZER_PWM_CHIP "/pwm%d/%s",BUZZER_PWM_CHANNEL,attr);
+    return open(path,O_WRONLY|O_CLOEXEC);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Close the PWM channel attributes
+/////////////////////////////////////////////////////////////////////
+static void BzClose()
+{
+    if(BzPeriodFd >= 0)
+    {
+		close(BzPeriodFd);
+    }
+    if(BzDutyFd >= 0)
+    {
+		close(BzDutyFd);
+    }
+    if(BzEnableFd >= 0)
+    {
+		close(BzEnableFd);
+    }
+    BzPeriodFd = BzDutyFd = BzEnableFd = -1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Export and enable the PWM channel, silent
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+static int BzHardwareStart()
+{
+    int fd,i;
+    char ch = '0' + BUZZER_PWM_CHANNEL;
+    if(access(BUZZER_PWM_CHIP,F_OK) != 0)
+    {
+		return -1;
+    }
+    if((BzEnableFd = BzOpen("enable")) < 0)
+    {
+		if((fd = open(BUZZER_PWM_CHIP "/export",O_WRONLY|O_CLOEXEC)) < 0)
+		{
+			return -1;
+		}
+		if(write(fd,&ch,1) != 1)
+		{
+			//Already exported by someone else, opening the attributes tells
+		}
+		close(fd);
+		for(i=0;i<50 && BzEnableFd < 0;i++)//udev needs a moment to hand the new channel to the gpio group
+		{
+			delay(2);
+			BzEnableFd = BzOpen("enable");
+		}
+    }
+    BzPeriodFd = BzOpen("period");
+    BzDutyFd = BzOpen("duty_cycle");
+    if(BzEnableFd < 0 || BzPeriodFd < 0 || BzDutyFd < 0)
+    {
+		BzClose();
+		return -1;
+    }
+    BzPeriodNs = 1000000000UL/BUZZER_TONE_HZ;
+    BzDutyNs = 0;
+    if(BzWrite(BzDutyFd,0) != 0 || BzWrite(BzPeriodFd,BzPeriodNs) != 0 || BzWrite(BzEnableFd,1) != 0)
+    {
+		BzClose();
+		return -1;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Take over the buzzer pin, hardware PWM first, softPwm otherwise
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int BuzzerStart()
+{
+    if(BzBackend != BUZZER_NONE)
+    {
+		return 0;
+    }
+    if(BzHardwareStart() == 0)
+    {
+		BzBackend = BUZZER_HARDWARE;
+		return 0;
+    }
+    BzRange = 10000/BUZZER_TONE_HZ;
+    BzValue = 0;
+    if(softPwmCreate(PWM,0,BzRange) == 0)
+    {
+		BzBackend = BUZZER_SOFTWARE;
+		return 0;
+    }
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Sound the buzzer
+//Parameters:hz[IN]:Tone frequency
+//         duty[IN]:High time in percent of the period
+/////////////////////////////////////////////////////////////////////
+void BuzzerTone(unsigned int hz,unsigned char duty)
+{
+    unsigned long period,high;
+    int range,value;
+    if(hz == 0 || duty > 100)
+    {
+		return;
+    }
+    if(BzBackend == BUZZER_HARDWARE)
+    {
+		period = 1000000000UL/hz;
+		high = period/100*duty;
+		if(period != BzPeriodNs)
+		{
+			//The driver refuses a period shorter than the current high time
+			if(BzDutyNs > period && BzWrite(BzDutyFd,0) == 0)
+			{
+				BzDutyNs = 0;
+			}
+			if(BzWrite(BzPeriodFd,period) == 0)
+			{
+				BzPeriodNs = period;
+			}
+		}
+		if(high != BzDutyNs && BzWrite(BzDutyFd,high) == 0)
+		{
+			BzDutyNs = high;
+		}
+    }
+    else if(BzBackend == BUZZER_SOFTWARE)
+    {
+		hz = hz < BUZZER_TONE_MIN ? BUZZER_TONE_MIN : (hz > BUZZER_TONE_MAX ? BUZZER_TONE_MAX : hz);
+		range = 10000/hz;
+		value = (range*duty + 50)/100;
+		if(range != BzRange)//softPwm has no period setter, restart its thread
+		{
+			softPwmStop(PWM);
+			softPwmCreate(PWM,value,range);
+			BzRange = range;
+			BzValue = value;
+		}
+		else if(value != BzValue)
+		{
+			softPwmWrite(PWM,value);
+			BzValue = value;
+		}
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Silence the buzzer, the channel stays configured
+/////////////////////////////////////////////////////////////////////
+void BuzzerOff()
+{
+    if(BzBackend == BUZZER_HARDWARE && BzDutyNs != 0 && BzWrite(BzDutyFd,0) == 0)
+    {
+		BzDutyNs = 0;
+    }
+    else if(BzBackend == BUZZER_SOFTWARE && BzValue != 0)
+    {
+		softPwmWrite(PWM,0);
+		BzValue = 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Silence the buzzer and release the PWM channel or the softPwm thread
+/////////////////////////////////////////////////////////////////////
+void BuzzerStop()
+{
+    BuzzerOff();
+    if(BzBackend == BUZZER_HARDWARE)
+    {
+		BzWrite(BzEnableFd,0);
+		BzClose();
+    }
+    else if(BzBackend == BUZZER_SOFTWARE)
+    {
+		softPwmStop(PWM);
+    }
+    BzBackend = BUZZER_NONE;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Backend in use
+//return:BUZZER_HARDWARE, BUZZER_SOFTWARE or BUZZER_NONE
+/////////////////////////////////////////////////////////////////////
+int BuzzerBackend()
+{
+    return BzBackend;
+}
@@ -0,0 +1,51 @@
+#ifndef __CARD_CACHE_H
+#define	__CARD_CACHE_H
+
+#include "rc522.h"
+
+/////////////////////////////////////////////////////////////////////
+//Card content cache configuration
+/////////////////////////////////////////////////////////////////////
+#define CACHE_ENTRIES         8                  //Number of cards kept in the cache
+#define CACHE_BLOCKS          64                 //Blocks per card, Mifare_One(S50) has 64 blocks
+#define CACHE_BLOCK_SIZE      16                 //Block size in bytes
+#define CACHE_UID_MAX         10                 //Triple size UID
+#define CACHE_KEEPALIVE_MS    200                //Presence must be confirmed at least this often
+
+typedef struct
+{
+    unsigned char uid[CACHE_UID_MAX];            //Full card UID, the cache key
+    unsigned char uid_len;                       //4, 7 or 10 bytes, 0 = free slot
+    unsigned char present;                       //Card is currently in the field
+    unsigned long epoch;                         //Presence epoch the block contents belong to
+    unsigned long write_gen;                     //Reader write_gen when the blocks were filled
+    unsigned int  confirmed_ms;                  //Last time the card was seen in the field
+    unsigned long last_use;                      //LRU stamp
+    unsigned long long valid;                    //One bit per cached block
+    unsigned char block[CACHE_BLOCKS][CACHE_BLOCK_SIZE];
+} card_cache_entry_t;
+
+typedef struct
+{
+    card_cache_entry_t entry[CACHE_ENTRIES];
+    unsigned long epoch;
+    unsigned long tick;
+    rc522_t *pcd;                                //Reader the cards are seen on
+    unsigned char has_key;                       //CacheRead authenticates a miss itself
+    unsigned char auth_mode;                     //C_A or C_B, as PcdAuthState takes it
+    unsigned char key[6];
+    int auth_sector;                             //Sector of the Crypto1 session CacheRead opened, -1 = none
+    unsigned long hits;                          //CacheRead served from memory...
+    unsigned long misses;                        //...and over RF
+} card_cache_t;
+
+void CacheInit(card_cache_t *cache,rc522_t *pcd);
+void CacheSetKey(card_cache_t *cache,unsigned char auth_mode,const unsigned char *pKey);
+void CacheCardPresent(card_cache_t *cache,unsigned char *pUid,unsigned char len);
+void CacheCardRemoved(card_cache_t *cache,unsigned char *pUid,unsigned char len);
+unsigned char CacheKeepalive(card_cache_t *cache,unsigned char *pUid,unsigned char len);
+unsigned char CacheLookup(card_cache_t *cache,unsigned char *pUid,unsigned char len,unsigned char addr,unsigned char *pData);
+void CacheStore(card_cache_t *cache,unsigned char *pUid,unsigned char len,unsigned char addr,unsigned char *pData);
+unsigned char CacheRead(card_cache_t *cache,unsigned char *pUid,unsigned char len,unsigned char addr,unsigned char *pData);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __EVTFMT_H
+#define	__EVTFMT_H
+
+#include "rc522d.h"
+
+/////////////////////////////////////////////////////////////////////
+//Tap event formatter
+//Events are the rc522d frames, written as JSON Lines or as a CBOR
+//sequence (RFC 8742, one map per event) with the same keys:
+//  ev seq t reader + uid atqa sak | uid block status data
+//                  | uid allowed tag | dropped
+//                  | fault status recover_us recoveries
+//UID, ATQA and block data are upper case hex strings in JSON, byte
+//strings in CBOR
+/////////////////////////////////////////////////////////////////////
+#define EVTFMT_JSONL          0
+#define EVTFMT_CBOR           1
+
+#define EVTFMT_BUF            8192               //Formatted events kept until the next flush
+#define EVTFMT_EVENT_MAX      192                //Longest formatted event
+#define EVTFMT_IOV_MAX        16                 //Buffers gathered by one flush
+
+typedef struct
+{
+    unsigned char fmt;                           //EVTFMT_JSONL or EVTFMT_CBOR
+    unsigned int len;                            //Bytes waiting in buf
+    unsigned char buf[EVTFMT_BUF];
+} evtfmt_t;
+
+void EvtFmtInit(evtfmt_t *f,unsigned char fmt);
+evtfmt_t *EvtFmtThread(void);
+int EvtFmtFrame(evtfmt_t *f,unsigned char reader,const rc522d_frame_t *frame);
+int EvtFmtFlush(int fd,evtfmt_t **f,int count);
+
+#endif
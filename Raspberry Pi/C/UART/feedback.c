@@ -0,0 +1,214 @@
+/***************************************************************************************
+ * Project  :rc522 buzzer/LED feedback
+ * Describe :Beep and blink patterns are played by a worker thread driven by a timerfd,
+ *			 so the read loop only posts a pattern ID and goes back to polling cards.
+ *			 Every pattern has one pending bit: taps that arrive faster than their
+ *			 pattern can be played are coalesced instead of queuing up seconds of beeps.
+***************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <wiringPi.h>
+#include "rc522.h"
+#include "buzzer.h"
+#include "feedback.h"
+
+static const fb_step_t FbError[] = {{0,1,300},{0,0,150},{0,1,300},{0,0,0}};
+static const fb_step_t FbDeny[]  = {{FB_TONE_LOW,0,60},{0,0,60},{FB_TONE_LOW,0,60},{0,0,60},{FB_TONE_LOW,0,60},{0,0,0}};
+static const fb_step_t FbAllow[] = {{FB_TONE_HIGH,1,300},{0,0,0}};
+static const fb_step_t FbTap[]   = {{FB_TONE_HIGH,0,100},{0,1,100},{0,0,0}};
+static const fb_step_t *FbPattern[FB_PATTERNS] = {FbError,FbDeny,FbAllow,FbTap};
+static const fb_step_t FbOff = {0,0,0};
+
+static unsigned int FbPending;                   //Bit n = pattern n waits to be played
+static volatile int FbRunning;
+static int FbEvtFd = -1;
+static int FbTimerFd = -1;
+static pthread_t FbThread;
+
+/////////////////////////////////////////////////////////////////////
+//function:Drive the buzzer and the LED
+/////////////////////////////////////////////////////////////////////
+static void FbApply(const fb_step_t *s)
+{
+    if(s->tone)
+    {
+		BuzzerTone(s->tone,FB_BUZZER_DUTY);
+    }
+    else
+    {
+		BuzzerOff();
+    }
+    if(s->led)
+    {
+		LED_Enable();
+    }
+    else
+    {
+		LED_Disable();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Start a step and arm the timer for its end
+/////////////////////////////////////////////////////////////////////
+static void FbPlay(const fb_step_t *s)
+{
+    struct itimerspec its;
+    memset(&its,0,sizeof(its));
+    its.it_value.tv_sec = s->ms/1000;
+    its.it_value.tv_nsec = (s->ms%1000)*1000000L;
+    FbApply(s);
+    timerfd_settime(FbTimerFd,0,&its,NULL);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Take the next pending pattern
+//return:First step, NULL when nothing is pending
+/////////////////////////////////////////////////////////////////////
+static const fb_step_t *FbNext()
+{
+    unsigned int id;
+    unsigned int pending = __atomic_load_n(&FbPending,__ATOMIC_ACQUIRE);
+    if(pending == 0)
+    {
+		return NULL;
+    }
+    id = __builtin_ctz(pending);
+    __atomic_fetch_and(&FbPending,~(1u<<id),__ATOMIC_ACQ_REL);
+    return FbPattern[id];
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Worker thread, the only thread that touches the buzzer and the LED
+/////////////////////////////////////////////////////////////////////
+static void *FbWorker(void *arg)
+{
+    struct pollfd pfd[2];
+    unsigned long long cnt;
+    const fb_step_t *step = NULL;
+    (void)arg;
+    pfd[0].fd = FbEvtFd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = FbTimerFd;
+    pfd[1].events = POLLIN;
+    while(FbRunning)
+    {
+		if(poll(pfd,2,-1) < 0)
+		{
+			continue;
+		}
+		if((pfd[0].revents & POLLIN) && read(FbEvtFd,&cnt,sizeof(cnt)) < 0)
+		{
+			//Counter already drained
+		}
+		if((pfd[1].revents & POLLIN) && read(FbTimerFd,&cnt,sizeof(cnt)) == sizeof(cnt) && step != NULL)
+		{
+			step++;
+			if(step->ms != 0)
+			{
+				FbPlay(step);
+			}
+			else
+			{
+				step = NULL;
+			}
+		}
+		if(step == NULL)//A post while a step plays waits for the end of the pattern
+		{
+			step = FbNext();
+			if(step != NULL)
+			{
+				FbPlay(step);
+			}
+			else
+			{
+				FbApply(&FbOff);
+			}
+		}
+    }
+    FbApply(&FbOff);
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Take over the buzzer and the LED and start the worker
+//         pinMode(LED,OUTPUT) must have been called
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int FeedbackStart()
+{
+    if(BuzzerStart() != 0)
+    {
+		fprintf(stderr,"feedback: no buzzer, LED only\n");
+    }
+    FbEvtFd = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+    FbTimerFd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+    if(FbEvtFd < 0 || FbTimerFd < 0)
+    {
+		FeedbackStop();
+		return -1;
+    }
+    FbApply(&FbOff);
+    FbRunning = 1;
+    if(pthread_create(&FbThread,NULL,FbWorker,NULL) != 0)
+    {
+		FbRunning = 0;
+		FeedbackStop();
+		return -1;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Queue a pattern, never blocks
+//         A pattern that is already pending is not queued twice
+//Parameters:pattern[IN]:FB_PATTERN_*
+/////////////////////////////////////////////////////////////////////
+void FeedbackPost(unsigned char pattern)
+{
+    unsigned long long one = 1;
+    if(pattern >= FB_PATTERNS || FbEvtFd < 0)
+    {
+		return;
+    }
+    //Only the first pending bit has to wake the worker, coalesced posts cost no syscall
+    if(__atomic_fetch_or(&FbPending,1u<<pattern,__ATOMIC_RELEASE) == 0 &&
+       write(FbEvtFd,&one,sizeof(one)) < 0)
+    {
+		//eventfd counter saturated, the worker is awake anyway
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Stop the worker, pending patterns are dropped
+/////////////////////////////////////////////////////////////////////
+void FeedbackStop()
+{
+    unsigned long long one = 1;
+    if(FbRunning)
+    {
+		FbRunning = 0;
+		if(write(FbEvtFd,&one,sizeof(one)) < 0)
+		{
+			//The worker is awake anyway
+		}
+		pthread_join(FbThread,NULL);
+    }
+    if(FbEvtFd >= 0)
+    {
+		close(FbEvtFd);
+		FbEvtFd = -1;
+    }
+    if(FbTimerFd >= 0)
+    {
+		close(FbTimerFd);
+		FbTimerFd = -1;
+    }
+    __atomic_store_n(&FbPending,0,__ATOMIC_RELAXED);
+    BuzzerStop();
+}
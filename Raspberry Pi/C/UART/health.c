@@ -0,0 +1,308 @@
+/***************************************************************************************
+ * Project  :rc522 health monitor
+ * Describe :Notices a chip that stopped working and brings it back. A brown-out resets
+ *			 the registers of the RC522 behind the driver's back, a latched-up chip no
+ *			 longer answers at all; either way every poll fails from then on until
+ *			 someone restarts the program. Every interval_ms the monitor reads VersionReg
+ *			 and a few setup registers and compares them with the register shadow, and
+ *			 it takes every wait on the chip that ran out (pcd->stuck, counted by the
+ *			 bounded waits of rc522.c) as a fault right away. Every selftest_s it also
+ *			 runs the digital self-test of the chip (AutoTestReg) and compares the 64
+ *			 bytes it produces with those of a good chip of the same version.
+ *			 On a fault the chip is reset through its RST pin, set up again by PcdReset
+ *			 and M500PcdConfigISOType (which restores the RF tuner), every register of
+ *			 the shadow is written back, and the checks run again. A chip that does not
+ *			 come back is tried again after a wait that doubles up to HEALTH_BACKOFF_MS.
+ *			 The number and duration of recoveries are kept here and, with make STATS=1,
+ *			 in the "recover" phase histogram of the driver statistics.
+***************************************************************************************/
+#include <string.h>
+#include <wiringPi.h>
+#include "rc522.h"
+#include "health.h"
+
+//Setup registers read back by a check, and their bits that read as written
+static const unsigned char HealthReg[] = {ModeReg,TxControlReg,RFCfgReg};
+static const unsigned char HealthMask[] = {0xAB,0xFB,0x70};
+#define HEALTH_REGS           (sizeof(HealthReg)/sizeof(HealthReg[0]))
+
+//Digital self-test result of a version 2.0 chip (VersionReg 0x92), other versions learn theirs
+static const unsigned char HealthSelfTestV2[64] =
+{
+    0x00,0xEB,0x66,0xBA,0x57,0xBF,0x23,0x95,0xD0,0xE3,0x0D,0x3D,0x27,0x89,0x5C,0xDE,
+    0x9D,0x3B,0xA7,0x00,0x21,0x5B,0x89,0x82,0x51,0x3A,0xEB,0x02,0x0C,0xA5,0x00,0x49,
+    0x7C,0x84,0x4D,0xB3,0xCC,0xD2,0x1B,0x81,0x5D,0x48,0x76,0xD5,0x71,0x61,0x21,0xA9,
+    0x86,0x96,0x83,0x38,0xCF,0x9D,0x5B,0x6D,0xDC,0x15,0xBA,0x3E,0x7D,0x95,0x3B,0x2F,
+};
+
+static const char *HealthFaults[HEALTH_FAULTS] = {"none","stuck","version","config","selftest"};
+
+/////////////////////////////////////////////////////////////////////
+//function:Reset a monitor
+//Parameters:h[OUT]:Monitor
+//  interval_ms[IN]:Period of the checks, 0 = HEALTH_INTERVAL_MS
+//   selftest_s[IN]:Period of the self-test, 0 = only from HealthAttach of a
+//                  chip RC522_Init reset
+/////////////////////////////////////////////////////////////////////
+void HealthInit(health_t *h,unsigned int interval_ms,unsigned int selftest_s)
+{
+    memset(h,0,sizeof(health_t));
+    h->interval_ms = interval_ms ? interval_ms : HEALTH_INTERVAL_MS;
+    h->selftest_ms = selftest_s*1000;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Set the chip up again after a reset: PcdReset, the RF setup,
+//         then every register of the shadow as it was before
+//Parameters:save[IN]:Shadow before the reset
+//          valid[IN]:Its shadow_valid
+/////////////////////////////////////////////////////////////////////
+static unsigned char HealthRestart(rc522_t *pcd,const unsigned char *save,unsigned long long valid)
+{
+    unsigned char status,r;
+    status = PcdReset(pcd);
+    M500PcdConfigISOType(pcd,'A');
+    for(r=0;r<64;r++)
+    {
+		if((valid & (1ULL<<r)) && (!(pcd->shadow_valid & (1ULL<<r)) || pcd->shadow[r] != save[r]))
+		{
+			WriteRawRC(pcd,r,save[r]);
+		}
+    }
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Digital self-test as the data sheet describes it, leaves the
+//         chip reset
+//Parameters:result[OUT]:The 64 bytes of the FIFO
+//return:Successfully returns MI_OK, MI_COM_ERR when the chip does not run it
+/////////////////////////////////////////////////////////////////////
+static unsigned char HealthRunSelfTest(rc522_t *pcd,unsigned char *result)
+{
+    unsigned int t0;
+    int i;
+    WriteRawRC(pcd,CommandReg,PCD_RESETPHASE);
+    pcd->shadow_valid = 0;
+    t0 = millis();
+    while(ReadRawRC(pcd,CommandReg) & 0x10)      //PowerDown until the oscillator runs
+    {
+		if(millis() - t0 >= PCD_START_MS)
+		{
+			return MI_COM_ERR;
+		}
+    }
+    WriteRawRC(pcd,FIFOLevelReg,0x80);
+    for(i=0;i<25;i++)
+    {
+		WriteRawRC(pcd,FIFODataReg,0x00);
+    }
+    WriteRawRC(pcd,CommandReg,PCD_MEM);          //Internal buffer cleared
+    WriteRawRC(pcd,AutoTestReg,0x09);
+    WriteRawRC(pcd,FIFODataReg,0x00);
+    WriteRawRC(pcd,CommandReg,PCD_CALCCRC);
+    t0 = millis();
+    while(ReadRawRC(pcd,FIFOLevelReg) < 64)
+    {
+		if(millis() - t0 >= PCD_START_MS)
+		{
+			return MI_COM_ERR;
+		}
+    }
+    WriteRawRC(pcd,CommandReg,PCD_IDLE);
+    for(i=0;i<64;i++)
+    {
+		result[i] = ReadRawRC(pcd,FIFODataReg);
+    }
+    WriteRawRC(pcd,AutoTestReg,0x40);
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Check the chip without touching its state: waits that ran
+//         out since the last check, VersionReg, the setup registers
+//return:HEALTH_OK or HEALTH_FAULT_*
+/////////////////////////////////////////////////////////////////////
+unsigned char HealthProbe(rc522_t *pcd,health_t *h)
+{
+    unsigned char v;
+    unsigned int i;
+    if(pcd->stuck != h->stuck)
+    {
+		h->stuck = pcd->stuck;
+		return HEALTH_FAULT_STUCK;
+    }
+    v = ReadRawRC(pcd,VersionReg);
+    if(v == 0x00 || v == 0xFF || (h->version && v != h->version))
+    {
+		return HEALTH_FAULT_VERSION;             //A dead bus reads all zeros or all ones
+    }
+    h->version = v;
+    for(i=0;i<HEALTH_REGS;i++)
+    {
+		if((pcd->shadow_valid & (1ULL<<HealthReg[i])) && ((ReadRawRC(pcd,HealthReg[i]) ^ pcd->shadow[HealthReg[i]]) & HealthMask[i]))
+		{
+			return HEALTH_FAULT_CONFIG;
+		}
+    }
+    return HEALTH_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Run the digital self-test and set the chip up again. The
+//         first run on a chip of unknown version keeps its result as
+//         the reference
+//return:Successfully returns MI_OK, MI_ERR when the result differs
+/////////////////////////////////////////////////////////////////////
+unsigned char HealthSelfTest(rc522_t *pcd,health_t *h)
+{
+    unsigned char save[64],result[64],status,restart;
+    unsigned long long valid = pcd->shadow_valid;
+    memcpy(save,pcd->shadow,sizeof(save));
+    h->selftests++;
+    h->selftest_last_ms = millis();
+    status = HealthRunSelfTest(pcd,result);
+    restart = HealthRestart(pcd,save,valid);
+    if(status == MI_OK && restart != MI_OK)
+    {
+		status = restart;
+    }
+    if(status == MI_OK && !h->has_reference)
+    {
+		memcpy(h->reference,result,sizeof(result));
+		h->has_reference = 1;
+    }
+    else if(status == MI_OK && memcmp(result,h->reference,sizeof(result)) != 0)
+    {
+		status = MI_ERR;
+    }
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Start watching a reader, after RC522_Init. Runs the first
+//         self-test; a chip that fails it is recovered by HealthCheck.
+//         A chip RC522_Init took over warm is not self-tested here, the
+//         reset of the test would switch off the field it kept on; its
+//         first self-test comes after selftest_ms
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char HealthAttach(rc522_t *pcd,health_t *h)
+{
+    unsigned char fault;
+    h->stuck = pcd->stuck;
+    h->last_ms = millis();
+    h->selftest_last_ms = h->last_ms;
+    fault = HealthProbe(pcd,h);
+    if(fault == HEALTH_OK && h->version == 0x92 && !h->has_reference)
+    {
+		memcpy(h->reference,HealthSelfTestV2,sizeof(h->reference));
+		h->has_reference = 1;
+    }
+    if(fault == HEALTH_OK && !pcd->warm && HealthSelfTest(pcd,h) != MI_OK)
+    {
+		fault = HEALTH_FAULT_SELFTEST;
+    }
+    if(fault != HEALTH_OK)
+    {
+		h->fault = fault;
+		h->faults[fault]++;
+		h->down = 1;
+		h->backoff_ms = h->interval_ms;
+		return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Reset the chip through RST, set it up again from the shadow
+//         and check it
+//return:MI_OK when the chip is back
+/////////////////////////////////////////////////////////////////////
+unsigned char HealthRecover(rc522_t *pcd,health_t *h)
+{
+    unsigned char save[64],status;
+    unsigned long long valid = pcd->shadow_valid;
+    unsigned int t0 = micros(),us;
+    memcpy(save,pcd->shadow,sizeof(save));
+    status = HealthRestart(pcd,save,valid);
+    h->stuck = pcd->stuck;                       //Waits of the fault itself
+    if(status == MI_OK && HealthProbe(pcd,h) != HEALTH_OK)
+    {
+		status = MI_COM_ERR;
+    }
+    us = micros() - t0;
+    STATS_PHASE(pcd,STATS_PH_RECOVER,t0,status);
+    h->recover_us = us;
+    h->recover_sum_us += us;
+    if(us > h->recover_max_us)
+    {
+		h->recover_max_us = us;
+    }
+    if(status == MI_OK)
+    {
+		h->recoveries++;
+		h->down = 0;
+		h->backoff_ms = 0;
+    }
+    else
+    {
+		h->failed++;
+		h->down = 1;
+		h->backoff_ms = h->backoff_ms ? h->backoff_ms*2 : h->interval_ms;
+		if(h->backoff_ms > HEALTH_BACKOFF_MS)
+		{
+			h->backoff_ms = HEALTH_BACKOFF_MS;
+		}
+    }
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Check the chip when it is due, and recover it from a fault.
+//         Call while no card is in the field
+//return:Fault recovered from in this call (h->down tells whether the
+//       recovery worked), HEALTH_OK when there was nothing to do
+/////////////////////////////////////////////////////////////////////
+unsigned char HealthCheck(rc522_t *pcd,health_t *h)
+{
+    unsigned int now = millis();
+    unsigned char fault;
+    if(h->down)
+    {
+		if(now - h->last_ms < h->backoff_ms)
+		{
+			return HEALTH_OK;
+		}
+		h->last_ms = now;
+		HealthRecover(pcd,h);
+		return h->fault;
+    }
+    if(pcd->stuck == h->stuck && now - h->last_ms < h->interval_ms)
+    {
+		return HEALTH_OK;
+    }
+    h->last_ms = now;
+    h->checks++;
+    fault = HealthProbe(pcd,h);
+    if(fault == HEALTH_OK && h->selftest_ms && now - h->selftest_last_ms >= h->selftest_ms && HealthSelfTest(pcd,h) != MI_OK)
+    {
+		fault = HEALTH_FAULT_SELFTEST;
+    }
+    if(fault == HEALTH_OK)
+    {
+		return HEALTH_OK;
+    }
+    h->fault = fault;
+    h->faults[fault]++;
+    HealthRecover(pcd,h);
+    return fault;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Name of a HEALTH_* fault, for logs and metrics
+/////////////////////////////////////////////////////////////////////
+const char *HealthFaultName(unsigned char fault)
+{
+    return fault < HEALTH_FAULTS ? HealthFaults[fault] : "?";
+}
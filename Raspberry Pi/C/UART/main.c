@@ -17,10 +17,85 @@
  * Web Site		   :
 ***************************************************************************************/
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <wiringPi.h>
 #include <wiringSerial.h>
-#include <softPwm.h>
 #include "rc522.h"
+#include "feedback.h"
+#include "presence.h"
+#include "evtfmt.h"
+
+/////////////////////////////////////////////////////////////////////
+//function:Print an event of the demo as one JSON line
+/////////////////////////////////////////////////////////////////////
+static void PrintEvent(rc522d_frame_t *ev,unsigned char type,unsigned char len)
+{
+    static unsigned short seq;
+    evtfmt_t *f = EvtFmtThread();
+    ev->hdr.type = type;
+    ev->hdr.len = len;
+    ev->hdr.seq = seq++;
+    ev->hdr.time_ms = millis();
+    EvtFmtFrame(f,0,ev);
+    fflush(stdout);//Keep the order of the printf prompts
+    EvtFmtFlush(STDOUT_FILENO,&f,1);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read the UID of the S50 card and print the card number
+//         Read block 8 data and can change the first 4 bytes of data by keyboard input
+//Parameters:pcd[IN]:Reader
+//          pres[IN]:Presence tracker of the reader, set up with PresenceInit
+/////////////////////////////////////////////////////////////////////
+static void ReadIDData(rc522_t *pcd,presence_t *pres)
+{
+    unsigned char sec[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}; //IC card initial password
+    unsigned char *blockdata1;
+    unsigned char b,ret;
+    rc522d_frame_t ev;
+    if(PresencePoll(pcd,pres) == PRES_EVT_ARRIVED)//A card left on the reader is reported once
+    {
+		memcpy(pcd->CT,pres->atqa,2);
+		memcpy(pcd->SN,pres->uid+pres->uid_len-4,4);//Crypto1 uses the last 4 UID bytes
+		ev.u.card.uid_len = pres->uid_len;
+		memcpy(ev.u.card.uid,pres->uid,pres->uid_len);
+		memcpy(ev.u.card.atqa,pres->atqa,2);
+		ev.u.card.sak = pres->sak;
+		PrintEvent(&ev,RC522D_EVT_PRESENT,sizeof(rc522d_card_t));
+		FeedbackPost(FB_PATTERN_TAP);//Played by the feedback worker, the read goes on
+		if(PcdAuthState(pcd,C_A,8,sec,pcd->SN) == MI_OK)//验证密码
+		{
+			ev.u.read.uid_len = pres->uid_len;
+			memcpy(ev.u.read.uid,pres->uid,pres->uid_len);
+			ev.u.read.block = 8;
+			blockdata1 = ev.u.read.data;
+			memset(blockdata1,0,16);
+			ev.u.read.status = PcdRead(pcd,8,blockdata1);//读取块8数据
+			PresenceReadProbe(pres,8);//Authenticated, keepalive with READ from now on
+			PrintEvent(&ev,RC522D_EVT_READ,sizeof(rc522d_read_t));
+			printf("Please enter the first 4 bytes of block data on the keyboard\n");
+			for(b=0;b<4;b++)
+			{
+				unsigned int v;
+				printf("input %d:",b);
+				ret=scanf("%X",&v);
+				while(ret!=1)
+				{
+					printf("Input error, please re-enter\n");
+					while(getchar()!='\n');
+					ret=scanf("%X",&v);
+				}
+				blockdata1[b] = (unsigned char)v;
+			}
+			PcdWrite(pcd,8,blockdata1);
+			ev.u.read.status = PcdRead(pcd,8,blockdata1);//再次读取块8数据
+			PrintEvent(&ev,RC522D_EVT_READ,sizeof(rc522d_read_t));
+			printf("----------------------------------\n");
+			delay(1000);
+		}
+    }
+}
 
 int main()
 {
@@ -35,6 +110,10 @@ int main()
     printf(" |          SCK  -> OFF					ADR0 -> 0      |\n");
     printf(" =======================================================\n");
     
+	int serial_Fd; //The file descriptor for serial
+	rc522_t reader; //The HAT on /dev/ttyS0
+	rc522_t *pcd = &reader;
+	presence_t pres;
 	if(wiringPiSetup()==-1)
 	{
 		printf("init wiringPi error\n");
@@ -46,12 +125,16 @@ int main()
 	}
 	pinMode(Res,OUTPUT);
 	pinMode(LED, OUTPUT);
-	pinMode(PWM, PWM_OUTPUT);
-	RC522_Init();
-	softPwmCreate(PWM, 0, 10);
+	PcdInit(pcd,serial_Fd,Res);
+	RC522_Init(pcd);
+	PresenceInit(&pres,PRES_ARRIVE_POLLS,PRES_LEAVE_POLLS);
+	if(FeedbackStart()!=0)
+	{
+		printf("init feedback failed!\n");
+	}
 	while(1)
 	{
-		ReadIDData();
+		ReadIDData(pcd,&pres);
 	}
 	return 0;
 }
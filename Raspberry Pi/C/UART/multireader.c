@@ -0,0 +1,235 @@
+/***************************************************************************************
+ * Project  :rc522 multi-reader scheduler
+ * Describe :Polls several RC522 boards stacked on one bus (SPI CE0/CE1, or I2C boards
+ *			 set to different ADR0-ADR5 addresses, or one UART each).
+ *			 Most of a card request is spent waiting for the RF timer, not on the bus:
+ *			 - threads mode runs one presence tracker per reader thread and sleeps
+ *			   between IRQ polls, so the bus is free for the other readers meanwhile;
+ *			 - interleaved mode sends the card requests of every empty reader first
+ *			   and collects the answers afterwards, so one thread waits for all
+ *			   of them at once.
+ *			 Readers must be added in bus order; with a shared reset line only the
+ *			 first one pulses it, the chips initialised before would be reset again.
+***************************************************************************************/
+#include <string.h>
+#include <wiringPi.h>
+#include "rc522.h"
+#include "presence.h"
+#include "multireader.h"
+
+/////////////////////////////////////////////////////////////////////
+//function:Reset a scheduler
+//Parameters:s[OUT]:Scheduler
+//   on_event[IN]:Presence change callback, may be NULL
+//        arg[IN]:Callback argument
+/////////////////////////////////////////////////////////////////////
+void MrInit(mr_sched_t *s,mr_event_fn on_event,void *arg)
+{
+    memset(s,0,sizeof(mr_sched_t));
+    s->poll_ms = MR_POLL_MS;
+    s->on_event = on_event;
+    s->arg = arg;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Add and initialise a reader
+//Parameters:s[IN]:Scheduler
+//          fd[IN]:SPI channel, or I2C/serial file descriptor of the board
+//         rst[IN]:Reset pin, -1 when an earlier reader shares the line
+//return:Reader ID, -1 when the scheduler is full
+/////////////////////////////////////////////////////////////////////
+int MrAddReader(mr_sched_t *s,int fd,int rst)
+{
+    mr_reader_t *r;
+    if(s->count == MR_READERS_MAX)
+    {
+		return -1;
+    }
+    r = &s->reader[s->count];
+    PcdInit(&r->pcd,fd,rst);
+    PresenceInit(&r->pres,0,0);
+    r->id = s->count;
+    r->sched = s;
+    RC522_Init(&r->pcd);
+    return s->count++;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Hand a presence change to the application
+/////////////////////////////////////////////////////////////////////
+static void MrDispatch(mr_reader_t *r,unsigned char evt)
+{
+    if(evt == PRES_EVT_NONE)
+    {
+		return;
+    }
+    if(evt == PRES_EVT_ARRIVED)
+    {
+		r->taps++;
+    }
+    if(r->sched->on_event != NULL)
+    {
+		r->sched->on_event(r->id,evt,&r->pres,r->sched->arg);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Thread of one reader in MR_MODE_THREADS
+/////////////////////////////////////////////////////////////////////
+static void *MrReaderThread(void *arg)
+{
+    mr_reader_t *r = (mr_reader_t *)arg;
+    r->pcd.poll_us = MR_THREAD_POLL_US;
+    while(r->sched->running)
+    {
+		r->polls++;
+		MrDispatch(r,PresencePoll(&r->pcd,&r->pres));
+		delay(r->sched->poll_ms);
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:One round over every reader
+//         The card requests of all empty readers are in flight together,
+//         a reader with a card runs its keepalive probe on its own
+//Parameters:s[IN]:Scheduler
+//return:1 when a card answered a request, 0 = the empty fields stayed empty
+/////////////////////////////////////////////////////////////////////
+unsigned char MrPoll(mr_sched_t *s)
+{
+    unsigned char i,busy,events;
+    mr_reader_t *r;
+    for(i=0;i<s->count;i++)
+    {
+		r = &s->reader[i];
+		r->req_pending = (r->pres.state == PRES_ABSENT);
+		if(r->req_pending)
+		{
+			PcdRequestStart(&r->pcd,PICC_REQIDL);
+		}
+    }
+    do
+    {
+		busy = 0;
+		for(i=0;i<s->count;i++)
+		{
+			r = &s->reader[i];
+			if(r->req_pending == 1)
+			{
+				if(PcdRequestPoll(&r->pcd,r->pres.atqa,&r->req_status))
+				{
+					r->req_pending = 2;
+				}
+				else
+				{
+					busy = 1;
+				}
+			}
+		}
+    }
+    while(busy);
+    events = 0;
+    for(i=0;i<s->count;i++)
+    {
+		r = &s->reader[i];
+		r->polls++;
+		if(r->req_pending)
+		{
+			events |= r->req_status == MI_OK;
+			MrDispatch(r,PresencePollRequested(&r->pcd,&r->pres,r->req_status));
+		}
+		else
+		{
+			MrDispatch(r,PresencePoll(&r->pcd,&r->pres));
+		}
+    }
+    return events;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Poll every reader from the calling thread while the scheduler
+//         runs, poll_ms between rounds that found no card. MrStart
+//         (MR_MODE_INTERLEAVED) calls it on a thread of its own; a caller
+//         that polls in its own thread sets s->running first, MrStop
+//         from a signal handler or another thread ends it
+//Parameters:s[IN]:Scheduler
+/////////////////////////////////////////////////////////////////////
+void MrRunInterleaved(mr_sched_t *s)
+{
+    s->mode = MR_MODE_INTERLEAVED;
+    while(s->running)
+    {
+		if(!MrPoll(s))
+		{
+			delay(s->poll_ms);
+		}
+    }
+}
+
+static void *MrInterleavedThread(void *arg)
+{
+    MrRunInterleaved((mr_sched_t *)arg);
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Start polling in the background
+//Parameters:s[IN]:Scheduler
+//        mode[IN]:MR_MODE_THREADS or MR_MODE_INTERLEAVED
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int MrStart(mr_sched_t *s,unsigned char mode)
+{
+    unsigned char i;
+    s->mode = mode;
+    s->running = 1;                              //Before the threads, a quick MrStop must not be undone
+    if(mode == MR_MODE_INTERLEAVED)
+    {
+		if(pthread_create(&s->reader[0].thread,NULL,MrInterleavedThread,s) != 0)
+		{
+			s->running = 0;
+			return -1;
+		}
+		s->threads = 1;
+		return 0;
+    }
+    for(i=0;i<s->count;i++)
+    {
+		if(pthread_create(&s->reader[i].thread,NULL,MrReaderThread,&s->reader[i]) != 0)
+		{
+			MrStop(s);                           //Joins the threads already running
+			return -1;
+		}
+		s->threads = i+1;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Stop polling and wait for the threads MrStart created
+/////////////////////////////////////////////////////////////////////
+void MrStop(mr_sched_t *s)
+{
+    unsigned char i;
+    s->running = 0;
+    for(i=0;i<s->threads;i++)
+    {
+		pthread_join(s->reader[i].thread,NULL);
+    }
+    s->threads = 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Taps of all readers so far
+/////////////////////////////////////////////////////////////////////
+unsigned long MrTaps(mr_sched_t *s)
+{
+    unsigned char i;
+    unsigned long taps = 0;
+    for(i=0;i<s->count;i++)
+    {
+		taps += __atomic_load_n(&s->reader[i].taps,__ATOMIC_RELAXED);
+    }
+    return taps;
+}
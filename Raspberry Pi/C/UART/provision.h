@@ -0,0 +1,74 @@
+#ifndef __PROVISION_H
+#define	__PROVISION_H
+
+#include <stdio.h>
+#include <signal.h>
+#include "rc522.h"
+
+/////////////////////////////////////////////////////////////////////
+//Access conditions C1C2C3 of one block, bit 2 = C1, bit 1 = C2, bit 0 = C3
+/////////////////////////////////////////////////////////////////////
+#define ACC_DATA_TRANSPORT    0x00               //Data block: read/write/value with key A|B
+#define ACC_DATA_RW_B         0x04               //Data block: read A|B, write B
+#define ACC_DATA_READ_ONLY    0x02               //Data block: read A|B, never written
+#define ACC_DATA_VALUE        0x06               //Data block: value block, decrement A|B, increment B
+#define ACC_TRAILER_TRANSPORT 0x01               //Trailer: key A writes keys and access bits (transport configuration)
+#define ACC_TRAILER_B         0x03               //Trailer: key B writes keys and access bits
+#define ACC_TRAILER_LOCKED    0x07               //Trailer: nothing can be changed any more
+
+#define PROV_SECTORS          16                 //Mifare_One(S50)
+#define PROV_SECTOR_DATA      0x01               //Write the data blocks of the sector
+#define PROV_SECTOR_TRAILER   0x02               //Write the trailer of the sector
+
+/////////////////////////////////////////////////////////////////////
+//Pipeline stages
+/////////////////////////////////////////////////////////////////////
+#define PROV_STAGE_DETECT     0                  //Request, anticollision and select
+#define PROV_STAGE_AUTH       1                  //Authentication with the transport key
+#define PROV_STAGE_DATA       2                  //Data block writes
+#define PROV_STAGE_TRAILER    3                  //Trailer writes
+#define PROV_STAGE_VERIFY     4                  //Authentication with the new keys and read back
+#define PROV_STAGES           5
+
+typedef struct
+{
+    unsigned char flags;                         //PROV_SECTOR_*
+    unsigned char data[3][16];                   //Blocks 0-2, block 0 of sector 0 is never written
+    unsigned char key_a[6];
+    unsigned char key_b[6];
+    unsigned char cond[4];                       //Access conditions of blocks 0-3
+    unsigned char gpb;                           //General purpose byte of the trailer
+} prov_sector_t;
+
+typedef struct
+{
+    unsigned char transport_mode;                //C_A or C_B
+    unsigned char transport_key[6];              //Key the blank cards are shipped with
+    unsigned char verify;                        //Read back every written block with the new key
+    //Per card hook, may change the data of a block before it is written (serial numbers, UID binding)
+    void (*fill)(unsigned char sector,unsigned char block,unsigned char *pData,unsigned char *pUid,unsigned char len,void *arg);
+    void *arg;
+    prov_sector_t sector[PROV_SECTORS];
+} prov_template_t;
+
+typedef struct
+{
+    unsigned long cards_ok;
+    unsigned long cards_failed;
+    unsigned long stage_fail[PROV_STAGES];
+    unsigned long long stage_us[PROV_STAGES];    //Time spent per stage over all cards
+    unsigned long long idle_us;                  //Time waiting for the next card
+    unsigned long long start_us;
+    unsigned long long last_card_us;             //Duration of the last card
+    volatile sig_atomic_t stop;                  //Set from a signal handler, ProvisionRun returns at the next poll
+} prov_stats_t;
+
+void AccessBitsEncode(const unsigned char *pCond,unsigned char *pBits);
+unsigned char AccessBitsDecode(const unsigned char *pBits,unsigned char *pCond);
+void TrailerBuild(const prov_sector_t *pSector,unsigned char *pTrailer);
+void ProvisionTemplateInit(prov_template_t *tpl);
+unsigned char ProvisionCard(rc522_t *pcd,prov_template_t *tpl,prov_stats_t *stats);
+void ProvisionRun(rc522_t *pcd,prov_template_t *tpl,unsigned long count,prov_stats_t *stats,FILE *report);
+void ProvisionReport(const prov_stats_t *stats,FILE *fp);
+
+#endif
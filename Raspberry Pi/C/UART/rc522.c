@@ -18,33 +18,29 @@
 ***************************************************************************************/
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <wiringPi.h>
 #include <wiringSerial.h>
-#include <softPwm.h>
 #include "rc522.h"
-
-unsigned char fHasRATS = 0;
-unsigned char CT[2];//Card type
-unsigned char SN[4]; //card number
-unsigned char sec[12] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}; //IC card initial password
-unsigned char blockdata1[16]= {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+#include "rftune.h"
+#include "retry.h"
 
 /////////////////////////////////////////////////////////////////////
 //function:Serial port read and write data processing
 //Parameters that:TxData[IN]:Data to be sent
 //return:Read data
 /////////////////////////////////////////////////////////////////////
-unsigned char Uart_ReadWriteByte(unsigned char TxData)
+unsigned char Uart_ReadWriteByte(rc522_t *pcd,unsigned char TxData)
 {
     unsigned char rev=1;
     int waittime=5;
-    serialPutchar(serial_Fd, TxData);
+    serialPutchar(pcd->fd, TxData);
     while(waittime--)
     {
-		if(serialDataAvail(serial_Fd)==1)
+		if(serialDataAvail(pcd->fd)==1)
 		{
-			rev = serialGetchar(serial_Fd);
-			serialFlush(serial_Fd);
+			rev = serialGetchar(pcd->fd);
+			serialFlush(pcd->fd);
 			break;
 		}
 		else delay(3);
@@ -62,9 +58,13 @@ unsigned char Uart_ReadWriteByte(unsigned char TxData)
 //Parameters that:Address[IN]:Register address
 //return:Read data
 /////////////////////////////////////////////////////////////////////
-unsigned char ReadRawRC(unsigned char Address)
+unsigned char ReadRawRC(rc522_t *pcd,unsigned char Address)
 {
-    return Uart_ReadWriteByte((Address&0x3F) | 0x80);
+    AUDIT_START(t);
+    unsigned char ucResult = Uart_ReadWriteByte(pcd,(Address&0x3F) | 0x80);
+    TRACE_READ(pcd,Address,ucResult);
+    AUDIT_READ(pcd,Address,ucResult,t);
+    return ucResult;
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -72,14 +72,45 @@ unsigned char ReadRawRC(unsigned char Address)
 //Parameters that:Address[IN]:Register address
 //                  value[IN]:Written data
 /////////////////////////////////////////////////////////////////////
-void WriteRawRC(unsigned char Address, unsigned char value)
+void WriteRawRC(rc522_t *pcd,unsigned char Address, unsigned char value)
 {
-    unsigned char ch = Uart_ReadWriteByte(Address & 0x3F);
+    AUDIT_START(t);
+    unsigned char ch = Uart_ReadWriteByte(pcd,Address & 0x3F);
     if(ch != Address)
     {
+		TRACE_ECHO_BAD(pcd,Address,ch);
 		printf("Not equal");
     }
-    serialPutchar(serial_Fd, value);
+    serialPutchar(pcd->fd, value);
+    TRACE_WRITE(pcd,Address,value);
+    AUDIT_WRITE(pcd,Address,value,t);
+	pcd->shadow[Address&0x3F] = value;
+	pcd->shadow_valid |= PCD_SHADOW_REGS & (1ULL<<(Address&0x3F));
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Set up a reader handle, RC522_Init then brings up the chip
+//Parameters:pcd[OUT]:Reader
+//            fd[IN]:serialOpen() descriptor
+//           rst[IN]:Reset pin, -1 when another reader already resets the shared line
+/////////////////////////////////////////////////////////////////////
+void PcdInit(rc522_t *pcd,int fd,int rst)
+{
+    memset(pcd,0,sizeof(rc522_t));
+    pcd->fd = fd;
+    pcd->rst = rst;
+    TRACE_SETUP("uart");
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Give the bus away while the card is answering
+/////////////////////////////////////////////////////////////////////
+static void PcdWaitRF(rc522_t *pcd)
+{
+    struct timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = pcd->poll_us*1000L;
+    nanosleep(&ts,NULL);
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -87,11 +118,20 @@ void WriteRawRC(unsigned char Address, unsigned char value)
 //Parameters:reg[IN]:Register address
 //          mask[IN]:Setting value
 /////////////////////////////////////////////////////////////////////
-void SetBitMask(unsigned char reg,unsigned char mask)
+void SetBitMask(rc522_t *pcd,unsigned char reg,unsigned char mask)
 {
     unsigned char  tmp = 0x0;
-    tmp = ReadRawRC(reg);
-    WriteRawRC(reg,tmp | mask);  // set bit mask
+    AUDIT_RMW_START(pcd);
+    if(pcd->shadow_valid & (1ULL<<reg))
+    {
+		tmp = pcd->shadow[reg];   //Only this library writes it, no need to read it back
+    }
+    else
+    {
+		tmp = ReadRawRC(pcd,reg);
+    }
+    WriteRawRC(pcd,reg,tmp | mask);  // set bit mask
+    AUDIT_RMW(pcd,reg,tmp,tmp | mask);
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -99,29 +139,39 @@ void SetBitMask(unsigned char reg,unsigned char mask)
 //Parameters:reg[IN]:Register address
 //          mask[IN]:Setting value
 /////////////////////////////////////////////////////////////////////
-void ClearBitMask(unsigned char reg,unsigned char mask)
+void ClearBitMask(rc522_t *pcd,unsigned char reg,unsigned char mask)
 {
     unsigned char  tmp = 0x0;
-    tmp = ReadRawRC(reg);
-    WriteRawRC(reg, tmp & ~mask);  // clear bit mask
+    AUDIT_RMW_START(pcd);
+    if(pcd->shadow_valid & (1ULL<<reg))
+    {
+		tmp = pcd->shadow[reg];
+    }
+    else
+    {
+		tmp = ReadRawRC(pcd,reg);
+    }
+    WriteRawRC(pcd,reg, tmp & ~mask);  // clear bit mask
+    AUDIT_RMW(pcd,reg,tmp,tmp & ~mask);
 } 
 
 /////////////////////////////////////////////////////////////////////
 //function:Open the antenna
 //There shall be a minimum interval of 1ms between each start or close of the celestial launch
 /////////////////////////////////////////////////////////////////////
-void PcdAntennaOn()
+void PcdAntennaOn(rc522_t *pcd)
 {
-    SetBitMask(TxControlReg, 0x03);
-    delay(10);
+    SetBitMask(pcd,TxControlReg, 0x03);
+    pcd->field_us = micros() + PCD_FIELD_US;     //The next exchange waits for the cards, not this call
+    pcd->field_wait = 1;
 }
 
 /////////////////////////////////////////////////////////////////////
 //function:Close the antenna
 /////////////////////////////////////////////////////////////////////
-void PcdAntennaOff()
+void PcdAntennaOff(rc522_t *pcd)
 {
-    ClearBitMask(TxControlReg, 0x03);
+    ClearBitMask(pcd,TxControlReg, 0x03);
     delay(10);
 }
 
@@ -129,145 +179,361 @@ void PcdAntennaOff()
 //function:Initialize for ISO14443A type card
 //Parameters:ucType[IN]:Card type
 /////////////////////////////////////////////////////////////////////
-void M500PcdConfigISOType(unsigned char ucType)
+void M500PcdConfigISOType(rc522_t *pcd,unsigned char ucType)
 {
     if ( ucType == 'A')   //ISO14443A
     {
-        ClearBitMask ( Status2Reg, 0x08 );  //Contains status flags for receivers and transmitters
-        WriteRawRC ( ModeReg, 0x3D );	    //Define common modes for sending and receiving
-        WriteRawRC ( RxSelReg, 0x86 );      //Define received data
-        WriteRawRC( RFCfgReg, 0x6F );       //Configuring receive Gain
-        WriteRawRC( TReloadRegL, 30 );      //Describes the reinstallation value of a 16-bit timer
-        WriteRawRC ( TReloadRegH, 0 );
-        WriteRawRC ( TModeReg, 0x8D );	    //Internal timer setting
-        WriteRawRC ( TPrescalerReg, 0x3E );	//Internal timer setting
-        delay(1);
-        PcdAntennaOn ();                    //Open the antenna
+        ClearBitMask (pcd, Status2Reg, 0x08 );  //Contains status flags for receivers and transmitters
+        WriteRawRC (pcd, ModeReg, 0x3D );	    //Define common modes for sending and receiving
+        WriteRawRC (pcd, RxSelReg, 0x86 );      //Define received data
+        WriteRawRC(pcd, RFCfgReg, 0x6F );       //Configuring receive Gain
+        WriteRawRC(pcd, TReloadRegL, 30 );      //Describes the reinstallation value of a 16-bit timer
+        WriteRawRC (pcd, TReloadRegH, 0 );
+        WriteRawRC (pcd, TModeReg, 0x8D );	    //Internal timer setting
+        WriteRawRC (pcd, TPrescalerReg, 0x3E );	//Internal timer setting
+        if(pcd->tune != NULL)
+        {
+            RfTuneRestore(pcd);                 //Receiver and field as tuned for this site
+        }
+        PcdAntennaOn (pcd);                    //Open the antenna
     }
 }
 
 /////////////////////////////////////////////////////////////////////
-//function:Through RC522 and ISO14443 cartoon news
+//function:Wait until the cards of a field PcdAntennaOn switched on
+//         can answer
+/////////////////////////////////////////////////////////////////////
+static void PcdFieldWait(rc522_t *pcd)
+{
+    int left = (int)(pcd->field_us - micros());
+    pcd->field_wait = 0;
+    if(left > 0)
+    {
+		delayMicroseconds(left);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Start an exchange with the card and return at once
 //Parameters:Command[IN]:RC522 command word
 //           pInData[IN]:Data sent to the card via RC522
 //         InLenByte[IN]:Length of sent data in bytes
-//	       pOutData[OUT]:The received card returns data
-//	     pOutLenBit[OUT]:The bit length of the returned data
 //		     TimeOut[IN]:timeout
 /////////////////////////////////////////////////////////////////////
-unsigned char PcdComMF522_P(unsigned char Command, 
-							 unsigned char *pInData, 
-							 unsigned char InLenByte,
-							 unsigned char *pOutData, 
-							 unsigned int  *pOutLenBit,
-							 unsigned short TimeOut)
+void PcdComStart(rc522_t *pcd,unsigned char Command,
+                 unsigned char *pInData,
+                 unsigned char InLenByte,
+                 unsigned short TimeOut)
 {
-    unsigned char n,status;
-    unsigned int i;
+    unsigned char n;
+    pcd->com_halt = (pInData[0] == PICC_HALT);
+    if(pcd->field_wait)
+    {
+		PcdFieldWait(pcd);
+    }
+    STATS_MARK(pcd,t_com);
     delayMicrosecondsHard(100);
-    WriteRawRC(TPrescalerReg,0xFF);
-    WriteRawRC(TModeReg,0x87);		
-    WriteRawRC(TReloadRegL,(unsigned char)TimeOut); 
-    WriteRawRC(TReloadRegH,(unsigned char)(TimeOut>>8));
+    WriteRawRC(pcd,TPrescalerReg,0xFF);
+    WriteRawRC(pcd,TModeReg,0x87);		
+    WriteRawRC(pcd,TReloadRegL,(unsigned char)TimeOut); 
+    WriteRawRC(pcd,TReloadRegH,(unsigned char)(TimeOut>>8));
     delayMicrosecondsHard(10);
-    WriteRawRC(ComIrqReg,0x7F);
-    WriteRawRC(DivIrqReg,0x7F);
-    WriteRawRC(FIFOLevelReg,0x80);
-    SetBitMask(CommandReg,Command);
+    WriteRawRC(pcd,ComIrqReg,0x7F);
+    WriteRawRC(pcd,DivIrqReg,0x7F);
+    WriteRawRC(pcd,FIFOLevelReg,0x80);
+    SetBitMask(pcd,CommandReg,Command);
     delayMicrosecondsHard(1);
-    SetBitMask(ComIEnReg,0xA1);		
-    SetBitMask(DivlEnReg,0x00);		
+    SetBitMask(pcd,ComIEnReg,0xA1);		
     //-------------------------------
     for(n=0;n<InLenByte;n++)	
     {
-		WriteRawRC(FIFODataReg,pInData[n]);
+		WriteRawRC(pcd,FIFODataReg,pInData[n]);
 	}
-    SetBitMask(BitFramingReg,0x80);
-    while(1)
+    SetBitMask(pcd,BitFramingReg,0x80);
+    pcd->com_deadline = micros() + TimeOut*PCD_TIMER_TICK_US + PCD_WAIT_US;//From StartSend, a slow bus must not eat it
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Give up a command the chip never ended: neither an answer
+//         nor its timer came, it lost its setup or hangs
+/////////////////////////////////////////////////////////////////////
+void PcdStuck(rc522_t *pcd)
+{
+    WriteRawRC(pcd,CommandReg,PCD_IDLE);
+    pcd->com_answered = 0;
+    pcd->com_error = 0;
+    pcd->stuck++;
+    STATS_COUNT(pcd,STATS_CNT_STUCK);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Check whether the exchange started by PcdComStart is over
+//Parameters:pOutData[OUT]:The received card returns data
+//	       pOutLenBit[OUT]:The bit length of the returned data
+//	          pStatus[OUT]:Result of the exchange, as PcdComMF522_P,
+//                         MI_COM_ERR when the chip did not end it in time
+//return:1 when the exchange is over, 0 while the card is still answering
+/////////////////////////////////////////////////////////////////////
+unsigned char PcdComPoll(rc522_t *pcd,unsigned char *pOutData,unsigned int *pOutLenBit,unsigned char *pStatus)
+{
+    unsigned char n,status;
+    unsigned int i,now = micros();              //Before the read: a late poll must not look like a hang
+    n = ReadRawRC(pcd,ComIrqReg);
+    status = ReadRawRC(pcd,DivIrqReg);
+    if(!(n & 0x20) && !(n & 0x01))
     {
-		n = ReadRawRC(ComIrqReg);
-		status = ReadRawRC(DivIrqReg);
-		if(n & 0x20)
-			break;
-		if(n & 0x01)
-			break;
+		if((int)(now - pcd->com_deadline) < 0)
+		{
+			return 0;
+		}
+		PcdStuck(pcd);
+		STATS_SINCE(pcd,STATS_PH_TRANSCEIVE,t_com,MI_COM_ERR);
+		*pStatus = MI_COM_ERR;
+		return 1;
     }
     if(!(n&0x01))
     {
-		SetBitMask(ControlReg,0x90);
-		ClearBitMask(ComIEnReg,0x7F);
-		ClearBitMask(DivlEnReg,0xFF);
-		n = ReadRawRC(FIFOLevelReg);
-		ReadRawRC(ControlReg);
-		status = ReadRawRC(ErrorReg);
+		SetBitMask(pcd,ControlReg,0x90);
+		ClearBitMask(pcd,ComIEnReg,0x7F);
+		ClearBitMask(pcd,DivlEnReg,0xFF);
+		n = ReadRawRC(pcd,FIFOLevelReg);
+		status = ReadRawRC(pcd,ErrorReg);
+		STATS_ERROR(pcd,status);
+		pcd->com_answered = 1;
+		pcd->com_error = status;
+		if(pcd->tune != NULL)
+		{
+			RfTuneNote(pcd->tune,status);
+		}
 		for (i=0; i<n; i++)
 		{   
-			pOutData[i] = ReadRawRC(FIFODataReg);    
+			pOutData[i] = ReadRawRC(pcd,FIFODataReg);    
 		}
 		*pOutLenBit = n*8;
-		WriteRawRC(ComIrqReg,0x20);
+		WriteRawRC(pcd,ComIrqReg,0x20);
     }
     else
     {
-		ClearBitMask(ComIEnReg,0x7F);
-		ClearBitMask(DivlEnReg,0xFF);
-		if(pInData[0] == PICC_HALT)
+		ClearBitMask(pcd,ComIEnReg,0x7F);
+		ClearBitMask(pcd,DivlEnReg,0xFF);
+		if(pcd->com_halt)
 		{
-			ClearBitMask(ComIrqReg,0xFF);
-			return 0;	
+			ClearBitMask(pcd,ComIrqReg,0xFF);
+			STATS_SINCE(pcd,STATS_PH_TRANSCEIVE,t_com,MI_OK);
+			*pStatus = 0;
+			return 1;	
 		}
-		WriteRawRC(ComIrqReg,0x01);
+		STATS_COUNT(pcd,STATS_CNT_TIMEOUT);
+		pcd->com_answered = 0;
+		pcd->com_error = 0;
 		status = MI_TIMEOUT;
     }
-    WriteRawRC(DivIrqReg,0x00);
-    WriteRawRC(FIFOLevelReg,0x80);
-    WriteRawRC(ComIrqReg,0x01);
-    WriteRawRC(BitFramingReg,0x00);
+    WriteRawRC(pcd,DivIrqReg,0x00);
+    WriteRawRC(pcd,FIFOLevelReg,0x80);
+    WriteRawRC(pcd,ComIrqReg,0x01);
+    WriteRawRC(pcd,BitFramingReg,0x00);
+    STATS_SINCE(pcd,STATS_PH_TRANSCEIVE,t_com,status);
+    *pStatus = status;
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Through RC522 and ISO14443 cartoon news
+//Parameters:Command[IN]:RC522 command word
+//           pInData[IN]:Data sent to the card via RC522
+//         InLenByte[IN]:Length of sent data in bytes
+//	       pOutData[OUT]:The received card returns data
+//	     pOutLenBit[OUT]:The bit length of the returned data
+//		     TimeOut[IN]:timeout
+/////////////////////////////////////////////////////////////////////
+unsigned char PcdComMF522_P(rc522_t *pcd,unsigned char Command, 
+							 unsigned char *pInData, 
+							 unsigned char InLenByte,
+							 unsigned char *pOutData, 
+							 unsigned int  *pOutLenBit,
+							 unsigned short TimeOut)
+{
+    unsigned char status;
+    PcdComStart(pcd,Command,pInData,InLenByte,TimeOut);
+    while(!PcdComPoll(pcd,pOutData,pOutLenBit,&status))
+    {
+		if(pcd->poll_us)
+		{
+			PcdWaitRF(pcd);
+		}
+    }
     return status;
 }
 
+//Registers RC522_Init sets to other than their reset values, the bits
+//of each that read back as written, and what they read when set up.
+//RFCfgReg is left out, the RF tuner moves its RxGain around the reset value
+static const unsigned char PcdSignReg[] = {ModeReg,TxControlReg,TxAutoReg,RxSelReg};
+static const unsigned char PcdSignMask[] = {0xAB,0xFB,0x7F,0xFF};
+static const unsigned char PcdSignValue[] = {0x29,0x83,0x40,0x86};
+#define PCD_SIGN_REGS         (sizeof(PcdSignReg)/sizeof(PcdSignReg[0]))
+
+/////////////////////////////////////////////////////////////////////
+//function:Wait for the chip to come out of a reset: CommandReg reads
+//         its reset value, Idle with PowerDown cleared once the
+//         oscillator runs, instead of a fixed sleep
+//return:Successfully returns MI_OK, MI_COM_ERR after PCD_START_MS
+/////////////////////////////////////////////////////////////////////
+static unsigned char PcdStarted(rc522_t *pcd)
+{
+    unsigned int t0 = millis();
+    while((ReadRawRC(pcd,CommandReg) & 0x3F) != 0x20)//A chip in reset or a dead bus reads 0x00 or 0xFF
+    {
+		if(millis() - t0 >= PCD_START_MS)
+		{
+			return MI_COM_ERR;
+		}
+    }
+    return MI_OK;
+}
+
 /////////////////////////////////////////////////////////////////////
-//function:Initialize RC522
+//function:Reset the chip and set up its timer and modulation, the RF
+//         setup is left to M500PcdConfigISOType. Every wait on the chip
+//         gives up after PCD_START_MS
+//return:Successfully returns MI_OK, MI_COM_ERR when the chip does not start
 /////////////////////////////////////////////////////////////////////
-void RC522_Init()
+unsigned char PcdReset(rc522_t *pcd)
 {
     unsigned char Temp;
-    printf("RC522 RST:");	
-    macRC522_Reset_Disable();	
-    delay(10);
-    macRC522_Reset_Enable();	
-    delay(10);	
-    macRC522_Reset_Disable();	
-    delay(10);
-    WriteRawRC(CommandReg,PCD_RESETPHASE);  //Software reset
-    delay(10);
-    WriteRawRC(ControlReg,0x10);
-    WriteRawRC(ModeReg,0x3F);               //Define sending and receiving common modes and Mifare card messages, CRC initial value 0x6363
-    WriteRawRC(RFU23,0x00);
-    WriteRawRC(RFU25,0x80);
-    WriteRawRC(AutoTestReg,0x40);
-    WriteRawRC(TxAutoReg,0x40);             //The modulation sends a signal of 100%ASK
-    ReadRawRC(TxAutoReg); 
-    SetBitMask(TxControlReg,0x03);
-    WriteRawRC(TPrescalerReg,0x3D);         //Set the timer frequency division coefficient
-    WriteRawRC(TModeReg,0x0D);              //Define internal timer Settings
-    WriteRawRC(TReloadRegL,0x0A);           //Low value of 16-bit timer
-    WriteRawRC(TReloadRegH,0x00);           //High value of 16-bit timer
-    WriteRawRC(ComIrqReg,0x01);
-    SetBitMask(ControlReg,0x40);
+    unsigned int t0;
+    if(pcd->rst >= 0)
+    {
+		macRC522_Reset_Enable();                 //Hard power-down, 100 ns low are enough
+		delayMicrosecondsHard(1);
+		macRC522_Reset_Disable();	
+		if(PcdStarted(pcd) != MI_OK)
+		{
+			return MI_COM_ERR;
+		}
+    }
+    WriteRawRC(pcd,CommandReg,PCD_RESETPHASE);  //Software reset
+    pcd->shadow_valid = 0;                  //Every register is back to its reset value
+    if(PcdStarted(pcd) != MI_OK)
+    {
+		return MI_COM_ERR;
+    }
+    WriteRawRC(pcd,ControlReg,0x10);
+    WriteRawRC(pcd,ModeReg,0x3F);               //Define sending and receiving common modes and Mifare card messages, CRC initial value 0x6363
+    WriteRawRC(pcd,RFU23,0x00);
+    WriteRawRC(pcd,RFU25,0x80);
+    WriteRawRC(pcd,AutoTestReg,0x40);
+    WriteRawRC(pcd,TxAutoReg,0x40);             //The modulation sends a signal of 100%ASK
+    SetBitMask(pcd,TxControlReg,0x03);
+    WriteRawRC(pcd,TPrescalerReg,0x3D);         //Set the timer frequency division coefficient
+    WriteRawRC(pcd,TModeReg,0x0D);              //Define internal timer Settings
+    WriteRawRC(pcd,TReloadRegL,0x01);           //Low value of 16-bit timer, two 0.5 ms ticks show the clock runs
+    WriteRawRC(pcd,TReloadRegH,0x00);           //High value of 16-bit timer
+    WriteRawRC(pcd,ComIrqReg,0x01);
+    SetBitMask(pcd,ControlReg,0x40);
+    t0 = millis();
     do
     {
-		Temp = ReadRawRC(ComIrqReg);
+		Temp = ReadRawRC(pcd,ComIrqReg);
+    }
+    while(!(Temp&0x01) && millis() - t0 < PCD_START_MS);
+    if(!(Temp&0x01))
+    {
+		return MI_COM_ERR;                       //The timer never ran: no clock
+    }
+    WriteRawRC(pcd,ComIrqReg,0x01);
+    WriteRawRC(pcd,CommandReg,0x00);	
+    t0 = millis();
+    while( ReadRawRC(pcd,0x27) != 0x88)         //wait chip start ok
+    {
+		if(millis() - t0 >= PCD_START_MS)
+		{
+			return MI_COM_ERR;
+		}
+    }
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Take over a chip that RC522_Init set up before, e.g. when
+//         the daemon restarts: the signature registers must hold what
+//         RC522_Init writes, which differs from their reset values, so
+//         a chip that lost power or was reset does not pass. Stops what
+//         the last owner left running and writes the RF setup again;
+//         the field stays on, the cards in it keep their power
+//return:Successfully returns MI_OK, MI_ERR when the chip needs a reset
+/////////////////////////////////////////////////////////////////////
+static unsigned char PcdWarm(rc522_t *pcd)
+{
+    unsigned char v;
+    unsigned int i;
+    pcd->shadow_valid = 0;                       //Whatever the chip went through, the registers tell
+    v = ReadRawRC(pcd,VersionReg);
+    if(v == 0x00 || v == 0xFF || (ReadRawRC(pcd,CommandReg) & 0x10))
+    {
+		return MI_ERR;
+    }
+    for(i=0;i<PCD_SIGN_REGS;i++)
+    {
+		v = ReadRawRC(pcd,PcdSignReg[i]);
+		if((v & PcdSignMask[i]) != PcdSignValue[i])
+		{
+			return MI_ERR;
+		}
+		pcd->shadow[PcdSignReg[i]] = v;
+		pcd->shadow_valid |= PCD_SHADOW_REGS & (1ULL<<PcdSignReg[i]);
+    }
+    WriteRawRC(pcd,CommandReg,PCD_IDLE);
+    WriteRawRC(pcd,FIFOLevelReg,0x80);
+    if(pcd->tune != NULL)
+    {
+		RfTuneRestore(pcd);
+    }
+    else
+    {
+		RfTuneApply(pcd,NULL);                   //A tuned profile of the last owner is not this one's
+    }
+    return MI_OK;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Initialize RC522, or take it over as it is when it is set
+//         up already
+//return:Successfully returns MI_OK, MI_COM_ERR when the chip does not
+//       start; it is set up anyway so that a recovery can find it
+/////////////////////////////////////////////////////////////////////
+unsigned char RC522_Init(rc522_t *pcd)
+{
+    unsigned char status;
+    printf("RC522 RST:");	
+    pcd->warm = PcdWarm(pcd) == MI_OK;
+    if(pcd->warm)
+    {
+		printf("SKIPPED, set up already\r\n");
+		return MI_OK;
     }
-    while(!(Temp&0x01));	
-    WriteRawRC(ComIrqReg,0x01);
-    WriteRawRC(CommandReg,0x00);	
-    while( ReadRawRC(0x27) != 0x88)         //wait chip start ok
+    status = PcdReset(pcd);
+    printf(status == MI_OK ? "OK\r\n" : "FAIL\r\n");	
+    M500PcdConfigISOType (pcd,'A');
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Whether to send a failed command again. The retry policy
+//         decides, without one a silent REQA is sent twice and
+//         nothing else again
+//Parameters:phase[IN]:RETRY_*
+//         attempt[IN]:Attempts so far
+//              t0[IN]:micros() when the attempt started
+//return:Gap in us before the next attempt, -1 = done
+/////////////////////////////////////////////////////////////////////
+static int PcdRetry(rc522_t *pcd,unsigned char phase,unsigned char attempt,unsigned char status,unsigned int t0)
+{
+    if(pcd->retry != NULL)
     {
-		delay(10);
+		return RetryAgain(pcd,phase,attempt,status,t0);
     }
-    printf("OK\r\n");	
-    M500PcdConfigISOType ('A');
+    return (phase == RETRY_REQUEST && status == MI_TIMEOUT && attempt < 2) ? 5 : -1;
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -283,52 +549,61 @@ void RC522_Init()
 //              0x4403 = Mifare_DESFire
 //return:Successfully returns MI_OK
 /////////////////////////////////////////////////////////////////////
-unsigned char PcdRequest(unsigned char req_code,unsigned char *pTagType)
+unsigned char PcdRequest(rc522_t *pcd,unsigned char req_code,unsigned char *pTagType)
 {
     char status = 0;
     unsigned int  unLen = 0;
-    unsigned char ucComMF522Buf[MAXRLEN] = {0};
+    unsigned char *ucComMF522Buf = pcd->buf;
     char i=0;
-    if(fHasRATS != 1)
+    int gap;
+    unsigned int t0;
+    STATS_START(t);
+    if(pcd->retry != NULL)
     {
-		do
+		RetryTap(pcd->retry);                    //The tap budget starts here
+    }
+    if(pcd->fHasRATS != 1)
+    {
+		for(;;)
 		{
-			status = ReadRawRC(Status2Reg);	
-			WriteRawRC(Status2Reg,status&0xf7);	
-			WriteRawRC(CollReg,0x80);		
-			ClearBitMask(TxModeReg,0x80);	
-			ClearBitMask(RxModeReg,0x80);			
-			WriteRawRC(BitFramingReg,0x07); 
-			SetBitMask(TxControlReg,0x03);  
+			t0 = micros();
+			status = ReadRawRC(pcd,Status2Reg);	
+			WriteRawRC(pcd,Status2Reg,status&0xf7);	
+			WriteRawRC(pcd,CollReg,0x80);		
+			ClearBitMask(pcd,TxModeReg,0x80);	
+			ClearBitMask(pcd,RxModeReg,0x80);			
+			WriteRawRC(pcd,BitFramingReg,0x07); 
+			SetBitMask(pcd,TxControlReg,0x03);  
 			ucComMF522Buf[0] = req_code;
 			i++;
-			status = PcdComMF522_P(PCD_TRANSCEIVE,ucComMF522Buf,1,ucComMF522Buf,&unLen,0x0002);
-			if(i>=2)
+			status = PcdComMF522_P(pcd,PCD_TRANSCEIVE,ucComMF522Buf,1,ucComMF522Buf,&unLen,0x0002);
+			if((gap = PcdRetry(pcd,RETRY_REQUEST,i,status,t0)) < 0)
 			break;
-			delayMicrosecondsHard(5);
-		}while(status ==MI_TIMEOUT);
+			STATS_COUNT(pcd,STATS_CNT_RETRY);
+			delayMicrosecondsHard(gap);
+		}
     }
     else
     {
-		SetBitMask(TxModeReg,0x80);
-		SetBitMask(RxModeReg,0x80);
+		SetBitMask(pcd,TxModeReg,0x80);
+		SetBitMask(pcd,RxModeReg,0x80);
 		ucComMF522Buf[0] = 0xCA;
 		ucComMF522Buf[1] = 0x00;
-		status = PcdComMF522_P(PCD_TRANSCEIVE,ucComMF522Buf,2,ucComMF522Buf,&unLen,0x00F0);
+		status = PcdComMF522_P(pcd,PCD_TRANSCEIVE,ucComMF522Buf,2,ucComMF522Buf,&unLen,0x00F0);
 		//add below 3lines
-		status = ReadRawRC(Status2Reg);	
-		WriteRawRC(Status2Reg,status&0xf7);	
-		WriteRawRC(CollReg,0x80);		
-		ClearBitMask(TxModeReg,0x80);	
-		ClearBitMask(RxModeReg,0x80);	
-		WriteRawRC(BitFramingReg,0x07);	
+		status = ReadRawRC(pcd,Status2Reg);	
+		WriteRawRC(pcd,Status2Reg,status&0xf7);	
+		WriteRawRC(pcd,CollReg,0x80);		
+		ClearBitMask(pcd,TxModeReg,0x80);	
+		ClearBitMask(pcd,RxModeReg,0x80);	
+		WriteRawRC(pcd,BitFramingReg,0x07);	
 		//add 1 line
-		SetBitMask(TxControlReg,0x03);
+		SetBitMask(pcd,TxControlReg,0x03);
 		ucComMF522Buf[0] = req_code;
-		status = PcdComMF522_P(PCD_TRANSCEIVE,ucComMF522Buf,1,ucComMF522Buf,&unLen,0x0002);
+		status = PcdComMF522_P(pcd,PCD_TRANSCEIVE,ucComMF522Buf,1,ucComMF522Buf,&unLen,0x0002);
 		if(status == 0)
 		{
-			fHasRATS = 0;
+			pcd->fHasRATS = 0;
 		}
     }
     if ((status == MI_OK) && (unLen == 0x10))
@@ -340,32 +615,94 @@ unsigned char PcdRequest(unsigned char req_code,unsigned char *pTagType)
     {   
 		status = MI_ERR;  
     }
+    STATS_PHASE(pcd,STATS_PH_REQUEST,t,status);
     return status;
 }
 
+/////////////////////////////////////////////////////////////////////
+//function:Send a card request and return without waiting for the answer
+//         Lets a scheduler wait for the cards of several readers at once,
+//         finish with PcdRequestPoll. Single attempt, no RATS handling
+//Parameters:req_code[IN]:Find card way, as PcdRequest
+/////////////////////////////////////////////////////////////////////
+void PcdRequestStart(rc522_t *pcd,unsigned char req_code)
+{
+    unsigned char status;
+    STATS_MARK(pcd,t_req);
+    status = ReadRawRC(pcd,Status2Reg);
+    WriteRawRC(pcd,Status2Reg,status&0xf7);
+    WriteRawRC(pcd,CollReg,0x80);
+    ClearBitMask(pcd,TxModeReg,0x80);
+    ClearBitMask(pcd,RxModeReg,0x80);
+    WriteRawRC(pcd,BitFramingReg,0x07);
+    SetBitMask(pcd,TxControlReg,0x03);
+    PcdComStart(pcd,PCD_TRANSCEIVE,&req_code,1,0x0002);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Check for the answer to PcdRequestStart
+//Parameters:pTagType[OUT]:Card type code
+//            pStatus[OUT]:MI_OK when a card answered
+//return:1 when the request is over, 0 while waiting
+/////////////////////////////////////////////////////////////////////
+unsigned char PcdRequestPoll(rc522_t *pcd,unsigned char *pTagType,unsigned char *pStatus)
+{
+    unsigned int unLen = 0;
+    unsigned char *ucComMF522Buf = pcd->buf;
+    if(!PcdComPoll(pcd,ucComMF522Buf,&unLen,pStatus))
+    {
+		return 0;
+    }
+    if((*pStatus == MI_OK) && (unLen == 0x10))
+    {
+		*pTagType     = ucComMF522Buf[0];
+		*(pTagType+1) = ucComMF522Buf[1];
+    }
+    else
+    {
+		*pStatus = MI_ERR;
+    }
+    STATS_SINCE(pcd,STATS_PH_REQUEST,t_req,*pStatus);
+    return 1;
+}
+
 /////////////////////////////////////////////////////////////////////
 //function:Prevent a collision
 //Parameters:pSnr[OUT]:Card serial number, 4 bytes
 //return:Successfully returns MI_OK
 /////////////////////////////////////////////////////////////////////  
-unsigned char PcdAnticoll(unsigned char *pSnr)
+unsigned char PcdAnticoll(rc522_t *pcd,unsigned char *pSnr)
+{
+    return PcdAnticollLevel(pcd,PICC_ANTICOLL1,pSnr);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Prevent a collision on one cascade level
+//Parameters:level[IN]:Cascade level command word
+//                0x93 = Cascade level 1
+//                0x95 = Cascade level 2
+//                0x97 = Cascade level 3
+//          pSnr[OUT]:UID bytes of the level, 4 bytes (cascade tag 0x88 first if incomplete)
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////  
+static unsigned char PcdAnticollOnce(rc522_t *pcd,unsigned char level,unsigned char *pSnr)
 {
     unsigned char status;
     unsigned int  unLen;
-    unsigned char ucComMF522Buf[MAXRLEN];
+    unsigned char *ucComMF522Buf = pcd->buf;
     unsigned char i;
     unsigned char snr_check=0;    
-    ClearBitMask(TxModeReg,0x80);
-    ClearBitMask(RxModeReg,0x80);
-    WriteRawRC(CollReg,0x00);	
+    ClearBitMask(pcd,TxModeReg,0x80);
+    ClearBitMask(pcd,RxModeReg,0x80);
+    WriteRawRC(pcd,CollReg,0x00);	
     delayMicrosecondsHard(200);
-    WriteRawRC(BitFramingReg,0x00);
-    ucComMF522Buf[0] = PICC_ANTICOLL1;
+    WriteRawRC(pcd,BitFramingReg,0x00);
+    ucComMF522Buf[0] = level;
     ucComMF522Buf[1] = 0x20;
-    status = PcdComMF522_P(PCD_TRANSCEIVE,ucComMF522Buf,2,ucComMF522Buf,&unLen,0x0020);
+    status = PcdComMF522_P(pcd,PCD_TRANSCEIVE,ucComMF522Buf,2,ucComMF522Buf,&unLen,0x0020);
     delayMicrosecondsHard(100);
-    WriteRawRC(BitFramingReg,0x00);
-    WriteRawRC(CollReg,0x80);
+    WriteRawRC(pcd,BitFramingReg,0x00);
+    WriteRawRC(pcd,CollReg,0x80);
     if (status == MI_OK)
     {
 		for (i=0; i<4; i++)
@@ -381,20 +718,59 @@ unsigned char PcdAnticoll(unsigned char *pSnr)
     return status;
 }
 
+/////////////////////////////////////////////////////////////////////
+//function:Prevent a collision on one cascade level, sent again as
+//         long as the retry policy says so
+//Parameters:as PcdAnticollOnce
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char PcdAnticollLevel(rc522_t *pcd,unsigned char level,unsigned char *pSnr)
+{
+    unsigned char status,attempt = 0;
+    unsigned int t0;
+    int gap;
+    STATS_START(t);
+    for(;;)
+    {
+		t0 = micros();
+		status = PcdAnticollOnce(pcd,level,pSnr);
+		if((gap = PcdRetry(pcd,RETRY_ANTICOLL,++attempt,status,t0)) < 0)
+		{
+			break;
+		}
+		STATS_COUNT(pcd,STATS_CNT_RETRY);
+		delayMicroseconds(gap);
+    }
+    STATS_PHASE(pcd,STATS_PH_ANTICOLL,t,status);
+    return status;
+}
+
 /////////////////////////////////////////////////////////////////////
 //function:Selected card
 //Parameters:pSnr[IN]:Card serial number, 4 bytes
 //return:Successfully returns MI_OK
 /////////////////////////////////////////////////////////////////////
-unsigned char PcdSelect(unsigned char *pSnr)
+unsigned char PcdSelect(rc522_t *pcd,unsigned char *pSnr)
+{
+    return PcdSelectLevel(pcd,PICC_ANTICOLL1,pSnr,NULL);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Select the card on one cascade level
+//Parameters:level[IN]:Cascade level command word, 0x93/0x95/0x97
+//            pSnr[IN]:UID bytes of the level, 4 bytes
+//           pSak[OUT]:Select acknowledge, bit 0x04 set = UID not complete, may be NULL
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+static unsigned char PcdSelectOnce(rc522_t *pcd,unsigned char level,unsigned char *pSnr,unsigned char *pSak)
 {
     char status;
-    unsigned char ucComMF522Buf[MAXRLEN];
+    unsigned char *ucComMF522Buf = pcd->buf;
     unsigned char i;
     unsigned int  unLen;
-    SetBitMask(TxModeReg,0x80);
-    SetBitMask(RxModeReg,0x80);
-    ucComMF522Buf[0] = PICC_ANTICOLL1;
+    SetBitMask(pcd,TxModeReg,0x80);
+    SetBitMask(pcd,RxModeReg,0x80);
+    ucComMF522Buf[0] = level;
     ucComMF522Buf[1] = 0x70;
     ucComMF522Buf[6] = 0;
     for (i=0; i<4; i++)
@@ -402,10 +778,14 @@ unsigned char PcdSelect(unsigned char *pSnr)
     	ucComMF522Buf[i+2] = *(pSnr+i);
 		ucComMF522Buf[6]  ^= *(pSnr+i);
     }
-    status = PcdComMF522_P(PCD_TRANSCEIVE,ucComMF522Buf,7,ucComMF522Buf,&unLen,0x0010);
+    status = PcdComMF522_P(pcd,PCD_TRANSCEIVE,ucComMF522Buf,7,ucComMF522Buf,&unLen,0x0010);
     if ((status == MI_OK))
     {  
 		status = MI_OK;
+		if(pSak != NULL)
+		{
+			*pSak = ucComMF522Buf[0];
+		}
     }
     else
     {   
@@ -414,6 +794,124 @@ unsigned char PcdSelect(unsigned char *pSnr)
     return status; 
 }
 
+/////////////////////////////////////////////////////////////////////
+//function:Select the card on one cascade level, sent again as long
+//         as the retry policy says so
+//Parameters:as PcdSelectOnce
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char PcdSelectLevel(rc522_t *pcd,unsigned char level,unsigned char *pSnr,unsigned char *pSak)
+{
+    unsigned char status,attempt = 0;
+    unsigned int t0;
+    int gap;
+    STATS_START(t);
+    for(;;)
+    {
+		t0 = micros();
+		status = PcdSelectOnce(pcd,level,pSnr,pSak);
+		if((gap = PcdRetry(pcd,RETRY_SELECT,++attempt,status,t0)) < 0)
+		{
+			break;
+		}
+		STATS_COUNT(pcd,STATS_CNT_RETRY);
+		delayMicroseconds(gap);
+    }
+    STATS_PHASE(pcd,STATS_PH_SELECT,t,status);
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Anticollision and selection through every cascade level
+//         Single size UIDs (S50/S70) finish on level 1, double size
+//         UIDs (Mifare_UltraLight, NTAG) need level 2
+//Parameters:pUid[OUT]:Card UID, up to 10 bytes
+//           pLen[OUT]:UID length, 4, 7 or 10 bytes
+//           pSak[OUT]:Select acknowledge of the last level
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char PcdAnticollSelect(rc522_t *pcd,unsigned char *pUid,unsigned char *pLen,unsigned char *pSak)
+{
+    unsigned char status;
+    unsigned char level;
+    unsigned char snr[4];
+    unsigned char sak = 0;
+    *pLen = 0;
+    for(level=PICC_ANTICOLL1;level<=PICC_ANTICOLL3;level+=2)
+    {
+		status = PcdAnticollLevel(pcd,level,snr);
+		if(status != MI_OK)
+		{
+			return status;
+		}
+		status = PcdSelectLevel(pcd,level,snr,&sak);
+		if(status != MI_OK)
+		{
+			return status;
+		}
+		if(!(sak & 0x04))
+		{
+			memcpy(pUid+*pLen,snr,4);
+			*pLen += 4;
+			*pSak = sak;
+			return MI_OK;
+		}
+		memcpy(pUid+*pLen,snr+1,3);//Skip the cascade tag
+		*pLen += 3;
+    }
+    return MI_ERR;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Select a card whose full UID is already known, without anticollision
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length, 4, 7 or 10 bytes
+//          pSak[OUT]:Select acknowledge of the last level, may be NULL
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char PcdSelectUid(rc522_t *pcd,unsigned char *pUid,unsigned char len,unsigned char *pSak)
+{
+    unsigned char status;
+    unsigned char level = PICC_ANTICOLL1;
+    unsigned char snr[4];
+    if(len != 4 && len != 7 && len != 10)
+    {
+		return MI_ERR;
+    }
+    while(len > 4)
+    {
+		snr[0] = 0x88;//Cascade tag
+		memcpy(snr+1,pUid,3);
+		status = PcdSelectLevel(pcd,level,snr,NULL);
+		if(status != MI_OK)
+		{
+			return status;
+		}
+		pUid += 3;
+		len -= 3;
+		level += 2;
+    }
+    return PcdSelectLevel(pcd,level,pUid,pSak);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Check that a known card is still in the field
+//         Wakes the card with WUPA and selects it directly by its UID,
+//         which is much cheaper than a full request/anticollision cycle
+//Parameters:pUid[IN]:Card UID
+//            len[IN]:UID length, 4, 7 or 10 bytes
+//return:Card answered returns MI_OK
+/////////////////////////////////////////////////////////////////////
+unsigned char PcdWakeupSelect(rc522_t *pcd,unsigned char *pUid,unsigned char len)
+{
+    unsigned char ucTagType[2];
+    if(PcdRequest(pcd,PICC_REQALL,ucTagType) != MI_OK)
+    {
+		return MI_NOTAGERR;
+    }
+    return PcdSelectUid(pcd,pUid,len,NULL);
+}
+
 /////////////////////////////////////////////////////////////////////
 //function:Verify card password
 //Parameters: auth_mode[IN]:Password authentication mode
@@ -424,10 +922,11 @@ unsigned char PcdSelect(unsigned char *pSnr)
 //                 pSnr[IN]:Card serial number, 4 bytes
 //return:Successfully returns MI_OK
 /////////////////////////////////////////////////////////////////////               
-unsigned char PcdAuthState(unsigned char auth_mode,unsigned char addr,unsigned char *pKey,unsigned char *pSnr)
+unsigned char PcdAuthState(rc522_t *pcd,unsigned char auth_mode,unsigned char addr,unsigned char *pKey,unsigned char *pSnr)
 {
     unsigned char status;
-    unsigned char ucComMF522Buf[MAXRLEN]; 
+    unsigned char *ucComMF522Buf = pcd->buf;
+    STATS_START(t);
     switch(auth_mode)
     {
 		case 0x01:
@@ -442,13 +941,12 @@ unsigned char PcdAuthState(unsigned char auth_mode,unsigned char addr,unsigned c
     ucComMF522Buf[1] = addr;
     memcpy(&ucComMF522Buf[2], pKey, 6); 
     memcpy(&ucComMF522Buf[8], pSnr, 4);  
-    status =Opation_MF1Card(PCD_AUTHENT,ucComMF522Buf,12,0X0020);
+    status =Opation_MF1Card(pcd,PCD_AUTHENT,ucComMF522Buf,12,0X0020);
     if(status == MI_OK)
     {
-		status=ReadRawRC(Status2Reg);
-		if(status & 0x08)
-		status = MI_OK;
+		status = (ReadRawRC(pcd,Status2Reg) & 0x08) ? MI_OK : MI_ERR;//MFCrypto1On
     }
+    STATS_PHASE(pcd,STATS_PH_AUTH,t,status);
     return status;
 }
 
@@ -459,7 +957,7 @@ unsigned char PcdAuthState(unsigned char auth_mode,unsigned char addr,unsigned c
 //         InLenByte[IN]:Length of sent data in bytes
 //		     TimeOut[IN]:timeout
 /////////////////////////////////////////////////////////////////////
-unsigned char Opation_MF1Card(unsigned char Command, 
+unsigned char Opation_MF1Card(rc522_t *pcd,unsigned char Command, 
 							 unsigned char *pInData, 
 							 unsigned char InLenByte,
 							 unsigned short TimeOut)
@@ -468,8 +966,9 @@ unsigned char Opation_MF1Card(unsigned char Command,
     unsigned char waitFor ;
     unsigned char lastBits;
     unsigned char n;
-    unsigned int i;
+    unsigned int i,deadline,now;
     unsigned  status = MI_ERR;
+    STATS_START(t);
     switch (Command)
     {
 		case PCD_AUTHENT:
@@ -485,37 +984,46 @@ unsigned char Opation_MF1Card(unsigned char Command,
 			waitFor = 0x10;
 			break;
     }
-    WriteRawRC(TPrescalerReg,0xFF);
-    WriteRawRC(TModeReg,0x87);		
-    WriteRawRC(TReloadRegL,(unsigned char)TimeOut); 
-    WriteRawRC(TReloadRegH,(unsigned char)(TimeOut>>8));
-    WriteRawRC(ComIEnReg,irqEn|0x80);
-    ClearBitMask(ComIrqReg,0x80);
-    WriteRawRC(CommandReg,PCD_IDLE);
-    SetBitMask(FIFOLevelReg,0x80);
+    WriteRawRC(pcd,TPrescalerReg,0xFF);
+    WriteRawRC(pcd,TModeReg,0x87);		
+    WriteRawRC(pcd,TReloadRegL,(unsigned char)TimeOut); 
+    WriteRawRC(pcd,TReloadRegH,(unsigned char)(TimeOut>>8));
+    WriteRawRC(pcd,ComIEnReg,irqEn|0x80);
+    ClearBitMask(pcd,ComIrqReg,0x80);
+    WriteRawRC(pcd,CommandReg,PCD_IDLE);
+    SetBitMask(pcd,FIFOLevelReg,0x80);
     for (i=0; i<InLenByte; i++)
     {   
-		WriteRawRC(FIFODataReg, pInData[i]);    
+		WriteRawRC(pcd,FIFODataReg, pInData[i]);    
     }
-    WriteRawRC(CommandReg, Command);
+    WriteRawRC(pcd,CommandReg, Command);
     if (Command == PCD_TRANSCEIVE)
     {    
-		SetBitMask(BitFramingReg,0x80);  
+		SetBitMask(pcd,BitFramingReg,0x80);  
     }
     else
     {
-		SetBitMask(ControlReg,0x40);//start time 
+		SetBitMask(pcd,ControlReg,0x40);//start time 
     }
+    deadline = micros() + TimeOut*PCD_TIMER_TICK_US + PCD_WAIT_US;
     do 
     {
-         n = ReadRawRC(ComIrqReg);
+         now = micros();
+         n = ReadRawRC(pcd,ComIrqReg);
+    }
+    while ( !(n&0x01) && !(n&waitFor) && (int)(now - deadline) < 0);
+    if(!(n&0x01) && !(n&waitFor))
+    {
+		PcdStuck(pcd);
+		STATS_PHASE(pcd,STATS_PH_TRANSCEIVE,t,MI_COM_ERR);
+		return MI_COM_ERR;
     }
-    while ( !(n&0x01) && !(n&waitFor));
-    ClearBitMask(BitFramingReg,0x80); 
-    status = ReadRawRC(ErrorReg); 
+    ClearBitMask(pcd,BitFramingReg,0x80); 
+    status = ReadRawRC(pcd,ErrorReg); 
     if (!(n&0x01))	
     {
-		SetBitMask(ControlReg,0x80);//stop time   
+		STATS_ERROR(pcd,status);
+		SetBitMask(pcd,ControlReg,0x80);//stop time   
 		if(!(status&0x1B))
 		{
 			status = MI_OK;
@@ -525,8 +1033,8 @@ unsigned char Opation_MF1Card(unsigned char Command,
 			}
 			if (Command == PCD_TRANSCEIVE)
 			{
-				n = ReadRawRC(FIFOLevelReg);
-				lastBits = ReadRawRC(ControlReg) & 0x07;
+				n = ReadRawRC(pcd,FIFOLevelReg);
+				lastBits = ReadRawRC(pcd,ControlReg) & 0x07;
 				if (lastBits)
 				{   
 					InLenByte = (n-1)*8 + lastBits;   
@@ -537,7 +1045,7 @@ unsigned char Opation_MF1Card(unsigned char Command,
 				}
 				for (i=0; i<n; i++)
 				{   
-					pInData[i] = ReadRawRC(FIFODataReg);    
+					pInData[i] = ReadRawRC(pcd,FIFODataReg);    
 				}
 			}
 		}
@@ -546,7 +1054,13 @@ unsigned char Opation_MF1Card(unsigned char Command,
 			status = MI_ERR;   
 		}
     }
-    WriteRawRC(CommandReg,PCD_IDLE); 
+    else
+    {
+		STATS_COUNT(pcd,STATS_CNT_TIMEOUT);
+		status = MI_TIMEOUT;                     //ErrorReg is usually clear after a timeout, it must not read as MI_OK
+    }
+    WriteRawRC(pcd,CommandReg,PCD_IDLE); 
+    STATS_PHASE(pcd,STATS_PH_TRANSCEIVE,t,status);
     return status;
 }
 
@@ -556,16 +1070,17 @@ unsigned char Opation_MF1Card(unsigned char Command,
 //         pData[OUT]:Read data, 16 bytes
 //return:Successfully returns MI_OK
 ///////////////////////////////////////////////////////////////////// 
-unsigned char PcdRead(unsigned char addr,unsigned char *pData)
+unsigned char PcdRead(rc522_t *pcd,unsigned char addr,unsigned char *pData)
 {
     unsigned char status;
-    unsigned char ucComMF522Buf[MAXRLEN]; 
+    unsigned char *ucComMF522Buf = pcd->buf;
+    STATS_START(t);
     ucComMF522Buf[0] = PICC_READ;
     ucComMF522Buf[1] = addr;
-    SetBitMask(TxModeReg,0x80);//Enable tx crc generation during transmit
-    SetBitMask(RxModeReg,0x80);//Enable rx crc generation during recieve
+    SetBitMask(pcd,TxModeReg,0x80);//Enable tx crc generation during transmit
+    SetBitMask(pcd,RxModeReg,0x80);//Enable rx crc generation during recieve
     delayMicrosecondsHard(10);
-    status = Opation_MF1Card(PCD_TRANSCEIVE,ucComMF522Buf,2,0X0020);
+    status = Opation_MF1Card(pcd,PCD_TRANSCEIVE,ucComMF522Buf,2,0X0020);
     if ((status == MI_OK)) 
     {
 		memcpy(pData, ucComMF522Buf, 16);   
@@ -574,6 +1089,7 @@ unsigned char PcdRead(unsigned char addr,unsigned char *pData)
     {
 		status = MI_ERR; 
     }
+    STATS_PHASE(pcd,STATS_PH_READ,t,status);
     return status;
 }
 
@@ -583,95 +1099,47 @@ unsigned char PcdRead(unsigned char addr,unsigned char *pData)
 //          pData[IN]:Write data, 16 bytes
 //return:Successfully returns MI_OK
 /////////////////////////////////////////////////////////////////////                  
-unsigned char PcdWrite(unsigned char addr,unsigned char *pData)
+unsigned char PcdWrite(rc522_t *pcd,unsigned char addr,unsigned char *pData)
 {
     unsigned char status=0;
-    unsigned char ucComMF522Buf[MAXRLEN];
+    unsigned char *ucComMF522Buf = pcd->buf;
+    STATS_START(t);
+    pcd->write_gen++;
     ucComMF522Buf[0] = PICC_WRITE;
     ucComMF522Buf[1] = addr;
-    SetBitMask(TxModeReg,0x80);
-    SetBitMask(RxModeReg,0x80);
+    SetBitMask(pcd,TxModeReg,0x80);
+    SetBitMask(pcd,RxModeReg,0x80);
     delayMicrosecondsHard(10);   
-    status = Opation_MF1Card(PCD_TRANSCEIVE,ucComMF522Buf,2,0X0010);//Step A:To query the block status, the card should respond with 4 bits,1010
+    status = Opation_MF1Card(pcd,PCD_TRANSCEIVE,ucComMF522Buf,2,0X0010);//Step A:To query the block status, the card should respond with 4 bits,1010
     if((status == MI_OK) && ((ucComMF522Buf[0] &0x0F) == 0X0A))
     {
-    	status = Opation_MF1Card(PCD_TRANSCEIVE,pData,16,0X0020);//Step B: Write data
+    	status = Opation_MF1Card(pcd,PCD_TRANSCEIVE,pData,16,0X0020);//Step B: Write data
     }
     else
     {
 		status = MI_ERR;
     }
+    STATS_PHASE(pcd,STATS_PH_WRITE,t,status);
     return status;
 }
 
 /////////////////////////////////////////////////////////////////////
-//function:Read the UID of the S50 card and print the card number
-//         Read block 8 data and can change the first 4 bytes of data by keyboard input
+//function:Put the selected card into HALT state
+//         A halted card only answers WUPA, so it is not found again by
+//         PICC_REQIDL until it has left the field
+//return:Successfully returns MI_OK
 /////////////////////////////////////////////////////////////////////
-void ReadIDData()
+unsigned char PcdHalt(rc522_t *pcd)
 {
-    unsigned char i,a,b,ret;
-    unsigned char ucStatusReturn = MI_ERR;           
-    unsigned char bFind = 0;
-    if((ucStatusReturn = PcdRequest(PICC_REQIDL,CT)) != MI_OK) //寻卡
-	ucStatusReturn = PcdRequest(PICC_REQIDL,CT);//再寻卡
-    if(ucStatusReturn != MI_OK)  //防止连续打卡                    
-	bFind = 0;	
-    if((ucStatusReturn == MI_OK) && (bFind == 0))
-    {
-		if(PcdAnticoll(SN) == MI_OK) //防止冲撞
-		{
-			delay(250);//等待卡片放置稳定
-			if(PcdSelect(SN) == MI_OK)//选定卡片
-			{
-				printf("Card ID:");
-				for(i=0;i<4;i++)
-				{
-					printf("%d",SN[i]);
-				}
-				printf("\r\n");
-				softPwmWrite(PWM,9);
-				delay(100);
-				softPwmWrite(PWM,0);
-				LED_Enable();
-				delay(100);
-				LED_Disable();
-				if(PcdAuthState(C_A,8,sec,SN) == MI_OK)//验证密码
-				{
-					printf("Read block data\n");
-					PcdRead(8,blockdata1);//读取块8数据
-					printf("block_8=[ ");
-					for(a=0;a<16;a++)
-					{
-						printf("%02X ",blockdata1[a]);
-					}
-					printf("]\n");
-					printf("Please enter the first 4 bytes of block data on the keyboard\n");
-					for(b=0;b<4;b++)
-					{
-						printf("input %d:",b);
-						ret=scanf("%X", (unsigned int*)&blockdata1[b]);
-						while(ret!=1)
-						{
-							printf("Input error, please re-enter\n");
-							while(getchar()!='\n');
-							ret=scanf("%X", (unsigned int*)&blockdata1[b]);
-						}
-					}					
-					PcdWrite(8,blockdata1);
-					printf("Read block data again\n");
-					PcdRead(8,blockdata1);//读取块8数据
-					printf("block_8=[ ");
-					for(a=0;a<16;a++)
-					{
-						printf("%02X ",blockdata1[a]);
-					}
-					printf("]\n");		
-					printf("----------------------------------\n");	
-					delay(1000);			
-				}
-			}
-		}
-    }
+    unsigned int  unLen;
+    unsigned char *ucComMF522Buf = pcd->buf;
+    unsigned char status;
+    STATS_START(t);
+    ucComMF522Buf[0] = PICC_HALT;
+    ucComMF522Buf[1] = 0;
+    SetBitMask(pcd,TxModeReg,0x80);
+    SetBitMask(pcd,RxModeReg,0x80);
+    status = PcdComMF522_P(pcd,PCD_TRANSCEIVE,ucComMF522Buf,2,ucComMF522Buf,&unLen,0x0010);//The card does not answer HALT
+    STATS_PHASE(pcd,STATS_PH_HALT,t,status);
+    return status;
 }
-
@@ -0,0 +1,835 @@
+/***************************************************************************************
+ * Project  :rc522 driver benchmark
+ * Describe :Runs the standard scenarios against the reader on /dev/ttyS0, the HAT or the
+ *			 chip model of ../emu (make EMU=1), and reports per logical operation the latency
+ *			 percentiles, throughput, register reads/writes, syscalls and CPU time.
+ *			 init       RC522_Init of a chip at its reset values, cold start
+ *			 restart    RC522_Init of a chip set up already, warm start of a new process
+ *			 cold       RF field off, then field on to UID: REQA, anticollision, SELECT
+ *			 warm       a halted card of known UID: WUPA and SELECT
+ *			 dump       the 64 blocks of a Mifare_One 1K, one authentication per sector
+ *			 cached     the same dump of a card left on the reader, through the card cache
+ *			            with its keepalive: the first run fills it, the others hit
+ *			 write      the 3 data blocks of a sector, written back with what they hold
+ *			 inventory  every card of the field: REQA, anticollision, SELECT, HALT
+ *			 idle       one poll of an empty field: REQA
+ *			 recover    reset of a failed chip by the health monitor, until it is set up again
+ *			 threads    taps on 1, then 2 readers polled by MrStart(MR_MODE_THREADS) of
+ *			            multireader.h: a card placed on every reader at once, until all
+ *			            arrivals are reported and the readers are empty again; units/s
+ *			            are taps/s, one row per number of readers
+ *			 interleaved the same with MrStart(MR_MODE_INTERLEAVED)
+ *			            (both emulator only, it places the cards; they run on its wall
+ *			            clock, the virtual one would add up the waits of the threads)
+ *			 The bus is counted by wrapping the wiringPi calls of the driver at link time
+ *			 (-Wl,--wrap), latency comes from micros(), the virtual clock of the emulator.
+ *			 Results are JSON Lines, -c compares them with a saved run. Built with
+ *			 make STATS=1 it also shows the phase histograms of the driver. -R runs the
+ *			 scenarios under the retry policy of retry.h instead of the fixed retries.
+ * Usage    :rc522_bench [-s scenarios] [-n runs] [-N cards] [-S sector] [-k keyA]
+ *			 [-o results.jsonl] [-c baseline.jsonl] [-t tolerance%] [-R persist[,budget_us]]
+***************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <wiringPi.h>
+#include <wiringSerial.h>
+#include "rc522.h"
+#include "retry.h"
+#include "health.h"
+#include "card_cache.h"
+#include "presence.h"
+#include "multireader.h"
+#ifdef RC522_EMU
+#include "rc522_emu.h"
+#define BENCH_EMULATED        1
+#define BENCH_EMU_SCENARIOS   ",threads,interleaved"//Default scenarios that need the emulator to place the cards
+#else
+#define BENCH_EMULATED        0
+#define BENCH_EMU_SCENARIOS   ""
+#endif
+
+#define BENCH_TRANSPORT       "uart"
+#define BENCH_POLLS           20                 //Card requests of a cold detect before it counts as missed
+#define BENCH_CARDS_MAX       16                 //Inventory stops after that many cards
+#define BENCH_LINE            512
+#define BENCH_READERS         2                  //Multi-reader scenarios run with 1..BENCH_READERS readers
+#define BENCH_MULTI_US        20000000           //Wall time a multi-reader scenario may take per number of readers
+#define BENCH_TAP_US          5000000            //A tap not reported by then is missed, a poll takes 0.3 s at 9600 baud
+
+typedef struct
+{
+    unsigned char uid[10];
+    unsigned char len;
+    unsigned char sak;
+} bench_card_t;
+
+typedef struct
+{
+    const char *name;
+    unsigned int cards;                          //Cards in the field
+    unsigned int n;                              //Runs
+    unsigned int ok;
+    unsigned long long units;                    //Blocks or cards moved by the successful runs
+    unsigned int *lat;                           //Latency of each run, us
+    unsigned long long reads,writes,syscalls;
+    unsigned long long hits;                     //Blocks the card cache served without RF
+    double cpu_us;
+    //Snapshot of the run in progress
+    unsigned long long r0,w0,s0;
+    unsigned int t0;
+    double c0;
+} bench_result_t;
+
+//Bus traffic of the driver, counted by the __wrap_ functions
+static struct
+{
+    unsigned long long reads;
+    unsigned long long writes;
+    unsigned long long syscalls;
+} BenchBus;
+
+/////////////////////////////////////////////////////////////////////
+//Transport: /dev/ttyS0. A register read is its address with the MSB
+//set, a write the address and then the value; every call is a syscall
+/////////////////////////////////////////////////////////////////////
+void __real_serialPutchar(const int fd,const unsigned char c);
+void __wrap_serialPutchar(const int fd,const unsigned char c)
+{
+    static int value;                            //The byte after a write address is its value
+    if(value)
+    {
+		value = 0;
+    }
+    else if(c & 0x80)
+    {
+		BenchBus.reads++;
+    }
+    else
+    {
+		BenchBus.writes++;
+		value = 1;
+    }
+    BenchBus.syscalls++;
+    __real_serialPutchar(fd,c);
+}
+
+int __real_serialGetchar(const int fd);
+int __wrap_serialGetchar(const int fd)
+{
+    BenchBus.syscalls++;
+    return __real_serialGetchar(fd);
+}
+
+int __real_serialDataAvail(const int fd);
+int __wrap_serialDataAvail(const int fd)
+{
+    BenchBus.syscalls++;
+    return __real_serialDataAvail(fd);
+}
+
+void __real_serialFlush(const int fd);
+void __wrap_serialFlush(const int fd)
+{
+    BenchBus.syscalls++;
+    __real_serialFlush(fd);
+}
+
+static int BenchOpen(rc522_t *pcd)
+{
+    int fd = serialOpen("/dev/ttyS0",9600);
+    if(fd == -1)
+    {
+		printf("init serial error!\n");
+		return -1;
+    }
+    pinMode(Res,OUTPUT);
+    PcdInit(pcd,fd,Res);
+    return 0;
+}
+
+#ifdef RC522_EMU
+//Second reader of the multi-reader scenarios: on the second UART, reset together with the first
+static int BenchOpenSecond(void)
+{
+    return serialOpen("/dev/ttyAMA1",9600);
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+//delay() is a nanosleep
+/////////////////////////////////////////////////////////////////////
+void __real_delay(unsigned int howLong);
+void __wrap_delay(unsigned int howLong)
+{
+    BenchBus.syscalls++;
+    __real_delay(howLong);
+}
+
+//Keeps the messages of RC522_Init out of the table, and their cost out of the timing
+static void BenchQuiet(int on)
+{
+    static int saved = -1;
+    int fd;
+    fflush(stdout);
+    if(on && saved < 0 && (fd = open("/dev/null",O_WRONLY)) >= 0)
+    {
+		saved = dup(1);
+		dup2(fd,1);
+		close(fd);
+    }
+    else if(!on && saved >= 0)
+    {
+		dup2(saved,1);
+		close(saved);
+		saved = -1;
+    }
+}
+
+static double BenchCpuUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+static void BenchStart(bench_result_t *r)
+{
+    r->r0 = BenchBus.reads;
+    r->w0 = BenchBus.writes;
+    r->s0 = BenchBus.syscalls;
+    r->c0 = BenchCpuUs();
+    r->t0 = micros();
+}
+
+static void BenchStop(bench_result_t *r,int ok,unsigned int units)
+{
+    unsigned int t = micros();
+    r->cpu_us += BenchCpuUs() - r->c0;
+    r->lat[r->n++] = t - r->t0;
+    r->reads += BenchBus.reads - r->r0;
+    r->writes += BenchBus.writes - r->w0;
+    r->syscalls += BenchBus.syscalls - r->s0;
+    if(ok)
+    {
+		r->ok++;
+		r->units += units;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Load the cards of a scenario into the emulated field,
+//         unless RC522_EMU_CARDS/RC522_EMU_SCRIPT brought their own
+/////////////////////////////////////////////////////////////////////
+static void BenchCards(unsigned int cards)
+{
+#ifdef RC522_EMU
+    char text[BENCH_CARDS_MAX*32] = "";
+    unsigned int i,len = 0;
+    if(getenv("RC522_EMU_CARDS") != NULL || getenv("RC522_EMU_SCRIPT") != NULL)
+    {
+		return;
+    }
+    for(i=0;i<cards && i<BENCH_CARDS_MAX;i++)
+    {
+		len += snprintf(text+len,sizeof(text)-len,"card classic1k %08X;",0xDEADBEEFu+i*0x01010101u);
+    }
+    EmuCardsClear();
+    EmuScript(text);
+#else
+    (void)cards;                                 //The cards of the real field stay where they are
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Power the field up again and select the first card, up to
+//         BENCH_POLLS times in a noisy field
+//return:Successfully returns MI_OK
+/////////////////////////////////////////////////////////////////////
+static unsigned char BenchFind(rc522_t *pcd,bench_card_t *card)
+{
+    unsigned char atqa[2];
+    unsigned int i;
+    for(i=0;i<BENCH_POLLS;i++)
+    {
+		PcdAntennaOff(pcd);
+		PcdAntennaOn(pcd);
+		if(PcdRequest(pcd,PICC_REQALL,atqa) == MI_OK && PcdAnticollSelect(pcd,card->uid,&card->len,&card->sak) == MI_OK)
+		{
+			return MI_OK;
+		}
+    }
+    return MI_NOTAGERR;
+}
+
+#ifdef RC522_EMU
+typedef struct
+{
+    unsigned int arrived;
+    unsigned int t;                              //micros() of the last arrival
+} bench_taps_t;
+
+//Called from the reader threads in threads mode
+static void BenchMultiEvent(unsigned char reader,unsigned char evt,presence_t *pres,void *arg)
+{
+    bench_taps_t *e = (bench_taps_t *)arg;
+    (void)reader;
+    (void)pres;
+    if(evt == PRES_EVT_ARRIVED)
+    {
+		__atomic_store_n(&e->t,micros(),__ATOMIC_RELAXED);
+		__atomic_add_fetch(&e->arrived,1,__ATOMIC_RELEASE);
+    }
+}
+
+//Waits on the wall clock, the scheduler threads poll meanwhile
+static void BenchNap(void)
+{
+    struct timespec ts = {0,100000};
+    nanosleep(&ts,NULL);
+}
+
+static int BenchEmpty(mr_sched_t *sched)
+{
+    unsigned int i;
+    for(i=0;i<sched->count;i++)
+    {
+		if(__atomic_load_n(&sched->reader[i].pres.state,__ATOMIC_RELAXED) != PRES_ABSENT)
+		{
+			return 0;
+		}
+    }
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Multi-reader scenarios: MrStart the readers, place a card on
+//         each of them at once and wait until every arrival is reported,
+//         then take the cards away until the readers are empty again
+//Parameters:mode[IN]:MR_MODE_THREADS or MR_MODE_INTERLEAVED
+//        readers[IN]:1..BENCH_READERS
+//return:Successfully returns 0, -1 = no second reader or no thread
+/////////////////////////////////////////////////////////////////////
+static int BenchMulti(rc522_t *pcd,bench_result_t *r,unsigned int runs,unsigned char mode,unsigned int readers)
+{
+    mr_sched_t sched;
+    bench_taps_t e = {0,0};
+    char text[BENCH_READERS*48];
+    unsigned int i,k,len,t,start;
+    int fd = -1;
+    if(readers > 1 && (fd = BenchOpenSecond()) < 0)
+    {
+		return -1;
+    }
+    MrInit(&sched,BenchMultiEvent,&e);
+    BenchQuiet(1);
+    MrAddReader(&sched,pcd->fd,pcd->rst);
+    if(readers > 1)
+    {
+		MrAddReader(&sched,fd,-1);
+    }
+    BenchQuiet(0);
+    EmuCardsClear();
+    EmuSetRealtime(1);
+    if(MrStart(&sched,mode) != 0)
+    {
+		EmuSetRealtime(0);
+		return -1;
+    }
+    start = micros();
+    for(i=0;i<runs && micros()-start < BENCH_MULTI_US;i++)
+    {
+		for(k=0,len=0;k<readers;k++)
+		{
+			len += snprintf(text+len,sizeof(text)-len,"card classic1k %08X reader=%u;",0xDEADBEEFu+i*BENCH_READERS+k,k);
+		}
+		__atomic_store_n(&e.arrived,0,__ATOMIC_RELAXED);
+		BenchStart(r);
+		EmuScript(text);
+		while(__atomic_load_n(&e.arrived,__ATOMIC_ACQUIRE) < readers && micros()-r->t0 < BENCH_TAP_US)
+		{
+			BenchNap();
+		}
+		t = __atomic_load_n(&e.t,__ATOMIC_RELAXED);
+		BenchStop(r,e.arrived == readers,readers);
+		if(e.arrived == readers)
+		{
+			r->lat[r->n-1] = t - r->t0;          //Not the end of the last nap
+		}
+		EmuCardsClear();
+		for(t=micros();!BenchEmpty(&sched) && micros()-t < BENCH_TAP_US;)
+		{
+			BenchNap();
+		}
+    }
+    MrStop(&sched);
+    EmuSetRealtime(0);
+    return 0;
+}
+#endif
+
+//Crypto1 uses the last 4 UID bytes
+static unsigned char BenchAuth(rc522_t *pcd,const bench_card_t *card,unsigned char block,unsigned char *key)
+{
+    return PcdAuthState(pcd,C_A,block,key,(unsigned char *)card->uid+card->len-4);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Run one scenario
+//Parameters:r[OUT]:Result, r->lat holds room for runs samples
+//return:Successfully returns 0, -1 = no card to run it on
+/////////////////////////////////////////////////////////////////////
+static int BenchRun(rc522_t *pcd,bench_result_t *r,unsigned int runs,unsigned int cards,unsigned char sector,unsigned char *key)
+{
+    bench_card_t card,found;
+    health_t health;
+    card_cache_t cache;
+    unsigned char atqa[2],data[3][16];
+    unsigned int i,j,k,n;
+    int ok;
+    r->cards = !strcmp(r->name,"inventory") ? cards : !strcmp(r->name,"idle") || !strcmp(r->name,"recover") ? 0 : 1;
+    BenchCards(r->cards);
+    if(!strcmp(r->name,"init") || !strcmp(r->name,"restart"))
+    {
+		BenchQuiet(1);
+		RC522_Init(pcd);
+		for(i=0;i<runs;i++)
+		{
+			if(!strcmp(r->name,"init"))
+			{
+				WriteRawRC(pcd,CommandReg,PCD_RESETPHASE);//Registers back to reset values, nothing to take over
+			}
+			BenchStart(r);
+			ok = RC522_Init(pcd) == MI_OK;
+			BenchStop(r,ok,0);
+		}
+		BenchQuiet(0);
+		return 0;
+    }
+    if(!strcmp(r->name,"idle"))
+    {
+		for(i=0;i<runs;i++)
+		{
+			BenchStart(r);
+			ok = PcdRequest(pcd,PICC_REQIDL,atqa) != MI_OK;
+			BenchStop(r,ok,1);
+		}
+		return 0;
+    }
+    if(!strcmp(r->name,"threads") || !strcmp(r->name,"interleaved"))
+    {
+		r->cards = cards;                        //Number of readers, one card on each
+#ifdef RC522_EMU
+		return BenchMulti(pcd,r,runs,!strcmp(r->name,"threads") ? MR_MODE_THREADS : MR_MODE_INTERLEAVED,cards);
+#else
+		return -1;
+#endif
+    }
+    if(!strcmp(r->name,"recover"))
+    {
+		HealthInit(&health,0,0);
+		if(HealthAttach(pcd,&health) != MI_OK)
+		{
+			return -1;
+		}
+		for(i=0;i<runs;i++)
+		{
+			BenchStart(r);
+			ok = HealthRecover(pcd,&health) == MI_OK;
+			BenchStop(r,ok,1);
+		}
+		return 0;
+    }
+    if(strcmp(r->name,"inventory") && BenchFind(pcd,&card) != MI_OK)//Inventory counts whatever is there
+    {
+		return -1;
+    }
+    if(!strcmp(r->name,"write"))//Keep what the blocks hold, the run writes it back
+    {
+		if(BenchAuth(pcd,&card,sector*4,key) != MI_OK)
+		{
+			return -1;
+		}
+		for(j=0;j<3;j++)
+		{
+			if(PcdRead(pcd,sector*4+j,data[j]) != MI_OK)
+			{
+				return -1;
+			}
+		}
+    }
+    if(!strcmp(r->name,"cached"))
+    {
+		CacheInit(&cache,pcd);
+		CacheSetKey(&cache,C_A,key);
+		CacheCardPresent(&cache,card.uid,card.len);
+    }
+    for(i=0;i<runs;i++)
+    {
+		if(!strcmp(r->name,"cold"))
+		{
+			PcdAntennaOff(pcd);                  //The card loses power as if it had left
+			BenchStart(r);
+			PcdAntennaOn(pcd);
+			for(j=0;j<BENCH_POLLS && PcdRequest(pcd,PICC_REQIDL,atqa) != MI_OK;j++);
+			ok = j < BENCH_POLLS && PcdAnticollSelect(pcd,found.uid,&found.len,&found.sak) == MI_OK;
+			BenchStop(r,ok,1);
+		}
+		else if(!strcmp(r->name,"warm"))
+		{
+			PcdHalt(pcd);
+			BenchStart(r);
+			ok = PcdWakeupSelect(pcd,card.uid,card.len) == MI_OK;
+			BenchStop(r,ok,1);
+		}
+		else if(!strcmp(r->name,"dump"))
+		{
+			PcdHalt(pcd);
+			PcdWakeupSelect(pcd,card.uid,card.len);
+			BenchStart(r);
+			for(ok=1,k=0;k<64 && ok;k++)
+			{
+				ok = (k%4 || BenchAuth(pcd,&card,k,key) == MI_OK) && PcdRead(pcd,k,data[0]) == MI_OK;
+			}
+			BenchStop(r,ok,64);
+		}
+		else if(!strcmp(r->name,"cached"))
+		{
+			BenchStart(r);
+			ok = CacheKeepalive(&cache,card.uid,card.len) == MI_OK;//A WUPA+SELECT when due, CacheRead authenticates again
+			for(k=0;k<64 && ok;k++)
+			{
+				ok = CacheRead(&cache,card.uid,card.len,k,data[0]) == MI_OK;
+			}
+			BenchStop(r,ok,64);
+		}
+		else if(!strcmp(r->name,"write"))
+		{
+			PcdHalt(pcd);
+			PcdWakeupSelect(pcd,card.uid,card.len);
+			BenchStart(r);
+			ok = BenchAuth(pcd,&card,sector*4,key) == MI_OK;
+			for(j=0;j<3 && ok;j++)
+			{
+				ok = PcdWrite(pcd,sector*4+j,data[j]) == MI_OK;
+			}
+			BenchStop(r,ok,3);
+		}
+		else if(!strcmp(r->name,"inventory"))
+		{
+			PcdAntennaOff(pcd);                  //Every card back to IDLE
+			PcdAntennaOn(pcd);
+			BenchStart(r);
+			for(n=0;n<BENCH_CARDS_MAX && PcdRequest(pcd,PICC_REQIDL,atqa) == MI_OK;n++)
+			{
+				if(PcdAnticollSelect(pcd,found.uid,&found.len,&found.sak) != MI_OK)
+				{
+					break;
+				}
+				PcdHalt(pcd);
+			}
+			BenchStop(r,n == cards,n);
+		}
+    }
+    if(!strcmp(r->name,"cached"))
+    {
+		r->hits = cache.hits;
+    }
+    return 0;
+}
+
+#ifdef RC522_STATS
+//Where the time of a scenario went, from the histograms of the driver (make STATS=1)
+static void BenchPhases(const rc522_t *pcd)
+{
+    static rc522_stats_t snap;
+    unsigned char p;
+    StatsSnapshot(pcd,&snap);
+    for(p=0;p<STATS_PHASES;p++)
+    {
+		if(snap.phase[p].count)
+		{
+			printf("  %-10s %8lu calls %6lu failed   p50 %6lu us   p99 %6lu us   max %6lu us\n",StatsPhaseName(p),
+				   snap.phase[p].count,snap.phase[p].failed,StatsPercentile(&snap.phase[p],0.5),
+				   StatsPercentile(&snap.phase[p],0.99),snap.phase[p].max_us);
+		}
+    }
+    for(p=0;p<STATS_COUNTERS;p++)
+    {
+		if(snap.counter[p])
+		{
+			printf("  %-10s %8lu\n",StatsCounterName(p),snap.counter[p]);
+		}
+    }
+}
+#endif
+
+static int BenchCmp(const void *a,const void *b)
+{
+    unsigned int x = *(const unsigned int *)a,y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+//Nearest rank percentile of sorted samples
+static unsigned int BenchPercentile(const bench_result_t *r,double p)
+{
+    unsigned int i = (unsigned int)(p*r->n + 0.999999);
+    return r->lat[i ? i-1 : 0];
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Format a result as one JSON line, r->lat sorted
+/////////////////////////////////////////////////////////////////////
+static void BenchLine(const bench_result_t *r,char *line,int size)
+{
+    unsigned long long sum = 0;
+    unsigned int i;
+    double n = r->n;
+    for(i=0;i<r->n;i++)
+    {
+		sum += r->lat[i];
+    }
+    snprintf(line,size,"{\"transport\":\"%s\",\"emulated\":%d,\"scenario\":\"%s\",\"cards\":%u,\"n\":%u,\"ok\":%u,\"ok_rate\":%.4f,"
+			 "\"p50_us\":%u,\"p99_us\":%u,\"p999_us\":%u,\"max_us\":%u,\"mean_us\":%.1f,\"ops_s\":%.1f,\"units_s\":%.1f,"
+			 "\"reg_reads\":%.1f,\"reg_writes\":%.1f,\"syscalls\":%.1f,\"cpu_us\":%.1f,\"cache_hits\":%llu}",
+			 BENCH_TRANSPORT,BENCH_EMULATED,r->name,r->cards,r->n,r->ok,r->ok/n,BenchPercentile(r,0.50),BenchPercentile(r,0.99),BenchPercentile(r,0.999),
+			 r->lat[r->n-1],sum/n,sum ? r->ok*1e6/sum : 0.0,sum ? r->units*1e6/sum : 0.0,
+			 r->reads/n,r->writes/n,r->syscalls/n,r->cpu_us/n,r->hits);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Value of a key in one of our JSON lines
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+static int BenchField(const char *line,const char *key,double *v)
+{
+    char pat[32];
+    const char *p;
+    snprintf(pat,sizeof(pat),"\"%s\":",key);
+    if((p = strstr(line,pat)) == NULL)
+    {
+		return -1;
+    }
+    *v = strtod(p+strlen(pat),NULL);
+    return 0;
+}
+
+static int BenchString(const char *line,const char *key,char *s,int size)
+{
+    char pat[32];
+    const char *p,*e;
+    snprintf(pat,sizeof(pat),"\"%s\":\"",key);
+    if((p = strstr(line,pat)) == NULL || (e = strchr(p += strlen(pat),'"')) == NULL || e-p >= size)
+    {
+		return -1;
+    }
+    memcpy(s,p,e-p);
+    s[e-p] = '\0';
+    return 0;
+}
+
+//Table row of a result, from its JSON line; the multi-reader ones named with their number of readers
+static void BenchRow(const bench_result_t *r,const char *line)
+{
+    static const char *Col[] = {"p50_us","p99_us","p999_us","ops_s","units_s","reg_reads","reg_writes","syscalls","cpu_us"};
+    char name[24];
+    double v[9];
+    unsigned int i;
+    for(i=0;i<9;i++)
+    {
+		BenchField(line,Col[i],&v[i]);
+    }
+    if(!strcmp(r->name,"threads") || !strcmp(r->name,"interleaved"))
+    {
+		snprintf(name,sizeof(name),"%s/%u",r->name,r->cards);
+    }
+    else
+    {
+		snprintf(name,sizeof(name),"%s",r->name);
+    }
+    printf("%-13s %6u %6u %8.0f %8.0f %8.0f %9.1f %9.1f %7.1f %7.1f %7.1f %8.1f\n",name,r->n,r->ok,
+		   v[0],v[1],v[2],v[3],v[4],v[5],v[6],v[7],v[8]);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Compare a result with the same transport, scenario and
+//         number of cards of a baseline file
+//Parameters:tol[IN]:Change in percent still counted as noise
+//return:Number of metrics that got worse by more than tol
+/////////////////////////////////////////////////////////////////////
+static int BenchCompare(FILE *base,const char *line,double tol)
+{
+    static const struct
+    {
+		const char *key;
+		int higher;                              //Higher is better
+    } Metric[] = {{"ok_rate",1},{"p50_us",0},{"p99_us",0},{"p999_us",0},{"units_s",1},
+				  {"reg_reads",0},{"reg_writes",0},{"syscalls",0},{"cpu_us",0}};
+    char b[BENCH_LINE],name[32],bname[32],tr[16],btr[16];
+    double x,y,d,cards,bcards;
+    unsigned int i;
+    int worse = 0;
+    BenchString(line,"scenario",name,sizeof(name));
+    BenchString(line,"transport",tr,sizeof(tr));
+    BenchField(line,"cards",&cards);
+    rewind(base);
+    while(fgets(b,sizeof(b),base) != NULL)
+    {
+		if(BenchString(b,"scenario",bname,sizeof(bname)) || BenchString(b,"transport",btr,sizeof(btr)) ||
+		   BenchField(b,"cards",&bcards) || strcmp(name,bname) || strcmp(tr,btr) || cards != bcards)
+		{
+			continue;
+		}
+		for(i=0;i<sizeof(Metric)/sizeof(Metric[0]);i++)
+		{
+			if(BenchField(b,Metric[i].key,&x) || BenchField(line,Metric[i].key,&y))
+			{
+				continue;
+			}
+			d = x ? (y-x)*100/x : (y ? 100 : 0);
+			if(d > tol || d < -tol)
+			{
+				printf("  %-10s %-10s %12.1f -> %12.1f %+7.1f%%  %s\n",name,Metric[i].key,x,y,d,
+					   (d > 0) == Metric[i].higher ? "better" : "REGRESSION");
+				worse += (d > 0) != Metric[i].higher;
+			}
+		}
+		return worse;
+    }
+    printf("  %-10s not in the baseline\n",name);
+    return 0;
+}
+
+int main(int argc,char *argv[])
+{
+    static const char *Scenarios[] = {"init","restart","cold","warm","dump","cached","write","inventory","idle","recover","threads","interleaved"};
+    unsigned char key[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+    char list[128] = "init,restart,cold,warm,dump,cached,write,inventory,idle,recover" BENCH_EMU_SCENARIOS,line[BENCH_LINE],*s,*save;
+    const char *out = NULL,*baseline = NULL;
+    unsigned int runs = 1000,cards = 1,sector = 1,i,k,multi;
+    double tol = 10;
+    FILE *fo = NULL,*fb = NULL;
+    bench_result_t r;
+    unsigned int *lat;
+    rc522_t reader;
+    rc522_t *pcd = &reader;
+    retry_t policy;
+    unsigned int persist = 0,budget = 0;
+    int opt,worse = 0,err = 0,retry = 0;
+
+    while((opt = getopt(argc,argv,"s:n:N:S:k:o:c:t:R:")) != -1)
+    {
+		switch(opt)
+		{
+			case 's': snprintf(list,sizeof(list),"%s",optarg); break;
+			case 'n': runs = strtoul(optarg,NULL,0); break;
+			case 'N': cards = strtoul(optarg,NULL,0); break;
+			case 'S': sector = strtoul(optarg,NULL,0); break;
+			case 'k':
+				for(i=0;i<6 && sscanf(optarg+2*i,"%2hhx",&key[i]) == 1;i++);
+				if(i < 6)
+				{
+					fprintf(stderr,"key A is 12 hex digits\n");
+					return 1;
+				}
+				break;
+			case 'o': out = optarg; break;
+			case 'c': baseline = optarg; break;
+			case 't': tol = strtod(optarg,NULL); break;
+			case 'R':
+				retry = sscanf(optarg,"%u,%u",&persist,&budget) >= 1;
+				break;
+			default:
+				fprintf(stderr,"usage: %s [-s init,restart,cold,warm,dump,cached,write,inventory,idle,recover,threads,interleaved] [-n runs] [-N cards] [-S sector] [-k keyA]\n"
+						"          [-o results.jsonl] [-c baseline.jsonl] [-t tolerance%%] [-R persist[,budget_us]]\n",argv[0]);
+				return 1;
+		}
+    }
+    if(runs == 0 || cards == 0 || cards > BENCH_CARDS_MAX || sector == 0 || sector > 15)
+    {
+		fprintf(stderr,"need -n > 0, -N 1..%d and -S 1..15, sector 0 holds the manufacturer block\n",BENCH_CARDS_MAX);
+		return 1;
+    }
+    if((out != NULL && (fo = fopen(out,"w")) == NULL) || (baseline != NULL && (fb = fopen(baseline,"r")) == NULL))
+    {
+		perror(out != NULL && fo == NULL ? out : baseline);
+		return 1;
+    }
+    if((lat = malloc(runs*sizeof(unsigned int))) == NULL)
+    {
+		return 1;
+    }
+    if(wiringPiSetup()==-1)
+    {
+		printf("init wiringPi error\n");
+		return 1;
+    }
+    if(BenchOpen(pcd) != 0)
+    {
+		return 1;
+    }
+    BenchQuiet(1);
+    RC522_Init(pcd);
+    BenchQuiet(0);
+    if(retry)
+    {
+		RetryInit(&policy,budget,persist);
+		RetryAttach(pcd,&policy);
+    }
+    printf("%-13s %6s %6s %8s %8s %8s %9s %9s %7s %7s %7s %8s\n","scenario","runs","ok","p50 us","p99 us","p999 us",
+		   "ops/s","units/s","rd/op","wr/op","sys/op","cpu us");
+    for(s=strtok_r(list,",",&save);s != NULL;s=strtok_r(NULL,",",&save))
+    {
+		for(i=0;i<sizeof(Scenarios)/sizeof(Scenarios[0]) && strcmp(s,Scenarios[i]);i++);
+		if(i == sizeof(Scenarios)/sizeof(Scenarios[0]))
+		{
+			fprintf(stderr,"unknown scenario %s\n",s);
+			err = 1;
+			continue;
+		}
+		multi = !strcmp(s,"threads") || !strcmp(s,"interleaved");
+		for(k=1;k<=(multi ? BENCH_READERS : 1);k++)//The multi-reader ones once per number of readers
+		{
+			memset(&r,0,sizeof(r));
+			r.name = Scenarios[i];
+			r.lat = lat;
+#ifdef RC522_STATS
+			StatsReset(pcd);
+#endif
+			if(BenchRun(pcd,&r,runs,multi ? k : cards,sector,key) != 0 || r.n == 0)
+			{
+				printf("%-10s no card that takes it (Mifare_One with key A of sector %u)\n",r.name,sector);
+				err = 1;
+				break;
+			}
+			qsort(r.lat,r.n,sizeof(unsigned int),BenchCmp);
+			BenchLine(&r,line,sizeof(line));
+			BenchRow(&r,line);
+#ifdef RC522_STATS
+			BenchPhases(pcd);
+#endif
+			if(fo != NULL)
+			{
+				fprintf(fo,"%s\n",line);
+			}
+			if(fb != NULL)
+			{
+				worse += BenchCompare(fb,line,tol);
+			}
+		}
+    }
+    if(fb != NULL)
+    {
+		printf("%d regression(s) against %s beyond %.1f%%\n",worse,baseline,tol);
+		fclose(fb);
+    }
+    if(fo != NULL)
+    {
+		fclose(fo);
+    }
+    free(lat);
+    return worse ? 2 : err;
+}
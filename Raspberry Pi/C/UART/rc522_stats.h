@@ -0,0 +1,138 @@
+#ifndef __RC522_STATS_H
+#define	__RC522_STATS_H
+
+/////////////////////////////////////////////////////////////////////
+//Protocol phases, each one has its own latency histogram
+/////////////////////////////////////////////////////////////////////
+#define STATS_PH_REQUEST      0                  //PcdRequest, REQA/WUPA with its retries
+#define STATS_PH_ANTICOLL     1                  //One cascade level
+#define STATS_PH_SELECT       2                  //One cascade level
+#define STATS_PH_AUTH         3
+#define STATS_PH_READ         4
+#define STATS_PH_WRITE        5                  //Both steps
+#define STATS_PH_HALT         6
+#define STATS_PH_TRANSCEIVE   7                  //Every command the chip runs, from FIFO load to IRQ
+#define STATS_PH_RECOVER      8                  //Chip reset and restored by the health monitor
+#define STATS_PHASES          9
+
+/////////////////////////////////////////////////////////////////////
+//Counters
+/////////////////////////////////////////////////////////////////////
+#define STATS_CNT_TIMEOUT     0                  //Timer IRQ before the card answered
+#define STATS_CNT_CRC         1                  //ErrorReg CRCErr
+#define STATS_CNT_PARITY      2                  //ErrorReg ParityErr
+#define STATS_CNT_COLL        3                  //ErrorReg CollErr
+#define STATS_CNT_PROTOCOL    4                  //ErrorReg ProtocolErr
+#define STATS_CNT_OVERFLOW    5                  //ErrorReg BufferOvfl
+#define STATS_CNT_RETRY       6                  //Commands sent again after a failure
+#define STATS_CNT_STUCK       7                  //Waits on the chip that ran out, neither answer nor timer IRQ
+#define STATS_COUNTERS        8
+
+/////////////////////////////////////////////////////////////////////
+//HDR-style histogram of microseconds: values below 2^STATS_SUB_BITS
+//get a bucket each, above that every power of two is cut into
+//2^STATS_SUB_BITS buckets, 12.5% resolution up to 2^32 us
+/////////////////////////////////////////////////////////////////////
+#define STATS_SUB_BITS        3
+#define STATS_SUB             (1 << STATS_SUB_BITS)
+#define STATS_BUCKETS         (STATS_SUB*(32 - STATS_SUB_BITS + 1))
+#define STATS_EXPORT_MS       10000              //Period of the Prometheus textfile
+
+typedef struct
+{
+    unsigned long count;
+    unsigned long failed;                        //Returned something else than MI_OK
+    unsigned long long sum_us;
+    unsigned long max_us;
+    unsigned long bucket[STATS_BUCKETS];
+} stats_hist_t;
+
+/////////////////////////////////////////////////////////////////////
+//Statistics of one reader. Only the reader's own thread writes them,
+//with plain relaxed stores; any thread can take a snapshot
+/////////////////////////////////////////////////////////////////////
+typedef struct rc522_stats
+{
+    unsigned long counter[STATS_COUNTERS];
+    unsigned int t_com;                          //micros() at PcdComStart
+    unsigned int t_req;                          //micros() at PcdRequestStart
+    stats_hist_t phase[STATS_PHASES];
+} rc522_stats_t;
+
+#ifdef RC522_STATS
+static inline void StatsAdd(unsigned long *c,unsigned long v)
+{
+    __atomic_store_n(c,__atomic_load_n(c,__ATOMIC_RELAXED) + v,__ATOMIC_RELAXED);
+}
+
+static inline unsigned int StatsBucket(unsigned long us)
+{
+    unsigned int e;
+    if(us < STATS_SUB)
+    {
+		return us;
+    }
+    if(us > 0xFFFFFFFFUL)
+    {
+		us = 0xFFFFFFFFUL;
+    }
+    e = 31 - __builtin_clz((unsigned int)us);    //us lies in [2^e,2^(e+1))
+    return (e - STATS_SUB_BITS + 1)*STATS_SUB + ((us >> (e - STATS_SUB_BITS)) & (STATS_SUB - 1));
+}
+
+static inline void StatsPhase(rc522_stats_t *s,unsigned char ph,unsigned long us,unsigned char status)
+{
+    stats_hist_t *h = &s->phase[ph];
+    StatsAdd(&h->bucket[StatsBucket(us)],1);
+    __atomic_store_n(&h->sum_us,__atomic_load_n(&h->sum_us,__ATOMIC_RELAXED) + us,__ATOMIC_RELAXED);
+    if(us > h->max_us)
+    {
+		__atomic_store_n(&h->max_us,us,__ATOMIC_RELAXED);
+    }
+    if(status != 0)
+    {
+		StatsAdd(&h->failed,1);
+    }
+    __atomic_store_n(&h->count,h->count + 1,__ATOMIC_RELEASE);//Last: a snapshot that loads count first finds at least that many in the buckets
+}
+
+//Count the error bits of ErrorReg
+static inline void StatsErrorReg(rc522_stats_t *s,unsigned char err)
+{
+    if(err & 0x01) StatsAdd(&s->counter[STATS_CNT_PROTOCOL],1);
+    if(err & 0x02) StatsAdd(&s->counter[STATS_CNT_PARITY],1);
+    if(err & 0x04) StatsAdd(&s->counter[STATS_CNT_CRC],1);
+    if(err & 0x08) StatsAdd(&s->counter[STATS_CNT_COLL],1);
+    if(err & 0x10) StatsAdd(&s->counter[STATS_CNT_OVERFLOW],1);
+}
+
+//Instrumentation of rc522.c, nothing at all without RC522_STATS
+#define STATS_START(t)                unsigned int t = micros()
+#define STATS_PHASE(pcd,ph,t,status)  StatsPhase(&(pcd)->stats,ph,micros() - (t),status)
+#define STATS_MARK(pcd,field)         ((pcd)->stats.field = micros())
+#define STATS_SINCE(pcd,ph,field,status) StatsPhase(&(pcd)->stats,ph,micros() - (pcd)->stats.field,status)
+#define STATS_COUNT(pcd,c)            StatsAdd(&(pcd)->stats.counter[c],1)
+#define STATS_ADD(pcd,c,n)            StatsAdd(&(pcd)->stats.counter[c],n)
+#define STATS_ERROR(pcd,err)          StatsErrorReg(&(pcd)->stats,err)
+#else
+#define STATS_START(t)
+#define STATS_PHASE(pcd,ph,t,status)
+#define STATS_MARK(pcd,field)
+#define STATS_SINCE(pcd,ph,field,status)
+#define STATS_COUNT(pcd,c)
+#define STATS_ADD(pcd,c,n)
+#define STATS_ERROR(pcd,err)
+#endif
+
+struct rc522;
+
+void StatsSnapshot(const struct rc522 *pcd,rc522_stats_t *snap);
+void StatsReset(struct rc522 *pcd);
+unsigned long StatsPercentile(const stats_hist_t *h,double p);
+const char *StatsPhaseName(unsigned char ph);
+const char *StatsCounterName(unsigned char c);
+int StatsWriteProm(const char *path,struct rc522 *const *pcd,int n);
+int StatsExportStart(const char *path,struct rc522 *const *pcd,int n,unsigned int period_ms);
+void StatsExportStop(void);
+
+#endif
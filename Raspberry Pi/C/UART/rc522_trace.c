@@ -0,0 +1,262 @@
+/***************************************************************************************
+ * Project  :rc522 bus trace
+ * Describe :Binary trace of every register access of the driver: direction, register,
+ *			 value, nanosecond timestamp and thread, 16 bytes each, in a preallocated
+ *			 mmap'd file. Recording is a slot reservation and plain stores, no syscall,
+ *			 so the timing it looks at barely changes. A linear trace keeps the start of
+ *			 a run and can be replayed by the emulator; a ring trace (TRACE_RING) keeps
+ *			 the last records before a hang or a crash, the kernel still writes the
+ *			 pages back when the process dies.
+ *			 rc522.c records only when built with make TRACE=1 and started with
+ *			 RC522_TRACE=<file> in the environment (RC522_TRACE_RECORDS=<n>,
+ *			 RC522_TRACE_RING=1); trace_dump prints a trace.
+***************************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "rc522_trace.h"
+#ifdef RC522_EMU
+#include "rc522_emu.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////
+//function:Map a trace file
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+static int TraceMap(trace_t *t,int fd,unsigned long size,int prot)
+{
+    void *base = mmap(NULL,size,prot,MAP_SHARED,fd,0);
+    if(base == MAP_FAILED)
+    {
+		return -1;
+    }
+    t->base = (unsigned char *)base;
+    t->size = size;
+    t->hdr = (trace_hdr_t *)base;
+    t->rec = (trace_rec_t *)(t->base + TRACE_DATA_OFF);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Create a trace, an existing file is overwritten
+//Parameters:t[OUT]:Trace
+//        path[IN]:File
+//   transport[IN]:"spi", "i2c" or "uart", for the reader of the file
+//    capacity[IN]:Records, 0 = TRACE_RECORDS
+//       flags[IN]:TRACE_RING or 0
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int TraceOpen(trace_t *t,const char *path,const char *transport,unsigned int capacity,int flags)
+{
+    struct timespec ts;
+    unsigned long size;
+    int fd;
+    memset(t,0,sizeof(trace_t));
+    capacity = capacity ? capacity : TRACE_RECORDS;
+    size = TRACE_DATA_OFF + (unsigned long)capacity*sizeof(trace_rec_t);
+    if((fd = open(path,O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC,0644)) < 0)
+    {
+		return -1;
+    }
+    //Allocate every block now, a store into the file can never hit a full disk
+    if(posix_fallocate(fd,0,size) != 0 || TraceMap(t,fd,size,PROT_READ|PROT_WRITE) != 0)
+    {
+		close(fd);
+		return -1;
+    }
+    close(fd);
+    clock_gettime(CLOCK_REALTIME,&ts);
+    t->capacity = capacity;
+    t->hdr->version = TRACE_VERSION;
+    t->hdr->record_size = sizeof(trace_rec_t);
+    t->hdr->capacity = capacity;
+    t->hdr->flags = flags;
+    snprintf(t->hdr->transport,sizeof(t->hdr->transport),"%s",transport);
+    t->hdr->real_ns = (unsigned long long)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+    __atomic_store_n(&t->hdr->magic,TRACE_MAGIC,__ATOMIC_RELEASE);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Open a trace for reading, while it may still be recorded
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int TraceOpenReadOnly(trace_t *t,const char *path)
+{
+    struct stat st;
+    int fd;
+    memset(t,0,sizeof(trace_t));
+    if((fd = open(path,O_RDONLY|O_CLOEXEC)) < 0)
+    {
+		return -1;
+    }
+    if(fstat(fd,&st) != 0 || st.st_size < TRACE_DATA_OFF || TraceMap(t,fd,st.st_size,PROT_READ) != 0)
+    {
+		close(fd);
+		return -1;
+    }
+    close(fd);
+    if(t->hdr->magic != TRACE_MAGIC || t->hdr->version != TRACE_VERSION ||
+       t->hdr->record_size != sizeof(trace_rec_t) || t->hdr->capacity == 0 ||
+       t->size != TRACE_DATA_OFF + (unsigned long)t->hdr->capacity*sizeof(trace_rec_t))
+    {
+		TraceClose(t);
+		return -1;
+    }
+    t->capacity = t->hdr->capacity;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Append a record, any number of threads at once, no syscall
+//Parameters:t[IN]:Trace opened for writing
+//         rec[IN]:Record, kind != 0
+/////////////////////////////////////////////////////////////////////
+void TraceAppend(trace_t *t,const trace_rec_t *rec)
+{
+    unsigned long long i = __atomic_fetch_add(&t->hdr->head,1,__ATOMIC_RELAXED);
+    trace_rec_t *r;
+    if(i >= t->capacity && !(t->hdr->flags & TRACE_RING))
+    {
+		__atomic_add_fetch(&t->hdr->dropped,1,__ATOMIC_RELAXED);
+		return;
+    }
+    r = &t->rec[i % t->capacity];
+    __atomic_store_n(&r->kind,0,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);     //A reader sees the slot empty before its body changes
+    r->t_ns = rec->t_ns;
+    r->tid = rec->tid;
+    r->reader = rec->reader;
+    r->addr = rec->addr;
+    r->value = rec->value;
+    __atomic_store_n(&r->kind,rec->kind,__ATOMIC_RELEASE);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Range of records still in the file
+//Parameters:pFirst[OUT]:Oldest record
+//             pEnd[OUT]:One past the newest record
+/////////////////////////////////////////////////////////////////////
+void TraceBounds(trace_t *t,unsigned long long *pFirst,unsigned long long *pEnd)
+{
+    unsigned long long end = __atomic_load_n(&t->hdr->head,__ATOMIC_ACQUIRE);
+    if(!(t->hdr->flags & TRACE_RING) && end > t->capacity)
+    {
+		end = t->capacity;                       //Reservations that found the file full
+    }
+    *pEnd = end;
+    *pFirst = end > t->capacity ? end - t->capacity : 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Record i of the trace
+//return:NULL when the slot is empty or being written
+/////////////////////////////////////////////////////////////////////
+const trace_rec_t *TraceGet(trace_t *t,unsigned long long i)
+{
+    const trace_rec_t *r = &t->rec[i % t->capacity];
+    return __atomic_load_n(&r->kind,__ATOMIC_ACQUIRE) != 0 ? r : NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Flush and unmap the trace
+/////////////////////////////////////////////////////////////////////
+void TraceClose(trace_t *t)
+{
+    if(t->base != NULL)
+    {
+		msync(t->base,t->size,MS_SYNC);
+		munmap(t->base,t->size);
+    }
+    memset(t,0,sizeof(trace_t));
+}
+
+#ifdef RC522_TRACE
+/////////////////////////////////////////////////////////////////////
+//Recorder of the driver, one trace for every reader of the process
+/////////////////////////////////////////////////////////////////////
+static trace_t Trace;
+static const char *TraceTransport;
+static pthread_once_t TraceOnce = PTHREAD_ONCE_INIT;
+static unsigned long long TraceT0;
+static __thread unsigned int TraceTid;
+
+//Nanoseconds, virtual time under the emulator so that a replay runs at the recorded pace
+static unsigned long long TraceNow(void)
+{
+#ifdef RC522_EMU
+    return EmuNow();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (unsigned long long)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+//At exit, other threads may still be recording: flush, leave it mapped
+static void TraceStop(void)
+{
+    msync(Trace.base,Trace.size,MS_SYNC);
+}
+
+static void TraceEnv(void)
+{
+    const char *path = getenv("RC522_TRACE"),*s;
+    unsigned int records = (s = getenv("RC522_TRACE_RECORDS")) != NULL ? strtoul(s,NULL,0) : 0;
+    int ring = (s = getenv("RC522_TRACE_RING")) != NULL && atoi(s) != 0;
+    if(path == NULL || *path == 0)
+    {
+		return;
+    }
+    TraceT0 = TraceNow();
+    if(TraceOpen(&Trace,path,TraceTransport,records,ring ? TRACE_RING : 0) != 0)
+    {
+		perror(path);
+		return;
+    }
+    atexit(TraceStop);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Start recording if RC522_TRACE names a file, once per process
+//Parameters:transport[IN]:"spi", "i2c" or "uart"
+/////////////////////////////////////////////////////////////////////
+void TraceSetup(const char *transport)
+{
+    TraceTransport = transport;
+    pthread_once(&TraceOnce,TraceEnv);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Record one register access
+//Parameters:kind[IN]:TRACE_RD/WR/ECHO
+//         reader[IN]:fd of the reader
+/////////////////////////////////////////////////////////////////////
+void TraceAccess(unsigned char kind,int reader,unsigned char addr,unsigned char value)
+{
+    trace_rec_t rec;
+    if(Trace.base == NULL)
+    {
+		return;
+    }
+    if(TraceTid == 0)
+    {
+		TraceTid = (unsigned int)syscall(SYS_gettid);
+    }
+    rec.t_ns = TraceNow() - TraceT0;
+    rec.tid = TraceTid;
+    rec.kind = kind;
+    rec.reader = (unsigned char)reader;
+    rec.addr = addr;
+    rec.value = value;
+    TraceAppend(&Trace,&rec);
+}
+#endif
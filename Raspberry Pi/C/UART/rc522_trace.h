@@ -0,0 +1,77 @@
+#ifndef __RC522_TRACE_H
+#define	__RC522_TRACE_H
+
+/////////////////////////////////////////////////////////////////////
+//Bus trace file: one header page followed by fixed size records, host
+//byte order. The emulator replays it (RC522_EMU_REPLAY, ../emu) and
+//keeps its own copy of this layout
+/////////////////////////////////////////////////////////////////////
+#define TRACE_MAGIC           0x43525452         //"RTRC"
+#define TRACE_VERSION         1
+#define TRACE_DATA_OFF        4096               //Records start on the second page
+#define TRACE_RECORDS         (1U << 20)         //Default size, 16 MiB of records
+
+#define TRACE_RING            0x01               //Flags: keep the newest records instead of the first ones
+
+//Kind of a record, 0 = slot not written yet
+#define TRACE_RD              1                  //ReadRawRC, value as read
+#define TRACE_WR              2                  //WriteRawRC
+#define TRACE_ECHO            3                  //UART: the chip echoed value instead of the address of a write
+
+typedef struct
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int record_size;                    //sizeof(trace_rec_t)
+    unsigned int capacity;                       //Records the file holds
+    unsigned int flags;                          //TRACE_RING
+    char transport[8];                           //"spi", "i2c", "uart"
+    unsigned int reserved;
+    unsigned long long real_ns;                  //CLOCK_REALTIME when the trace was opened
+    unsigned long long head;                     //Records appended, record i sits at i % capacity
+    unsigned long long dropped;                  //Not recorded because the file was full
+} trace_hdr_t;
+
+typedef struct
+{
+    unsigned long long t_ns;                     //Since the trace was opened, emulator time under EMU=1
+    unsigned int tid;                            //Thread that made the access
+    unsigned char kind;                          //TRACE_RD/WR/ECHO, stored last
+    unsigned char reader;                        //Low byte of the reader's fd
+    unsigned char addr;                          //Register
+    unsigned char value;
+} trace_rec_t;                                   //16 bytes
+
+typedef struct
+{
+    unsigned char *base;                         //mmap'd file
+    unsigned long size;
+    trace_hdr_t *hdr;
+    trace_rec_t *rec;
+    unsigned int capacity;
+} trace_t;
+
+int TraceOpen(trace_t *t,const char *path,const char *transport,unsigned int capacity,int flags);
+int TraceOpenReadOnly(trace_t *t,const char *path);
+void TraceAppend(trace_t *t,const trace_rec_t *rec);
+void TraceBounds(trace_t *t,unsigned long long *pFirst,unsigned long long *pEnd);
+const trace_rec_t *TraceGet(trace_t *t,unsigned long long i);
+void TraceClose(trace_t *t);
+
+#ifdef RC522_TRACE
+void TraceSetup(const char *transport);
+void TraceAccess(unsigned char kind,int reader,unsigned char addr,unsigned char value);
+
+//Instrumentation of rc522.c, nothing at all without RC522_TRACE
+#define TRACE_SETUP(transport)        TraceSetup(transport)
+#define TRACE_READ(pcd,addr,v)        TraceAccess(TRACE_RD,(pcd)->fd,(addr) & 0x3F,v)
+#define TRACE_WRITE(pcd,addr,v)       TraceAccess(TRACE_WR,(pcd)->fd,(addr) & 0x3F,v)
+#define TRACE_ECHO_BAD(pcd,addr,v)    TraceAccess(TRACE_ECHO,(pcd)->fd,(addr) & 0x3F,v)
+#else
+#define TRACE_SETUP(transport)
+#define TRACE_READ(pcd,addr,v)
+#define TRACE_WRITE(pcd,addr,v)
+#define TRACE_ECHO_BAD(pcd,addr,v)
+#endif
+
+#endif
@@ -0,0 +1,721 @@
+/***************************************************************************************
+ * Project  :rc522d-uart
+ * Describe :Reader daemon. A polling thread owns the RC522 and publishes card
+ *			 present/removed/read complete events, the main thread fans them out to
+ *			 any number of subscribers on a Unix domain socket (SOCK_SEQPACKET, framing
+ *			 in rc522d.h). Every subscriber has a bounded queue, a slow subscriber loses
+ *			 its oldest events and gets an overflow event, the reader never waits.
+ * Usage    :rc522d [-s socket] [-b block] [-k keyA] [-p poll_ms] [-r keepalive_ms]
+ *			 [-a arrive_polls] [-l leave_polls] [-A allowlist.acl] [-L journal] [-i reader_id]
+ *			 [-o jsonl|cbor] [-B shm_name] [-P metrics.prom] [-T rf.profile]
+ *			 [-R persist[,budget_us]] [-H interval_ms[,selftest_s]]
+ *			 -b reads the block of every card that arrives with key -k, through the card
+ *			 cache (card_cache.h) whose contents last until the card leaves; a client
+ *			 reads a block of the card in the field again with RC522D_REQ_READ, served
+ *			 from the cache while the card stays
+ *			 -L journals every arrival and departure (taplog.h, taplog_tail), -i is the
+ *			 reader ID written there and with -o, to tell the daemons of a site apart
+ *			 -o also writes every event to stdout, framing in evtfmt.h
+ *			 -B also publishes every event on a shared memory bus (evtbus.h, evtbus_cat)
+ *			 -P writes the driver statistics for node_exporter every 10 s (make STATS=1)
+ *			 -T tunes the receiver to the site while no card is in the field (rftune.h),
+ *			 starting from the profile in the file and saving every better one there
+ *			 -R lets the retry policy of retry.h decide the retries of a tap, persist 0..100
+ *			 trades success of marginal reads for latency, budget_us caps a tap
+ *			 -H checks the chip every interval_ms while no card is in the field and runs
+ *			 its self-test every selftest_s (health.h); a chip that failed is reset and
+ *			 set up again, and a health event reports how long that took
+ * Hardware Connection :
+ *	SW1:	RX   -> ON			SW2:	A1	 -> -
+ *          TX   -> ON					A0	 -> -
+ *          SDA  -> OFF					ADR5 -> 0
+ *          SCL  -> OFF					ADR4 -> 0
+ *          NSS  -> OFF					ADR3 -> 0
+ *          MOSI -> OFF					ADR2 -> 0
+ *          MISO -> OFF					ADR1 -> 0
+ *          SCK  -> OFF					ADR0 -> 0
+ * Library Version :WiringPi_V2.52
+***************************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <wiringPi.h>
+#include <wiringSerial.h>
+#include "rc522.h"
+#include "rc522d.h"
+#include "feedback.h"
+#include "presence.h"
+#include "allowlist.h"
+#include "taplog.h"
+#include "evtfmt.h"
+#include "evtbus.h"
+#include "rftune.h"
+#include "retry.h"
+#include "health.h"
+#include "card_cache.h"
+
+#define EVT_RING              256                //Events between the polling thread and the socket thread
+#define CLIENT_MAX            16                 //Subscribers
+#define CLIENT_QUEUE          32                 //Events queued per subscriber
+#define REQ_RING              16                 //Read requests between the socket thread and the polling thread
+
+typedef struct
+{
+    int fd;
+    unsigned int head,tail;                      //Queue indexes, tail-head = queued events
+    unsigned int dropped;                        //Events lost since the last delivered overflow event
+    rc522d_frame_t queue[CLIENT_QUEUE];
+} client_t;
+
+static rc522d_frame_t EvtRing[EVT_RING];
+static unsigned int EvtHead,EvtTail;             //Single producer (poller), single consumer (socket thread)
+static unsigned int EvtLost;
+static unsigned short EvtSeq;
+static int EvtFd = -1;
+static client_t Client[CLIENT_MAX];
+static unsigned char ReqRing[REQ_RING];          //Blocks of RC522D_REQ_READ requests
+static unsigned int ReqHead,ReqTail;             //Single producer (socket thread), single consumer (poller)
+static volatile sig_atomic_t Running = 1;
+
+static const char *SockPath = RC522D_SOCKET;
+static int ReadBlock = -1;
+static unsigned char ReadKey[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+static unsigned int PollMs = 10;
+static unsigned int KeepaliveMs = 100;
+static unsigned char ArrivePolls = PRES_ARRIVE_POLLS;
+static unsigned char LeavePolls = PRES_LEAVE_POLLS;
+static const char *AclPath = NULL;
+static acl_t Acl;
+static const char *LogPath = NULL;
+static taplog_t TapLog;
+static unsigned short ReaderId = 0;              //Reader of the journal records and the stdout events
+static int OutFmt = -1;                          //EVTFMT_* of the stdout copy, -1 = none
+static const char *BusName = NULL;
+static evtbus_t Bus;
+static const char *PromPath = NULL;
+static const char *TunePath = NULL;
+static rftune_t Tune;
+static int RetryOn = 0;
+static retry_t Retry;
+static int HealthOn = 0;
+static health_t Health;
+static card_cache_t Cache;                        //Blocks of the card in the field, dropped when it leaves
+static rc522_t Reader;
+
+/////////////////////////////////////////////////////////////////////
+//function:Monotonic time in milliseconds
+/////////////////////////////////////////////////////////////////////
+static unsigned int NowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (unsigned int)(ts.tv_sec*1000 + ts.tv_nsec/1000000);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Queue an event for the socket thread, never blocks
+//Parameters:type[IN]:RC522D_EVT_*
+//          pData[IN]:Payload
+//            len[IN]:Payload length
+/////////////////////////////////////////////////////////////////////
+static void Publish(unsigned char type,const void *pData,unsigned char len)
+{
+    unsigned long long one = 1;
+    unsigned int head = __atomic_load_n(&EvtHead,__ATOMIC_ACQUIRE);
+    rc522d_frame_t *f;
+    if(EvtTail - head >= EVT_RING)
+    {
+		__atomic_add_fetch(&EvtLost,1,__ATOMIC_RELAXED);
+		return;
+    }
+    f = &EvtRing[EvtTail % EVT_RING];
+    f->hdr.type = type;
+    f->hdr.len = len;
+    f->hdr.seq = EvtSeq++;
+    f->hdr.time_ms = NowMs();
+    memcpy(&f->u,pData,len);
+    if(BusName != NULL)
+    {
+		EvtBusPublish(&Bus,f);               //Local consumers read it from shared memory
+    }
+    __atomic_store_n(&EvtTail,EvtTail+1,__ATOMIC_RELEASE);
+    if(write(EvtFd,&one,sizeof(one)) < 0)
+    {
+		//eventfd counter saturated, the socket thread is awake anyway
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read a block of the tracked card through the card cache and
+//         publish it; a block of the same card read before comes from
+//         the cache as long as the card has not left the field
+//Parameters:block[IN]:Block address
+/////////////////////////////////////////////////////////////////////
+static void PublishRead(presence_t *pres,unsigned char block)
+{
+    rc522d_read_t rd;
+    memset(&rd,0,sizeof(rd));
+    rd.block = block;
+    if(pres->state != PRES_PRESENT)
+    {
+		rd.status = MI_NOTAGERR;
+		Publish(RC522D_EVT_READ,&rd,sizeof(rd));
+		return;
+    }
+    rd.uid_len = pres->uid_len;
+    memcpy(rd.uid,pres->uid,pres->uid_len);
+    rd.status = CacheRead(&Cache,pres->uid,pres->uid_len,block,rd.data);//Authenticates a miss with -k
+    if(rd.status == MI_OK)
+    {
+		PresenceReadProbe(pres,block);
+    }
+    Publish(RC522D_EVT_READ,&rd,sizeof(rd));
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Polling thread, the only thread that talks to the RC522
+//Parameters:arg[IN]:Reader
+/////////////////////////////////////////////////////////////////////
+static void *PollThread(void *arg)
+{
+    rc522_t *pcd = (rc522_t *)arg;
+    presence_t pres;
+    rc522d_card_t card;
+    rc522d_access_t acc;
+    rc522d_health_t hl;
+    taplog_rec_t tap;
+    unsigned int tag,t0;
+    unsigned char evt,state,fault,failed,selected;
+    PresenceInit(&pres,ArrivePolls,LeavePolls);
+    while(Running)
+    {
+		t0 = micros();
+		state = pres.state;
+		failed = pres.count;                     //LEAVING: probes the card has not answered
+		selected = pres.read_probe;
+		evt = PresencePoll(pcd,&pres);
+		if(TunePath != NULL)
+		{
+			if(state == PRES_LEAVING && pres.state == PRES_PRESENT)
+			{
+				while(failed--)
+				{
+					RfTuneMiss(&Tune);           //The card was there all along, it was not heard
+				}
+			}
+			else if(state == PRES_PRESENT && pres.state == PRES_PRESENT && selected && !pres.read_probe)
+			{
+				RfTuneMiss(&Tune);               //READ of the selected card failed, WUPA found it still there
+			}
+			if(pres.state == PRES_ABSENT)
+			{
+				RfTuneIdle(pcd);
+				if(RfTuneChanged(&Tune) && RfTuneSave(Tune.best,TunePath) != 0)
+				{
+					fprintf(stderr,"rc522d: cannot save RF profile to %s\n",TunePath);
+				}
+			}
+		}
+		if(HealthOn && pres.state == PRES_ABSENT && (fault = HealthCheck(pcd,&Health)) != HEALTH_OK)
+		{
+			memset(&hl,0,sizeof(hl));
+			hl.fault = fault;
+			hl.status = Health.down ? MI_COM_ERR : MI_OK;
+			hl.recover_us = Health.recover_us;
+			hl.recoveries = Health.recoveries;
+			Publish(RC522D_EVT_HEALTH,&hl,sizeof(hl));
+			fprintf(stderr,"rc522d: RC522 fault (%s), %s after %u us\n",HealthFaultName(fault),
+					Health.down ? "still down" : "recovered",Health.recover_us);
+		}
+		if(pres.state == PRES_PRESENT)
+		{
+			CacheCardPresent(&Cache,pres.uid,pres.uid_len);//Arrived, or confirmed by the keepalive probe
+		}
+		if(evt != PRES_EVT_NONE)
+		{
+			memset(&card,0,sizeof(card));
+			card.uid_len = pres.uid_len;
+			memcpy(card.uid,pres.uid,pres.uid_len);
+			memcpy(card.atqa,pres.atqa,2);
+			card.sak = pres.sak;
+		}
+		if(evt != PRES_EVT_NONE && LogPath != NULL)
+		{
+			memset(&tap,0,sizeof(tap));
+			tap.latency_us = micros() - t0;
+			tap.reader = ReaderId;
+			tap.status = pres.status;            //MI_OK of the select, or what the last probe of a leaving card got
+			tap.event = evt == PRES_EVT_LEFT ? TAPLOG_EVT_LEFT : TAPLOG_EVT_ARRIVED;
+			tap.uid_len = card.uid_len;
+			memcpy(tap.uid,card.uid,sizeof(tap.uid));
+			memcpy(tap.atqa,card.atqa,2);
+			tap.sak = card.sak;
+			TapLogAppend(&TapLog,&tap);
+		}
+		if(evt == PRES_EVT_ARRIVED)
+		{
+			Publish(RC522D_EVT_PRESENT,&card,sizeof(card));
+			if(AclPath != NULL)
+			{
+				memset(&acc,0,sizeof(acc));
+				acc.uid_len = card.uid_len;
+				memcpy(acc.uid,card.uid,sizeof(acc.uid));
+				acc.allowed = AclCheck(&Acl,card.uid,card.uid_len,&tag) == ACL_ALLOW;
+				acc.tag = acc.allowed ? tag : 0;
+				FeedbackPost(acc.allowed ? FB_PATTERN_ALLOW : FB_PATTERN_DENY);
+				Publish(RC522D_EVT_ACCESS,&acc,sizeof(acc));
+			}
+			else
+			{
+				FeedbackPost(FB_PATTERN_TAP);
+			}
+			if(ReadBlock >= 0)
+			{
+				PublishRead(&pres,(unsigned char)ReadBlock);
+			}
+		}
+		else if(evt == PRES_EVT_LEFT)
+		{
+			CacheCardRemoved(&Cache,card.uid,card.uid_len);
+			Publish(RC522D_EVT_REMOVED,&card,sizeof(card));
+		}
+		while(ReqHead != __atomic_load_n(&ReqTail,__ATOMIC_ACQUIRE))
+		{
+			PublishRead(&pres,ReqRing[ReqHead % REQ_RING]);
+			__atomic_store_n(&ReqHead,ReqHead+1,__ATOMIC_RELEASE);
+		}
+		delay(pres.state == PRES_PRESENT ? KeepaliveMs : PollMs);
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Send queued events to a subscriber until its socket is full
+//return:0, or -1 when the subscriber has gone away
+/////////////////////////////////////////////////////////////////////
+static int ClientFlush(client_t *c)
+{
+    rc522d_frame_t *f;
+    rc522d_frame_t ovf;
+    if(c->dropped)
+    {
+		ovf.hdr.type = RC522D_EVT_OVERFLOW;
+		ovf.hdr.len = sizeof(rc522d_overflow_t);
+		ovf.hdr.seq = 0;
+		ovf.hdr.time_ms = NowMs();
+		ovf.u.overflow.dropped = c->dropped;
+		if(send(c->fd,&ovf,sizeof(rc522d_hdr_t)+ovf.hdr.len,MSG_DONTWAIT|MSG_NOSIGNAL) < 0)
+		{
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		c->dropped = 0;
+    }
+    while(c->head != c->tail)
+    {
+		f = &c->queue[c->head % CLIENT_QUEUE];
+		if(send(c->fd,f,sizeof(rc522d_hdr_t)+f->hdr.len,MSG_DONTWAIT|MSG_NOSIGNAL) < 0)
+		{
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		c->head++;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Append an event to a subscriber queue, the oldest event is dropped when full
+/////////////////////////////////////////////////////////////////////
+static void ClientQueue(client_t *c,const rc522d_frame_t *f)
+{
+    if(c->tail - c->head >= CLIENT_QUEUE)
+    {
+		c->head++;
+		c->dropped++;
+    }
+    c->queue[c->tail % CLIENT_QUEUE] = *f;
+    c->tail++;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Take the requests a subscriber sent, a full request ring
+//         drops them
+//return:0, or -1 when the subscriber has gone away
+/////////////////////////////////////////////////////////////////////
+static int ClientRequests(client_t *c)
+{
+    rc522d_frame_t req;
+    ssize_t n;
+    while((n = recv(c->fd,&req,sizeof(req),MSG_DONTWAIT)) != 0)
+    {
+		if(n < 0)
+		{
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		if(req.hdr.type == RC522D_REQ_READ && n >= (ssize_t)(sizeof(rc522d_hdr_t)+sizeof(rc522d_req_read_t)) &&
+		   ReqTail - __atomic_load_n(&ReqHead,__ATOMIC_ACQUIRE) < REQ_RING)
+		{
+			ReqRing[ReqTail % REQ_RING] = req.u.req_read.block;
+			__atomic_store_n(&ReqTail,ReqTail+1,__ATOMIC_RELEASE);
+		}
+    }
+    return -1;
+}
+
+static void ClientClose(client_t *c)
+{
+    close(c->fd);
+    c->fd = -1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Open the listening socket
+//return:Socket, -1 on error
+/////////////////////////////////////////////////////////////////////
+static int ListenSocket(const char *path)
+{
+    int fd;
+    struct sockaddr_un addr;
+    fd = socket(AF_UNIX,SOCK_SEQPACKET|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+    if(fd < 0)
+    {
+		return -1;
+    }
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path,path,sizeof(addr.sun_path)-1);
+    unlink(path);
+    if(bind(fd,(struct sockaddr *)&addr,sizeof(addr)) < 0 || listen(fd,CLIENT_MAX) < 0)
+    {
+		close(fd);
+		return -1;
+    }
+    return fd;
+}
+
+static void Stop(int sig)
+{
+    (void)sig;
+    Running = 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Parse a 6 byte key given as 12 hex digits
+/////////////////////////////////////////////////////////////////////
+static int ParseKey(const char *s,unsigned char *pKey)
+{
+    unsigned int i,v;
+    if(strlen(s) != 12)
+    {
+		return -1;
+    }
+    for(i=0;i<6;i++)
+    {
+		if(sscanf(s+2*i,"%2x",&v) != 1)
+		{
+			return -1;
+		}
+		pKey[i] = (unsigned char)v;
+    }
+    return 0;
+}
+
+int main(int argc,char *argv[])
+{
+    int opt,i,n,lfd,cfd,serial_Fd;
+    unsigned long long cnt;
+    unsigned int lost,head;
+    struct pollfd pfd[2+CLIENT_MAX];
+    client_t *slot[2+CLIENT_MAX];
+    pthread_t poller;
+    rc522d_frame_t f;
+    struct sigaction sa;
+    sigset_t mask;
+    evtfmt_t *out = EvtFmtThread();
+
+    while((opt = getopt(argc,argv,"s:b:k:p:r:a:l:A:L:i:o:B:P:T:R:H:")) != -1)
+    {
+		switch(opt)
+		{
+			case 's': SockPath = optarg; break;
+			case 'b': ReadBlock = atoi(optarg); break;
+			case 'k':
+				if(ParseKey(optarg,ReadKey) != 0)
+				{
+					fprintf(stderr,"key must be 12 hex digits\n");
+					return 1;
+				}
+				break;
+			case 'p': PollMs = atoi(optarg); break;
+			case 'r': KeepaliveMs = atoi(optarg); break;
+			case 'a': ArrivePolls = atoi(optarg); break;
+			case 'l': LeavePolls = atoi(optarg); break;
+			case 'A': AclPath = optarg; break;
+			case 'L': LogPath = optarg; break;
+			case 'i': ReaderId = atoi(optarg); break;
+			case 'o':
+				OutFmt = strcmp(optarg,"cbor") == 0 ? EVTFMT_CBOR : strcmp(optarg,"jsonl") == 0 ? EVTFMT_JSONL : -2;
+				if(OutFmt == -2)
+				{
+					fprintf(stderr,"output format must be jsonl or cbor\n");
+					return 1;
+				}
+				EvtFmtInit(out,OutFmt);
+				break;
+			case 'B': BusName = optarg; break;
+			case 'P': PromPath = optarg; break;
+			case 'T': TunePath = optarg; break;
+			case 'R':
+				{
+					unsigned int persist = RETRY_PERSIST,budget = 0;
+					RetryOn = sscanf(optarg,"%u,%u",&persist,&budget) >= 1;
+					RetryInit(&Retry,budget,persist);
+				}
+				break;
+			case 'H':
+				{
+					unsigned int interval = 0,selftest = HEALTH_SELFTEST_S;
+					sscanf(optarg,"%u,%u",&interval,&selftest);
+					HealthInit(&Health,interval,selftest);
+					HealthOn = 1;
+				}
+				break;
+			default:
+				fprintf(stderr,"usage: %s [-s socket] [-b block] [-k keyA] [-p poll_ms] [-r keepalive_ms] [-a arrive_polls] [-l leave_polls] [-A allowlist.acl] [-L journal] [-i reader_id] [-o jsonl|cbor] [-B shm_name] [-P metrics.prom] [-T rf.profile] [-R persist[,budget_us]] [-H interval_ms[,selftest_s]]\n",argv[0]);
+				return 1;
+		}
+    }
+
+	if(wiringPiSetup()==-1)
+	{
+		printf("init wiringPi error\n");
+		return 1;
+	}
+	serial_Fd=serialOpen("/dev/ttyS0", 9600); 
+	if(serial_Fd==-1)
+	{
+		printf("init serial error!\n");
+		return 1;
+	}
+	pinMode(Res,OUTPUT);
+	pinMode(LED, OUTPUT);
+	PcdInit(&Reader,serial_Fd,Res);
+	CacheInit(&Cache,&Reader);
+	CacheSetKey(&Cache,C_A,ReadKey);
+	if(RC522_Init(&Reader) != MI_OK && !HealthOn)
+	{
+		fprintf(stderr,"rc522d: the RC522 does not start\n");
+		return 1;
+	}
+    if(TunePath != NULL)
+    {
+		unsigned char profile[RFTUNE_REGS];
+		RfTuneInit(&Tune,RfTuneLoad(profile,TunePath) == 0 ? profile : NULL);
+		RfTuneAttach(&Reader,&Tune);
+    }
+    if(RetryOn)
+    {
+		RetryAttach(&Reader,&Retry);
+    }
+    if(HealthOn && HealthAttach(&Reader,&Health) != MI_OK)
+    {
+		fprintf(stderr,"rc522d: RC522 fault (%s), recovering\n",HealthFaultName(Health.fault));
+    }
+    if(LogPath != NULL && TapLogOpen(&TapLog,LogPath,0) != 0)
+    {
+		fprintf(stderr,"rc522d: cannot open tap journal %s\n",LogPath);
+		return 1;
+    }
+    if(BusName != NULL && EvtBusCreate(&Bus,BusName) != 0)
+    {
+		fprintf(stderr,"rc522d: cannot create event bus %s\n",BusName);
+		return 1;
+    }
+
+    memset(&sa,0,sizeof(sa));
+    sa.sa_handler = Stop;
+    sigaction(SIGINT,&sa,NULL);
+    sigaction(SIGTERM,&sa,NULL);
+    signal(SIGPIPE,SIG_IGN);
+    for(i=0;i<CLIENT_MAX;i++)
+    {
+		Client[i].fd = -1;
+    }
+    EvtFd = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+    lfd = ListenSocket(SockPath);
+    if(EvtFd < 0 || lfd < 0)
+    {
+		perror("rc522d");
+		return 1;
+    }
+    sigemptyset(&mask);
+    sigaddset(&mask,SIGINT);
+    sigaddset(&mask,SIGTERM);
+    pthread_sigmask(SIG_BLOCK,&mask,NULL);//Signals must interrupt poll() in this thread, not the poller
+    if(FeedbackStart() != 0)
+    {
+		fprintf(stderr,"rc522d: no buzzer/LED feedback\n");
+    }
+    if(AclPath != NULL && AclOpen(&Acl,AclPath) != 0)//The watcher thread must not take signals either
+    {
+		fprintf(stderr,"rc522d: cannot load allowlist %s\n",AclPath);
+		return 1;
+    }
+    if(PromPath != NULL)
+    {
+#ifdef RC522_STATS
+		rc522_t *readers[1] = {&Reader};
+		if(StatsExportStart(PromPath,readers,1,STATS_EXPORT_MS) != 0)
+		{
+			fprintf(stderr,"rc522d: cannot write statistics to %s\n",PromPath);
+			return 1;
+		}
+#else
+		fprintf(stderr,"rc522d: built without statistics, rebuild with make STATS=1\n");
+		return 1;
+#endif
+    }
+    if(pthread_create(&poller,NULL,PollThread,&Reader) != 0)
+    {
+		perror("rc522d");
+		return 1;
+    }
+    pthread_sigmask(SIG_UNBLOCK,&mask,NULL);
+    fprintf(OutFmt >= 0 ? stderr : stdout,"rc522d listening on %s\n",SockPath);//stdout carries the events with -o
+    fflush(stdout);
+
+    while(Running)
+    {
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = EvtFd;
+		pfd[1].events = POLLIN;
+		n = 2;
+		for(i=0;i<CLIENT_MAX;i++)
+		{
+			if(Client[i].fd >= 0)
+			{
+				pfd[n].fd = Client[i].fd;
+				pfd[n].events = POLLIN | ((Client[i].head != Client[i].tail || Client[i].dropped) ? POLLOUT : 0);
+				slot[n++] = &Client[i];
+			}
+		}
+		if(poll(pfd,n,-1) < 0)
+		{
+			continue;
+		}
+		if(pfd[0].revents & POLLIN)
+		{
+			while((cfd = accept4(lfd,NULL,NULL,SOCK_NONBLOCK|SOCK_CLOEXEC)) >= 0)
+			{
+				for(i=0;i<CLIENT_MAX && Client[i].fd >= 0;i++);
+				if(i == CLIENT_MAX)
+				{
+					close(cfd);
+					continue;
+				}
+				memset(&Client[i],0,sizeof(client_t));
+				Client[i].fd = cfd;
+			}
+		}
+		if(pfd[1].revents & POLLIN)
+		{
+			if(read(EvtFd,&cnt,sizeof(cnt)) < 0)
+			{
+				cnt = 0;
+			}
+			lost = __atomic_exchange_n(&EvtLost,0,__ATOMIC_RELAXED);
+			head = EvtHead;
+			while(head != __atomic_load_n(&EvtTail,__ATOMIC_ACQUIRE))
+			{
+				f = EvtRing[head % EVT_RING];
+				head++;
+				__atomic_store_n(&EvtHead,head,__ATOMIC_RELEASE);
+				for(i=0;i<CLIENT_MAX;i++)
+				{
+					if(Client[i].fd >= 0)
+					{
+						Client[i].dropped += lost;
+						ClientQueue(&Client[i],&f);
+					}
+				}
+				lost = 0;
+				if(OutFmt >= 0 && EvtFmtFrame(out,ReaderId,&f) != 0)
+				{
+					EvtFmtFlush(STDOUT_FILENO,&out,1);
+					EvtFmtFrame(out,ReaderId,&f);
+				}
+			}
+			if(OutFmt >= 0)
+			{
+				EvtFmtFlush(STDOUT_FILENO,&out,1);//One writev per wakeup
+			}
+			for(i=0;i<CLIENT_MAX;i++)
+			{
+				if(Client[i].fd >= 0 && ClientFlush(&Client[i]) < 0)
+				{
+					ClientClose(&Client[i]);
+				}
+			}
+		}
+		for(i=2;i<n;i++)
+		{
+			if(slot[i]->fd < 0)
+			{
+				continue;
+			}
+			if(pfd[i].revents & (POLLHUP|POLLERR))
+			{
+				ClientClose(slot[i]);
+			}
+			else if((pfd[i].revents & POLLIN) && ClientRequests(slot[i]) < 0)
+			{
+				ClientClose(slot[i]);
+			}
+			else if((pfd[i].revents & POLLOUT) && ClientFlush(slot[i]) < 0)
+			{
+				ClientClose(slot[i]);
+			}
+		}
+    }
+    pthread_join(poller,NULL);
+    if(ReadBlock >= 0 || Cache.hits || Cache.misses)
+    {
+		fprintf(stderr,"rc522d: card cache %lu hits, %lu misses\n",Cache.hits,Cache.misses);
+    }
+#ifdef RC522_STATS
+    StatsExportStop();
+#endif
+    FeedbackStop();
+    if(AclPath != NULL)
+    {
+		AclClose(&Acl);
+    }
+    if(LogPath != NULL)
+    {
+		TapLogClose(&TapLog);
+    }
+    if(BusName != NULL)
+    {
+		EvtBusClose(&Bus);
+    }
+    for(i=0;i<CLIENT_MAX;i++)
+    {
+		if(Client[i].fd >= 0)
+		{
+			ClientClose(&Client[i]);
+		}
+    }
+    close(lfd);
+    unlink(SockPath);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef __RETRY_H
+#define	__RETRY_H
+
+#include "rc522.h"
+
+/////////////////////////////////////////////////////////////////////
+//Phases of a tap that can be retried
+/////////////////////////////////////////////////////////////////////
+#define RETRY_REQUEST         0                  //REQA/WUPA
+#define RETRY_ANTICOLL        1                  //One cascade level
+#define RETRY_SELECT          2                  //One cascade level
+#define RETRY_PHASES          3
+
+#define RETRY_BUDGET_US       30000              //Default: a tap gives up once its retries would end later
+#define RETRY_PERSIST         50                 //Default of the trade-off knob, 0 = fastest, 100 = most persistent
+#define RETRY_MAX             4                  //Retries of one phase at persist 100
+#define RETRY_RECENT_MS       1000               //A card answered this recently: a silent field may be a marginal card
+#define RETRY_GAP_US          50                 //First gap after a garbled answer, doubles with every retry
+
+/////////////////////////////////////////////////////////////////////
+//Retry policy of one reader. Rates are per 1024 and move 1/8 of the
+//way to every new outcome, so they follow the last few dozen attempts
+/////////////////////////////////////////////////////////////////////
+typedef struct retry
+{
+    unsigned int budget_us;                      //Hard limit of a tap, from the first REQA to the last SELECT
+    unsigned char persist;                       //Trade-off knob, 0..100
+    unsigned char seen;                          //last_card_ms is valid
+    unsigned int tap_us;                         //micros() at the start of the tap
+    unsigned int last_card_ms;                   //millis() of the last answer of any card
+    unsigned short p_first[RETRY_PHASES];        //First attempts that succeed
+    unsigned short p_retry[RETRY_PHASES];        //Retries that succeed
+    unsigned short noise;                        //Answers with CRC, parity or protocol errors
+    unsigned int cost_us[RETRY_PHASES];          //Duration of one attempt
+    unsigned long retries[RETRY_PHASES];         //Totals
+    unsigned long saved[RETRY_PHASES];           //Retries that succeeded
+    unsigned long idle;                          //Silent requests not retried: no card around
+    unsigned long denied;                        //Retries the budget or the knob did not allow
+} retry_t;
+
+void RetryInit(retry_t *r,unsigned int budget_us,unsigned char persist);
+void RetryAttach(rc522_t *pcd,retry_t *r);
+void RetryTap(retry_t *r);
+int RetryAgain(rc522_t *pcd,unsigned char phase,unsigned char attempt,unsigned char status,unsigned int t0);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef __SOFTPWM_H
+#define	__SOFTPWM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int softPwmCreate(int pin,int value,int range);
+void softPwmWrite(int pin,int value);
+void softPwmStop(int pin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
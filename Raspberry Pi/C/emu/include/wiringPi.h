@@ -0,0 +1,31 @@
+#ifndef __WIRINGPI_H
+#define	__WIRINGPI_H
+
+/////////////////////////////////////////////////////////////////////
+//wiringPi as far as the demos use it, implemented by the emulator
+/////////////////////////////////////////////////////////////////////
+#define INPUT                 0
+#define OUTPUT                1
+#define PWM_OUTPUT            2
+#define LOW                   0
+#define HIGH                  1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int wiringPiSetup(void);
+void pinMode(int pin,int mode);
+void digitalWrite(int pin,int value);
+int digitalRead(int pin);
+void pwmWrite(int pin,int value);
+void delay(unsigned int howLong);
+void delayMicroseconds(unsigned int howLong);
+unsigned int millis(void);
+unsigned int micros(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
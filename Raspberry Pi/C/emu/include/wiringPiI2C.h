@@ -0,0 +1,16 @@
+#ifndef __WIRINGPII2C_H
+#define	__WIRINGPII2C_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int wiringPiI2CSetup(const int devId);
+int wiringPiI2CReadReg8(int fd,int reg);
+int wiringPiI2CWriteReg8(int fd,int reg,int data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
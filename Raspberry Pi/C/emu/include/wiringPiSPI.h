@@ -0,0 +1,16 @@
+#ifndef __WIRINGPISPI_H
+#define	__WIRINGPISPI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int wiringPiSPIGetFd(int channel);
+int wiringPiSPIDataRW(int channel,unsigned char *data,int len);
+int wiringPiSPISetup(int channel,int speed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
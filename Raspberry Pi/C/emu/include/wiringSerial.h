@@ -0,0 +1,19 @@
+#ifndef __WIRINGSERIAL_H
+#define	__WIRINGSERIAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int serialOpen(const char *device,const int baud);
+void serialClose(const int fd);
+void serialFlush(const int fd);
+void serialPutchar(const int fd,const unsigned char c);
+int serialDataAvail(const int fd);
+int serialGetchar(const int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,25 @@
+# RC522 emulator for the Python demos
+# Describe:Loads librc522emu.so (make in ../) for the spidev, smbus, serial and wiringpi
+#          stand-ins of this directory. Put the directory first on the module path to
+#          run a demo without the HAT:
+#          PYTHONPATH="../C/emu/python" RC522_EMU_CARDS="card classic1k DEADBEEF" python3 rc522-python-spi.py
+#          RC522_EMU_LIB=path overrides where the library is loaded from
+
+import ctypes
+import os
+import time
+
+_path = os.environ.get("RC522_EMU_LIB",
+                       os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "librc522emu.so"))
+lib = ctypes.CDLL(_path)
+lib.EmuNow.restype = ctypes.c_ulonglong
+lib.EmuSpend.argtypes = [ctypes.c_ulonglong]
+lib.wiringPiSPIDataRW.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_ubyte), ctypes.c_int]
+lib.serialOpen.argtypes = [ctypes.c_char_p, ctypes.c_int]
+lib.serialPutchar.argtypes = [ctypes.c_int, ctypes.c_ubyte]
+
+if not lib.EmuRealtime():
+    # virtual clock: a sleep of the demo moves the emulator time on and returns at once
+    def _sleep(seconds):
+        lib.EmuSpend(int(seconds * 1e9))
+    time.sleep = _sleep
@@ -0,0 +1,48 @@
+# pyserial on the RC522 emulator, as much as rc522-python-uart.py uses
+
+from _rc522emu import lib
+
+
+class SerialException(IOError):
+    pass
+
+
+class Serial(object):
+    def __init__(self, port=None, baudrate=9600, timeout=None, **kwargs):
+        self.port = port
+        self.baudrate = baudrate
+        self.timeout = timeout
+        self._fd = lib.serialOpen(port.encode(), baudrate)
+        if self._fd < 0:
+            raise SerialException("could not open port %s" % port)
+
+    def write(self, data):
+        for b in bytes(data):
+            lib.serialPutchar(self._fd, b)
+        return len(data)
+
+    def inWaiting(self):
+        return lib.serialDataAvail(self._fd)
+
+    @property
+    def in_waiting(self):
+        return self.inWaiting()
+
+    def read(self, size=1):
+        out = bytearray()
+        while len(out) < size:
+            if self.timeout is not None and not self.inWaiting():
+                break
+            c = lib.serialGetchar(self._fd)
+            if c < 0:
+                break
+            out.append(c)
+        return bytes(out)
+
+    def flushInput(self):
+        lib.serialFlush(self._fd)
+
+    reset_input_buffer = flushInput
+
+    def close(self):
+        lib.serialClose(self._fd)
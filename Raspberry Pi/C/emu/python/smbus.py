@@ -0,0 +1,25 @@
+# smbus on the RC522 emulator, as much as rc522-python-i2c.py uses
+
+from _rc522emu import lib
+
+
+class SMBus(object):
+    def __init__(self, bus=None):
+        self._fd = {}
+
+    def _open(self, addr):
+        if addr not in self._fd:
+            fd = lib.wiringPiI2CSetup(addr)
+            if fd < 0:
+                raise IOError("smbus: no emulated chip")
+            self._fd[addr] = fd
+        return self._fd[addr]
+
+    def read_byte_data(self, addr, cmd):
+        return lib.wiringPiI2CReadReg8(self._open(addr), int(cmd))
+
+    def write_byte_data(self, addr, cmd, val):
+        lib.wiringPiI2CWriteReg8(self._open(addr), int(cmd), int(val) & 0xFF)
+
+    def close(self):
+        self._fd = {}
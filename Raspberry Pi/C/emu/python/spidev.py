@@ -0,0 +1,45 @@
+# spidev on the RC522 emulator, as much as rc522-python-spi.py uses
+
+import ctypes
+from _rc522emu import lib
+
+
+class SpiDev(object):
+    def __init__(self):
+        self.max_speed_hz = 125000000
+        self.mode = 0
+        self._dev = None
+        self._hz = 0
+        self._addr = None
+
+    def open(self, bus, device):
+        self._dev = device & 1
+        self._setup()
+
+    def _setup(self):
+        if lib.wiringPiSPISetup(self._dev, self.max_speed_hz) < 0:
+            raise IOError("spidev: no emulated chip")
+        self._hz = self.max_speed_hz
+
+    def xfer(self, values, *args):
+        if self._hz != self.max_speed_hz:
+            self._setup()
+        buf = (ctypes.c_ubyte * len(values))(*[int(v) & 0xFF for v in values])
+        lib.wiringPiSPIDataRW(self._dev, buf, len(values))
+        return list(buf)
+
+    xfer2 = xfer
+
+    def writebytes(self, values):
+        if len(values) == 1 and values[0] & 0x80:
+            self._addr = values[0]  # read address, the register comes with readbytes()
+            return
+        self.xfer(values)
+
+    def readbytes(self, n):
+        addr = self._addr if self._addr is not None else 0x80
+        self._addr = None
+        return self.xfer([addr] * n + [0])[1:]
+
+    def close(self):
+        self._dev = None
@@ -0,0 +1,52 @@
+# wiringpi on the RC522 emulator, GPIO 25 is the RST of the HAT
+
+from _rc522emu import lib
+
+INPUT = 0
+OUTPUT = 1
+LOW = 0
+HIGH = 1
+
+
+def wiringPiSetup():
+    return lib.wiringPiSetup()
+
+
+def pinMode(pin, mode):
+    lib.pinMode(pin, mode)
+
+
+def digitalWrite(pin, value):
+    lib.digitalWrite(pin, value)
+
+
+def digitalRead(pin):
+    return lib.digitalRead(pin)
+
+
+def delay(ms):
+    lib.delay(ms)
+
+
+def delayMicroseconds(us):
+    lib.delayMicroseconds(us)
+
+
+def millis():
+    return lib.millis()
+
+
+def micros():
+    return lib.micros()
+
+
+def softPwmCreate(pin, value, prange):
+    return lib.softPwmCreate(pin, value, prange)
+
+
+def softPwmWrite(pin, value):
+    lib.softPwmWrite(pin, value)
+
+
+def softPwmStop(pin):
+    lib.softPwmStop(pin)
@@ -0,0 +1,2200 @@
+/***************************************************************************************
+ * Project  :rc522 emulator
+ * Describe :Register-level model of the MFRC522 and of the cards in its field, so the
+ *			 drivers run without the HAT. The chip side has the 64 byte FIFO with its
+ *			 water level alerts, the CommandReg state machine (Idle, Mem, RandomID,
+ *			 CalcCRC, Transmit, Receive, Transceive, MFAuthent, SoftReset), ComIrqReg/
+ *			 DivIrqReg with their Set1/Set2 writes, the timer with TAuto/TAutoRestart,
+ *			 the CRC coprocessor, the digital self-test, ErrorReg/CollReg, SerialSpeedReg
+ *			 and soft/hard power-down, and scripted brown-outs and hangs of the chip. The card side is ISO14443-3 (REQA/WUPA, bit oriented
+ *			 anticollision on every cascade level, SELECT, HLTA) with Mifare_One (keys and
+ *			 access bits of MFAuthent, READ, two phase WRITE) and Mifare_UltraLight/NTAG21x
+ *			 (READ, WRITE, COMPATIBILITY_WRITE, GET_VERSION, FAST_READ, PWD_AUTH, lock
+ *			 bits). The cards of one field all answer, their bits are merged and the first
+ *			 differing bit is reported in CollReg as on the real chip.
+ *			 Time is virtual: every bus access, delay() and RF frame moves the clock on by
+ *			 its modelled duration, so a run is repeatable and takes no real time.
+ * Environment:
+ *			 RC522_EMU_SCRIPT=file   cards and readers, see EmuScriptLine()
+ *			 RC522_EMU_CARDS=text    the same inline, lines separated by ';'
+ *			 RC522_EMU_REALTIME=1    run on CLOCK_MONOTONIC, delays really wait
+ *			 RC522_EMU_RF=0          RF frames take no time
+ *			 RC522_EMU_BUS_NS=n      every bus access takes n ns instead of the model
+ *			 RC522_EMU_REPLAY=trace  answer the reads from a bus trace, see replay_emu.c
+***************************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "rc522_emu.h"
+
+/////////////////////////////////////////////////////////////////////
+//MF522 registers and command words, as in rc522.h
+/////////////////////////////////////////////////////////////////////
+#define CommandReg            0x01
+#define ComIEnReg             0x02
+#define DivlEnReg             0x03
+#define ComIrqReg             0x04
+#define DivIrqReg             0x05
+#define ErrorReg              0x06
+#define Status1Reg            0x07
+#define Status2Reg            0x08
+#define FIFODataReg           0x09
+#define FIFOLevelReg          0x0A
+#define WaterLevelReg         0x0B
+#define ControlReg            0x0C
+#define BitFramingReg         0x0D
+#define CollReg               0x0E
+#define ModeReg               0x11
+#define TxModeReg             0x12
+#define RxModeReg             0x13
+#define TxControlReg          0x14
+#define TxSelReg              0x16
+#define RxSelReg              0x17
+#define RxThresholdReg        0x18
+#define DemodReg              0x19
+#define MifareReg             0x1C
+#define SerialSpeedReg        0x1F
+#define CRCResultRegM         0x21
+#define CRCResultRegL         0x22
+#define ModWidthReg           0x24
+#define RFCfgReg              0x26
+#define GsNReg                0x27
+#define CWGsCfgReg            0x28
+#define ModGsCfgReg           0x29
+#define TModeReg              0x2A
+#define TPrescalerReg         0x2B
+#define TReloadRegH           0x2C
+#define TReloadRegL           0x2D
+#define TCounterValueRegH     0x2E
+#define TCounterValueRegL     0x2F
+#define TestPinEnReg          0x33
+#define AutoTestReg           0x36
+#define VersionReg            0x37
+
+#define PCD_IDLE              0x00
+#define PCD_MEM               0x01
+#define PCD_RANDOMID          0x02
+#define PCD_CALCCRC           0x03
+#define PCD_TRANSMIT          0x04
+#define PCD_NOCMDCHANGE       0x07
+#define PCD_RECEIVE           0x08
+#define PCD_TRANSCEIVE        0x0C
+#define PCD_AUTHENT           0x0E
+#define PCD_RESETPHASE        0x0F
+
+#define IRQ_TX                0x40               //ComIrqReg
+#define IRQ_RX                0x20
+#define IRQ_IDLE              0x10
+#define IRQ_HIALERT           0x08
+#define IRQ_LOALERT           0x04
+#define IRQ_ERR               0x02
+#define IRQ_TIMER             0x01
+#define IRQ_CRC               0x04               //DivIrqReg
+#define ERR_BUFFEROVFL        0x10               //ErrorReg
+#define ERR_COLL              0x08
+#define ERR_CRC               0x04
+#define ERR_PARITY            0x02
+#define ERR_PROTOCOL          0x01
+
+/////////////////////////////////////////////////////////////////////
+//Card commands
+/////////////////////////////////////////////////////////////////////
+#define PICC_REQIDL           0x26
+#define PICC_REQALL           0x52
+#define PICC_ANTICOLL1        0x93
+#define PICC_AUTHENT1A        0x60
+#define PICC_AUTHENT1B        0x61
+#define PICC_READ             0x30
+#define PICC_WRITE            0xA0
+#define PICC_HALT             0x50
+#define UL_WRITE              0xA2
+#define UL_COMP_WRITE         0xA0
+#define UL_GET_VERSION        0x60
+#define UL_FAST_READ          0x3A
+#define UL_READ_CNT           0x39
+#define UL_READ_SIG           0x3C
+#define UL_PWD_AUTH           0x1B
+#define PICC_ACK              0x0A
+#define NAK_INVALID           0x00               //Invalid argument or address
+#define NAK_CRC               0x01               //Parity or CRC error
+#define NAK_CLASSIC           0x04               //Mifare_One: operation not allowed
+
+/////////////////////////////////////////////////////////////////////
+//Timing
+/////////////////////////////////////////////////////////////////////
+#define EMU_FC                13560000ULL        //Carrier
+#define EMU_BIT_NS            9440ULL            //One bit at 106 kBd, 128/fc
+#define EMU_FDT_NS            91150ULL           //Frame delay of a card answer, (1236)/fc
+#define EMU_FDT_SHORT_NS      86430ULL           //REQA/WUPA and anticollision, (1172)/fc
+#define EMU_POR_NS            1000000ULL         //Card power-on until it answers REQA
+#define EMU_OSC_NS            38000ULL           //Oscillator start-up after reset/power-down
+#define EMU_CLASSIC_WRITE_NS  2500000ULL         //EEPROM write of a Mifare_One block
+#define EMU_UL_WRITE_NS       4100000ULL         //EEPROM write of an UltraLight/NTAG page
+#define EMU_SLEEP_NS          200000ULL          //Realtime: shorter waits spin instead of sleeping
+#define EMU_RF(ns)            (Emu.rf ? (ns) : 0ULL)
+
+/////////////////////////////////////////////////////////////////////
+//Phases of a chip command
+/////////////////////////////////////////////////////////////////////
+#define EMU_PH_IDLE           0
+#define EMU_PH_SEND           1                  //Transceive waiting for StartSend
+#define EMU_PH_TX             2                  //Frame on air
+#define EMU_PH_WAIT           3                  //Waiting for the first bit of an answer
+#define EMU_PH_RX             4                  //Answer coming in
+#define EMU_PH_AUTH           5                  //MFAuthent exchanging its frames
+
+//Access conditions of a Mifare_One sector
+#define AC_DATA_READ          0
+#define AC_DATA_WRITE         1
+#define AC_KEYA_WRITE         2
+#define AC_BITS_READ          3
+#define AC_BITS_WRITE         4
+#define AC_KEYB_READ          5
+#define AC_KEYB_WRITE         6
+
+static struct
+{
+    pthread_mutex_t lock;
+    unsigned char realtime;
+    unsigned char rf;
+    long bus_ns;
+    unsigned long long now;                      //Virtual clock
+    struct timespec t0;
+    unsigned int rand;
+    int chips;
+    emu_chip_t chip[EMU_CHIPS];
+    int cards;
+    emu_card_t card[EMU_CARDS];
+    int reader_rst[EMU_CHIPS];
+    unsigned char reader_fault[EMU_CHIPS];       //EMU_FAULT_* of the script
+    unsigned long long fault_at[EMU_CHIPS];
+    unsigned long long fault_every[EMU_CHIPS];
+    unsigned char pin[64];
+} Emu;
+static pthread_once_t EmuOnce = PTHREAD_ONCE_INIT;
+
+//Power-on values of the registers, 0 when not listed
+static const unsigned char EmuResetValue[64] =
+{
+    [CommandReg] = 0x20,[ComIEnReg] = 0x80,[ComIrqReg] = 0x14,[WaterLevelReg] = 0x08,[ControlReg] = 0x10,
+    [CollReg] = 0xA0,[ModeReg] = 0x3F,[TxControlReg] = 0x80,[TxSelReg] = 0x10,[RxSelReg] = 0x84,
+    [RxThresholdReg] = 0x84,[DemodReg] = 0x4D,[MifareReg] = 0x62,[SerialSpeedReg] = 0xEB,
+    [CRCResultRegM] = 0xFF,[CRCResultRegL] = 0xFF,[ModWidthReg] = 0x26,[RFCfgReg] = 0x48,[GsNReg] = 0x88,
+    [CWGsCfgReg] = 0x20,[ModGsCfgReg] = 0x20,[TestPinEnReg] = 0x80,[AutoTestReg] = 0x40,[VersionReg] = 0x92,
+};
+
+//Digital self-test result of a version 2.0 chip (VersionReg 0x92)
+static const unsigned char EmuSelfTestV2[64] =
+{
+    0x00,0xEB,0x66,0xBA,0x57,0xBF,0x23,0x95,0xD0,0xE3,0x0D,0x3D,0x27,0x89,0x5C,0xDE,
+    0x9D,0x3B,0xA7,0x00,0x21,0x5B,0x89,0x82,0x51,0x3A,0xEB,0x02,0x0C,0xA5,0x00,0x49,
+    0x7C,0x84,0x4D,0xB3,0xCC,0xD2,0x1B,0x81,0x5D,0x48,0x76,0xD5,0x71,0x61,0x21,0xA9,
+    0x86,0x96,0x83,0x38,0xCF,0x9D,0x5B,0x6D,0xDC,0x15,0xBA,0x3E,0x7D,0x95,0x3B,0x2F,
+};
+
+//{key A, key B} session: one bit per access condition C1C2C3 that allows the operation
+static const unsigned char EmuAcTable[7][2] =
+{
+    {0x57,0x7F},                                 //AC_DATA_READ
+    {0x01,0x59},                                 //AC_DATA_WRITE
+    {0x03,0x18},                                 //AC_KEYA_WRITE
+    {0xFF,0xF8},                                 //AC_BITS_READ
+    {0x02,0x28},                                 //AC_BITS_WRITE
+    {0x07,0x00},                                 //AC_KEYB_READ
+    {0x03,0x18},                                 //AC_KEYB_WRITE
+};
+
+static int EmuScriptText(const char *text);
+static int EmuScriptLoad(const char *path);
+static void EmuChipReset(emu_chip_t *c,unsigned long long t);
+
+/////////////////////////////////////////////////////////////////////
+//Clock and lock
+/////////////////////////////////////////////////////////////////////
+static void EmuSetup(void)
+{
+    pthread_mutexattr_t attr;
+    const char *s;
+    int i;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr,PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&Emu.lock,&attr);
+    pthread_mutexattr_destroy(&attr);
+    clock_gettime(CLOCK_MONOTONIC,&Emu.t0);
+    Emu.realtime = (s = getenv("RC522_EMU_REALTIME")) != NULL && atoi(s) != 0;
+    Emu.rf = (s = getenv("RC522_EMU_RF")) == NULL || atoi(s) != 0;
+    if((s = getenv("RC522_EMU_REPLAY")) != NULL && EmuReplayLoad(s) != 0)
+    {
+		exit(1);
+    }
+    Emu.bus_ns = (s = getenv("RC522_EMU_BUS_NS")) != NULL ? atol(s) : -1;
+    Emu.rand = 0x2545F491;
+    for(i=0;i<EMU_CHIPS;i++)
+    {
+		Emu.reader_rst[i] = 25;                  //RST of the demos
+    }
+    if((s = getenv("RC522_EMU_SCRIPT")) != NULL && EmuScriptLoad(s) != 0)
+    {
+		exit(1);
+    }
+    if((s = getenv("RC522_EMU_CARDS")) != NULL && EmuScriptText(s) != 0)
+    {
+		exit(1);
+    }
+}
+
+void EmuInit(void)
+{
+    pthread_once(&EmuOnce,EmuSetup);
+}
+
+void EmuLock(void)
+{
+    EmuInit();
+    pthread_mutex_lock(&Emu.lock);
+}
+
+void EmuUnlock(void)
+{
+    pthread_mutex_unlock(&Emu.lock);
+}
+
+int EmuRealtime(void)
+{
+    EmuInit();
+    return Emu.realtime;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Switch between the virtual clock and the wall clock, time
+//         goes on from where it was. Threads that wait at the same time
+//         only overlap their waits on the wall clock, the virtual clock
+//         adds them up. Call while no other thread uses the emulator
+//Parameters:on[IN]:1 = wall clock, 0 = virtual clock
+/////////////////////////////////////////////////////////////////////
+void EmuSetRealtime(int on)
+{
+    struct timespec ts;
+    unsigned long long now;
+    EmuLock();
+    now = EmuNow();
+    if(on)
+    {
+		clock_gettime(CLOCK_MONOTONIC,&ts);
+		ts.tv_sec -= now/1000000000ULL;
+		ts.tv_nsec -= now%1000000000ULL;
+		if(ts.tv_nsec < 0)
+		{
+			ts.tv_nsec += 1000000000L;
+			ts.tv_sec--;
+		}
+		Emu.t0 = ts;
+    }
+    else
+    {
+		__atomic_store_n(&Emu.now,now,__ATOMIC_RELAXED);
+    }
+    Emu.realtime = on != 0;
+    EmuUnlock();
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Cost of one bus access
+//return:Nanoseconds forced by RC522_EMU_BUS_NS, -1 = use the bus model
+/////////////////////////////////////////////////////////////////////
+long EmuBusNs(void)
+{
+    EmuInit();
+    return Emu.bus_ns;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Emulator time
+//return:Nanoseconds since the emulator started
+/////////////////////////////////////////////////////////////////////
+unsigned long long EmuNow(void)
+{
+    struct timespec ts;
+    if(!Emu.realtime)
+    {
+		return __atomic_load_n(&Emu.now,__ATOMIC_RELAXED);
+    }
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (unsigned long long)((ts.tv_sec - Emu.t0.tv_sec)*1000000000LL + ts.tv_nsec - Emu.t0.tv_nsec);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Let time pass, called without the lock held
+//Parameters:ns[IN]:Duration of a delay or of a bus transfer
+/////////////////////////////////////////////////////////////////////
+void EmuSpend(unsigned long long ns)
+{
+    struct timespec ts;
+    unsigned long long end;
+    EmuInit();
+    if(!Emu.realtime)
+    {
+		__atomic_add_fetch(&Emu.now,ns,__ATOMIC_RELAXED);
+		return;
+    }
+    if(ns >= EMU_SLEEP_NS)
+    {
+		ts.tv_sec = ns/1000000000ULL;
+		ts.tv_nsec = ns%1000000000ULL;
+		nanosleep(&ts,NULL);
+		return;
+    }
+    end = EmuNow() + ns;
+    while(EmuNow() < end);
+}
+
+static unsigned char EmuRandom(void)
+{
+    Emu.rand ^= Emu.rand << 13;
+    Emu.rand ^= Emu.rand >> 17;
+    Emu.rand ^= Emu.rand << 5;
+    return (unsigned char)Emu.rand;
+}
+
+/////////////////////////////////////////////////////////////////////
+//Bits and CRC_A
+/////////////////////////////////////////////////////////////////////
+static int EmuBit(const unsigned char *p,unsigned int i)
+{
+    return (p[i >> 3] >> (i & 7)) & 1;
+}
+
+static void EmuSetBit(unsigned char *p,unsigned int i,int v)
+{
+    if(v)
+    {
+		p[i >> 3] |= 1 << (i & 7);
+    }
+    else
+    {
+		p[i >> 3] &= ~(1 << (i & 7));
+    }
+}
+
+//ISO14443-3 annex B
+static unsigned short EmuCrcByte(unsigned short crc,unsigned char b)
+{
+    b ^= (unsigned char)crc;
+    b ^= b << 4;
+    return (crc >> 8) ^ ((unsigned short)b << 8) ^ ((unsigned short)b << 3) ^ (b >> 4);
+}
+
+static unsigned short EmuCrc(unsigned short crc,const unsigned char *p,unsigned int len)
+{
+    while(len--)
+    {
+		crc = EmuCrcByte(crc,*p++);
+    }
+    return crc;
+}
+
+//Preset of the CRC coprocessor and of TxCRCEn/RxCRCEn, ModeReg CRCPreset
+static unsigned short EmuCrcPreset(emu_chip_t *c)
+{
+    static const unsigned short Preset[4] = {0x0000,0x6363,0xA671,0xFFFF};
+    return Preset[c->reg[ModeReg] & 0x03];
+}
+
+static unsigned long long EmuAirNs(unsigned int bits)
+{
+    return EMU_RF((2ULL + bits + bits/8)*EMU_BIT_NS);//SOF, parity and EOF
+}
+
+/////////////////////////////////////////////////////////////////////
+//Cards
+/////////////////////////////////////////////////////////////////////
+static int EmuClassic(const emu_card_t *k)
+{
+    return k->type == EMU_CARD_CLASSIC1K || k->type == EMU_CARD_CLASSIC4K;
+}
+
+static void EmuCardDrop(emu_card_t *k)
+{
+    k->state = k->halted ? EMU_PICC_HALT : EMU_PICC_IDLE;
+    k->level = 0;
+    k->auth = 0;
+    k->write_block = 0;
+    k->pwd_auth = 0;
+}
+
+static int EmuAck(emu_frame_t *r)
+{
+    r->data[0] = PICC_ACK;
+    r->bits = 4;
+    return 1;
+}
+
+static int EmuNak(emu_card_t *k,emu_frame_t *r,unsigned char nak)
+{
+    EmuCardDrop(k);
+    r->data[0] = nak;
+    r->bits = 4;
+    return 1;
+}
+
+static int EmuAnswer(emu_frame_t *r,unsigned int len)
+{
+    unsigned short crc = EmuCrc(0x6363,r->data,len);
+    r->data[len] = (unsigned char)crc;
+    r->data[len+1] = crc >> 8;
+    r->bits = (len + 2)*8;
+    return 1;
+}
+
+//CLn of a cascade level, returns 1 on the last level
+static int EmuCascade(const emu_card_t *k,unsigned char level,unsigned char *cl)
+{
+    unsigned char levels = k->uid_len == 4 ? 1 : k->uid_len == 7 ? 2 : 3;
+    if(level + 1 < levels)
+    {
+		cl[0] = 0x88;                            //Cascade tag
+		memcpy(cl + 1,k->uid + 3*level,3);
+    }
+    else
+    {
+		memcpy(cl,k->uid + 3*level,4);
+    }
+    cl[4] = cl[0] ^ cl[1] ^ cl[2] ^ cl[3];
+    return level + 1 >= levels;
+}
+
+static int EmuAnticoll(emu_card_t *k,const emu_frame_t *f,emu_frame_t *r,unsigned long long *fdt)
+{
+    const unsigned char *d = f->data;
+    unsigned char cl[5];
+    unsigned int known,i;
+    int last = EmuCascade(k,k->level,cl);
+    if(f->bits < 16 || d[0] != PICC_ANTICOLL1 + 2*k->level)
+    {
+		EmuCardDrop(k);
+		return 0;
+    }
+    if(d[1] == 0x70)                             //SELECT
+    {
+		if(f->bits != 72 || EmuCrc(0x6363,d,9) != 0 || memcmp(d + 2,cl,5) != 0)
+		{
+			EmuCardDrop(k);
+			return 0;
+		}
+		if(last)
+		{
+			k->state = EMU_PICC_ACTIVE;
+			r->data[0] = k->sak;
+		}
+		else
+		{
+			k->level++;
+			r->data[0] = 0x04;                   //UID not complete
+		}
+		return EmuAnswer(r,1);
+    }
+    known = ((d[1] >> 4) - 2)*8 + (d[1] & 0x0F);
+    if((d[1] >> 4) < 2 || known >= 40 || f->bits != 16 + known)
+    {
+		EmuCardDrop(k);
+		return 0;
+    }
+    for(i=0;i<known;i++)
+    {
+		if(EmuBit(d + 2,i) != EmuBit(cl,i))
+		{
+			return 0;                            //Another card's UID, this one stays READY
+		}
+    }
+    memset(r->data,0,5);
+    for(i=known;i<40;i++)
+    {
+		EmuSetBit(r->data,i - known,EmuBit(cl,i));
+    }
+    r->bits = 40 - known;
+    *fdt = EMU_FDT_SHORT_NS;
+    return 1;
+}
+
+//Mifare_One layout: 32 sectors of 4 blocks, then (4K) 8 sectors of 16
+static unsigned short EmuClassicBlocks(const emu_card_t *k)
+{
+    return k->type == EMU_CARD_CLASSIC4K ? 256 : 64;
+}
+
+static unsigned char EmuSector(unsigned short blk)
+{
+    return blk < 128 ? blk/4 : 32 + (blk - 128)/16;
+}
+
+static unsigned short EmuTrailer(unsigned char sector)
+{
+    return sector < 32 ? sector*4 + 3 : 128 + (sector - 32)*16 + 15;
+}
+
+static unsigned char EmuGroup(unsigned short blk)
+{
+    if(blk < 128)
+    {
+		return blk % 4;
+    }
+    return (blk - 128) % 16 == 15 ? 3 : ((blk - 128) % 16)/5;
+}
+
+//C1C2C3 of a block group, 0xFF when the access bytes are not consistent
+static unsigned char EmuAccess(const unsigned char *trailer,unsigned char group)
+{
+    unsigned char c1 = trailer[7] >> 4,c2 = trailer[8] & 0x0F,c3 = trailer[8] >> 4;
+    if((trailer[6] & 0x0F) != (~c1 & 0x0F) || (trailer[6] >> 4) != (~c2 & 0x0F) || (trailer[7] & 0x0F) != (~c3 & 0x0F))
+    {
+		return 0xFF;
+    }
+    return (((c1 >> group) & 1) << 2) | (((c2 >> group) & 1) << 1) | ((c3 >> group) & 1);
+}
+
+static int EmuClassicAllow(const emu_card_t *k,unsigned short blk,unsigned char op)
+{
+    const unsigned char *trailer = &k->mem[EmuTrailer(EmuSector(blk))*16];
+    unsigned char cond = EmuAccess(trailer,EmuGroup(blk)),tcond = EmuAccess(trailer,3);
+    if(cond == 0xFF || EmuSector(blk) != k->auth_sector)
+    {
+		return 0;
+    }
+    if(k->auth == PICC_AUTHENT1B && ((EmuAcTable[AC_KEYB_READ][0] >> tcond) & 1))
+    {
+		return 0;                                //Key B is readable, it cannot authenticate
+    }
+    return (EmuAcTable[op][k->auth == PICC_AUTHENT1B] >> cond) & 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:MFAuthent as seen by a Mifare_One card
+//Parameters:p[IN]:The 12 bytes of the FIFO: command, block, key, UID
+//return:0 = no answer, 1 = nonce sent but the reader's answer is wrong, 2 = authenticated
+/////////////////////////////////////////////////////////////////////
+static int EmuClassicAuth(emu_card_t *k,const unsigned char *p,unsigned char crypto)
+{
+    const unsigned char *trailer;
+    if(!EmuClassic(k) || (p[0] != PICC_AUTHENT1A && p[0] != PICC_AUTHENT1B) || !crypto != !k->auth || p[1] >= EmuClassicBlocks(k))
+    {
+		EmuCardDrop(k);
+		return 0;
+    }
+    trailer = &k->mem[EmuTrailer(EmuSector(p[1]))*16];
+    if(memcmp(p + 8,k->uid + k->uid_len - 4,4) != 0 || memcmp(p + 2,trailer + (p[0] == PICC_AUTHENT1A ? 0 : 10),6) != 0)
+    {
+		EmuCardDrop(k);
+		return 1;
+    }
+    k->auth = p[0];
+    k->auth_sector = EmuSector(p[1]);
+    k->write_block = 0;
+    return 2;
+}
+
+static int EmuClassicWritable(const emu_card_t *k,unsigned short blk)
+{
+    if(blk == 0 || blk >= EmuClassicBlocks(k))
+    {
+		return 0;                                //Manufacturer block
+    }
+    if(EmuGroup(blk) == 3)
+    {
+		return EmuClassicAllow(k,blk,AC_KEYA_WRITE) || EmuClassicAllow(k,blk,AC_BITS_WRITE) || EmuClassicAllow(k,blk,AC_KEYB_WRITE);
+    }
+    return EmuClassicAllow(k,blk,AC_DATA_WRITE);
+}
+
+static void EmuClassicStore(emu_card_t *k,unsigned short blk,const unsigned char *d)
+{
+    unsigned char *p = &k->mem[blk*16];
+    if(EmuGroup(blk) != 3)
+    {
+		memcpy(p,d,16);
+		return;
+    }
+    if(EmuClassicAllow(k,blk,AC_KEYA_WRITE))
+    {
+		memcpy(p,d,6);
+    }
+    if(EmuClassicAllow(k,blk,AC_BITS_WRITE))
+    {
+		memcpy(p + 6,d + 6,4);
+    }
+    if(EmuClassicAllow(k,blk,AC_KEYB_WRITE))
+    {
+		memcpy(p + 10,d + 10,6);
+    }
+}
+
+static int EmuClassicCommand(emu_card_t *k,const unsigned char *d,unsigned short len,emu_frame_t *r,unsigned long long *fdt)
+{
+    unsigned short blk;
+    if(k->write_block)                           //Second phase of WRITE
+    {
+		blk = k->write_block - 1;
+		k->write_block = 0;
+		if(len != 16)
+		{
+			return EmuNak(k,r,NAK_CLASSIC);
+		}
+		EmuClassicStore(k,blk,d);
+		*fdt += EMU_CLASSIC_WRITE_NS;
+		return EmuAck(r);
+    }
+    if(d[0] != PICC_READ && d[0] != PICC_WRITE)
+    {
+		EmuCardDrop(k);
+		return 0;
+    }
+    if(!k->auth || len != 2 || d[1] >= EmuClassicBlocks(k))
+    {
+		return EmuNak(k,r,NAK_CLASSIC);
+    }
+    blk = d[1];
+    if(d[0] == PICC_WRITE)
+    {
+		if(!EmuClassicWritable(k,blk))
+		{
+			return EmuNak(k,r,NAK_CLASSIC);
+		}
+		k->write_block = blk + 1;
+		return EmuAck(r);
+    }
+    if(EmuGroup(blk) == 3)
+    {
+		if(EmuAccess(&k->mem[blk*16],3) == 0xFF || EmuSector(blk) != k->auth_sector)
+		{
+			return EmuNak(k,r,NAK_CLASSIC);
+		}
+		memcpy(r->data,&k->mem[blk*16],16);
+		memset(r->data,0,6);                     //Key A is never readable
+		if(!EmuClassicAllow(k,blk,AC_BITS_READ))
+		{
+			memset(r->data + 6,0,4);
+		}
+		if(!EmuClassicAllow(k,blk,AC_KEYB_READ))
+		{
+			memset(r->data + 10,0,6);
+		}
+		return EmuAnswer(r,16);
+    }
+    if(!EmuClassicAllow(k,blk,AC_DATA_READ))
+    {
+		return EmuNak(k,r,NAK_CLASSIC);
+    }
+    memcpy(r->data,&k->mem[blk*16],16);
+    return EmuAnswer(r,16);
+}
+
+//NTAG21x configuration pages: CFG0 (AUTH0 in byte 3), CFG1 (PROT in bit 7), PWD, PACK
+static unsigned short EmuNtagCfg(const emu_card_t *k)
+{
+    return k->pages - 4;
+}
+
+static unsigned char EmuUlByte(const emu_card_t *k,unsigned int addr)
+{
+    unsigned short page = addr/4;
+    if(k->type >= EMU_CARD_NTAG213 && page >= EmuNtagCfg(k) + 2)
+    {
+		return 0;                                //PWD and PACK read as 0
+    }
+    return k->mem[addr];
+}
+
+static int EmuUlProtected(const emu_card_t *k,unsigned short page,int write)
+{
+    unsigned short cfg;
+    if(k->type < EMU_CARD_NTAG213 || k->pwd_auth)
+    {
+		return 0;
+    }
+    cfg = EmuNtagCfg(k);
+    return page >= k->mem[cfg*4 + 3] && (write || (k->mem[(cfg + 1)*4] & 0x80));
+}
+
+static int EmuUlWritable(const emu_card_t *k,unsigned short page)
+{
+    if(page < 2 || page >= k->pages || EmuUlProtected(k,page,1))
+    {
+		return 0;
+    }
+    if(page >= 3 && page <= 7)
+    {
+		return !((k->mem[10] >> page) & 1);      //Static lock bits L-OTP, L4..L7
+    }
+    if(page >= 8 && page <= 15)
+    {
+		return !((k->mem[11] >> (page - 8)) & 1);
+    }
+    return 1;
+}
+
+static int EmuUlStore(emu_card_t *k,unsigned short page,const unsigned char *d)
+{
+    unsigned char *p = &k->mem[page*4];
+    int i;
+    if(!EmuUlWritable(k,page))
+    {
+		return 0;
+    }
+    if(page == 2)
+    {
+		p[2] |= d[2];                            //Lock bytes are one-way
+		p[3] |= d[3];
+    }
+    else if(page == 3)
+    {
+		for(i=0;i<4;i++)
+		{
+			p[i] |= d[i];                        //OTP
+		}
+    }
+    else
+    {
+		memcpy(p,d,4);
+    }
+    return 1;
+}
+
+static int EmuUlCommand(emu_card_t *k,const unsigned char *d,unsigned short len,emu_frame_t *r,unsigned long long *fdt)
+{
+    unsigned int i,n;
+    unsigned short cfg = EmuNtagCfg(k);
+    int ntag = k->type >= EMU_CARD_NTAG213;
+    if(k->write_block)                           //Second phase of COMPATIBILITY_WRITE
+    {
+		n = k->write_block - 1;
+		k->write_block = 0;
+		if(len != 16 || !EmuUlStore(k,n,d))
+		{
+			return EmuNak(k,r,NAK_INVALID);
+		}
+		*fdt += EMU_UL_WRITE_NS;
+		return EmuAck(r);
+    }
+    switch(d[0])
+    {
+		case PICC_READ:
+			if(len != 2 || d[1] >= k->pages || EmuUlProtected(k,d[1],0))
+			{
+				return EmuNak(k,r,NAK_INVALID);
+			}
+			for(i=0;i<16;i++)
+			{
+				r->data[i] = EmuUlByte(k,(d[1]*4 + i) % (k->pages*4u));//Rolls over to page 0
+			}
+			return EmuAnswer(r,16);
+		case UL_WRITE:
+			if(len != 6 || !EmuUlStore(k,d[1],d + 2))
+			{
+				return EmuNak(k,r,NAK_INVALID);
+			}
+			*fdt += EMU_UL_WRITE_NS;
+			return EmuAck(r);
+		case UL_COMP_WRITE:
+			if(len != 2 || !EmuUlWritable(k,d[1]))
+			{
+				return EmuNak(k,r,NAK_INVALID);
+			}
+			k->write_block = d[1] + 1;
+			return EmuAck(r);
+		case UL_GET_VERSION:
+			if(!ntag || len != 1)
+			{
+				break;
+			}
+			memcpy(r->data,"\x00\x04\x04\x02\x01\x00\x0F\x03",8);
+			r->data[6] = k->type == EMU_CARD_NTAG213 ? 0x0F : k->type == EMU_CARD_NTAG215 ? 0x11 : 0x13;
+			return EmuAnswer(r,8);
+		case UL_FAST_READ:
+			if(!ntag)
+			{
+				break;
+			}
+			if(len != 3 || d[1] > d[2] || d[2] >= k->pages)
+			{
+				return EmuNak(k,r,NAK_INVALID);
+			}
+			for(i=d[1];i<=d[2];i++)
+			{
+				if(EmuUlProtected(k,i,0))
+				{
+					return EmuNak(k,r,NAK_INVALID);
+				}
+			}
+			n = (d[2] - d[1] + 1)*4;
+			for(i=0;i<n;i++)
+			{
+				r->data[i] = EmuUlByte(k,d[1]*4 + i);
+			}
+			return EmuAnswer(r,n);
+		case UL_READ_CNT:
+			if(!ntag)
+			{
+				break;
+			}
+			if(len != 2 || d[1] != 0x02)
+			{
+				return EmuNak(k,r,NAK_INVALID);
+			}
+			r->data[0] = (unsigned char)k->nfc_cnt;
+			r->data[1] = (unsigned char)(k->nfc_cnt >> 8);
+			r->data[2] = (unsigned char)(k->nfc_cnt >> 16);
+			return EmuAnswer(r,3);
+		case UL_READ_SIG:
+			if(!ntag)
+			{
+				break;
+			}
+			if(len != 2)
+			{
+				return EmuNak(k,r,NAK_INVALID);
+			}
+			for(i=0;i<32;i++)
+			{
+				r->data[i] = k->uid[i % k->uid_len] ^ (unsigned char)i;//Not ECC, only stable per UID
+			}
+			return EmuAnswer(r,32);
+		case UL_PWD_AUTH:
+			if(!ntag)
+			{
+				break;
+			}
+			if(len != 5 || memcmp(d + 1,&k->mem[(cfg + 2)*4],4) != 0)
+			{
+				return EmuNak(k,r,NAK_INVALID);
+			}
+			k->pwd_auth = 1;
+			memcpy(r->data,&k->mem[(cfg + 3)*4],2);
+			return EmuAnswer(r,2);
+    }
+    EmuCardDrop(k);                              //Unknown command, e.g. GET_VERSION to an UltraLight
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:A card receives a frame
+//Parameters:k[IN]:Powered card
+//           f[IN]:Frame as sent, CRC included
+//      crypto[IN]:Reader has Crypto1 on
+//           r[OUT]:Answer
+//         fdt[OUT]:Delay from the end of f to the first bit of r
+//return:1 = the card answers
+/////////////////////////////////////////////////////////////////////
+static int EmuPicc(emu_card_t *k,const emu_frame_t *f,unsigned char crypto,emu_frame_t *r,unsigned long long *fdt)
+{
+    const unsigned char *d = f->data;
+    unsigned short len;
+    r->bits = 0;
+    *fdt = EMU_FDT_NS;
+    if(f->bits == 7)
+    {
+		if((d[0] == PICC_REQIDL && k->state == EMU_PICC_IDLE) ||
+		   (d[0] == PICC_REQALL && (k->state == EMU_PICC_IDLE || k->state == EMU_PICC_HALT)))
+		{
+			k->halted = k->state == EMU_PICC_HALT;
+			EmuCardDrop(k);
+			k->state = EMU_PICC_READY;
+			memcpy(r->data,k->atqa,2);
+			r->bits = 16;
+			*fdt = EMU_FDT_SHORT_NS;
+			return 1;
+		}
+		if(k->state == EMU_PICC_READY || k->state == EMU_PICC_ACTIVE)
+		{
+			EmuCardDrop(k);
+		}
+		return 0;
+    }
+    if(k->state == EMU_PICC_READY)
+    {
+		return EmuAnticoll(k,f,r,fdt);
+    }
+    if(k->state != EMU_PICC_ACTIVE)
+    {
+		return 0;
+    }
+    if(!crypto != !k->auth)
+    {
+		EmuCardDrop(k);                          //Cannot decode the frame
+		return 0;
+    }
+    len = f->bits/8;
+    if((f->bits & 7) || len < 3 || EmuCrc(0x6363,d,len) != 0)
+    {
+		return EmuNak(k,r,NAK_CRC);
+    }
+    len -= 2;
+    if(d[0] == PICC_HALT && len == 2 && d[1] == 0x00)
+    {
+		k->halted = 1;
+		EmuCardDrop(k);
+		return 0;
+    }
+    if(EmuClassic(k))
+    {
+		return EmuClassicCommand(k,d,len,r,fdt);
+    }
+    return EmuUlCommand(k,d,len,r,fdt);
+}
+
+//Cards of a chip are powered while its field is on, after their power-on time
+static int EmuFieldOn(const emu_chip_t *c,unsigned long long t)
+{
+    return !c->in_reset && t >= c->t_ready && (c->reg[TxControlReg] & 0x03) && !(c->reg[CommandReg] & 0x10);
+}
+
+static void EmuFieldOff(emu_chip_t *c)
+{
+    int i;
+    for(i=0;i<Emu.cards;i++)
+    {
+		if(Emu.card[i].reader == c->id)
+		{
+			Emu.card[i].state = EMU_PICC_OFF;
+		}
+    }
+}
+
+static int EmuCardPowered(emu_chip_t *c,emu_card_t *k,unsigned long long t)
+{
+    unsigned long long on = k->at_ns > c->t_field ? k->at_ns : c->t_field;
+    if(k->reader != c->id)
+    {
+		return 0;
+    }
+    if(!EmuFieldOn(c,t) || (k->until_ns && t >= k->until_ns) || t < on + EMU_POR_NS)
+    {
+		k->state = EMU_PICC_OFF;
+		return 0;
+    }
+    if(k->state == EMU_PICC_OFF)
+    {
+		k->halted = 0;
+		EmuCardDrop(k);
+		k->nfc_cnt++;
+    }
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//Chip
+/////////////////////////////////////////////////////////////////////
+static void EmuFifoAlerts(emu_chip_t *c)
+{
+    unsigned char w = c->reg[WaterLevelReg] & 0x3F;
+    if(c->fifo_len <= w)
+    {
+		c->reg[ComIrqReg] |= IRQ_LOALERT;
+    }
+    if(64 - c->fifo_len <= w)
+    {
+		c->reg[ComIrqReg] |= IRQ_HIALERT;
+    }
+}
+
+static void EmuFifoPush(emu_chip_t *c,unsigned char b)
+{
+    if(c->fifo_len >= 64)
+    {
+		c->reg[ErrorReg] |= ERR_BUFFEROVFL;
+		c->reg[ComIrqReg] |= IRQ_ERR;
+		return;
+    }
+    c->fifo[(c->fifo_head + c->fifo_len) & 63] = b;
+    c->fifo_len++;
+    EmuFifoAlerts(c);
+}
+
+static unsigned char EmuFifoPop(emu_chip_t *c)
+{
+    unsigned char b;
+    if(!c->fifo_len)
+    {
+		return 0x00;
+    }
+    b = c->fifo[c->fifo_head];
+    c->fifo_head = (c->fifo_head + 1) & 63;
+    c->fifo_len--;
+    EmuFifoAlerts(c);
+    return b;
+}
+
+static void EmuCrcDone(emu_chip_t *c)
+{
+    c->reg[CRCResultRegM] = c->crc >> 8;
+    c->reg[CRCResultRegL] = (unsigned char)c->crc;
+    c->crc_ready = 1;
+    c->reg[DivIrqReg] |= IRQ_CRC;
+}
+
+static void EmuCommandDone(emu_chip_t *c)
+{
+    c->cmd = PCD_IDLE;
+    c->phase = EMU_PH_IDLE;
+    c->reg[ComIrqReg] |= IRQ_IDLE;
+}
+
+static void EmuTimerStart(emu_chip_t *c,unsigned long long t)
+{
+    unsigned int prescaler = ((c->reg[TModeReg] & 0x0F) << 8) | c->reg[TPrescalerReg];
+    c->tick_ns = ((2ULL*prescaler + 1)*1000000000ULL + EMU_FC/2)/EMU_FC;
+    c->reload = (c->reg[TReloadRegH] << 8) | c->reg[TReloadRegL];
+    c->t_timer = t + (c->reload + 1ULL)*c->tick_ns;
+    c->timer_on = 1;
+}
+
+static unsigned short EmuTimerCounter(const emu_chip_t *c,unsigned long long t)
+{
+    unsigned long long left;
+    if(!c->timer_on)
+    {
+		return c->counter;
+    }
+    left = c->t_timer > t ? (c->t_timer - t)/c->tick_ns : 0;
+    return left > c->reload ? c->reload : (unsigned short)left;
+}
+
+static void EmuTimerStop(emu_chip_t *c,unsigned long long t)
+{
+    if(c->timer_on)
+    {
+		c->counter = EmuTimerCounter(c,t);
+		c->timer_on = 0;
+    }
+}
+
+static void EmuTimerExpire(emu_chip_t *c,unsigned long long now)
+{
+    unsigned long long period = (c->reload + 1ULL)*c->tick_ns;
+    c->reg[ComIrqReg] |= IRQ_TIMER;
+    if(!(c->reg[TModeReg] & 0x10))
+    {
+		c->timer_on = 0;
+		c->counter = 0;
+		return;
+    }
+    c->t_timer += period*((now - c->t_timer)/period + 1);//TAutoRestart
+}
+
+//Status2Reg ModemState
+static unsigned char EmuModemState(const emu_chip_t *c)
+{
+    switch(c->phase)
+    {
+		case EMU_PH_SEND: return 1;
+		case EMU_PH_TX: case EMU_PH_AUTH: return 3;
+		case EMU_PH_WAIT: return 5;
+		case EMU_PH_RX: return 6;
+    }
+    return 0;
+}
+
+static void EmuTransmit(emu_chip_t *c,unsigned long long t)
+{
+    emu_frame_t *f = &c->tx;
+    unsigned char last = c->reg[BitFramingReg] & 0x07;
+    unsigned short n = 0,crc;
+    while(c->fifo_len && n < EMU_FRAME_MAX - 2)
+    {
+		f->data[n++] = EmuFifoPop(c);
+    }
+    f->bits = (last && n) ? (n - 1)*8 + last : n*8;
+    if((c->reg[TxModeReg] & 0x80) && !last && n)//TxCRCEn
+    {
+		crc = EmuCrc(EmuCrcPreset(c),f->data,n);
+		f->data[n] = (unsigned char)crc;
+		f->data[n+1] = crc >> 8;
+		f->bits += 16;
+    }
+    c->reg[ErrorReg] &= ~(ERR_COLL|ERR_CRC|ERR_PARITY|ERR_PROTOCOL);
+    c->frames++;
+    c->phase = EMU_PH_TX;
+    c->t_phase = t + EmuAirNs(f->bits);
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Merge the answer of one more card into what the receiver hears
+//Parameters:coll[IN/OUT]:First collided bit + 1, 0 = none so far
+/////////////////////////////////////////////////////////////////////
+static void EmuMerge(emu_frame_t *m,const emu_frame_t *r,unsigned int *coll)
+{
+    unsigned int i;
+    int b;
+    for(i=0;i<r->bits;i++)
+    {
+		b = EmuBit(r->data,i);
+		if(i >= m->bits)
+		{
+			EmuSetBit(m->data,i,b);
+		}
+		else if(EmuBit(m->data,i) != b)
+		{
+			if(!*coll || i + 1 < *coll)
+			{
+				*coll = i + 1;
+			}
+			EmuSetBit(m->data,i,1);
+		}
+    }
+    if(r->bits > m->bits)
+    {
+		m->bits = r->bits;
+    }
+}
+
+//Answer as the receiver will put it in the FIFO, aligned to RxAlign
+static void EmuRxLoad(emu_chip_t *c,emu_frame_t *m,unsigned int coll,unsigned long long t_rx)
+{
+    unsigned char align = (c->reg[BitFramingReg] >> 4) & 0x07;
+    unsigned int total = align + m->bits,i,n = (total + 7)/8;
+    if(coll && !(c->reg[CollReg] & 0x80))        //ValuesAfterColl = 0
+    {
+		for(i=coll;i<m->bits;i++)
+		{
+			EmuSetBit(m->data,i,0);
+		}
+    }
+    memset(c->rx,0,n);
+    for(i=0;i<m->bits;i++)
+    {
+		if(EmuBit(m->data,i))
+		{
+			EmuSetBit(c->rx,align + i,1);
+		}
+    }
+    c->rx_err = 0;
+    c->rx_coll = 0x20;                           //CollPosNotValid
+    if(coll)
+    {
+		c->rx_err |= ERR_COLL;
+		c->rx_coll = (align + coll) & 0x1F;
+    }
+    c->rx_last = total & 0x07;
+    c->rx_crcok = c->crc_ok;
+    if(c->reg[RxModeReg] & 0x80)                 //RxCRCEn
+    {
+		if(!(total & 0x07) && n >= 3 && EmuCrc(EmuCrcPreset(c),c->rx,n) == 0)
+		{
+			n -= 2;
+			c->rx_crcok = 1;
+		}
+		else
+		{
+			c->rx_err |= ERR_CRC;
+			c->rx_crcok = 0;
+		}
+    }
+    c->rx_len = n;
+    c->rx_pos = 0;
+    c->t_rx = t_rx;
+    c->t_rx_end = t_rx + EmuAirNs(m->bits);
+}
+
+//The frame in c->tx has reached the cards
+static void EmuExchange(emu_chip_t *c,unsigned long long t)
+{
+    static emu_frame_t r,m;
+    unsigned long long fdt = 0,f;
+    unsigned int coll = 0;
+    unsigned char crypto = c->reg[Status2Reg] & 0x08,gain = (c->reg[RFCfgReg] >> 4) & 0x07;
+    unsigned char minlevel = c->reg[RxThresholdReg] >> 4;
+    emu_card_t *k;
+    int i,heard = 0,noise = 0,n;
+    c->t_rx = EMU_NEVER;
+    if((c->reg[TxModeReg] & 0x70) || !c->tx.bits)
+    {
+		return;                                  //Cards only speak 106 kBd
+    }
+    m.bits = 0;
+    for(i=0;i<Emu.cards;i++)
+    {
+		k = &Emu.card[i];
+		if(!EmuCardPowered(c,k,t) || !EmuPicc(k,&c->tx,crypto,&r,&f) || !r.bits)
+		{
+			continue;
+		}
+		if((c->reg[CommandReg] & 0x20) || (c->reg[RxModeReg] & 0x70) || gain < k->min_gain)
+		{
+			continue;                            //Answered but not heard
+		}
+		if(!heard)
+		{
+			memset(m.data,0,(r.bits + 7)/8);
+		}
+		else if(r.bits > m.bits)
+		{
+			memset(m.data + (m.bits + 7)/8,0,(r.bits + 7)/8 - (m.bits + 7)/8);
+		}
+		EmuMerge(&m,&r,&coll);
+		fdt = f > fdt ? f : fdt;
+		heard = 1;
+		//Every RxGain step over max_gain is a 1 in 4 chance of a bit error, a MinLevel 4 steps up filters one
+		n = gain - k->max_gain - (minlevel > 8 ? (minlevel - 8)/4 : 0);
+		noise = n > noise ? n : noise;
+    }
+    if(heard)
+    {
+		noise = noise > 0 && EmuRandom() < noise*64;
+		if(noise)
+		{
+			m.data[0] ^= 0x10;
+		}
+		EmuRxLoad(c,&m,coll,t + EMU_RF(fdt));
+		if(noise)
+		{
+			c->rx_err |= ERR_PARITY;
+		}
+    }
+}
+
+static void EmuRxEnd(emu_chip_t *c)
+{
+    c->reg[ErrorReg] |= c->rx_err;
+    c->reg[CollReg] = (c->reg[CollReg] & 0x80) | c->rx_coll;
+    c->last_bits = c->rx_last;
+    c->crc_ok = c->rx_crcok;
+    c->reg[ComIrqReg] |= IRQ_RX | (c->reg[ErrorReg] ? IRQ_ERR : 0);
+    if(c->cmd == PCD_TRANSCEIVE)
+    {
+		c->phase = EMU_PH_SEND;                  //Next StartSend sends again
+    }
+    else
+    {
+		EmuCommandDone(c);
+    }
+}
+
+static void EmuAuthent(emu_chip_t *c,unsigned long long t)
+{
+    unsigned char p[12],crypto = c->reg[Status2Reg] & 0x08,gain = (c->reg[RFCfgReg] >> 4) & 0x07;
+    emu_card_t *k;
+    int i,r = 0;
+    if(c->fifo_len < 12)
+    {
+		c->reg[ErrorReg] |= ERR_PROTOCOL;
+		c->reg[ComIrqReg] |= IRQ_ERR;
+		EmuCommandDone(c);
+		return;
+    }
+    for(i=0;i<12;i++)
+    {
+		p[i] = EmuFifoPop(c);
+    }
+    c->reg[ErrorReg] &= ~(ERR_COLL|ERR_CRC|ERR_PARITY|ERR_PROTOCOL);
+    c->frames++;
+    if(!(c->reg[CommandReg] & 0x20) && !(c->reg[TxModeReg] & 0x70) && !(c->reg[RxModeReg] & 0x70))
+    {
+		for(i=0;i<Emu.cards && !r;i++)
+		{
+			k = &Emu.card[i];
+			if(EmuCardPowered(c,k,t) && k->state == EMU_PICC_ACTIVE && gain >= k->min_gain)
+			{
+				r = EmuClassicAuth(k,p,crypto);
+			}
+		}
+    }
+    c->auth_ok = r == 2;
+    c->phase = EMU_PH_AUTH;
+    c->t_phase = t + EmuAirNs(32);               //Request
+    if(r)
+    {
+		c->t_phase += EMU_RF(EMU_FDT_NS) + EmuAirNs(32) + EMU_RF(EMU_FDT_NS) + EmuAirNs(64);//Nonce, reader answer
+		c->frames++;
+    }
+    if(r == 2)
+    {
+		c->t_phase += EMU_RF(EMU_FDT_NS) + EmuAirNs(32);//Card answer
+    }
+}
+
+//Digital self-test, CalcCRC with AutoTestReg SelfTest = 9. The result
+//depends on the internal buffer, which the procedure clears first
+static void EmuSelfTest(emu_chip_t *c)
+{
+    int i;
+    c->fifo_head = 0;
+    c->fifo_len = 0;
+    for(i=0;i<64;i++)
+    {
+		EmuFifoPush(c,EmuSelfTestV2[i] ^ c->mem[i % 25]);
+    }
+}
+
+static void EmuCommand(emu_chip_t *c,unsigned char cmd,unsigned long long t)
+{
+    int i;
+    c->phase = EMU_PH_IDLE;
+    c->cmd = cmd;
+    switch(cmd)
+    {
+		case PCD_IDLE:
+			break;
+		case PCD_MEM:
+			if(c->fifo_len >= 25)
+			{
+				for(i=0;i<25;i++)
+				{
+					c->mem[i] = EmuFifoPop(c);
+				}
+			}
+			else
+			{
+				for(i=0;i<25;i++)
+				{
+					EmuFifoPush(c,c->mem[i]);
+				}
+			}
+			EmuCommandDone(c);
+			break;
+		case PCD_RANDOMID:
+			for(i=0;i<10;i++)
+			{
+				c->mem[i] = EmuRandom();
+			}
+			EmuCommandDone(c);
+			break;
+		case PCD_CALCCRC:                        //Runs until stopped, bytes written later are added
+			if((c->reg[AutoTestReg] & 0x0F) == 0x09)
+			{
+				EmuSelfTest(c);
+				break;
+			}
+			c->crc = EmuCrcPreset(c);
+			while(c->fifo_len)
+			{
+				c->crc = EmuCrcByte(c->crc,EmuFifoPop(c));
+			}
+			EmuCrcDone(c);
+			break;
+		case PCD_TRANSMIT:
+			EmuTransmit(c,t);
+			break;
+		case PCD_RECEIVE:
+			c->phase = EMU_PH_WAIT;
+			c->t_rx = EMU_NEVER;
+			break;
+		case PCD_TRANSCEIVE:
+			c->phase = EMU_PH_SEND;
+			if(c->reg[BitFramingReg] & 0x80)
+			{
+				EmuTransmit(c,t);
+			}
+			break;
+		case PCD_AUTHENT:
+			EmuAuthent(c,t);
+			break;
+		case PCD_RESETPHASE:
+			EmuChipReset(c,t);
+			break;
+		default:
+			EmuCommandDone(c);
+			break;
+    }
+}
+
+static unsigned long long EmuPhaseEvent(const emu_chip_t *c)
+{
+    unsigned long long t;
+    switch(c->phase)
+    {
+		case EMU_PH_TX: case EMU_PH_AUTH:
+			return c->t_phase;
+		case EMU_PH_WAIT:
+			return c->t_rx;
+		case EMU_PH_RX:
+			if(c->rx_pos >= c->rx_len)
+			{
+				return c->t_rx_end;
+			}
+			t = c->t_rx + EMU_RF((1 + 9ULL*(c->rx_pos + 1))*EMU_BIT_NS);
+			return t < c->t_rx_end ? t : c->t_rx_end;
+    }
+    return EMU_NEVER;
+}
+
+static void EmuPhaseStep(emu_chip_t *c,unsigned long long t)
+{
+    unsigned char tauto = c->reg[TModeReg] & 0x80;
+    switch(c->phase)
+    {
+		case EMU_PH_TX:
+			c->reg[ComIrqReg] |= IRQ_TX;
+			if(tauto)
+			{
+				EmuTimerStart(c,t);
+			}
+			EmuExchange(c,t);
+			if(c->cmd == PCD_TRANSMIT)
+			{
+				EmuCommandDone(c);
+				break;
+			}
+			c->phase = EMU_PH_WAIT;
+			break;
+		case EMU_PH_WAIT:
+			if(tauto)
+			{
+				EmuTimerStop(c,t);
+			}
+			c->phase = EMU_PH_RX;
+			break;
+		case EMU_PH_RX:
+			if(c->rx_pos < c->rx_len)
+			{
+				EmuFifoPush(c,c->rx[c->rx_pos++]);
+				break;
+			}
+			EmuRxEnd(c);
+			break;
+		case EMU_PH_AUTH:
+			if(c->auth_ok)
+			{
+				c->reg[Status2Reg] |= 0x08;      //MFCrypto1On
+				EmuCommandDone(c);
+				break;
+			}
+			if(tauto)
+			{
+				EmuTimerStart(c,t);
+			}
+			c->phase = EMU_PH_WAIT;              //Waits for an answer that never comes
+			c->t_rx = EMU_NEVER;
+			break;
+    }
+}
+
+//Run the chip up to now
+static void EmuUpdate(emu_chip_t *c,unsigned long long now)
+{
+    unsigned long long t_ph,t_tm;
+    while(1)
+    {
+		t_ph = EmuPhaseEvent(c);
+		t_tm = c->timer_on ? c->t_timer : EMU_NEVER;
+		if(t_ph != EMU_NEVER && t_ph <= now && t_ph <= t_tm)
+		{
+			EmuPhaseStep(c,t_ph);
+		}
+		else if(t_tm <= now)
+		{
+			EmuTimerExpire(c,now);
+		}
+		else
+		{
+			break;
+		}
+    }
+}
+
+static void EmuChipReset(emu_chip_t *c,unsigned long long t)
+{
+    memcpy(c->reg,EmuResetValue,sizeof(c->reg));
+    c->fifo_head = 0;
+    c->fifo_len = 0;
+    c->crc_ready = 1;
+    c->crc_ok = 0;
+    c->cmd = PCD_IDLE;
+    c->phase = EMU_PH_IDLE;
+    c->last_bits = 0;
+    c->t_rx = EMU_NEVER;
+    c->timer_on = 0;
+    c->counter = 0;
+    c->t_ready = t + EMU_OSC_NS;
+    c->uart_addr = 0;
+    EmuFieldOff(c);
+}
+
+//Scripted fault of the chip, once its time has come
+static void EmuFault(emu_chip_t *c,unsigned long long t)
+{
+    if(t < c->t_fault)
+    {
+		return;
+    }
+    if(c->fault == EMU_FAULT_HANG)
+    {
+		c->hung = 1;
+    }
+    else if(!c->in_reset)
+    {
+		EmuChipReset(c,c->t_fault);
+    }
+    c->t_fault = c->fault_every ? c->t_fault + c->fault_every*((t - c->t_fault)/c->fault_every + 1) : EMU_NEVER;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Read a register, caller holds the lock
+//Parameters:reg[IN]:Register address
+//return:Register value
+/////////////////////////////////////////////////////////////////////
+unsigned char EmuRead(emu_chip_t *c,unsigned char reg)
+{
+    unsigned long long t = EmuNow();
+    unsigned char v;
+    reg &= 0x3F;
+    c->reads++;
+    if(EmuReplayRead(c,reg,&v))
+    {
+		return v;
+    }
+    EmuFault(c,t);
+    if(c->in_reset || c->hung || (t < c->t_ready && reg != CommandReg))
+    {
+		return 0x00;                             //No clock, nothing answers
+    }
+    EmuUpdate(c,t);
+    switch(reg)
+    {
+		case CommandReg:
+			v = (c->reg[CommandReg] & 0x30) | c->cmd;
+			return t < c->t_ready ? v | 0x10 : v;
+		case ComIrqReg: case DivIrqReg:
+			return c->reg[reg] & 0x7F;
+		case Status1Reg:
+			v = (c->crc_ok ? 0x40 : 0) | (c->crc_ready ? 0x20 : 0) | (c->timer_on ? 0x08 : 0);
+			if((c->reg[ComIrqReg] & c->reg[ComIEnReg] & 0x7F) || (c->reg[DivIrqReg] & c->reg[DivlEnReg] & 0x14))
+			{
+				v |= 0x10;
+			}
+			if(64 - c->fifo_len <= (c->reg[WaterLevelReg] & 0x3F))
+			{
+				v |= 0x02;
+			}
+			if(c->fifo_len <= (c->reg[WaterLevelReg] & 0x3F))
+			{
+				v |= 0x01;
+			}
+			return v;
+		case Status2Reg:
+			return (c->reg[Status2Reg] & 0xC8) | EmuModemState(c);
+		case FIFODataReg:
+			return EmuFifoPop(c);
+		case FIFOLevelReg:
+			return c->fifo_len;
+		case ControlReg:
+			return (c->reg[ControlReg] & 0x38) | c->last_bits;
+		case TCounterValueRegH:
+			return EmuTimerCounter(c,t) >> 8;
+		case TCounterValueRegL:
+			return (unsigned char)EmuTimerCounter(c,t);
+    }
+    return c->reg[reg];
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Write a register, caller holds the lock
+//Parameters:reg[IN]:Register address
+//         value[IN]:Value to write
+/////////////////////////////////////////////////////////////////////
+void EmuWrite(emu_chip_t *c,unsigned char reg,unsigned char value)
+{
+    unsigned long long t = EmuNow();
+    int field;
+    reg &= 0x3F;
+    c->writes++;
+    EmuReplayWrite(c,reg,value);
+    EmuFault(c,t);
+    if(c->in_reset || c->hung || t < c->t_ready)
+    {
+		return;
+    }
+    EmuUpdate(c,t);
+    field = EmuFieldOn(c,t);
+    switch(reg)
+    {
+		case CommandReg:
+			if((c->reg[CommandReg] & 0x10) && !(value & 0x10))
+			{
+				c->t_ready = t + EMU_OSC_NS;     //Wake-up from soft power-down
+			}
+			c->reg[CommandReg] = value & 0x30;
+			if(value & 0x10)
+			{
+				c->cmd = PCD_IDLE;
+				c->phase = EMU_PH_IDLE;
+				EmuTimerStop(c,t);
+			}
+			else if((value & 0x0F) != PCD_NOCMDCHANGE)
+			{
+				EmuCommand(c,value & 0x0F,t);
+			}
+			break;
+		case ComIrqReg: case DivIrqReg:
+			if(value & 0x80)
+			{
+				c->reg[reg] |= value & 0x7F;     //Set1/Set2
+			}
+			else
+			{
+				c->reg[reg] &= ~value;
+			}
+			break;
+		case ErrorReg: case Status1Reg: case CRCResultRegM: case CRCResultRegL:
+		case TCounterValueRegH: case TCounterValueRegL: case VersionReg:
+			break;                               //Read-only
+		case Status2Reg:
+			c->reg[Status2Reg] = (value & 0xC0) | (c->reg[Status2Reg] & value & 0x08);//MFCrypto1On can only be cleared
+			break;
+		case FIFODataReg:
+			if(c->cmd == PCD_CALCCRC)
+			{
+				c->crc = EmuCrcByte(c->crc,value);
+				EmuCrcDone(c);
+			}
+			else
+			{
+				EmuFifoPush(c,value);
+			}
+			break;
+		case FIFOLevelReg:
+			if(value & 0x80)                     //FlushBuffer
+			{
+				c->fifo_head = 0;
+				c->fifo_len = 0;
+				c->reg[ErrorReg] &= ~ERR_BUFFEROVFL;
+				EmuFifoAlerts(c);
+			}
+			break;
+		case WaterLevelReg:
+			c->reg[WaterLevelReg] = value & 0x3F;
+			break;
+		case ControlReg:
+			if(value & 0x80)
+			{
+				EmuTimerStop(c,t);
+			}
+			if(value & 0x40)
+			{
+				EmuTimerStart(c,t);
+			}
+			c->reg[ControlReg] = value & 0x38;
+			break;
+		case BitFramingReg:
+			c->reg[BitFramingReg] = value;
+			if((value & 0x80) && c->cmd == PCD_TRANSCEIVE && c->phase == EMU_PH_SEND)
+			{
+				EmuTransmit(c,t);
+			}
+			break;
+		case CollReg:
+			c->reg[CollReg] = (c->reg[CollReg] & 0x7F) | (value & 0x80);
+			break;
+		default:
+			c->reg[reg] = value;
+			break;
+    }
+    if(!field && EmuFieldOn(c,t))
+    {
+		c->t_field = t;
+    }
+    else if(field && !EmuFieldOn(c,t))
+    {
+		EmuFieldOff(c);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Chip on a host interface, created on first use
+//Parameters:bus[IN]:EMU_BUS_*
+//          addr[IN]:SPI channel, I2C address or serial port number
+//return:Chip, NULL when EMU_CHIPS are in use
+/////////////////////////////////////////////////////////////////////
+emu_chip_t *EmuChip(unsigned char bus,int addr)
+{
+    emu_chip_t *c = NULL;
+    int i;
+    EmuLock();
+    for(i=0;i<Emu.chips;i++)
+    {
+		if(Emu.chip[i].bus == bus && Emu.chip[i].addr == addr)
+		{
+			c = &Emu.chip[i];
+		}
+    }
+    if(c == NULL && Emu.chips < EMU_CHIPS)
+    {
+		c = &Emu.chip[Emu.chips];
+		memset(c,0,sizeof(emu_chip_t));
+		c->id = Emu.chips++;
+		c->bus = bus;
+		c->addr = addr;
+		c->rst_pin = Emu.reader_rst[c->id];
+		c->baud = 9600;
+		EmuChipReset(c,0);
+		c->t_ready = 0;                          //Powered since boot
+		c->fault = Emu.reader_fault[c->id];
+		c->t_fault = c->fault ? Emu.fault_at[c->id] : EMU_NEVER;
+		c->fault_every = Emu.fault_every[c->id];
+    }
+    EmuUnlock();
+    return c;
+}
+
+emu_chip_t *EmuChipId(int id)
+{
+    EmuInit();
+    return id >= 0 && id < Emu.chips ? &Emu.chip[id] : NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:GPIO output, NRSTPD of every chip wired to the pin follows it
+/////////////////////////////////////////////////////////////////////
+void EmuPin(int pin,int level)
+{
+    unsigned long long t = EmuNow();
+    int i;
+    if(pin < 0 || pin >= 64)
+    {
+		return;
+    }
+    Emu.pin[pin] = level != 0;
+    for(i=0;i<Emu.chips;i++)
+    {
+		emu_chip_t *c = &Emu.chip[i];
+		if(c->rst_pin != pin)
+		{
+			continue;
+		}
+		if(!level && !c->in_reset)
+		{
+			EmuChipReset(c,t);
+			c->in_reset = 1;                     //Hard power-down
+			c->hung = 0;
+		}
+		else if(level && c->in_reset)
+		{
+			c->in_reset = 0;
+			EmuChipReset(c,t);
+		}
+    }
+}
+
+int EmuPinRead(int pin)
+{
+    return pin >= 0 && pin < 64 ? Emu.pin[pin] : 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//Serial interface: the host sends the address byte (MSB set = read),
+//a read is answered with the register, a write address is echoed
+//and the next byte is the value. Both sides need the same baud rate
+/////////////////////////////////////////////////////////////////////
+static unsigned int EmuChipBaud(const emu_chip_t *c)
+{
+    unsigned char t0 = c->reg[SerialSpeedReg] >> 5,t1 = c->reg[SerialSpeedReg] & 0x1F;
+    if(!t0)
+    {
+		return 27120000/(t1 + 1);
+    }
+    return 27120000/((t1 + 33) << (t0 - 1));
+}
+
+static int EmuBaudMismatch(unsigned int host,unsigned int chip)
+{
+    unsigned int d = host > chip ? host - chip : chip - host;
+    return d*100ULL > 3ULL*chip;                 //More than 3%: framing errors
+}
+
+static void EmuUartQueue(emu_chip_t *c,unsigned char b,unsigned long long t)
+{
+    if(c->uart_len == EMU_UART_QUEUE)
+    {
+		return;                                  //Host does not read, its buffer overruns
+    }
+    c->uart_byte[c->uart_len] = b;
+    c->uart_time[c->uart_len] = t;
+    c->uart_len++;
+}
+
+void EmuUartPut(emu_chip_t *c,unsigned char b)
+{
+    unsigned long long t = EmuNow(),byte_ns = 10000000000ULL/c->baud;
+    unsigned int chip = EmuChipBaud(c);
+    unsigned char reg;
+    c->t_uart_tx = (c->t_uart_tx > t ? c->t_uart_tx : t) + byte_ns;
+    EmuFault(c,t);
+    if(c->in_reset || c->hung || EmuBaudMismatch(c->baud,chip))
+    {
+		return;
+    }
+    if(c->uart_addr)
+    {
+		reg = c->uart_addr - 1;
+		c->uart_addr = 0;
+		EmuWrite(c,reg,b);
+		return;
+    }
+    if(b & 0x80)
+    {
+		EmuUartQueue(c,EmuRead(c,b & 0x3F),c->t_uart_tx + 10000000000ULL/chip);
+		return;
+    }
+    c->uart_addr = (b & 0x3F) + 1;
+    EmuUartQueue(c,EmuReplayEcho(c,b),c->t_uart_tx + 10000000000ULL/chip);
+}
+
+//Bytes that have reached the host
+int EmuUartAvail(emu_chip_t *c)
+{
+    unsigned long long t = EmuNow();
+    int n = 0;
+    while(n < c->uart_len && c->uart_time[n] <= t)
+    {
+		n++;
+    }
+    return n;
+}
+
+//Arrival of the next byte, EMU_NEVER = none on its way
+unsigned long long EmuUartNext(emu_chip_t *c)
+{
+    return c->uart_len ? c->uart_time[0] : EMU_NEVER;
+}
+
+int EmuUartGet(emu_chip_t *c)
+{
+    unsigned char b;
+    if(!EmuUartAvail(c))
+    {
+		return -1;
+    }
+    b = c->uart_byte[0];
+    c->uart_len--;
+    memmove(c->uart_byte,c->uart_byte + 1,c->uart_len);
+    memmove(c->uart_time,c->uart_time + 1,c->uart_len*sizeof(c->uart_time[0]));
+    return b;
+}
+
+void EmuUartFlush(emu_chip_t *c)
+{
+    int n = EmuUartAvail(c);
+    c->uart_len -= n;
+    memmove(c->uart_byte,c->uart_byte + n,c->uart_len);
+    memmove(c->uart_time,c->uart_time + n,c->uart_len*sizeof(c->uart_time[0]));
+}
+
+/////////////////////////////////////////////////////////////////////
+//Scripted cards
+/////////////////////////////////////////////////////////////////////
+static int EmuHex(const char *s,unsigned char *out,int max)
+{
+    int n = 0;
+    unsigned int v;
+    while(s[0] && s[1] && n < max)
+    {
+		if(sscanf(s,"%2x",&v) != 1)
+		{
+			return -1;
+		}
+		out[n++] = (unsigned char)v;
+		s += 2;
+    }
+    return s[0] ? -1 : n;
+}
+
+//Factory content of a card
+static void EmuCardDefaults(emu_card_t *k)
+{
+    static const unsigned short Pages[] = {0,0,0,16,45,135,231};
+    unsigned char *m = k->mem;
+    unsigned short i,cfg;
+    memset(m,0,EMU_CARD_MEM);
+    if(EmuClassic(k))
+    {
+		k->atqa[0] = k->type == EMU_CARD_CLASSIC4K ? 0x02 : 0x04;
+		if(k->uid_len == 7)
+		{
+			k->atqa[0] |= 0x40;
+		}
+		k->sak = k->type == EMU_CARD_CLASSIC4K ? 0x18 : 0x08;
+		memcpy(m,k->uid,k->uid_len);
+		if(k->uid_len == 4)
+		{
+			m[4] = m[0] ^ m[1] ^ m[2] ^ m[3];
+			m[5] = k->sak;
+			m[6] = k->atqa[0];
+			m[7] = k->atqa[1];
+		}
+		for(i=0;i<EmuClassicBlocks(k);i++)
+		{
+			if(EmuGroup(i) == 3)
+			{
+				memcpy(&m[i*16],"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x07\x80\x69\xFF\xFF\xFF\xFF\xFF\xFF",16);
+			}
+		}
+		return;
+    }
+    k->atqa[0] = 0x44;
+    k->sak = 0x00;
+    k->pages = Pages[k->type];
+    m[0] = k->uid[0];
+    m[1] = k->uid[1];
+    m[2] = k->uid[2];
+    m[3] = 0x88 ^ m[0] ^ m[1] ^ m[2];
+    memcpy(m + 4,k->uid + 3,4);
+    m[8] = m[4] ^ m[5] ^ m[6] ^ m[7];
+    m[9] = 0x48;
+    if(k->type == EMU_CARD_ULTRALIGHT)
+    {
+		return;
+    }
+    m[12] = 0xE1;                                //NDEF capability container
+    m[13] = 0x10;
+    m[14] = k->type == EMU_CARD_NTAG213 ? 0x12 : k->type == EMU_CARD_NTAG215 ? 0x3E : 0x6D;
+    memcpy(m + 16,"\x03\x00\xFE\x00",4);
+    cfg = EmuNtagCfg(k);
+    memcpy(&m[cfg*4],"\x04\x00\x00\xFF",4);
+    memcpy(&m[(cfg + 1)*4],"\x00\x05\x00\x00",4);
+    memcpy(&m[(cfg + 2)*4],"\xFF\xFF\xFF\xFF",4);
+}
+
+static int EmuReader(int id)
+{
+    return id >= 0 && id < EMU_CHIPS ? id : -1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:One line of a card script
+//  reader N rst=PIN                  NRSTPD of reader N (default 25)
+//  fault N brownout|hang at=ms [every=ms]
+//       brownout: the registers of reader N go back to power-on values
+//       hang: reader N stops answering until its NRSTPD is pulled low
+//  card TYPE UID [reader=N] [at=ms] [until=ms] [atqa=XXXX] [sak=XX] [gain=N] [noise=N]
+//       TYPE classic1k classic4k ultralight ntag213 ntag215 ntag216
+//       UID 4, 7 or 10 bytes hex; at/until: in the field during that time
+//       gain: lowest RFCfgReg RxGain (0..7) that still hears the card
+//       noise: highest RxGain that hears it without bit errors
+//  block N HEX32                     Mifare_One block of the last card
+//  page N HEX8                       UltraLight/NTAG page of the last card
+//  key SECTOR A|B HEX12              Mifare_One key of the last card
+//Readers are numbered in the order the driver opens them
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+static int EmuScriptLine(char *line,int no)
+{
+    static const char *Types[] = {NULL,"classic1k","classic4k","ultralight","ntag213","ntag215","ntag216"};
+    char *tok[16],*save,*p,*v;
+    emu_card_t *k = Emu.cards ? &Emu.card[Emu.cards - 1] : NULL;
+    unsigned char data[16];
+    int n = 0,i,id;
+    if((p = strchr(line,'#')) != NULL)
+    {
+		*p = '\0';
+    }
+    for(p=strtok_r(line," \t\r",&save);p != NULL && n < 16;p=strtok_r(NULL," \t\r",&save))
+    {
+		tok[n++] = p;
+    }
+    if(n == 0)
+    {
+		return 0;
+    }
+    if(!strcmp(tok[0],"reader") && n >= 2 && (id = EmuReader(atoi(tok[1]))) >= 0)
+    {
+		for(i=2;i<n;i++)
+		{
+			if(!strncmp(tok[i],"rst=",4))
+			{
+				Emu.reader_rst[id] = atoi(tok[i] + 4);
+			}
+		}
+		return 0;
+    }
+    if(!strcmp(tok[0],"fault") && n >= 3 && (id = EmuReader(atoi(tok[1]))) >= 0 &&
+       (!strcmp(tok[2],"brownout") || !strcmp(tok[2],"hang")))
+    {
+		Emu.reader_fault[id] = !strcmp(tok[2],"hang") ? EMU_FAULT_HANG : EMU_FAULT_BROWNOUT;
+		Emu.fault_at[id] = 0;
+		Emu.fault_every[id] = 0;
+		for(i=3;i<n;i++)
+		{
+			if(!strncmp(tok[i],"at=",3))
+			{
+				Emu.fault_at[id] = strtoull(tok[i] + 3,NULL,0)*1000000ULL;
+			}
+			else if(!strncmp(tok[i],"every=",6))
+			{
+				Emu.fault_every[id] = strtoull(tok[i] + 6,NULL,0)*1000000ULL;
+			}
+			else
+			{
+				fprintf(stderr,"rc522-emu: line %d: bad option %s\n",no,tok[i]);
+				return -1;
+			}
+		}
+		return 0;
+    }
+    if(!strcmp(tok[0],"card") && n >= 3 && Emu.cards < EMU_CARDS)
+    {
+		k = &Emu.card[Emu.cards];
+		memset(k,0,sizeof(emu_card_t));
+		for(i=1;i<7 && strcmp(tok[1],Types[i]);i++);
+		k->type = i;
+		i = EmuHex(tok[2],k->uid,10);
+		if(k->type > EMU_CARD_NTAG216 || (i != 4 && i != 7 && i != 10) || (!EmuClassic(k) && i != 7))
+		{
+			fprintf(stderr,"rc522-emu: line %d: bad card type or UID\n",no);
+			return -1;
+		}
+		k->uid_len = i;
+		EmuCardDefaults(k);
+		k->max_gain = 7;
+		for(i=3;i<n;i++)
+		{
+			if((v = strchr(tok[i],'=')) == NULL)
+			{
+				break;
+			}
+			v++;
+			if(!strncmp(tok[i],"reader=",7) && EmuReader(atoi(v)) >= 0)
+			{
+				k->reader = atoi(v);
+			}
+			else if(!strncmp(tok[i],"at=",3))
+			{
+				k->at_ns = strtoull(v,NULL,0)*1000000ULL;
+			}
+			else if(!strncmp(tok[i],"until=",6))
+			{
+				k->until_ns = strtoull(v,NULL,0)*1000000ULL;
+			}
+			else if(!strncmp(tok[i],"atqa=",5) && EmuHex(v,data,2) == 2)
+			{
+				k->atqa[0] = data[1];            //Written as the 16 bit value, sent LSB first
+				k->atqa[1] = data[0];
+			}
+			else if(!strncmp(tok[i],"sak=",4) && EmuHex(v,data,1) == 1)
+			{
+				k->sak = data[0];
+			}
+			else if(!strncmp(tok[i],"gain=",5))
+			{
+				k->min_gain = atoi(v) & 0x07;
+			}
+			else if(!strncmp(tok[i],"noise=",6))
+			{
+				k->max_gain = atoi(v) & 0x07;
+			}
+			else
+			{
+				break;
+			}
+		}
+		if(i < n)
+		{
+			fprintf(stderr,"rc522-emu: line %d: bad option %s\n",no,tok[i]);
+			return -1;
+		}
+		Emu.cards++;
+		return 0;
+    }
+    if(k != NULL && n == 3 && !strcmp(tok[0],"block") && EmuClassic(k) &&
+       (id = atoi(tok[1])) >= 0 && id < EmuClassicBlocks(k) && EmuHex(tok[2],data,16) == 16)
+    {
+		memcpy(&k->mem[id*16],data,16);
+		return 0;
+    }
+    if(k != NULL && n == 3 && !strcmp(tok[0],"page") && !EmuClassic(k) &&
+       (id = atoi(tok[1])) >= 0 && id < k->pages && EmuHex(tok[2],data,4) == 4)
+    {
+		memcpy(&k->mem[id*4],data,4);
+		return 0;
+    }
+    if(k != NULL && n == 4 && !strcmp(tok[0],"key") && EmuClassic(k) && (id = atoi(tok[1])) >= 0 &&
+       id < (k->type == EMU_CARD_CLASSIC4K ? 40 : 16) && (tok[2][0] == 'A' || tok[2][0] == 'B') && EmuHex(tok[3],data,6) == 6)
+    {
+		memcpy(&k->mem[EmuTrailer(id)*16 + (tok[2][0] == 'A' ? 0 : 10)],data,6);
+		return 0;
+    }
+    fprintf(stderr,"rc522-emu: line %d: cannot parse '%s'\n",no,tok[0]);
+    return -1;
+}
+
+static int EmuScriptText(const char *text)
+{
+    char *buf = strdup(text),*line = buf,*end;
+    int no = 1,ret = 0;
+    if(buf == NULL)
+    {
+		return -1;
+    }
+    while(line != NULL && ret == 0)
+    {
+		if((end = strpbrk(line,"\n;")) != NULL)
+		{
+			*end++ = '\0';
+		}
+		ret = EmuScriptLine(line,no++);
+		line = end;
+    }
+    free(buf);
+    return ret;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Add cards and readers, see EmuScriptLine()
+//Parameters:text[IN]:Script, lines separated by newlines or ';'
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int EmuScript(const char *text)
+{
+    int ret;
+    EmuLock();
+    ret = EmuScriptText(text);
+    EmuUnlock();
+    return ret;
+}
+
+static int EmuScriptLoad(const char *path)
+{
+    FILE *fp = fopen(path,"r");
+    char *buf;
+    long size;
+    int ret = -1;
+    if(fp == NULL)
+    {
+		perror(path);
+		return -1;
+    }
+    fseek(fp,0,SEEK_END);
+    size = ftell(fp);
+    fseek(fp,0,SEEK_SET);
+    if(size >= 0 && (buf = calloc(1,size + 1)) != NULL)
+    {
+		if(fread(buf,1,size,fp) == (size_t)size)
+		{
+			ret = EmuScriptText(buf);
+		}
+		free(buf);
+    }
+    fclose(fp);
+    return ret;
+}
+
+int EmuScriptFile(const char *path)
+{
+    int ret;
+    EmuLock();
+    ret = EmuScriptLoad(path);
+    EmuUnlock();
+    return ret;
+}
+
+void EmuCardsClear(void)
+{
+    EmuLock();
+    Emu.cards = 0;
+    EmuUnlock();
+}
+
+emu_card_t *EmuCard(int index)
+{
+    EmuInit();
+    return index >= 0 && index < Emu.cards ? &Emu.card[index] : NULL;
+}
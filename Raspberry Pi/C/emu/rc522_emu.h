@@ -0,0 +1,174 @@
+#ifndef __RC522_EMU_H
+#define	__RC522_EMU_H
+
+/////////////////////////////////////////////////////////////////////
+//Limits
+/////////////////////////////////////////////////////////////////////
+#define EMU_CHIPS             4                  //Readers, one per SPI channel/I2C address/serial port
+#define EMU_CARDS             16                 //Cards of every reader together
+#define EMU_FRAME_MAX         1024               //Longest RF frame in bytes, NTAG216 FAST_READ + CRC
+#define EMU_CARD_MEM          4096               //Classic 4K, the largest memory modelled
+#define EMU_UART_QUEUE        16                 //Bytes on their way from the chip to the host
+#define EMU_NEVER             (~0ULL)            //Time of an event that is not going to happen
+
+/////////////////////////////////////////////////////////////////////
+//Host interfaces a chip can sit on
+/////////////////////////////////////////////////////////////////////
+#define EMU_BUS_SPI           0
+#define EMU_BUS_I2C           1
+#define EMU_BUS_UART          2
+
+/////////////////////////////////////////////////////////////////////
+//Card types
+/////////////////////////////////////////////////////////////////////
+#define EMU_CARD_CLASSIC1K    1                  //Mifare_One S50
+#define EMU_CARD_CLASSIC4K    2                  //Mifare_One S70
+#define EMU_CARD_ULTRALIGHT   3                  //Mifare_UltraLight, 16 pages, no GET_VERSION
+#define EMU_CARD_NTAG213      4
+#define EMU_CARD_NTAG215      5
+#define EMU_CARD_NTAG216      6
+
+/////////////////////////////////////////////////////////////////////
+//ISO14443-3 card states
+/////////////////////////////////////////////////////////////////////
+#define EMU_PICC_OFF          0                  //Not powered: out of the field or RF off
+#define EMU_PICC_IDLE         1
+#define EMU_PICC_READY        2                  //Answered REQA/WUPA, anticollision on cascade level `level`
+#define EMU_PICC_ACTIVE       3                  //Selected
+#define EMU_PICC_HALT         4
+
+/////////////////////////////////////////////////////////////////////
+//Chip faults of a script
+/////////////////////////////////////////////////////////////////////
+#define EMU_FAULT_NONE        0
+#define EMU_FAULT_BROWNOUT    1                  //Supply dip: every register back to its power-on value
+#define EMU_FAULT_HANG        2                  //Digital part latched up: nothing answers until a hard reset
+
+/////////////////////////////////////////////////////////////////////
+//An RF frame, bits are sent LSB of data[0] first
+/////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    unsigned short bits;
+    unsigned char data[EMU_FRAME_MAX];
+} emu_frame_t;
+
+/////////////////////////////////////////////////////////////////////
+//Virtual card
+/////////////////////////////////////////////////////////////////////
+typedef struct emu_card
+{
+    unsigned char type;                          //EMU_CARD_*
+    unsigned char reader;                        //Chip whose field it is in
+    unsigned char uid[10];
+    unsigned char uid_len;                       //4, 7 or 10
+    unsigned char atqa[2];
+    unsigned char sak;                           //SAK of the last cascade level
+    unsigned char min_gain;                      //Lowest RFCfgReg RxGain that still receives the card
+    unsigned char max_gain;                      //Highest RxGain before noise corrupts its answers
+    unsigned long long at_ns;                    //In the field from ...
+    unsigned long long until_ns;                 //... until, 0 = for ever
+    //ISO14443-3
+    unsigned char state;                         //EMU_PICC_*
+    unsigned char halted;                        //Falls back to HALT instead of IDLE
+    unsigned char level;                         //READY: cascade level 0..2
+    //Mifare_One
+    unsigned char auth;                          //0 = none, else 0x60/0x61 of the session
+    unsigned char auth_sector;
+    unsigned short write_block;                  //Second phase of WRITE pending: block + 1
+    //Mifare_UltraLight/NTAG
+    unsigned short pages;
+    unsigned char pwd_auth;                      //PWD_AUTH passed in this session
+    unsigned int nfc_cnt;
+    unsigned char mem[EMU_CARD_MEM];             //Blocks or pages
+} emu_card_t;
+
+/////////////////////////////////////////////////////////////////////
+//Virtual MFRC522
+/////////////////////////////////////////////////////////////////////
+typedef struct emu_chip
+{
+    int id;                                      //Reader number of the script, order of first use
+    unsigned char bus;                           //EMU_BUS_*
+    int addr;                                    //SPI channel, I2C address, serial port number
+    int rst_pin;                                 //NRSTPD, held low = hard power-down
+    unsigned char reg[64];
+    unsigned char fifo[64];
+    unsigned char fifo_head;
+    unsigned char fifo_len;
+    unsigned char mem[25];                       //Internal buffer of the Mem command
+    unsigned short crc;                          //CRC coprocessor running value
+    unsigned char crc_ready;                     //Status1Reg CRCReady/CRCOk
+    unsigned char crc_ok;
+    //Command in progress
+    unsigned char cmd;
+    unsigned char phase;                         //EMU_PH_* of rc522_emu.c
+    unsigned long long t_phase;                  //Time the current phase ends
+    emu_frame_t tx;                              //Frame on its way to the cards
+    unsigned char rx[EMU_FRAME_MAX];             //Answer as the receiver writes it to the FIFO
+    unsigned short rx_len;
+    unsigned short rx_pos;                       //Bytes of rx already in the FIFO
+    unsigned char rx_last;                       //RxLastBits of the answer
+    unsigned char rx_err;                        //ErrorReg bits raised at the end of the answer
+    unsigned char rx_coll;                       //CollReg of the answer
+    unsigned char rx_crcok;
+    unsigned char last_bits;                     //ControlReg RxLastBits
+    unsigned long long t_rx;                     //First bit of the answer, EMU_NEVER = none
+    unsigned long long t_rx_end;
+    unsigned char auth_ok;                       //MFAuthent in progress will succeed
+    //Timer
+    unsigned char timer_on;
+    unsigned long long t_timer;                  //Expiry
+    unsigned long long tick_ns;
+    unsigned short reload;
+    unsigned short counter;                      //TCounterValue while stopped
+    unsigned long long t_ready;                  //Oscillator stable after reset/power-down
+    unsigned long long t_field;                  //RF field switched on
+    unsigned char in_reset;
+    unsigned char hung;                          //EMU_FAULT_HANG happened, cleared by NRSTPD
+    unsigned char fault;                         //EMU_FAULT_* of the script
+    unsigned long long t_fault;                  //Next fault, EMU_NEVER = none
+    unsigned long long fault_every;              //Period of a repeated fault, 0 = once
+    //Serial interface
+    unsigned int baud;                           //Host side of the line
+    unsigned char uart_addr;                     //Write in progress: register + 1
+    unsigned char uart_len;
+    unsigned char uart_byte[EMU_UART_QUEUE];
+    unsigned long long uart_time[EMU_UART_QUEUE];//Arrival of each byte at the host
+    unsigned long long t_uart_tx;                //Line from the host busy until
+    //Statistics
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long frames;                        //RF frames sent
+} emu_chip_t;
+
+void EmuInit(void);
+void EmuLock(void);
+void EmuUnlock(void);
+unsigned long long EmuNow(void);
+void EmuSpend(unsigned long long ns);
+int EmuRealtime(void);
+void EmuSetRealtime(int on);
+long EmuBusNs(void);
+emu_chip_t *EmuChip(unsigned char bus,int addr);
+emu_chip_t *EmuChipId(int id);
+unsigned char EmuRead(emu_chip_t *c,unsigned char reg);
+void EmuWrite(emu_chip_t *c,unsigned char reg,unsigned char value);
+void EmuPin(int pin,int level);
+int EmuPinRead(int pin);
+void EmuUartPut(emu_chip_t *c,unsigned char b);
+int EmuUartAvail(emu_chip_t *c);
+int EmuUartGet(emu_chip_t *c);
+unsigned long long EmuUartNext(emu_chip_t *c);
+void EmuUartFlush(emu_chip_t *c);
+int EmuScript(const char *text);
+int EmuScriptFile(const char *path);
+void EmuCardsClear(void);
+emu_card_t *EmuCard(int index);
+int EmuReplayLoad(const char *path);
+int EmuReplaying(void);
+int EmuReplayRead(emu_chip_t *c,unsigned char reg,unsigned char *value);
+void EmuReplayWrite(emu_chip_t *c,unsigned char reg,unsigned char value);
+unsigned char EmuReplayEcho(emu_chip_t *c,unsigned char b);
+
+#endif
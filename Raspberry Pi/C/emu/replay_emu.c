@@ -0,0 +1,386 @@
+/***************************************************************************************
+ * Project  :rc522 emulator
+ * Describe :Replay of a bus trace recorded by the C drivers (make TRACE=1, see
+ *			 rc522_trace.c). With RC522_EMU_REPLAY=<trace> every register read of the
+ *			 driver is answered from the trace instead of from the chip model, so a
+ *			 run captured on the HAT (a UART echo mismatch, RC522_Init waiting for
+ *			 GsNReg, a card that failed to authenticate) happens again here, as often as
+ *			 needed, under a debugger or with a changed driver.
+ *			 Each reader follows the records of its own reader in the trace, readers are
+ *			 paired in order of first use. An access is looked for in the next
+ *			 EMU_REPLAY_WINDOW records, records the driver no longer makes are skipped;
+ *			 an access that is not in the trace is a divergence and is answered by the
+ *			 model, as is everything after the end of the trace. Time follows the
+ *			 trace: the virtual clock is moved on to the timestamp of each record
+ *			 matched, so waits the recorded run went through happen again.
+ *			 RC522_EMU_REPLAY_STRICT=1 stops the program at the first divergence
+ *			 (exit status 3) or when every reader has reached the end of the trace.
+ *			 A summary goes to stderr at exit.
+***************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rc522_emu.h"
+
+/////////////////////////////////////////////////////////////////////
+//Trace file, the layout of rc522_trace.h
+/////////////////////////////////////////////////////////////////////
+#define TRACE_MAGIC           0x43525452         //"RTRC"
+#define TRACE_VERSION         1
+#define TRACE_DATA_OFF        4096
+#define TRACE_RING            0x01
+#define TRACE_RD              1
+#define TRACE_WR              2
+#define TRACE_ECHO            3
+
+#define EMU_REPLAY_WINDOW     64                 //Records of a reader looked at for one access
+
+typedef struct
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int record_size;
+    unsigned int capacity;
+    unsigned int flags;
+    char transport[8];
+    unsigned int reserved;
+    unsigned long long real_ns;
+    unsigned long long head;
+    unsigned long long dropped;
+} emu_trace_hdr_t;
+
+typedef struct
+{
+    unsigned long long t_ns;
+    unsigned int tid;
+    unsigned char kind;
+    unsigned char reader;
+    unsigned char addr;
+    unsigned char value;
+} emu_trace_rec_t;
+
+//Replay state of one chip
+typedef struct
+{
+    int reader;                                  //Reader byte of the trace, -1 = not paired yet
+    unsigned long pos;                           //Next record to look at
+    unsigned char done;                          //No record of the reader left
+    unsigned char t_set;
+    long long t_off;                             //Emulator time minus trace time
+    unsigned long hit;
+    unsigned long skip;                          //Records passed over
+    unsigned long miss;                          //Accesses not in the trace
+    unsigned long diff;                          //Writes of another value
+    unsigned long beyond;                        //Accesses after the end of the trace
+    char first[96];                              //First divergence
+} emu_replay_t;
+
+static struct
+{
+    const char *path;
+    emu_trace_rec_t *rec;                        //In recording order, NULL = no replay
+    unsigned long n;
+    unsigned char strict;
+    int readers;                                 //Readers in the trace
+    unsigned char reader[EMU_CHIPS];             //In order of their first record
+    unsigned long start[EMU_CHIPS];              //First record of each
+    int paired;                                  //Chips paired with a reader so far
+    emu_replay_t chip[EMU_CHIPS];
+} Replay;
+
+/////////////////////////////////////////////////////////////////////
+//function:Summary of the replay, at exit
+/////////////////////////////////////////////////////////////////////
+static void EmuReplayReport(void)
+{
+    emu_replay_t *r;
+    unsigned long j,left;
+    int i;
+    for(i=0;i<EMU_CHIPS;i++)
+    {
+		r = &Replay.chip[i];
+		if(r->reader < 0)
+		{
+			continue;
+		}
+		for(j=r->pos,left=0;j<Replay.n;j++)
+		{
+			left += Replay.rec[j].reader == r->reader;
+		}
+		fprintf(stderr,"rc522 emu: replay of %s, reader %d: %lu accesses matched, %lu records skipped, "
+				"%lu accesses not in the trace, %lu writes of another value, %lu after the end, %lu records left\n",
+				Replay.path,i,r->hit,r->skip,r->miss,r->diff,r->beyond,left);
+		if(r->first[0])
+		{
+			fprintf(stderr,"rc522 emu: reader %d first diverged at %s\n",i,r->first);
+		}
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Load a trace for replay, called once by the emulator setup
+//Parameters:path[IN]:Trace file
+//return:Successfully returns 0
+/////////////////////////////////////////////////////////////////////
+int EmuReplayLoad(const char *path)
+{
+    emu_trace_hdr_t hdr;
+    emu_trace_rec_t rec;
+    unsigned long long first,end,i;
+    const char *s;
+    FILE *fp;
+    int k;
+    if((fp = fopen(path,"rb")) == NULL || fread(&hdr,sizeof(hdr),1,fp) != 1 ||
+       hdr.magic != TRACE_MAGIC || hdr.version != TRACE_VERSION || hdr.record_size != sizeof(emu_trace_rec_t) || hdr.capacity == 0)
+    {
+		fprintf(stderr,"rc522 emu: %s: not a bus trace\n",path);
+		if(fp != NULL)
+		{
+			fclose(fp);
+		}
+		return -1;
+    }
+    end = hdr.head;
+    if(!(hdr.flags & TRACE_RING) && end > hdr.capacity)
+    {
+		end = hdr.capacity;
+    }
+    first = end > hdr.capacity ? end - hdr.capacity : 0;
+    if(first != 0)
+    {
+		fprintf(stderr,"rc522 emu: %s is a ring that lost its start, the replay diverges at once\n",path);
+    }
+    if((Replay.rec = malloc((end - first + 1)*sizeof(emu_trace_rec_t))) == NULL)
+    {
+		fclose(fp);
+		return -1;
+    }
+    for(i=first;i<end;i++)
+    {
+		if(((i == first || i % hdr.capacity == 0) &&      //A ring wraps once
+		    fseek(fp,TRACE_DATA_OFF + (long)(i % hdr.capacity)*sizeof(emu_trace_rec_t),SEEK_SET) != 0) ||
+		   fread(&rec,sizeof(rec),1,fp) != 1)
+		{
+			break;
+		}
+		if(rec.kind == 0)                        //Slot of a crash, never written
+		{
+			continue;
+		}
+		for(k=0;k<Replay.readers && Replay.reader[k] != rec.reader;k++);
+		if(k == Replay.readers && k < EMU_CHIPS)
+		{
+			Replay.reader[k] = rec.reader;
+			Replay.start[k] = Replay.n;
+			Replay.readers++;
+		}
+		Replay.rec[Replay.n++] = rec;
+    }
+    fclose(fp);
+    for(i=0;i<EMU_CHIPS;i++)
+    {
+		Replay.chip[i].reader = -1;
+    }
+    Replay.path = path;
+    Replay.strict = (s = getenv("RC522_EMU_REPLAY_STRICT")) != NULL && atoi(s) != 0;
+    atexit(EmuReplayReport);
+    return 0;
+}
+
+int EmuReplaying(void)
+{
+    return Replay.rec != NULL;
+}
+
+//Every paired reader has reached the end of the trace
+static void EmuReplayEnd(void)
+{
+    int i;
+    for(i=0;i<EMU_CHIPS;i++)
+    {
+		if(Replay.chip[i].reader >= 0 && !Replay.chip[i].done)
+		{
+			return;
+		}
+    }
+    if(Replay.strict)
+    {
+		exit(0);
+    }
+}
+
+//The replay state of a chip, paired with the next reader of the trace on first use
+static emu_replay_t *EmuReplayChip(emu_chip_t *c)
+{
+    emu_replay_t *r = &Replay.chip[c->id];
+    int k;
+    if(r->reader >= 0)
+    {
+		return r;
+    }
+    if((k = Replay.paired++) >= Replay.readers)
+    {
+		r->reader = 256;                         //More readers than the trace has
+		r->done = 1;
+		return r;
+    }
+    r->reader = Replay.reader[k];
+    r->pos = Replay.start[k];
+    return r;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Find the next record of an access
+//Parameters:kind[IN]:TRACE_RD/WR/ECHO
+//            reg[IN]:Register
+//         window[IN]:Records of the reader to look at
+//return:Index of the record, -1 = not found
+/////////////////////////////////////////////////////////////////////
+static long EmuReplayFind(emu_replay_t *r,unsigned char kind,unsigned char reg,unsigned int window)
+{
+    unsigned long i;
+    unsigned int seen = 0;
+    for(i=r->pos;i<Replay.n && seen < window;i++)
+    {
+		const emu_trace_rec_t *e = &Replay.rec[i];
+		if(e->reader != r->reader)
+		{
+			continue;
+		}
+		if(e->kind == kind && (e->addr & 0x3F) == reg)
+		{
+			return (long)i;
+		}
+		seen++;
+    }
+    if(i == Replay.n && seen == 0)
+    {
+		r->done = 1;
+		EmuReplayEnd();
+    }
+    return -1;
+}
+
+//Take record i: skip what lies before it and follow its time
+static const emu_trace_rec_t *EmuReplayTake(emu_replay_t *r,long i)
+{
+    const emu_trace_rec_t *e = &Replay.rec[i];
+    unsigned long j;
+    unsigned long long now,t;
+    for(j=r->pos;j<(unsigned long)i;j++)
+    {
+		r->skip += Replay.rec[j].reader == r->reader;
+    }
+    r->pos = i + 1;
+    r->hit++;
+    if(!EmuRealtime())
+    {
+		now = EmuNow();
+		if(!r->t_set)
+		{
+			r->t_off = (long long)(now - e->t_ns);
+			r->t_set = 1;
+		}
+		t = e->t_ns + r->t_off;
+		if(t > now)
+		{
+			EmuSpend(t - now);
+		}
+    }
+    return e;
+}
+
+//An access the trace does not have
+static void EmuReplayDiverge(emu_replay_t *r,int id,const char *what,unsigned char reg,unsigned char value)
+{
+    static const char Kind[] = "?RWE";
+    const emu_trace_rec_t *e;
+    unsigned long i;
+    if(r->done)
+    {
+		r->beyond++;
+		return;
+    }
+    if(r->first[0] == 0)
+    {
+		for(i=r->pos;i<Replay.n && Replay.rec[i].reader != r->reader;i++);
+		e = i < Replay.n ? &Replay.rec[i] : NULL;
+		snprintf(r->first,sizeof(r->first),"record %lu: driver %s 0x%02X = 0x%02X, trace %c 0x%02X = 0x%02X",
+				 i,what,reg,value,e ? Kind[e->kind & 3] : '-',e ? e->addr : 0,e ? e->value : 0);
+    }
+    if(Replay.strict)
+    {
+		fprintf(stderr,"rc522 emu: reader %d diverged from the trace\n",id);
+		exit(3);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Answer a register read from the trace, caller holds the lock
+//Parameters:value[OUT]:Value recorded
+//return:1 = answered, 0 = the model has to answer
+/////////////////////////////////////////////////////////////////////
+int EmuReplayRead(emu_chip_t *c,unsigned char reg,unsigned char *value)
+{
+    emu_replay_t *r;
+    long i;
+    if(Replay.rec == NULL)
+    {
+		return 0;
+    }
+    r = EmuReplayChip(c);
+    if(r->done || (i = EmuReplayFind(r,TRACE_RD,reg,EMU_REPLAY_WINDOW)) < 0)
+    {
+		r->miss += !r->done;
+		EmuReplayDiverge(r,c->id,"reads",reg,0);
+		return 0;
+    }
+    *value = EmuReplayTake(r,i)->value;
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Follow a register write in the trace, caller holds the lock;
+//         the model gets the write as well
+/////////////////////////////////////////////////////////////////////
+void EmuReplayWrite(emu_chip_t *c,unsigned char reg,unsigned char value)
+{
+    emu_replay_t *r;
+    long i;
+    if(Replay.rec == NULL)
+    {
+		return;
+    }
+    r = EmuReplayChip(c);
+    if(r->done || (i = EmuReplayFind(r,TRACE_WR,reg,EMU_REPLAY_WINDOW)) < 0)
+    {
+		r->miss += !r->done;
+		EmuReplayDiverge(r,c->id,"writes",reg,value);
+		return;
+    }
+    if(EmuReplayTake(r,i)->value != value)
+    {
+		r->diff++;
+		EmuReplayDiverge(r,c->id,"writes",reg,value);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//function:Echo of the address byte of a UART write: what the trace
+//         recorded when the line garbled it, else the address itself
+/////////////////////////////////////////////////////////////////////
+unsigned char EmuReplayEcho(emu_chip_t *c,unsigned char b)
+{
+    emu_replay_t *r;
+    long i;
+    if(Replay.rec == NULL)
+    {
+		return b;
+    }
+    r = EmuReplayChip(c);
+    if(r->done || (i = EmuReplayFind(r,TRACE_ECHO,b & 0x3F,1)) < 0)
+    {
+		return b;
+    }
+    return EmuReplayTake(r,i)->value;
+}
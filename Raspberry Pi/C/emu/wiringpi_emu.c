@@ -0,0 +1,349 @@
+/***************************************************************************************
+ * Project  :rc522 emulator
+ * Describe :The part of the wiringPi API the demos use, on top of the chip model of
+ *			 rc522_emu.c instead of the Raspberry Pi. Linked in place of -lwiringPi
+ *			 (make EMU=1) it runs the SPI, I2C and UART drivers unmodified; the Python
+ *			 drivers reach the same code through the modules in python/.
+ *			 Every transfer costs what it costs on the Pi: SPI at the wiringPiSPISetup()
+ *			 clock, I2C at 100 kHz, the serial line at the serialOpen() baud rate, which
+ *			 has to match SerialSpeedReg as on the HAT, plus a syscall each.
+***************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "wiringPi.h"
+#include "wiringPiSPI.h"
+#include "wiringPiI2C.h"
+#include "wiringSerial.h"
+#include "softPwm.h"
+#include "rc522_emu.h"
+
+#define EMU_SYSCALL_NS        5000ULL            //ioctl/read/write of one transfer
+#define EMU_SPI_CS_NS         5000ULL            //Chip select and transfer setup of spidev
+#define EMU_I2C_HZ            100000ULL          //Default I2C clock of the Raspberry Pi
+#define EMU_SERIAL_WAIT_NS    10000000000ULL     //serialGetchar gives up after 10 s
+#define EMU_FDS               16
+
+static struct
+{
+    int fd;
+    emu_chip_t *chip;
+} EmuFd[EMU_FDS];
+static emu_chip_t *SpiChip[2];
+static int SpiHz[2];
+static char SerialPort[EMU_CHIPS][64];
+
+//Duration of a bus transfer, or RC522_EMU_BUS_NS
+static void EmuBus(unsigned long long ns)
+{
+    long fixed = EmuBusNs();
+    EmuSpend(fixed >= 0 ? (unsigned long long)fixed : ns + EMU_SYSCALL_NS);
+}
+
+//A real descriptor, so callers can close() it or print it
+static int EmuFdNew(emu_chip_t *c)
+{
+    int i,fd;
+    if(c == NULL || (fd = open("/dev/null",O_RDWR|O_CLOEXEC)) < 0)
+    {
+		return -1;
+    }
+    for(i=0;i<EMU_FDS;i++)
+    {
+		if(EmuFd[i].chip == NULL)
+		{
+			EmuFd[i].fd = fd;
+			EmuFd[i].chip = c;
+			return fd;
+		}
+    }
+    close(fd);
+    return -1;
+}
+
+static emu_chip_t *EmuFdChip(int fd)
+{
+    int i;
+    for(i=0;i<EMU_FDS;i++)
+    {
+		if(EmuFd[i].chip != NULL && EmuFd[i].fd == fd)
+		{
+			return EmuFd[i].chip;
+		}
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//GPIO and timing
+/////////////////////////////////////////////////////////////////////
+int wiringPiSetup(void)
+{
+    EmuInit();
+    return 0;
+}
+
+void pinMode(int pin,int mode)
+{
+}
+
+void digitalWrite(int pin,int value)
+{
+    EmuLock();
+    EmuPin(pin,value);
+    EmuUnlock();
+}
+
+int digitalRead(int pin)
+{
+    return EmuPinRead(pin);
+}
+
+void pwmWrite(int pin,int value)
+{
+}
+
+void delay(unsigned int howLong)
+{
+    EmuSpend(howLong*1000000ULL);
+}
+
+void delayMicroseconds(unsigned int howLong)
+{
+    EmuSpend(howLong*1000ULL);
+}
+
+void delayMicrosecondsHard(unsigned int howLong)
+{
+    EmuSpend(howLong*1000ULL);
+}
+
+unsigned int millis(void)
+{
+    EmuInit();
+    return (unsigned int)(EmuNow()/1000000ULL);
+}
+
+unsigned int micros(void)
+{
+    EmuInit();
+    return (unsigned int)(EmuNow()/1000ULL);
+}
+
+int softPwmCreate(int pin,int value,int range)
+{
+    return 0;
+}
+
+void softPwmWrite(int pin,int value)
+{
+}
+
+void softPwmStop(int pin)
+{
+}
+
+/////////////////////////////////////////////////////////////////////
+//SPI: byte 0 is the address ((reg<<1)&0x7E, MSB set = read). A read
+//returns each register during the byte after its address, a write
+//puts every following byte into the same register
+/////////////////////////////////////////////////////////////////////
+int wiringPiSPISetup(int channel,int speed)
+{
+    channel &= 1;
+    if(speed <= 0 || (SpiChip[channel] = EmuChip(EMU_BUS_SPI,channel)) == NULL)
+    {
+		return -1;
+    }
+    SpiHz[channel] = speed;
+    return EmuFdNew(SpiChip[channel]);
+}
+
+int wiringPiSPIGetFd(int channel)
+{
+    int i;
+    for(i=0;i<EMU_FDS;i++)
+    {
+		if(EmuFd[i].chip != NULL && EmuFd[i].chip == SpiChip[channel & 1])
+		{
+			return EmuFd[i].fd;
+		}
+    }
+    return -1;
+}
+
+int wiringPiSPIDataRW(int channel,unsigned char *data,int len)
+{
+    emu_chip_t *c = SpiChip[channel & 1];
+    unsigned char addr,next;
+    int i;
+    if(c == NULL)
+    {
+		return -1;
+    }
+    EmuBus(len*8ULL*1000000000ULL/SpiHz[channel & 1] + EMU_SPI_CS_NS);
+    EmuLock();
+    addr = data[0];
+    data[0] = 0x00;
+    for(i=1;i<len;i++)
+    {
+		if(addr & 0x80)
+		{
+			next = data[i];
+			data[i] = EmuRead(c,(addr >> 1) & 0x3F);
+			addr = next;
+		}
+		else
+		{
+			EmuWrite(c,(addr >> 1) & 0x3F,data[i]);
+			data[i] = 0x00;
+		}
+    }
+    EmuUnlock();
+    return len;
+}
+
+/////////////////////////////////////////////////////////////////////
+//I2C: the register address is the command byte, the chip ignores
+//bits 6 and 7 of it
+/////////////////////////////////////////////////////////////////////
+int wiringPiI2CSetup(const int devId)
+{
+    return EmuFdNew(EmuChip(EMU_BUS_I2C,devId));
+}
+
+int wiringPiI2CReadReg8(int fd,int reg)
+{
+    emu_chip_t *c = EmuFdChip(fd);
+    int v;
+    if(c == NULL)
+    {
+		return -1;
+    }
+    EmuBus(39*1000000000ULL/EMU_I2C_HZ);         //START, address+W, register, repeated START, address+R, data, STOP
+    EmuLock();
+    v = EmuRead(c,reg & 0x3F);
+    EmuUnlock();
+    return v;
+}
+
+int wiringPiI2CWriteReg8(int fd,int reg,int data)
+{
+    emu_chip_t *c = EmuFdChip(fd);
+    if(c == NULL)
+    {
+		return -1;
+    }
+    EmuBus(29*1000000000ULL/EMU_I2C_HZ);         //START, address+W, register, data, STOP
+    EmuLock();
+    EmuWrite(c,reg & 0x3F,data);
+    EmuUnlock();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//Serial line, one chip per device name
+/////////////////////////////////////////////////////////////////////
+int serialOpen(const char *device,const int baud)
+{
+    emu_chip_t *c;
+    int i;
+    for(i=0;i<EMU_CHIPS && SerialPort[i][0] && strcmp(SerialPort[i],device);i++);
+    if(i == EMU_CHIPS || baud <= 0)
+    {
+		return -1;
+    }
+    snprintf(SerialPort[i],sizeof(SerialPort[i]),"%s",device);
+    if((c = EmuChip(EMU_BUS_UART,i)) == NULL)
+    {
+		return -1;
+    }
+    EmuLock();
+    c->baud = baud;
+    EmuUnlock();
+    return EmuFdNew(c);
+}
+
+void serialClose(const int fd)
+{
+    int i;
+    for(i=0;i<EMU_FDS;i++)
+    {
+		if(EmuFd[i].chip != NULL && EmuFd[i].fd == fd)
+		{
+			EmuFd[i].chip = NULL;
+			close(fd);
+		}
+    }
+}
+
+void serialPutchar(const int fd,const unsigned char c)
+{
+    emu_chip_t *chip = EmuFdChip(fd);
+    if(chip == NULL)
+    {
+		return;
+    }
+    EmuBus(0);                                   //The UART sends on its own, write() returns at once
+    EmuLock();
+    EmuUartPut(chip,c);
+    EmuUnlock();
+}
+
+int serialDataAvail(const int fd)
+{
+    emu_chip_t *chip = EmuFdChip(fd);
+    int n;
+    if(chip == NULL)
+    {
+		return -1;
+    }
+    EmuBus(0);
+    EmuLock();
+    n = EmuUartAvail(chip);
+    EmuUnlock();
+    return n;
+}
+
+int serialGetchar(const int fd)
+{
+    emu_chip_t *chip = EmuFdChip(fd);
+    unsigned long long t,now;
+    int v;
+    if(chip == NULL)
+    {
+		return -1;
+    }
+    EmuBus(0);
+    EmuLock();
+    t = EmuUartNext(chip);
+    EmuUnlock();
+    now = EmuNow();
+    if(t == EMU_NEVER)
+    {
+		EmuSpend(EMU_SERIAL_WAIT_NS);
+		return -1;
+    }
+    if(t > now)
+    {
+		EmuSpend(t - now);
+    }
+    EmuLock();
+    v = EmuUartGet(chip);
+    EmuUnlock();
+    return v;
+}
+
+void serialFlush(const int fd)
+{
+    emu_chip_t *chip = EmuFdChip(fd);
+    if(chip == NULL)
+    {
+		return;
+    }
+    EmuBus(0);
+    EmuLock();
+    EmuUartFlush(chip);
+    EmuUnlock();
+}
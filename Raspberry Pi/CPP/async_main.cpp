@@ -0,0 +1,86 @@
+/***************************************************************************************
+ * Project  :rc522-cpp
+ * Describe :Two RC522 boards on SPI CE0/CE1 served by one thread: each reader runs its
+ *			 own coroutine (select, print UID, read block 8, halt) and the event loop
+ *			 switches between them while the RF exchanges are in flight
+ * Experimental Platform :Raspberry Pi 4B + 2 x RC522 RFID HAT
+ * Hardware Connection :SPI, switches as in Raspberry Pi/C/SPI/main.c, shared RST
+ *			 Optional IRQ lines: ./async <irq gpio CE0> <irq gpio CE1>, polled otherwise
+ * Library Version :WiringPi_V2.52
+***************************************************************************************/
+#include <cstdio>
+#include <cstdlib>
+#include "rc522_async.hpp"
+
+#define RST 25
+
+static rc522::Task<> Conversation(rc522::AsyncReader<rc522::Spi> &reader,int id)
+{
+    const rc522::Key key = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}; //IC card initial password
+    rc522::Block block;
+    while(1)
+    {
+		rc522::Result<rc522::Card> card = co_await reader.Select();
+		if(!card)
+		{
+			co_await reader.Sleep(10000000ULL);
+			continue;
+		}
+		printf("reader %d Card ID:",id);
+		for(auto b : card->Uid())
+		{
+			printf("%02X",b);
+		}
+		printf("\r\n");
+		rc522::Result<void> ok = co_await reader.Auth(rc522::KeyA,8,key,card->AuthUid());
+		if(ok)
+		{
+			ok = co_await reader.Read(8,block);
+		}
+		if(ok)
+		{
+			printf("reader %d block_8=[ ",id);
+			for(auto b : block)
+			{
+				printf("%02X ",b);
+			}
+			printf("]\n");
+		}
+		co_await reader.Halt();
+		co_await reader.Sleep(1000000000ULL);
+    }
+}
+
+int main(int argc,char *argv[])
+{
+    int irq0 = -1,irq1 = -1;
+
+	if(wiringPiSetup()==-1)
+	{
+		printf("init wiringPi error\n");
+	}
+	if(wiringPiSPISetup(0,500000)==-1 || wiringPiSPISetup(1,500000)==-1)
+	{
+		printf("init spi failed!\n");
+	}
+	if(argc == 3)
+	{
+		irq0 = rc522::OpenIrqLine(atoi(argv[1]));
+		irq1 = rc522::OpenIrqLine(atoi(argv[2]));
+	}
+	pinMode(RST,OUTPUT);
+	rc522::Reader<rc522::Spi> reader0(rc522::Spi(0),RST);
+	rc522::Reader<rc522::Spi> reader1(rc522::Spi(1),-1);//Reset together with reader0
+	if(!reader0.Init() || !reader1.Init())
+	{
+		printf("RC522 does not start\n");
+	}
+
+	rc522::EventLoop loop;
+	rc522::AsyncReader<rc522::Spi> async0(loop,reader0,irq0);
+	rc522::AsyncReader<rc522::Spi> async1(loop,reader1,irq1);
+	loop.Spawn(Conversation(async0,0));
+	loop.Spawn(Conversation(async1,1));
+	loop.Run();
+	return 0;
+}
@@ -0,0 +1,60 @@
+/***************************************************************************************
+ * Project  :rc522-cpp
+ * Describe :Read the UID of the S50 card and print the card number, then block 8,
+ *			 through the header-only rc522::Reader
+ * Experimental Platform :Raspberry Pi 4B + RC522 RFID HAT
+ * Hardware Connection :SPI, switches as in Raspberry Pi/C/SPI/main.c
+ * Library Version :WiringPi_V2.52
+***************************************************************************************/
+#include <cstdio>
+#include "rc522.hpp"
+
+#define RST 25
+
+int main()
+{
+    const rc522::Key key = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}; //IC card initial password
+    rc522::Block block;
+
+	if(wiringPiSetup()==-1)
+	{
+		printf("init wiringPi error\n");
+	}
+	if(wiringPiSPISetup(0,500000)==-1)
+	{
+		printf("init spi failed!\n");
+	}
+	pinMode(RST,OUTPUT);
+	rc522::Reader<rc522::Spi> reader(rc522::Spi(0),RST);
+	if(!reader.Init())
+	{
+		printf("RC522 does not start\n");
+	}
+	while(1)
+	{
+		auto session = reader.Select();
+		if(!session)
+		{
+			delay(10);
+			continue;
+		}
+		const rc522::Card &card = session->GetCard();
+		printf("Card ID:");
+		for(auto b : card.Uid())
+		{
+			printf("%02X",b);
+		}
+		printf("\r\n");
+		if(session->Auth(rc522::KeyA,8,key) && session->Read(8,block))
+		{
+			printf("block_8=[ ");
+			for(auto b : block)
+			{
+				printf("%02X ",b);
+			}
+			printf("]\n");
+		}
+		delay(1000);
+	}                                            //The card is HALTed, it is read again once it left the field
+	return 0;
+}
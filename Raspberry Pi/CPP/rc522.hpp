@@ -0,0 +1,882 @@
+/***************************************************************************************
+ * Project  :rc522-cpp
+ * Describe :Header-only C++20 interface to the RC522 RFID HAT.
+ *			 rc522::Reader<Transport> runs the same register sequences as the C library
+ *			 (Raspberry Pi/C/xxx/rc522.c), with the bus backend as a template parameter:
+ *			 Spi, I2c and Uart are plain classes whose read/write inline into the
+ *			 protocol code, so there is no function pointer or virtual call per register.
+ *			 Every wait on the chip is bounded as in the C library, a chip that hangs
+ *			 fails with Error::Com, and Init takes over a chip set up already. The RF
+ *			 tuner, retry policy and health monitor of the C library are not ported.
+ *			 Results are rc522::Result<T> (std::expected when the library has it),
+ *			 a Session HALTs its card when it goes out of scope.
+ * Usage    :rc522::Reader<rc522::Spi> reader(rc522::Spi(0),25);
+ *			 reader.Init();
+ *			 if(auto s = reader.Select())
+ *			 {
+ *			     s->Auth(rc522::KeyA,8,key);
+ *			     s->Read(8,block);
+ *			 }                                  //HALT here
+ * Library Version :WiringPi_V2.52, g++ -std=c++20
+***************************************************************************************/
+#ifndef __RC522_HPP
+#define	__RC522_HPP
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <utility>
+#if __has_include(<expected>)
+#include <expected>
+#endif
+extern "C"
+{
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#include <wiringPiI2C.h>
+#include <wiringSerial.h>
+void delayMicrosecondsHard(unsigned int howLong);
+}
+#include "rc522_regs.hpp"
+
+namespace rc522
+{
+
+/////////////////////////////////////////////////////////////////////
+//Timing, as in rc522.h
+/////////////////////////////////////////////////////////////////////
+inline constexpr unsigned int TIMER_TICK_US = 302;   //Timer tick as Transceive sets it, (2*0x7FF+1)/13.56 MHz
+inline constexpr unsigned int WAIT_US = 20000;       //A wait on the chip gives up this long after its own timer should have ended it
+inline constexpr unsigned int START_MS = 100;        //Longest start-up of the chip after a reset
+inline constexpr unsigned int FIELD_US = 5000;       //A card in a field just switched on answers after this long (ISO 14443-3)
+
+/////////////////////////////////////////////////////////////////////
+//Results
+/////////////////////////////////////////////////////////////////////
+enum class Error : std::uint8_t
+{
+    NoTag   = mi::NOTAGERR,                      //No card answered
+    Failed  = mi::ERR,                           //Card answered wrong, CRC/parity/protocol error
+    Com     = mi::COM_ERR,                       //The chip did not start or did not end a command: it hangs or lost power
+    Timeout = mi::TIMEOUT,                       //The RC522 timer ran out
+};
+
+#if defined(__cpp_lib_expected)
+template<class T> using Result = std::expected<T,Error>;
+inline constexpr std::unexpected<Error> Fail(Error e) { return std::unexpected<Error>(e); }
+#else
+struct Unexpected
+{
+    Error error;
+};
+inline constexpr Unexpected Fail(Error e) { return Unexpected{e}; }
+
+//The part of std::expected the reader needs, for C++20 libraries without it
+template<class T>
+class Result
+{
+public:
+    constexpr Result(const T &v) : value_(v), error_() {}
+    constexpr Result(T &&v) : value_(std::move(v)), error_() {}
+    constexpr Result(Unexpected u) : value_(), error_(u.error) {}
+    constexpr bool has_value() const { return value_.has_value(); }
+    constexpr explicit operator bool() const { return value_.has_value(); }
+    constexpr T &value() { return *value_; }
+    constexpr const T &value() const { return *value_; }
+    constexpr T &operator*() { return *value_; }
+    constexpr const T &operator*() const { return *value_; }
+    constexpr T *operator->() { return &*value_; }
+    constexpr const T *operator->() const { return &*value_; }
+    constexpr Error error() const { return error_; }
+private:
+    std::optional<T> value_;                     //Empty on error, T needs no default constructor
+    Error error_;
+};
+
+template<>
+class Result<void>
+{
+public:
+    constexpr Result() : error_(), ok_(true) {}
+    constexpr Result(Unexpected u) : error_(u.error), ok_(false) {}
+    constexpr bool has_value() const { return ok_; }
+    constexpr explicit operator bool() const { return ok_; }
+    constexpr Error error() const { return error_; }
+private:
+    Error error_;
+    bool ok_;
+};
+#endif
+
+//MI_* code or raw ErrorReg value of the C path to a Result
+inline constexpr Result<void> Check(std::uint8_t status)
+{
+    switch(status)
+    {
+		case mi::OK:       return {};
+		case mi::NOTAGERR: return Fail(Error::NoTag);
+		case mi::COM_ERR:  return Fail(Error::Com);
+		case mi::TIMEOUT:  return Fail(Error::Timeout);
+		default:           return Fail(Error::Failed);
+    }
+}
+
+//Error of an exchange whose codes other than COM_ERR all mean the card did not answer right
+inline constexpr Error Failure(std::uint8_t status)
+{
+    return status == mi::COM_ERR ? Error::Com : Error::Failed;
+}
+
+/////////////////////////////////////////////////////////////////////
+//Card data
+/////////////////////////////////////////////////////////////////////
+using Atqa = std::array<std::uint8_t,2>;         //Card type code, see PcdRequest
+using Key = std::array<std::uint8_t,6>;
+using Block = std::array<std::uint8_t,16>;
+
+enum KeyType : std::uint8_t
+{
+    KeyA = 0x01,                                 //C_A
+    KeyB = 0x02,                                 //C_B
+};
+
+struct Card
+{
+    Atqa atqa{};
+    std::array<std::uint8_t,10> uid{};
+    std::uint8_t uid_len = 0;                    //4, 7 or 10 bytes
+    std::uint8_t sak = 0;
+    std::span<const std::uint8_t> Uid() const { return {uid.data(),uid_len}; }
+    std::span<const std::uint8_t,4> AuthUid() const { return std::span<const std::uint8_t,4>(uid.data()+uid_len-4,4); }//Crypto1 uses the last 4 UID bytes
+};
+
+/////////////////////////////////////////////////////////////////////
+//Transports
+/////////////////////////////////////////////////////////////////////
+template<class T>
+concept Transport = requires(T t,std::uint8_t a)
+{
+    { t.Read(a) } -> std::same_as<std::uint8_t>;
+    t.Write(a,a);
+};
+
+//SPI, wiringPiSPISetup(channel,speed) first
+class Spi
+{
+public:
+    explicit Spi(int channel = 0) : channel_(channel) {}
+    std::uint8_t Read(std::uint8_t address) const
+    {
+		unsigned char rec[2] = {static_cast<unsigned char>(((address<<1)&0x7E)|0x80),0x00};
+		wiringPiSPIDataRW(channel_,rec,2);
+		return rec[1];
+    }
+    void Write(std::uint8_t address,std::uint8_t value) const
+    {
+		unsigned char data[2] = {static_cast<unsigned char>((address<<1)&0x7E),value};
+		wiringPiSPIDataRW(channel_,data,2);
+    }
+private:
+    int channel_;
+};
+
+//I2C, fd = wiringPiI2CSetup(board address)
+class I2c
+{
+public:
+    explicit I2c(int fd) : fd_(fd) {}
+    std::uint8_t Read(std::uint8_t address) const { return static_cast<std::uint8_t>(wiringPiI2CReadReg8(fd_,address)); }
+    void Write(std::uint8_t address,std::uint8_t value) const { wiringPiI2CWriteReg8(fd_,address,value); }
+private:
+    int fd_;
+};
+
+//UART, fd = serialOpen("/dev/ttyS0",9600)
+class Uart
+{
+public:
+    explicit Uart(int fd) : fd_(fd) {}
+    std::uint8_t Read(std::uint8_t address) const { return Exchange((address&0x3F)|0x80); }
+    void Write(std::uint8_t address,std::uint8_t value) const
+    {
+		Exchange(address&0x3F);                  //The RC522 echoes the address
+		serialPutchar(fd_,value);
+    }
+private:
+    std::uint8_t Exchange(std::uint8_t tx) const
+    {
+		int waittime = 5;
+		serialPutchar(fd_,tx);
+		while(waittime--)
+		{
+			if(serialDataAvail(fd_) == 1)
+			{
+				std::uint8_t rev = static_cast<std::uint8_t>(serialGetchar(fd_));
+				serialFlush(fd_);
+				return rev;
+			}
+			delay(3);
+		}
+		return 0;
+    }
+    int fd_;
+};
+
+template<Transport T> class Session;
+
+/////////////////////////////////////////////////////////////////////
+//Reader
+/////////////////////////////////////////////////////////////////////
+template<Transport T>
+class Reader
+{
+public:
+    //rst = -1 when another reader already resets a shared line
+    Reader(T bus,int rst) : bus_(std::move(bus)), rst_(rst) {}
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    T &Bus() { return bus_; }
+
+    //Register access, the shadow spares the read-back of registers only we write
+    std::uint8_t ReadReg(std::uint8_t address) { return bus_.Read(address); }
+    void WriteReg(std::uint8_t address,std::uint8_t value)
+    {
+		bus_.Write(address,value);
+		shadow_[address&0x3F] = value;
+		shadow_valid_ |= SHADOW_REGS & (1ULL<<(address&0x3F));
+    }
+    void SetBits(std::uint8_t address,std::uint8_t mask)
+    {
+		WriteReg(address,Cached(address) | mask);
+    }
+    void ClearBits(std::uint8_t address,std::uint8_t mask)
+    {
+		WriteReg(address,Cached(address) & ~mask);
+    }
+
+    //RC522_Init: takes over a chip set up already, as on a restart of the
+    //program, otherwise resets it. Error::Com when the chip does not
+    //start; it is set up anyway so that a later Init can find it
+    Result<void> Init()
+    {
+		if(Warm())
+		{
+			return {};
+		}
+		auto r = Reset();
+		ConfigIsoTypeA();
+		return r;
+    }
+
+    //PcdReset: reset the chip and set up its timer and modulation, every
+    //wait on the chip gives up after START_MS
+    Result<void> Reset()
+    {
+		std::uint8_t n;
+		unsigned int t0;
+		if(rst_ >= 0)
+		{
+			digitalWrite(rst_,0);                //Hard power-down, 100 ns low are enough
+			delayMicrosecondsHard(1);
+			digitalWrite(rst_,1);
+			if(!Started())
+			{
+				return Fail(Error::Com);
+			}
+		}
+		WriteReg(reg::Command,pcd::RESETPHASE);
+		shadow_valid_ = 0;                       //Every register is back to its reset value
+		if(!Started())
+		{
+			return Fail(Error::Com);
+		}
+		WriteReg(reg::Control,0x10);
+		WriteReg(reg::Mode,0x3F);
+		WriteReg(reg::RFU23,0x00);
+		WriteReg(reg::RFU25,0x80);
+		WriteReg(reg::AutoTest,0x40);
+		WriteReg(reg::TxAuto,0x40);
+		SetBits(reg::TxControl,0x03);
+		WriteReg(reg::TPrescaler,0x3D);
+		WriteReg(reg::TMode,0x0D);
+		WriteReg(reg::TReloadL,0x01);            //Two 0.5 ms ticks show the clock runs
+		WriteReg(reg::TReloadH,0x00);
+		WriteReg(reg::ComIrq,0x01);
+		SetBits(reg::Control,0x40);
+		t0 = millis();
+		do
+		{
+			n = ReadReg(reg::ComIrq);
+		}
+		while(!(n&0x01) && millis() - t0 < START_MS);
+		if(!(n&0x01))
+		{
+			return Fail(Error::Com);             //The timer never ran: no clock
+		}
+		WriteReg(reg::ComIrq,0x01);
+		WriteReg(reg::Command,0x00);
+		t0 = millis();
+		while(ReadReg(reg::GsN) != 0x88)
+		{
+			if(millis() - t0 >= START_MS)
+			{
+				return Fail(Error::Com);
+			}
+		}
+		return {};
+    }
+
+    //PcdRequest, code = picc::REQIDL or picc::REQALL
+    Result<Atqa> Request(std::uint8_t code = picc::REQIDL)
+    {
+		std::uint8_t status;
+		unsigned int bits = 0;
+		int i = 0;
+		do
+		{
+			status = ReadReg(reg::Status2);
+			WriteReg(reg::Status2,status&0xF7);
+			WriteReg(reg::Coll,0x80);
+			ClearBits(reg::TxMode,0x80);
+			ClearBits(reg::RxMode,0x80);
+			WriteReg(reg::BitFraming,0x07);
+			SetBits(reg::TxControl,0x03);
+			buf_[0] = code;
+			i++;
+			status = Transceive(pcd::TRANSCEIVE,1,bits,0x0002);
+			if(i >= 2)
+			{
+				break;
+			}
+			delayMicrosecondsHard(5);
+		}
+		while(status == mi::TIMEOUT);
+		if(status != mi::OK || bits != 0x10)
+		{
+			return Fail(Failure(status));
+		}
+		return Atqa{buf_[0],buf_[1]};
+    }
+
+    //PcdAnticollSelect: every cascade level, card left selected
+    Result<Card> AnticollSelect()
+    {
+		Card card;
+		std::array<std::uint8_t,4> snr;
+		for(std::uint8_t level=picc::ANTICOLL1;level<=picc::ANTICOLL3;level+=2)
+		{
+			if(auto r = AnticollLevel(level,snr); !r)
+			{
+				return Fail(r.error());
+			}
+			auto sak = SelectLevel(level,snr);
+			if(!sak)
+			{
+				return Fail(sak.error());
+			}
+			if(!(*sak & 0x04))
+			{
+				std::memcpy(card.uid.data()+card.uid_len,snr.data(),4);
+				card.uid_len += 4;
+				card.sak = *sak;
+				return card;
+			}
+			std::memcpy(card.uid.data()+card.uid_len,snr.data()+1,3);//Skip the cascade tag
+			card.uid_len += 3;
+		}
+		return Fail(Error::Failed);
+    }
+
+    //PcdSelectUid: select a card whose UID is known, returns its SAK
+    Result<std::uint8_t> SelectUid(std::span<const std::uint8_t> uid)
+    {
+		std::uint8_t level = picc::ANTICOLL1;
+		std::array<std::uint8_t,4> snr;
+		if(uid.size() != 4 && uid.size() != 7 && uid.size() != 10)
+		{
+			return Fail(Error::Failed);
+		}
+		while(uid.size() > 4)
+		{
+			snr[0] = 0x88;//Cascade tag
+			std::memcpy(snr.data()+1,uid.data(),3);
+			if(auto r = SelectLevel(level,snr); !r)
+			{
+				return r;
+			}
+			uid = uid.subspan(3);
+			level += 2;
+		}
+		std::memcpy(snr.data(),uid.data(),4);
+		return SelectLevel(level,snr);
+    }
+
+    //PcdWakeupSelect: cheap check that a known card is still in the field
+    Result<void> WakeupSelect(std::span<const std::uint8_t> uid)
+    {
+		if(!Request(picc::REQALL))
+		{
+			return Fail(Error::NoTag);
+		}
+		if(auto r = SelectUid(uid); !r)
+		{
+			return Fail(r.error());
+		}
+		return {};
+    }
+
+    //Request and select the next card, the session HALTs it when it ends
+    Result<Session<T>> Select(std::uint8_t code = picc::REQIDL)
+    {
+		auto atqa = Request(code);
+		if(!atqa)
+		{
+			return Fail(atqa.error());
+		}
+		auto card = AnticollSelect();
+		if(!card)
+		{
+			return Fail(card.error());
+		}
+		card->atqa = *atqa;
+		return Session<T>(*this,*card);
+    }
+
+    //PcdAuthState
+    Result<void> Auth(KeyType type,std::uint8_t block,std::span<const std::uint8_t,6> key,std::span<const std::uint8_t,4> snr)
+    {
+		buf_[0] = type == KeyA ? picc::AUTHENT1A : picc::AUTHENT1B;
+		buf_[1] = block;
+		std::memcpy(&buf_[2],key.data(),6);
+		std::memcpy(&buf_[8],snr.data(),4);
+		if(auto r = Check(MfTransceive(pcd::AUTHENT,buf_.data(),12,0x0020)); !r)
+		{
+			return r;
+		}
+		if(!(ReadReg(reg::Status2) & 0x08))      //Crypto1 not switched on
+		{
+			return Fail(Error::Failed);
+		}
+		return {};
+    }
+
+    //PcdRead
+    Result<void> Read(std::uint8_t block,std::span<std::uint8_t,16> out)
+    {
+		buf_[0] = picc::READ;
+		buf_[1] = block;
+		SetBits(reg::TxMode,0x80);
+		SetBits(reg::RxMode,0x80);
+		delayMicrosecondsHard(10);
+		if(auto r = Check(MfTransceive(pcd::TRANSCEIVE,buf_.data(),2,0x0020)); !r)
+		{
+			return r;                            //Timeout when the card did not answer
+		}
+		std::memcpy(out.data(),buf_.data(),16);
+		return {};
+    }
+
+    //PcdWrite
+    Result<void> Write(std::uint8_t block,std::span<const std::uint8_t,16> in)
+    {
+		std::array<std::uint8_t,16> data;
+		write_gen_++;
+		buf_[0] = picc::WRITE;
+		buf_[1] = block;
+		SetBits(reg::TxMode,0x80);
+		SetBits(reg::RxMode,0x80);
+		delayMicrosecondsHard(10);
+		if(std::uint8_t status = MfTransceive(pcd::TRANSCEIVE,buf_.data(),2,0x0010); status != mi::OK)
+		{
+			return Check(status);
+		}
+		if((buf_[0]&0x0F) != 0x0A)
+		{
+			return Fail(Error::Failed);          //No ACK
+		}
+		std::memcpy(data.data(),in.data(),16);//The FIFO read-back overwrites the frame
+		return Check(MfTransceive(pcd::TRANSCEIVE,data.data(),16,0x0020));
+    }
+
+    //PcdHalt, the card does not answer
+    void Halt()
+    {
+		unsigned int bits;
+		buf_[0] = picc::HALT;
+		buf_[1] = 0;
+		SetBits(reg::TxMode,0x80);
+		SetBits(reg::RxMode,0x80);
+		Transceive(pcd::TRANSCEIVE,2,bits,0x0010);
+    }
+
+    unsigned long WriteGen() const { return write_gen_; }
+    //Waits on the chip that ran out: the chip hangs or lost its setup
+    unsigned long Stuck() const { return stuck_; }
+
+    //Microseconds the cards of a field just switched on still need before
+    //they answer, each exchange takes them once
+    unsigned int FieldLeft()
+    {
+		int left = static_cast<int>(field_us_ - micros());
+		bool wait = field_wait_;
+		field_wait_ = false;
+		return (wait && left > 0) ? static_cast<unsigned int>(left) : 0;
+    }
+
+    //PcdStuck: give up a command the chip never ended, neither an answer
+    //nor its timer came
+    std::uint8_t GiveUp()
+    {
+		WriteReg(reg::Command,pcd::IDLE);
+		stuck_++;
+		return mi::COM_ERR;
+    }
+
+private:
+    std::uint8_t Cached(std::uint8_t address)
+    {
+		return (shadow_valid_ & (1ULL<<address)) ? shadow_[address] : ReadReg(address);
+    }
+
+    //Registers Init sets to other than their reset values, the bits of each
+    //that read back as written, and what they read when set up (PcdSignReg)
+    static constexpr std::array<std::uint8_t,4> SignReg = {reg::Mode,reg::TxControl,reg::TxAuto,reg::RxSel};
+    static constexpr std::array<std::uint8_t,4> SignMask = {0xAB,0xFB,0x7F,0xFF};
+    static constexpr std::array<std::uint8_t,4> SignValue = {0x29,0x83,0x40,0x86};
+
+    //PcdStarted: CommandReg reads its reset value, Idle with PowerDown
+    //cleared, once the oscillator runs
+    bool Started()
+    {
+		unsigned int t0 = millis();
+		while((ReadReg(reg::Command) & 0x3F) != 0x20)//A chip in reset or a dead bus reads 0x00 or 0xFF
+		{
+			if(millis() - t0 >= START_MS)
+			{
+				return false;
+			}
+		}
+		return true;
+    }
+
+    //PcdWarm: a chip that Init set up before keeps its field and cards,
+    //only what the last owner left running is stopped and the RF setup
+    //written again. A chip that lost power or was reset does not pass
+    bool Warm()
+    {
+		std::uint8_t v;
+		shadow_valid_ = 0;
+		v = ReadReg(reg::Version);
+		if(v == 0x00 || v == 0xFF || (ReadReg(reg::Command) & 0x10))
+		{
+			return false;
+		}
+		for(std::size_t i=0;i<SignReg.size();i++)
+		{
+			v = ReadReg(SignReg[i]);
+			if((v & SignMask[i]) != SignValue[i])
+			{
+				return false;
+			}
+			shadow_[SignReg[i]] = v;
+			shadow_valid_ |= SHADOW_REGS & (1ULL<<SignReg[i]);
+		}
+		WriteReg(reg::Command,pcd::IDLE);
+		WriteReg(reg::FIFOLevel,0x80);
+		RfDefault();
+		return true;
+    }
+
+    //RfTuneApply(pcd,NULL): the receiver and field setup of a chip that
+    //was not tuned, a profile the last owner tuned is not this one's
+    void RfDefault()
+    {
+		WriteReg(reg::RFCfg,0x6F);
+		WriteReg(reg::RxThreshold,0x84);
+		WriteReg(reg::Demod,0x4D);
+		WriteReg(reg::GsN,0x88);
+		WriteReg(reg::CWGsCfg,0x20);
+    }
+
+    //M500PcdConfigISOType('A') + PcdAntennaOn
+    void ConfigIsoTypeA()
+    {
+		ClearBits(reg::Status2,0x08);
+		WriteReg(reg::Mode,0x3D);
+		WriteReg(reg::RxSel,0x86);
+		WriteReg(reg::RFCfg,0x6F);
+		WriteReg(reg::TReloadL,30);
+		WriteReg(reg::TReloadH,0);
+		WriteReg(reg::TMode,0x8D);
+		WriteReg(reg::TPrescaler,0x3E);
+		SetBits(reg::TxControl,0x03);
+		field_us_ = micros() + FIELD_US;         //The next exchange waits for the cards, not Init
+		field_wait_ = true;
+    }
+
+    //PcdComMF522_P on buf_: sends len bytes, answer replaces them
+    std::uint8_t Transceive(std::uint8_t command,std::uint8_t len,unsigned int &bits,std::uint16_t timeout)
+    {
+		std::uint8_t n,status;
+		unsigned int deadline,now;
+		bool halt = buf_[0] == picc::HALT;
+		if(unsigned int left = FieldLeft())      //PcdFieldWait
+		{
+			delayMicroseconds(left);
+		}
+		delayMicrosecondsHard(100);
+		WriteReg(reg::TPrescaler,0xFF);
+		WriteReg(reg::TMode,0x87);
+		WriteReg(reg::TReloadL,static_cast<std::uint8_t>(timeout));
+		WriteReg(reg::TReloadH,static_cast<std::uint8_t>(timeout>>8));
+		delayMicrosecondsHard(10);
+		WriteReg(reg::ComIrq,0x7F);
+		WriteReg(reg::DivIrq,0x7F);
+		WriteReg(reg::FIFOLevel,0x80);
+		SetBits(reg::Command,command);
+		delayMicrosecondsHard(1);
+		SetBits(reg::ComIEn,0xA1);
+		for(n=0;n<len;n++)
+		{
+			WriteReg(reg::FIFOData,buf_[n]);
+		}
+		SetBits(reg::BitFraming,0x80);
+		deadline = micros() + timeout*TIMER_TICK_US + WAIT_US;//From StartSend, a slow bus must not eat it
+		do
+		{
+			now = micros();                      //Before the read: a late poll must not look like a hang
+			n = ReadReg(reg::ComIrq);
+			status = ReadReg(reg::DivIrq);
+		}
+		while(!(n & 0x20) && !(n & 0x01) && static_cast<int>(now - deadline) < 0);
+		if(!(n & 0x20) && !(n & 0x01))
+		{
+			return GiveUp();
+		}
+		if(!(n & 0x01))
+		{
+			SetBits(reg::Control,0x90);
+			ClearBits(reg::ComIEn,0x7F);
+			ClearBits(reg::DivlEn,0xFF);
+			n = ReadReg(reg::FIFOLevel);
+			status = ReadReg(reg::Error);
+			for(std::uint8_t i=0;i<n;i++)
+			{
+				buf_[i] = ReadReg(reg::FIFOData);
+			}
+			bits = n*8;
+			WriteReg(reg::ComIrq,0x20);
+		}
+		else
+		{
+			ClearBits(reg::ComIEn,0x7F);
+			ClearBits(reg::DivlEn,0xFF);
+			if(halt)
+			{
+				ClearBits(reg::ComIrq,0xFF);
+				return mi::OK;
+			}
+			WriteReg(reg::ComIrq,0x01);
+			status = mi::TIMEOUT;
+		}
+		WriteReg(reg::DivIrq,0x00);
+		WriteReg(reg::FIFOLevel,0x80);
+		WriteReg(reg::ComIrq,0x01);
+		WriteReg(reg::BitFraming,0x00);
+		return status;
+    }
+
+    //Opation_MF1Card: sends len bytes of data, a TRANSCEIVE answer replaces them
+    std::uint8_t MfTransceive(std::uint8_t command,std::uint8_t *data,std::uint8_t len,std::uint16_t timeout)
+    {
+		std::uint8_t irqEn,waitFor,n,status;
+		unsigned int deadline,now;
+		if(command == pcd::TRANSCEIVE)
+		{
+			irqEn = 0x77;
+			waitFor = 0x30;
+		}
+		else
+		{
+			irqEn = 0x12;
+			waitFor = 0x10;
+		}
+		WriteReg(reg::TPrescaler,0xFF);
+		WriteReg(reg::TMode,0x87);
+		WriteReg(reg::TReloadL,static_cast<std::uint8_t>(timeout));
+		WriteReg(reg::TReloadH,static_cast<std::uint8_t>(timeout>>8));
+		WriteReg(reg::ComIEn,irqEn|0x80);
+		ClearBits(reg::ComIrq,0x80);
+		WriteReg(reg::Command,pcd::IDLE);
+		SetBits(reg::FIFOLevel,0x80);
+		for(std::uint8_t i=0;i<len;i++)
+		{
+			WriteReg(reg::FIFOData,data[i]);
+		}
+		WriteReg(reg::Command,command);
+		if(command == pcd::TRANSCEIVE)
+		{
+			SetBits(reg::BitFraming,0x80);
+		}
+		else
+		{
+			SetBits(reg::Control,0x40);
+		}
+		deadline = micros() + timeout*TIMER_TICK_US + WAIT_US;
+		do
+		{
+			now = micros();
+			n = ReadReg(reg::ComIrq);
+		}
+		while(!(n&0x01) && !(n&waitFor) && static_cast<int>(now - deadline) < 0);
+		if(!(n&0x01) && !(n&waitFor))
+		{
+			return GiveUp();
+		}
+		ClearBits(reg::BitFraming,0x80);
+		status = ReadReg(reg::Error);
+		if(!(n&0x01))
+		{
+			SetBits(reg::Control,0x80);
+			if(!(status&0x1B))
+			{
+				status = (n & irqEn & 0x01) ? mi::NOTAGERR : mi::OK;
+				if(command == pcd::TRANSCEIVE)
+				{
+					n = ReadReg(reg::FIFOLevel);
+					for(std::uint8_t i=0;i<n;i++)
+					{
+						data[i] = ReadReg(reg::FIFOData);
+					}
+				}
+			}
+			else
+			{
+				status = mi::ERR;
+			}
+		}
+		else
+		{
+			status = mi::TIMEOUT;                //The card did not answer before the timer ran out
+		}
+		WriteReg(reg::Command,pcd::IDLE);
+		return status;
+    }
+
+    //PcdAnticollLevel
+    Result<void> AnticollLevel(std::uint8_t level,std::array<std::uint8_t,4> &snr)
+    {
+		unsigned int bits;
+		std::uint8_t check = 0;
+		ClearBits(reg::TxMode,0x80);
+		ClearBits(reg::RxMode,0x80);
+		WriteReg(reg::Coll,0x00);
+		delayMicrosecondsHard(200);
+		WriteReg(reg::BitFraming,0x00);
+		buf_[0] = level;
+		buf_[1] = 0x20;
+		std::uint8_t status = Transceive(pcd::TRANSCEIVE,2,bits,0x0020);
+		delayMicrosecondsHard(100);
+		WriteReg(reg::BitFraming,0x00);
+		WriteReg(reg::Coll,0x80);
+		if(status != mi::OK)
+		{
+			return Check(status);
+		}
+		for(int i=0;i<4;i++)
+		{
+			snr[i] = buf_[i];
+			check ^= buf_[i];
+		}
+		if(check != buf_[4])
+		{
+			return Fail(Error::Failed);
+		}
+		return {};
+    }
+
+    //PcdSelectLevel, returns the SAK
+    Result<std::uint8_t> SelectLevel(std::uint8_t level,const std::array<std::uint8_t,4> &snr)
+    {
+		unsigned int bits;
+		SetBits(reg::TxMode,0x80);
+		SetBits(reg::RxMode,0x80);
+		buf_[0] = level;
+		buf_[1] = 0x70;
+		buf_[6] = 0;
+		for(int i=0;i<4;i++)
+		{
+			buf_[i+2] = snr[i];
+			buf_[6] ^= snr[i];
+		}
+		if(std::uint8_t status = Transceive(pcd::TRANSCEIVE,7,bits,0x0010); status != mi::OK)
+		{
+			return Fail(Failure(status));
+		}
+		return buf_[0];
+    }
+
+    T bus_;
+    int rst_;
+    unsigned long write_gen_ = 0;
+    unsigned long stuck_ = 0;
+    unsigned int field_us_ = 0;                  //micros() from which the cards of the field ConfigIsoTypeA switched on...
+    bool field_wait_ = false;                    //...answer, the next exchange waits for it while set
+    std::uint64_t shadow_valid_ = 0;
+    std::array<std::uint8_t,64> shadow_{};
+    alignas(64) std::array<std::uint8_t,MAXRLEN> buf_{};
+};
+
+/////////////////////////////////////////////////////////////////////
+//A selected card, HALTed when the session ends
+/////////////////////////////////////////////////////////////////////
+template<Transport T>
+class Session
+{
+public:
+    Session(Reader<T> &reader,const Card &card) : reader_(&reader), card_(card) {}
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+    Session(Session &&o) noexcept : reader_(std::exchange(o.reader_,nullptr)), card_(o.card_) {}
+    Session &operator=(Session &&o) noexcept
+    {
+		if(this != &o)
+		{
+			End();
+			reader_ = std::exchange(o.reader_,nullptr);
+			card_ = o.card_;
+		}
+		return *this;
+    }
+    ~Session() { End(); }
+
+    const Card &GetCard() const { return card_; }
+    Result<void> Auth(KeyType type,std::uint8_t block,std::span<const std::uint8_t,6> key)
+    {
+		return reader_->Auth(type,block,key,card_.AuthUid());
+    }
+    Result<void> Read(std::uint8_t block,std::span<std::uint8_t,16> out) { return reader_->Read(block,out); }
+    Result<void> Write(std::uint8_t block,std::span<const std::uint8_t,16> in) { return reader_->Write(block,in); }
+    //Leave the card selected, for example to hand it to the C library
+    void Release() { reader_ = nullptr; }
+
+private:
+    void End()
+    {
+		if(reader_ != nullptr)
+		{
+			reader_->Halt();
+			reader_ = nullptr;
+		}
+    }
+    Reader<T> *reader_;
+    Card card_;
+};
+
+}
+
+#endif
@@ -0,0 +1,870 @@
+/***************************************************************************************
+ * Project  :rc522-cpp
+ * Describe :C++20 coroutine API over rc522::Reader.
+ *			 PcdComMF522_P and Opation_MF1Card spin on ComIrqReg for the whole frame
+ *			 delay time. Here an exchange is split at that wait: the coroutine loads the
+ *			 FIFO, starts the command and suspends until the reader's IRQ line falls
+ *			 (epoll on the sysfs GPIO) or, without IRQ wiring, until the next poll tick
+ *			 (timerfd). One thread then keeps a conversation going on every reader.
+ *			 Bus phases (register bursts between two RF waits) run to completion and the
+ *			 ready queue is FIFO, so each conversation gets one bus phase per round and
+ *			 no reader can starve the others on a shared SPI/I2C bus.
+ *			 One conversation per reader at a time: the RC522 has a single FIFO.
+ * Usage    :rc522::EventLoop loop;
+ *			 rc522::AsyncReader<rc522::Spi> r(loop,reader);
+ *			 loop.Spawn(Conversation(r));         //Task<> Conversation(AsyncReader<Spi> &r)
+ *			 loop.Run();                          //{ auto atqa = co_await r.Request(); ... }
+***************************************************************************************/
+#ifndef __RC522_ASYNC_HPP
+#define	__RC522_ASYNC_HPP
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <queue>
+#include <type_traits>
+#include <vector>
+#include <cstdio>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "rc522.hpp"
+
+namespace rc522
+{
+
+/////////////////////////////////////////////////////////////////////
+//Timing of the event loop, the chip timing is TIMER_TICK_US and
+//WAIT_US of rc522.hpp
+/////////////////////////////////////////////////////////////////////
+inline constexpr unsigned int POLL_US = 200;         //ComIrqReg poll interval of a reader without IRQ line
+inline constexpr unsigned int IRQ_SLACK_US = 1000;   //After timer + slack a missed IRQ edge falls back to polling
+
+template<class T = void> class Task;
+
+namespace detail
+{
+struct PromiseBase
+{
+    std::coroutine_handle<> cont;                //Awaiting coroutine, resumed when this one ends
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    struct Final
+    {
+		bool await_ready() noexcept { return false; }
+		template<class P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+		{
+			std::coroutine_handle<> c = h.promise().cont;
+			return c ? c : std::noop_coroutine();
+		}
+		void await_resume() noexcept {}
+    };
+    Final final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { std::terminate(); }
+};
+
+template<class T>
+struct Promise : PromiseBase
+{
+    std::optional<T> value;
+    Task<T> get_return_object();
+    void return_value(T v) { value.emplace(std::move(v)); }
+};
+
+template<>
+struct Promise<void> : PromiseBase
+{
+    Task<void> get_return_object();
+    void return_void() {}
+};
+
+//Top-level coroutine owned by nobody, frees itself at the end
+struct Detached
+{
+    struct promise_type
+    {
+		Detached get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+}
+
+/////////////////////////////////////////////////////////////////////
+//Lazy coroutine, starts when awaited
+/////////////////////////////////////////////////////////////////////
+template<class T>
+class Task
+{
+public:
+    using promise_type = detail::Promise<T>;
+    explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+    Task(Task &&o) noexcept : h_(std::exchange(o.h_,{})) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+		if(h_)
+		{
+			h_.destroy();
+		}
+    }
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept
+    {
+		h_.promise().cont = c;
+		return h_;
+    }
+    T await_resume()
+    {
+		if constexpr(!std::is_void_v<T>)
+		{
+			return std::move(*h_.promise().value);
+		}
+    }
+private:
+    std::coroutine_handle<promise_type> h_;
+};
+
+namespace detail
+{
+template<class T>
+inline Task<T> Promise<T>::get_return_object() { return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this)); }
+inline Task<void> Promise<void>::get_return_object() { return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this)); }
+}
+
+/////////////////////////////////////////////////////////////////////
+//Single-threaded executor: FIFO ready queue, timerfd deadlines,
+//epoll on IRQ lines
+/////////////////////////////////////////////////////////////////////
+class EventLoop
+{
+    struct Waiter
+    {
+		std::coroutine_handle<> h;
+		bool fired = false;
+		bool by_fd = false;                      //Woken by the IRQ line, not the deadline
+    };
+    struct Timer
+    {
+		unsigned long long when;
+		std::shared_ptr<Waiter> w;
+		bool operator>(const Timer &o) const { return when > o.when; }
+    };
+
+public:
+    EventLoop()
+    {
+		struct epoll_event ev = {};
+		epfd_ = epoll_create1(EPOLL_CLOEXEC);
+		tfd_ = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+		ev.events = EPOLLIN;
+		ev.data.fd = tfd_;
+		epoll_ctl(epfd_,EPOLL_CTL_ADD,tfd_,&ev);
+    }
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+    ~EventLoop()
+    {
+		close(tfd_);
+		close(epfd_);
+    }
+
+    static unsigned long long Now()
+    {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC,&ts);
+		return (unsigned long long)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+    }
+
+    //Run a conversation, it starts on the next round of Run
+    void Spawn(Task<> task)
+    {
+		active_++;
+		Start(*this,std::move(task));
+    }
+
+    //Resume coroutines until every spawned one has ended or Stop is called
+    void Run()
+    {
+		struct epoll_event ev[16];
+		int i,n;
+		stop_ = false;
+		while(!stop_ && active_ > 0)
+		{
+			for(std::size_t k=ready_.size();k>0 && !ready_.empty();k--)//One bus phase each, newly woken ones go next round
+			{
+				std::coroutine_handle<> h = ready_.front();
+				ready_.pop_front();
+				h.resume();
+			}
+			if(ready_.empty() && timers_.empty() && fd_waiters_.empty())
+			{
+				break;                           //Everything left waits on something that cannot happen
+			}
+			ArmTimer();
+			n = epoll_wait(epfd_,ev,16,ready_.empty() ? -1 : 0);
+			for(i=0;i<n;i++)
+			{
+				if(ev[i].data.fd == tfd_)
+				{
+					unsigned long long expirations;
+					if(read(tfd_,&expirations,sizeof(expirations)) < 0)
+					{
+						//Nothing due yet, the heap below is the truth
+					}
+				}
+				else
+				{
+					FireFd(ev[i].data.fd);
+				}
+			}
+			ExpireTimers();
+		}
+    }
+
+    void Stop() { stop_ = true; }
+
+    //Let the other conversations run first
+    auto Schedule()
+    {
+		struct Awaiter
+		{
+			EventLoop &loop;
+			bool await_ready() noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> h) { loop.ready_.push_back(h); }
+			void await_resume() noexcept {}
+		};
+		return Awaiter{*this};
+    }
+
+    auto SleepUntil(unsigned long long when)
+    {
+		struct Awaiter
+		{
+			EventLoop &loop;
+			unsigned long long when;
+			bool await_ready() noexcept { return when <= Now(); }
+			void await_suspend(std::coroutine_handle<> h)
+			{
+				std::shared_ptr<Waiter> w = std::make_shared<Waiter>();
+				w->h = h;
+				loop.timers_.push(Timer{when,w});
+			}
+			void await_resume() noexcept {}
+		};
+		return Awaiter{*this,when};
+    }
+
+    //Wait for an edge on fd (sysfs GPIO value file) or the deadline
+    //return:true when the line fired
+    auto WaitFd(int fd,unsigned long long deadline)
+    {
+		struct Awaiter
+		{
+			EventLoop &loop;
+			int fd;
+			unsigned long long deadline;
+			std::shared_ptr<Waiter> w;
+			bool await_ready() noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> h)
+			{
+				w = std::make_shared<Waiter>();
+				w->h = h;
+				loop.Watch(fd);
+				loop.fd_waiters_.push_back({fd,w});
+				loop.timers_.push(Timer{deadline,w});
+			}
+			bool await_resume() noexcept { return w->by_fd; }
+		};
+		return Awaiter{*this,fd,deadline,nullptr};
+    }
+
+private:
+    static detail::Detached Start(EventLoop &loop,Task<> task)
+    {
+		co_await loop.Schedule();
+		co_await task;
+		loop.active_--;
+    }
+
+    void Wake(const std::shared_ptr<Waiter> &w,bool by_fd)
+    {
+		if(!w->fired)
+		{
+			w->fired = true;
+			w->by_fd = by_fd;
+			ready_.push_back(w->h);
+		}
+    }
+
+    void Watch(int fd)
+    {
+		struct epoll_event ev = {};
+		for(int f : watched_)
+		{
+			if(f == fd)
+			{
+				return;
+			}
+		}
+		ev.events = EPOLLPRI|EPOLLERR;           //sysfs GPIO edges
+		ev.data.fd = fd;
+		epoll_ctl(epfd_,EPOLL_CTL_ADD,fd,&ev);
+		watched_.push_back(fd);
+    }
+
+    void FireFd(int fd)
+    {
+		char value[4];
+		lseek(fd,0,SEEK_SET);
+		if(read(fd,value,sizeof(value)) < 0)     //Clears the edge
+		{
+			return;
+		}
+		for(std::size_t i=0;i<fd_waiters_.size();)
+		{
+			if(fd_waiters_[i].first == fd)
+			{
+				Wake(fd_waiters_[i].second,true);
+				fd_waiters_[i] = fd_waiters_.back();
+				fd_waiters_.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+    }
+
+    void ExpireTimers()
+    {
+		unsigned long long now = Now();
+		while(!timers_.empty() && timers_.top().when <= now)
+		{
+			Wake(timers_.top().w,false);
+			timers_.pop();
+		}
+		for(std::size_t i=0;i<fd_waiters_.size();)//Drop fd waits that ended on their deadline
+		{
+			if(fd_waiters_[i].second->fired)
+			{
+				fd_waiters_[i] = fd_waiters_.back();
+				fd_waiters_.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+    }
+
+    void ArmTimer()
+    {
+		struct itimerspec its = {};
+		while(!timers_.empty() && timers_.top().w->fired)//Deadline of a wait the IRQ already ended
+		{
+			timers_.pop();
+		}
+		if(!timers_.empty())
+		{
+			unsigned long long when = timers_.top().when;
+			its.it_value.tv_sec = when/1000000000ULL;
+			its.it_value.tv_nsec = when%1000000000ULL;
+			if(its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+			{
+				its.it_value.tv_nsec = 1;        //0 would disarm
+			}
+		}
+		timerfd_settime(tfd_,TFD_TIMER_ABSTIME,&its,NULL);
+    }
+
+    int epfd_;
+    int tfd_;
+    bool stop_ = false;
+    unsigned int active_ = 0;
+    std::deque<std::coroutine_handle<>> ready_;
+    std::priority_queue<Timer,std::vector<Timer>,std::greater<Timer>> timers_;
+    std::vector<std::pair<int,std::shared_ptr<Waiter>>> fd_waiters_;
+    std::vector<int> watched_;
+};
+
+/////////////////////////////////////////////////////////////////////
+//function:Open the RC522 IRQ line for EventLoop::WaitFd
+//Parameters:gpio[IN]:BCM GPIO number the IRQ pin is wired to
+//return:fd of the sysfs value file, -1 on failure
+/////////////////////////////////////////////////////////////////////
+inline int OpenIrqLine(int gpio)
+{
+    char path[64];
+    FILE *fp;
+    if((fp = fopen("/sys/class/gpio/export","w")) != NULL)//Fails harmlessly when already exported
+    {
+		fprintf(fp,"%d",gpio);
+		fclose(fp);
+    }
+    snprintf(path,sizeof(path),"/sys/class/gpio/gpio%d/direction",gpio);
+    if((fp = fopen(path,"w")) == NULL)
+    {
+		return -1;
+    }
+    fputs("in",fp);
+    fclose(fp);
+    snprintf(path,sizeof(path),"/sys/class/gpio/gpio%d/edge",gpio);
+    if((fp = fopen(path,"w")) == NULL)
+    {
+		return -1;
+    }
+    fputs("falling",fp);                         //ComIEnReg IRqInv: the line is active low
+    fclose(fp);
+    snprintf(path,sizeof(path),"/sys/class/gpio/gpio%d/value",gpio);
+    return open(path,O_RDONLY|O_NONBLOCK|O_CLOEXEC);
+}
+
+/////////////////////////////////////////////////////////////////////
+//Awaitable protocol of one reader
+/////////////////////////////////////////////////////////////////////
+template<Transport T>
+class AsyncReader
+{
+public:
+    //irq_fd from OpenIrqLine, -1 = poll ComIrqReg every POLL_US
+    AsyncReader(EventLoop &loop,Reader<T> &reader,int irq_fd = -1) : loop_(loop), rd_(reader), irq_fd_(irq_fd) {}
+
+    //PcdComMF522_P: sends tx, answer in rx, returns the bits received.
+    //Error::Failed for a tx longer than the FIFO
+    Task<Result<unsigned int>> Transceive(std::span<const std::uint8_t> tx,std::span<std::uint8_t> rx,std::uint16_t timeout)
+    {
+		unsigned int bits = 0;
+		std::uint8_t status;
+		if(tx.size() > MAXRLEN)
+		{
+			co_return Fail(Error::Failed);
+		}
+		std::memcpy(frame_.data(),tx.data(),tx.size());
+		status = co_await ComExchange(static_cast<std::uint8_t>(tx.size()),bits,timeout);
+		if(status != mi::OK)
+		{
+			co_return Fail(Check(status).error());
+		}
+		std::memcpy(rx.data(),frame_.data(),std::min<std::size_t>(rx.size(),(bits+7)/8));
+		co_return bits;
+    }
+
+    //PcdRequest
+    Task<Result<Atqa>> Request(std::uint8_t code = picc::REQIDL)
+    {
+		std::uint8_t status;
+		unsigned int bits = 0;
+		int i = 0;
+		do
+		{
+			status = rd_.ReadReg(reg::Status2);
+			rd_.WriteReg(reg::Status2,status&0xF7);
+			rd_.WriteReg(reg::Coll,0x80);
+			rd_.ClearBits(reg::TxMode,0x80);
+			rd_.ClearBits(reg::RxMode,0x80);
+			rd_.WriteReg(reg::BitFraming,0x07);
+			rd_.SetBits(reg::TxControl,0x03);
+			frame_[0] = code;
+			i++;
+			status = co_await ComExchange(1,bits,0x0002);
+			if(i >= 2)
+			{
+				break;
+			}
+			delayMicrosecondsHard(5);
+		}
+		while(status == mi::TIMEOUT);
+		if(status != mi::OK || bits != 0x10)
+		{
+			co_return Fail(Failure(status));
+		}
+		co_return Atqa{frame_[0],frame_[1]};
+    }
+
+    //PcdAnticollSelect
+    Task<Result<Card>> AnticollSelect()
+    {
+		Card card;
+		std::array<std::uint8_t,4> snr;
+		for(std::uint8_t level=picc::ANTICOLL1;level<=picc::ANTICOLL3;level+=2)
+		{
+			Result<void> coll = co_await AnticollLevel(level,snr);
+			if(!coll)
+			{
+				co_return Fail(coll.error());
+			}
+			Result<std::uint8_t> sak = co_await SelectLevel(level,snr);
+			if(!sak)
+			{
+				co_return Fail(sak.error());
+			}
+			if(!(*sak & 0x04))
+			{
+				std::memcpy(card.uid.data()+card.uid_len,snr.data(),4);
+				card.uid_len += 4;
+				card.sak = *sak;
+				co_return card;
+			}
+			std::memcpy(card.uid.data()+card.uid_len,snr.data()+1,3);//Skip the cascade tag
+			card.uid_len += 3;
+		}
+		co_return Fail(Error::Failed);
+    }
+
+    //Request + anticollision/select, card left selected
+    Task<Result<Card>> Select(std::uint8_t code = picc::REQIDL)
+    {
+		Result<Atqa> atqa = co_await Request(code);
+		if(!atqa)
+		{
+			co_return Fail(atqa.error());
+		}
+		Result<Card> card = co_await AnticollSelect();
+		if(card)
+		{
+			card->atqa = *atqa;
+		}
+		co_return card;
+    }
+
+    //PcdSelectUid, returns the SAK
+    Task<Result<std::uint8_t>> SelectUid(std::span<const std::uint8_t> uid)
+    {
+		std::uint8_t level = picc::ANTICOLL1;
+		std::array<std::uint8_t,4> snr;
+		if(uid.size() != 4 && uid.size() != 7 && uid.size() != 10)
+		{
+			co_return Fail(Error::Failed);
+		}
+		while(uid.size() > 4)
+		{
+			snr[0] = 0x88;//Cascade tag
+			std::memcpy(snr.data()+1,uid.data(),3);
+			Result<std::uint8_t> r = co_await SelectLevel(level,snr);
+			if(!r)
+			{
+				co_return r;
+			}
+			uid = uid.subspan(3);
+			level += 2;
+		}
+		std::memcpy(snr.data(),uid.data(),4);
+		co_return co_await SelectLevel(level,snr);
+    }
+
+    //PcdWakeupSelect: cheap check that a known card is still in the field
+    Task<Result<void>> WakeupSelect(std::span<const std::uint8_t> uid)
+    {
+		Result<Atqa> atqa = co_await Request(picc::REQALL);
+		if(!atqa)
+		{
+			co_return Fail(Error::NoTag);
+		}
+		Result<std::uint8_t> sak = co_await SelectUid(uid);
+		if(!sak)
+		{
+			co_return Fail(sak.error());
+		}
+		co_return Result<void>{};
+    }
+
+    //PcdAuthState
+    Task<Result<void>> Auth(KeyType type,std::uint8_t block,std::span<const std::uint8_t,6> key,std::span<const std::uint8_t,4> snr)
+    {
+		frame_[0] = type == KeyA ? picc::AUTHENT1A : picc::AUTHENT1B;
+		frame_[1] = block;
+		std::memcpy(&frame_[2],key.data(),6);
+		std::memcpy(&frame_[8],snr.data(),4);
+		Result<void> r = Check(co_await MfExchange(pcd::AUTHENT,frame_.data(),12,0x0020));
+		if(r && !(rd_.ReadReg(reg::Status2) & 0x08))//Crypto1 not switched on
+		{
+			co_return Fail(Error::Failed);
+		}
+		co_return r;
+    }
+
+    //PcdRead
+    Task<Result<void>> Read(std::uint8_t block,std::span<std::uint8_t,16> out)
+    {
+		frame_[0] = picc::READ;
+		frame_[1] = block;
+		rd_.SetBits(reg::TxMode,0x80);
+		rd_.SetBits(reg::RxMode,0x80);
+		delayMicrosecondsHard(10);
+		std::uint8_t status = co_await MfExchange(pcd::TRANSCEIVE,frame_.data(),2,0x0020);//GCC 12 miscompiles co_await inside the condition
+		if(status != mi::OK)
+		{
+			co_return Check(status);             //Timeout when the card did not answer
+		}
+		std::memcpy(out.data(),frame_.data(),16);
+		co_return Result<void>{};
+    }
+
+    //PcdWrite
+    Task<Result<void>> Write(std::uint8_t block,std::span<const std::uint8_t,16> in)
+    {
+		frame_[0] = picc::WRITE;
+		frame_[1] = block;
+		rd_.SetBits(reg::TxMode,0x80);
+		rd_.SetBits(reg::RxMode,0x80);
+		delayMicrosecondsHard(10);
+		std::uint8_t status = co_await MfExchange(pcd::TRANSCEIVE,frame_.data(),2,0x0010);
+		if(status != mi::OK)
+		{
+			co_return Check(status);
+		}
+		if((frame_[0]&0x0F) != 0x0A)
+		{
+			co_return Fail(Error::Failed);       //No ACK
+		}
+		std::memcpy(frame_.data(),in.data(),16);
+		co_return Check(co_await MfExchange(pcd::TRANSCEIVE,frame_.data(),16,0x0020));
+    }
+
+    //PcdHalt, the card does not answer
+    Task<> Halt()
+    {
+		unsigned int bits;
+		frame_[0] = picc::HALT;
+		frame_[1] = 0;
+		rd_.SetBits(reg::TxMode,0x80);
+		rd_.SetBits(reg::RxMode,0x80);
+		co_await ComExchange(2,bits,0x0010);
+    }
+
+    //Give the other conversations a turn
+    auto Yield() { return loop_.Schedule(); }
+    //Suspend this conversation only
+    auto Sleep(unsigned long long ns) { return loop_.SleepUntil(EventLoop::Now()+ns); }
+
+private:
+    //Suspend until ComIrqReg shows one of mask, the RC522 timer makes it
+    //happen on a working chip. 0 = the chip hangs, nothing came in time
+    Task<std::uint8_t> WaitIrq(std::uint8_t mask,std::uint16_t timeout)
+    {
+		unsigned long long start = EventLoop::Now(),timer = timeout*TIMER_TICK_US*1000ULL;
+		unsigned long long deadline = start + timer + IRQ_SLACK_US*1000ULL;
+		unsigned long long give_up = start + timer + WAIT_US*1000ULL;
+		std::uint8_t n;
+		while(!((n = rd_.ReadReg(reg::ComIrq)) & mask))
+		{
+			if(EventLoop::Now() >= give_up)
+			{
+				co_return 0;
+			}
+			if(irq_fd_ >= 0 && EventLoop::Now() < deadline)
+			{
+				co_await loop_.WaitFd(irq_fd_,deadline);
+			}
+			else
+			{
+				co_await loop_.SleepUntil(EventLoop::Now()+POLL_US*1000ULL);
+			}
+		}
+		co_return n;
+    }
+
+    //PcdComStart + PcdComPoll on frame_
+    Task<std::uint8_t> ComExchange(std::uint8_t len,unsigned int &bits,std::uint16_t timeout)
+    {
+		std::uint8_t n,status;
+		bool halt = frame_[0] == picc::HALT;
+		if(unsigned int left = rd_.FieldLeft())  //PcdFieldWait without blocking the other readers
+		{
+			co_await loop_.SleepUntil(EventLoop::Now()+left*1000ULL);
+		}
+		co_await loop_.SleepUntil(EventLoop::Now()+100000);//Guard time before the frame, others use the bus meanwhile
+		rd_.WriteReg(reg::TPrescaler,0xFF);
+		rd_.WriteReg(reg::TMode,0x87);
+		rd_.WriteReg(reg::TReloadL,static_cast<std::uint8_t>(timeout));
+		rd_.WriteReg(reg::TReloadH,static_cast<std::uint8_t>(timeout>>8));
+		delayMicrosecondsHard(10);
+		rd_.WriteReg(reg::ComIrq,0x7F);
+		rd_.WriteReg(reg::DivIrq,0x7F);
+		rd_.WriteReg(reg::FIFOLevel,0x80);
+		rd_.SetBits(reg::Command,pcd::TRANSCEIVE);
+		delayMicrosecondsHard(1);
+		rd_.SetBits(reg::ComIEn,0xA1);
+		for(n=0;n<len;n++)
+		{
+			rd_.WriteReg(reg::FIFOData,frame_[n]);
+		}
+		rd_.SetBits(reg::BitFraming,0x80);
+		n = co_await WaitIrq(0x21,timeout);
+		if(!n)
+		{
+			co_return rd_.GiveUp();
+		}
+		if(!(n & 0x01))
+		{
+			rd_.SetBits(reg::Control,0x90);
+			rd_.ClearBits(reg::ComIEn,0x7F);
+			rd_.ClearBits(reg::DivlEn,0xFF);
+			n = rd_.ReadReg(reg::FIFOLevel);
+			status = rd_.ReadReg(reg::Error);
+			for(std::uint8_t i=0;i<n;i++)
+			{
+				frame_[i] = rd_.ReadReg(reg::FIFOData);
+			}
+			bits = n*8;
+			rd_.WriteReg(reg::ComIrq,0x20);
+		}
+		else
+		{
+			rd_.ClearBits(reg::ComIEn,0x7F);
+			rd_.ClearBits(reg::DivlEn,0xFF);
+			if(halt)
+			{
+				rd_.ClearBits(reg::ComIrq,0xFF);
+				co_return mi::OK;
+			}
+			rd_.WriteReg(reg::ComIrq,0x01);
+			status = mi::TIMEOUT;
+		}
+		rd_.WriteReg(reg::DivIrq,0x00);
+		rd_.WriteReg(reg::FIFOLevel,0x80);
+		rd_.WriteReg(reg::ComIrq,0x01);
+		rd_.WriteReg(reg::BitFraming,0x00);
+		co_return status;
+    }
+
+    //Opation_MF1Card: a TRANSCEIVE answer replaces the sent data
+    Task<std::uint8_t> MfExchange(std::uint8_t command,std::uint8_t *data,std::uint8_t len,std::uint16_t timeout)
+    {
+		std::uint8_t irqEn,waitFor,n,status;
+		if(command == pcd::TRANSCEIVE)
+		{
+			irqEn = 0x77;
+			waitFor = 0x30;
+		}
+		else
+		{
+			irqEn = 0x12;
+			waitFor = 0x10;
+		}
+		rd_.WriteReg(reg::TPrescaler,0xFF);
+		rd_.WriteReg(reg::TMode,0x87);
+		rd_.WriteReg(reg::TReloadL,static_cast<std::uint8_t>(timeout));
+		rd_.WriteReg(reg::TReloadH,static_cast<std::uint8_t>(timeout>>8));
+		rd_.WriteReg(reg::ComIEn,irqEn|0x80);
+		rd_.ClearBits(reg::ComIrq,0x80);
+		rd_.WriteReg(reg::Command,pcd::IDLE);
+		rd_.SetBits(reg::FIFOLevel,0x80);
+		for(std::uint8_t i=0;i<len;i++)
+		{
+			rd_.WriteReg(reg::FIFOData,data[i]);
+		}
+		rd_.WriteReg(reg::Command,command);
+		if(command == pcd::TRANSCEIVE)
+		{
+			rd_.SetBits(reg::BitFraming,0x80);
+		}
+		else
+		{
+			rd_.SetBits(reg::Control,0x40);
+		}
+		n = co_await WaitIrq(0x01|waitFor,timeout);
+		if(!n)
+		{
+			co_return rd_.GiveUp();
+		}
+		rd_.ClearBits(reg::BitFraming,0x80);
+		status = rd_.ReadReg(reg::Error);
+		if(!(n&0x01))
+		{
+			rd_.SetBits(reg::Control,0x80);
+			if(!(status&0x1B))
+			{
+				status = (n & irqEn & 0x01) ? mi::NOTAGERR : mi::OK;
+				if(command == pcd::TRANSCEIVE)
+				{
+					n = rd_.ReadReg(reg::FIFOLevel);
+					for(std::uint8_t i=0;i<n;i++)
+					{
+						data[i] = rd_.ReadReg(reg::FIFOData);
+					}
+				}
+			}
+			else
+			{
+				status = mi::ERR;
+			}
+		}
+		else
+		{
+			status = mi::TIMEOUT;                //The card did not answer before the timer ran out
+		}
+		rd_.WriteReg(reg::Command,pcd::IDLE);
+		co_return status;
+    }
+
+    //PcdAnticollLevel
+    Task<Result<void>> AnticollLevel(std::uint8_t level,std::array<std::uint8_t,4> &snr)
+    {
+		unsigned int bits;
+		std::uint8_t status,check = 0;
+		rd_.ClearBits(reg::TxMode,0x80);
+		rd_.ClearBits(reg::RxMode,0x80);
+		rd_.WriteReg(reg::Coll,0x00);
+		co_await loop_.SleepUntil(EventLoop::Now()+200000);
+		rd_.WriteReg(reg::BitFraming,0x00);
+		frame_[0] = level;
+		frame_[1] = 0x20;
+		status = co_await ComExchange(2,bits,0x0020);
+		co_await loop_.SleepUntil(EventLoop::Now()+100000);
+		rd_.WriteReg(reg::BitFraming,0x00);
+		rd_.WriteReg(reg::Coll,0x80);
+		if(status != mi::OK)
+		{
+			co_return Check(status);
+		}
+		for(int i=0;i<4;i++)
+		{
+			snr[i] = frame_[i];
+			check ^= frame_[i];
+		}
+		if(check != frame_[4])
+		{
+			co_return Fail(Error::Failed);
+		}
+		co_return Result<void>{};
+    }
+
+    //PcdSelectLevel, returns the SAK
+    Task<Result<std::uint8_t>> SelectLevel(std::uint8_t level,const std::array<std::uint8_t,4> &snr)
+    {
+		unsigned int bits;
+		rd_.SetBits(reg::TxMode,0x80);
+		rd_.SetBits(reg::RxMode,0x80);
+		frame_[0] = level;
+		frame_[1] = 0x70;
+		frame_[6] = 0;
+		for(int i=0;i<4;i++)
+		{
+			frame_[i+2] = snr[i];
+			frame_[6] ^= snr[i];
+		}
+		std::uint8_t status = co_await ComExchange(7,bits,0x0010);
+		if(status != mi::OK)
+		{
+			co_return Fail(Failure(status));
+		}
+		co_return frame_[0];
+    }
+
+    EventLoop &loop_;
+    Reader<T> &rd_;
+    int irq_fd_;
+    alignas(64) std::array<std::uint8_t,MAXRLEN> frame_{};
+};
+
+}
+
+#endif
@@ -0,0 +1,122 @@
+//Generated from rc522.h by "make regs", do not edit
+#ifndef __RC522_REGS_HPP
+#define	__RC522_REGS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace rc522
+{
+inline constexpr std::size_t FIFO_LENGTH = 64;
+inline constexpr std::size_t MAXRLEN = 64;
+inline constexpr std::uint64_t SHADOW_REGS = 0x00003FD003FE000CULL;
+
+namespace reg
+{
+inline constexpr std::uint8_t RFU00              = 0x00;
+inline constexpr std::uint8_t Command            = 0x01;
+inline constexpr std::uint8_t ComIEn             = 0x02;
+inline constexpr std::uint8_t DivlEn             = 0x03;
+inline constexpr std::uint8_t ComIrq             = 0x04;
+inline constexpr std::uint8_t DivIrq             = 0x05;
+inline constexpr std::uint8_t Error              = 0x06;
+inline constexpr std::uint8_t Status1            = 0x07;
+inline constexpr std::uint8_t Status2            = 0x08;
+inline constexpr std::uint8_t FIFOData           = 0x09;
+inline constexpr std::uint8_t FIFOLevel          = 0x0A;
+inline constexpr std::uint8_t WaterLevel         = 0x0B;
+inline constexpr std::uint8_t Control            = 0x0C;
+inline constexpr std::uint8_t BitFraming         = 0x0D;
+inline constexpr std::uint8_t Coll               = 0x0E;
+inline constexpr std::uint8_t RFU0F              = 0x0F;
+inline constexpr std::uint8_t RFU10              = 0x10;
+inline constexpr std::uint8_t Mode               = 0x11;
+inline constexpr std::uint8_t TxMode             = 0x12;
+inline constexpr std::uint8_t RxMode             = 0x13;
+inline constexpr std::uint8_t TxControl          = 0x14;
+inline constexpr std::uint8_t TxAuto             = 0x15;
+inline constexpr std::uint8_t TxSel              = 0x16;
+inline constexpr std::uint8_t RxSel              = 0x17;
+inline constexpr std::uint8_t RxThreshold        = 0x18;
+inline constexpr std::uint8_t Demod              = 0x19;
+inline constexpr std::uint8_t RFU1A              = 0x1A;
+inline constexpr std::uint8_t RFU1B              = 0x1B;
+inline constexpr std::uint8_t Mifare             = 0x1C;
+inline constexpr std::uint8_t RFU1D              = 0x1D;
+inline constexpr std::uint8_t RFU1E              = 0x1E;
+inline constexpr std::uint8_t SerialSpeed        = 0x1F;
+inline constexpr std::uint8_t RFU20              = 0x20;
+inline constexpr std::uint8_t CRCResultM         = 0x21;
+inline constexpr std::uint8_t CRCResultL         = 0x22;
+inline constexpr std::uint8_t RFU23              = 0x23;
+inline constexpr std::uint8_t ModWidth           = 0x24;
+inline constexpr std::uint8_t RFU25              = 0x25;
+inline constexpr std::uint8_t RFCfg              = 0x26;
+inline constexpr std::uint8_t GsN                = 0x27;
+inline constexpr std::uint8_t CWGsCfg            = 0x28;
+inline constexpr std::uint8_t ModGsCfg           = 0x29;
+inline constexpr std::uint8_t TMode              = 0x2A;
+inline constexpr std::uint8_t TPrescaler         = 0x2B;
+inline constexpr std::uint8_t TReloadH           = 0x2C;
+inline constexpr std::uint8_t TReloadL           = 0x2D;
+inline constexpr std::uint8_t TCounterValueH     = 0x2E;
+inline constexpr std::uint8_t TCounterValueL     = 0x2F;
+inline constexpr std::uint8_t RFU30              = 0x30;
+inline constexpr std::uint8_t TestSel1           = 0x31;
+inline constexpr std::uint8_t TestSel2           = 0x32;
+inline constexpr std::uint8_t TestPinEn          = 0x33;
+inline constexpr std::uint8_t TestPinValue       = 0x34;
+inline constexpr std::uint8_t TestBus            = 0x35;
+inline constexpr std::uint8_t AutoTest           = 0x36;
+inline constexpr std::uint8_t Version            = 0x37;
+inline constexpr std::uint8_t AnalogTest         = 0x38;
+inline constexpr std::uint8_t TestDAC1           = 0x39;
+inline constexpr std::uint8_t TestDAC2           = 0x3A;
+inline constexpr std::uint8_t TestADC            = 0x3B;
+inline constexpr std::uint8_t RFU3C              = 0x3C;
+inline constexpr std::uint8_t RFU3D              = 0x3D;
+inline constexpr std::uint8_t RFU3E              = 0x3E;
+inline constexpr std::uint8_t RFU3F              = 0x3F;
+}
+
+namespace pcd
+{
+inline constexpr std::uint8_t IDLE               = 0x00;
+inline constexpr std::uint8_t AUTHENT            = 0x0E;
+inline constexpr std::uint8_t RECEIVE            = 0x08;
+inline constexpr std::uint8_t TRANSMIT           = 0x04;
+inline constexpr std::uint8_t TRANSCEIVE         = 0x0C;
+inline constexpr std::uint8_t RESETPHASE         = 0x0F;
+inline constexpr std::uint8_t CALCCRC            = 0x03;
+}
+
+namespace picc
+{
+inline constexpr std::uint8_t REQIDL             = 0x26;
+inline constexpr std::uint8_t REQALL             = 0x52;
+inline constexpr std::uint8_t ANTICOLL1          = 0x93;
+inline constexpr std::uint8_t ANTICOLL2          = 0x95;
+inline constexpr std::uint8_t ANTICOLL3          = 0x97;
+inline constexpr std::uint8_t AUTHENT1A          = 0x60;
+inline constexpr std::uint8_t AUTHENT1B          = 0x61;
+inline constexpr std::uint8_t READ               = 0x30;
+inline constexpr std::uint8_t WRITE              = 0xA0;
+inline constexpr std::uint8_t DECREMENT          = 0xC0;
+inline constexpr std::uint8_t INCREMENT          = 0xC1;
+inline constexpr std::uint8_t RESTORE            = 0xC2;
+inline constexpr std::uint8_t TRANSFER           = 0xB0;
+inline constexpr std::uint8_t HALT               = 0x50;
+inline constexpr std::uint8_t RESET              = 0xE0;
+}
+
+namespace mi
+{
+inline constexpr std::uint8_t OK                 = 0;
+inline constexpr std::uint8_t NOTAGERR           = 1;
+inline constexpr std::uint8_t ERR                = 2;
+inline constexpr std::uint8_t COM_ERR            = 3;
+inline constexpr std::uint8_t TIMEOUT            = 4;
+}
+}
+
+#endif
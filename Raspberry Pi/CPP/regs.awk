@@ -0,0 +1,49 @@
+#Turns the #defines of rc522.h into the constexpr tables of rc522_regs.hpp
+#  xxxReg / RFUxx  -> rc522::reg::xxx   (register address)
+#  PCD_xxx         -> rc522::pcd::xxx   (MF522 command word)
+#  PICC_xxx        -> rc522::picc::xxx  (card command word)
+#  MI_xxx          -> rc522::mi::xxx    (C status code)
+function emit(ns,name,value)
+{
+    names[ns,++count[ns]] = name
+    values[ns,count[ns]] = value
+}
+$1 == "#define" && $3 ~ /^0x[0-9A-Fa-f]+$/ && $2 ~ /Reg|^RFU/ {
+    name = $2
+    sub(/Reg/,"",name)
+    emit("reg",name,$3)
+}
+$1 == "#define" && $2 == "PCD_SHADOW_REGS" { shadow = $3; sub(/\/\/.*/,"",shadow); next }
+$1 == "#define" && $3 ~ /^(0x)?[0-9A-Fa-f]+$/ && $2 ~ /^PCD_/  { name = $2; sub(/^PCD_/,"",name);  emit("pcd",name,$3) }
+$1 == "#define" && $3 ~ /^(0x)?[0-9A-Fa-f]+$/ && $2 ~ /^PICC_/ { name = $2; sub(/^PICC_/,"",name); emit("picc",name,$3) }
+$1 == "#define" && $3 ~ /^(0x)?[0-9A-Fa-f]+$/ && $2 ~ /^MI_/   { name = $2; sub(/^MI_/,"",name);   emit("mi",name,$3) }
+$1 == "#define" && $2 == "FIFO_LENGTH" { fifo = $3 }
+$1 == "#define" && $2 == "MAXRLEN"     { maxrlen = $3 }
+END {
+    print "//Generated from rc522.h by \"make regs\", do not edit"
+    print "#ifndef __RC522_REGS_HPP"
+    print "#define\t__RC522_REGS_HPP"
+    print ""
+    print "#include <cstddef>\n#include <cstdint>"
+    print ""
+    print "namespace rc522"
+    print "{"
+    printf "inline constexpr std::size_t FIFO_LENGTH = %s;\n", fifo
+    printf "inline constexpr std::size_t MAXRLEN = %s;\n", maxrlen
+    printf "inline constexpr std::uint64_t SHADOW_REGS = %s;\n", shadow
+    split("reg pcd picc mi",order," ")
+    for(o=1;o<=4;o++)
+    {
+		ns = order[o]
+		print ""
+		printf "namespace %s\n{\n", ns
+		for(i=1;i<=count[ns];i++)
+		{
+			printf "inline constexpr std::uint8_t %-18s = %s;\n", names[ns,i], values[ns,i]
+		}
+		printf "}\n"
+    }
+    print "}"
+    print ""
+    print "#endif"
+}
@@ -14,6 +14,7 @@
 
 import serial
 import time
+import threading
 import numpy as np
 import wiringpi 
 
@@ -50,6 +51,8 @@ PICC_HALT             = 0x50    #dormancy
 #MF522 FIFO length
 DEF_FIFO_LENGTH       = 64      #FIFO size=64byte
 MAXRLEN  = 18
+POLL_S                = 0.01    #idle time between two reads of the card
+LEAVE_MISSES          = 3       #failed reads in a row before the card counts as gone, as PRES_LEAVE_POLLS in the C driver
 #MF522 regsiter
 # PAGE 0
 RFU00                 = 0x00
@@ -133,7 +136,34 @@ READCARD              = 0xa3
 ADDMONEY              = 0xa4
 
 
+class Feedback(threading.Thread):
+    """buzzer/led patterns played off the read loop, taps posted while one plays are coalesced"""
+    def __init__(self, duty):
+        super().__init__(daemon=True)
+        self.duty = duty
+        self.pending = threading.Event()
+
+    def post(self):
+        """queue one beep+blink, returns immediately"""
+        self.pending.set()
+
+    def run(self):
+        while True:
+            self.pending.wait()
+            self.pending.clear()
+            wiringpi.digitalWrite(29,0)  # turn on red led
+            wiringpi.softPwmWrite(24, self.duty)  # turn on buzzer
+            time.sleep(0.2)
+            wiringpi.digitalWrite(29,1)  # turn off red led
+            wiringpi.softPwmWrite(24,0)  # turn off buzzer
+            time.sleep(0.3)
+
+
 class Rc522_api():
+    # registers init sets to other than their reset values, the bits of each that read back
+    # as written, and what they read when set up (PcdSignReg of rc522.c)
+    SIGNATURE = ((ModeReg, 0xAB, 0x29), (TxControlReg, 0xFB, 0x83), (TxAutoReg, 0x7F, 0x40), (RxSelReg, 0xFF, 0x86))
+
     def __init__(self):
         self.CT = [0, 0]  # card type
         self.SN = [0, 0, 0, 0]  # card serial number
@@ -142,7 +172,7 @@ class Rc522_api():
         self.total = 0
         self.KEY = [0xff, 0xff, 0xff, 0xff, 0xff, 0xff]
         self.AUDIO_OPEN = [0xAA, 0x07, 0x02, 0x00, 0x09, 0xBC]
-        self.RFID1 = [0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x07, 0x80, 0x29, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff]
+        self.RFID1 = self.sector_trailer([0x00] * 6, [0, 0, 0, 1], 0x29, [0xff] * 6)  # transport access conditions
         self.card_id = [0,0,0,0,0,0,0,0,0]
         self.status = 0
         self.block_num = 0x08
@@ -486,19 +516,51 @@ class Rc522_api():
             cstatus = MI_ERR
         return cstatus
 
+    @staticmethod
+    def encode_access_bits(conditions):
+        """encode the C1C2C3 access conditions of blocks 0-3 (bit2=C1, bit1=C2, bit0=C3)
+           into trailer bytes 6-8, every bit is stored a second time inverted"""
+        c1 = c2 = c3 = 0
+        for i, cond in enumerate(conditions):
+            c1 |= ((cond >> 2) & 1) << i
+            c2 |= ((cond >> 1) & 1) << i
+            c3 |= (cond & 1) << i
+        return [((~c2 & 0x0F) << 4) | (~c1 & 0x0F), (c1 << 4) | (~c3 & 0x0F), (c3 << 4) | c2]
+
+    @staticmethod
+    def decode_access_bits(bits):
+        """decode trailer bytes 6-8, returns None when the inverted copies disagree
+           (writing such a trailer locks the sector for good)"""
+        c1, c2, c3 = bits[1] >> 4, bits[2] & 0x0F, bits[2] >> 4
+        if (bits[0] & 0x0F) != (~c1 & 0x0F) or (bits[0] >> 4) != (~c2 & 0x0F) or (bits[1] & 0x0F) != (~c3 & 0x0F):
+            return None
+        return [((c1 >> i) & 1) << 2 | ((c2 >> i) & 1) << 1 | ((c3 >> i) & 1) for i in range(4)]
+
+    def sector_trailer(self, key_a, conditions, gpb, key_b):
+        """build a 16 byte sector trailer: key A, access bits, general purpose byte, key B"""
+        return list(key_a) + self.encode_access_bits(conditions) + [gpb] + list(key_b)
+
+    def pcd_started(self):
+        """wait for the rc522 to leave a reset: CommandReg reads Idle with PowerDown cleared once
+        the oscillator runs, a chip in reset or a dead bus reads 0x00 or 0xFF"""
+        deadline = time.time() + 0.1  # the chip starts within 100 ms
+        while (self.read_rawrc(CommandReg) & 0x3F) != 0x20:
+            if time.time() > deadline:
+                return False
+        return True
+
     def pcd_reset(self):
         """rc522 reset"""
         wiringpi.digitalWrite(25,0)
         time.sleep(0.001)
         wiringpi.digitalWrite(25,1)
-        time.sleep(0.001)
+        if not self.pcd_started():
+            print('FAIL')
+            return False
         self.write_rawrc(CommandReg, 0x0f)  # reset the rc522
-        while True:
-            temp = self.read_rawrc(CommandReg)
-            if (temp & 0x10) == 0:
-                break
-        self.read_rawrc(CommandReg)
-        time.sleep(0.001)
+        if not self.pcd_started():
+            print('FAIL')
+            return False
         # self.PcdSet_Uart_band(115200)  # available on the RC522 board power off and restart
         self.write_rawrc(ModeReg, 0x3D)  # define the common mode of sending and receiving,
                                         # communicate with Mifare card,the initial value of CRC is 0x6363
@@ -507,12 +569,26 @@ class Rc522_api():
         self.write_rawrc(TModeReg, 0x8D)  # define the settings for the internal timer
         self.write_rawrc(TPrescalerReg, 0x3E)  # set the timer division factor
         self.write_rawrc(TxAutoReg, 0x40)  # the modulated transmit signal set to 100%ASK
+        return True
+
+    def pcd_configured(self):
+        """whether an earlier init set the rc522 up: a chip that lost power or was reset reads its reset values"""
+        version = self.read_rawrc(VersionReg)
+        if version in (0x00, 0xFF) or self.read_rawrc(CommandReg) & 0x10:  # no chip, or in power-down
+            return False
+        return all((self.read_rawrc(reg) & mask) == value for reg, mask, value in self.SIGNATURE)
 
     def init(self):
-        """rc522 init"""
-        time.sleep(1)
-        self.pcd_reset()
-        self.pcd_config_iso_type('A')  # set work mode
+        """rc522 init, a chip still set up from the last run is taken over without a reset
+        returns False when the chip does not start"""
+        if self.pcd_configured():
+            self.write_rawrc(CommandReg, PCD_IDLE)  # stop what the last run left running
+            self.write_rawrc(FIFOLevelReg, 0x80)
+            self.write_rawrc(RFCfgReg, 0x7F)
+            return True
+        started = self.pcd_reset()
+        self.pcd_config_iso_type('A')  # set work mode, also on a failed start so a later init finds it
+        return started
 
 
 if __name__ == '__main__':
@@ -530,9 +606,12 @@ if __name__ == '__main__':
     rc522 = Rc522_api()
     wiringpi.digitalWrite(29,1)  # turn on red led
     wiringpi.softPwmCreate(24, 0, 8)  # turn on buzzer
+    feedback = Feedback(5)
+    feedback.start()
     
     print("RC522_UART_TEST...")
-    rc522.init()
+    if not rc522.init():
+        print("RC522 does not start")
 
     print(" start write and read card...")
 
@@ -540,16 +619,23 @@ if __name__ == '__main__':
         if rc522.write(rc522.block_num, "0123456789112233"): # if necessary,the content can be modified to other
             print('write card success')
             break
+    last_sn = None
+    misses = 0
     while True:
         if rc522.read(rc522.block_num):  # read the content written to the card in the previous step
-            print("read card:", rc522.RFID)
-            print("sn:", [hex(i) for i in rc522.SN])
-            wiringpi.digitalWrite(29,0)  # turn on red led
-            wiringpi.softPwmWrite(24, 5)
-            time.sleep(0.2)
-            wiringpi.digitalWrite(29,1)  # turn off red led
-            wiringpi.softPwmWrite(24,0)  # turn off buzzer
-            time.sleep(0.3)
+            misses = 0
+            if rc522.SN != last_sn:  # report a card once per tap, not on every loop
+                print("read card:", rc522.RFID)
+                print("sn:", [hex(i) for i in rc522.SN])
+                feedback.post()
+                last_sn = list(rc522.SN)
+        else:
+            # a card that stays in the field misses every other read (it was left selected),
+            # so it is forgotten only after several failed reads in a row
+            misses += 1
+            if misses >= LEAVE_MISSES:
+                last_sn = None
+        time.sleep(POLL_S)
 
 
 